@@ -41,6 +41,15 @@ static int copy_engine = TRUE;
 static unsigned long copy_opts = 0UL;
 #define COPY_OPT_NO_DELETE_ON_FAILURE	0x0001
 
+/* How many processes may copy file data at once, when copying a directory
+ * tree.  By default, files are copied one at a time by the session process.
+ */
+static unsigned int copy_concurrency = 1;
+#define COPY_MAX_CONCURRENCY		64
+
+/* How often, in seconds, to log the progress of a directory copy. */
+#define COPY_PROGRESS_INTERVAL		5
+
 static const char *trace_channel = "copy";
 
 static int copy_sess_init(void);
@@ -187,8 +196,507 @@ static int copy_symlink(pool *p, const char *src_path, const char *dst_path,
   return 0;
 }
 
-static int copy_dir(pool *p, const char *src_dir, const char *dst_dir,
+/* Parallel copying of directory trees.
+ *
+ * Walking the source tree, creating directories, and checking each file
+ * against the <Limit>s all happen in the session process, in order.  Only
+ * the copying of the file data itself is handed to a bounded set of copier
+ * processes, forked from the session on demand.  Each copier reads jobs
+ * from its own pipe, and reports results on a pipe shared by all of them.
+ *
+ * Other modules' SITE COPY handlers (e.g. mod_quotatab) keep per-file state
+ * from PRE_CMD to POST_CMD; when any are present, files are copied one at a
+ * time instead.
+ */
+
+struct copy_worker {
+  pid_t pid;
+  int job_fd;
+
+  /* The file being copied by this worker, if any. */
+  pool *job_pool;
+  cmd_rec *job_cmd;
+  const char *src_path;
+  const char *dst_path;
+};
+
+struct copy_engine {
+  pool *pool;
+  int flags;
+
+  struct copy_worker *workers;
+  unsigned int nworkers;
+  unsigned int nbusy;
+
+  int result_fds[2];
+
+  /* The errno of the first failed copy, if any. */
+  int xerrno;
+
+  unsigned long nfiles;
+  off_t nbytes;
+  time_t last_progress;
+  struct timeval start_tv;
+};
+
+struct copy_job_msg {
+  uint32_t src_len;
+  uint32_t dst_len;
+};
+
+struct copy_result_msg {
+  uint32_t worker_idx;
+  int32_t res;
+  int32_t xerrno;
+};
+
+static int copy_read_msg(int fd, void *buf, size_t buflen) {
+  size_t nread = 0;
+
+  while (nread < buflen) {
+    ssize_t res;
+
+    res = read(fd, ((char *) buf) + nread, buflen - nread);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res == 0) {
+      errno = EPIPE;
+      return -1;
+    }
+
+    nread += res;
+  }
+
+  return 0;
+}
+
+static int copy_write_msg(int fd, const void *buf, size_t buflen) {
+  size_t nwritten = 0;
+
+  while (nwritten < buflen) {
+    ssize_t res;
+
+    res = write(fd, ((const char *) buf) + nwritten, buflen - nwritten);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    nwritten += res;
+  }
+
+  return 0;
+}
+
+static void copy_worker_run(int job_fd, int result_fd, unsigned int idx,
     int flags) {
+  char src_path[PR_TUNABLE_PATH_MAX+1], dst_path[PR_TUNABLE_PATH_MAX+1];
+
+  /* This process only copies files; the session's timers and signal
+   * handling are not ours to act upon.
+   */
+  pr_timer_remove(-1, ANY_MODULE);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+  session.pid = getpid();
+
+  while (TRUE) {
+    struct copy_job_msg job;
+    struct copy_result_msg result;
+
+    if (copy_read_msg(job_fd, &job, sizeof(job)) < 0) {
+      /* The session is done with us. */
+      break;
+    }
+
+    if (job.src_len > PR_TUNABLE_PATH_MAX ||
+        job.dst_len > PR_TUNABLE_PATH_MAX ||
+        copy_read_msg(job_fd, src_path, job.src_len) < 0 ||
+        copy_read_msg(job_fd, dst_path, job.dst_len) < 0) {
+      break;
+    }
+
+    src_path[job.src_len] = '\0';
+    dst_path[job.dst_len] = '\0';
+
+    result.worker_idx = idx;
+    result.res = pr_fs_copy_file2(src_path, dst_path, flags, NULL);
+    result.xerrno = result.res < 0 ? errno : 0;
+
+    /* This is smaller than PIPE_BUF, and so will not be interleaved with the
+     * results of other workers.
+     */
+    if (copy_write_msg(result_fd, &result, sizeof(result)) < 0) {
+      break;
+    }
+  }
+
+  _exit(0);
+}
+
+static struct copy_engine *copy_engine_create(pool *p, int flags) {
+  pool *engine_pool;
+  struct copy_engine *engine;
+
+  engine_pool = make_sub_pool(p);
+  pr_pool_tag(engine_pool, "mod_copy engine pool");
+
+  engine = pcalloc(engine_pool, sizeof(struct copy_engine));
+  engine->pool = engine_pool;
+  engine->flags = flags;
+  engine->workers = pcalloc(engine_pool,
+    sizeof(struct copy_worker) * copy_concurrency);
+
+  if (pipe(engine->result_fds) < 0) {
+    int xerrno = errno;
+
+    destroy_pool(engine_pool);
+    errno = xerrno;
+    return NULL;
+  }
+
+  (void) fcntl(engine->result_fds[0], F_SETFD, FD_CLOEXEC);
+  (void) fcntl(engine->result_fds[1], F_SETFD, FD_CLOEXEC);
+
+  gettimeofday(&(engine->start_tv), NULL);
+  engine->last_progress = engine->start_tv.tv_sec;
+
+  return engine;
+}
+
+static struct copy_worker *copy_engine_add_worker(struct copy_engine *engine) {
+  struct copy_worker *worker;
+  int job_fds[2];
+  pid_t pid;
+
+  if (pipe(job_fds) < 0) {
+    return NULL;
+  }
+
+  (void) fcntl(job_fds[1], F_SETFD, FD_CLOEXEC);
+
+  pid = fork();
+  if (pid < 0) {
+    int xerrno = errno;
+
+    pr_log_pri(PR_LOG_WARNING, MOD_COPY_VERSION
+      ": unable to fork copier process: %s", strerror(xerrno));
+
+    (void) close(job_fds[0]);
+    (void) close(job_fds[1]);
+    errno = xerrno;
+    return NULL;
+  }
+
+  if (pid == 0) {
+    register unsigned int i;
+
+    /* Child process; only keep the pipes this copier needs. */
+    (void) close(job_fds[1]);
+    (void) close(engine->result_fds[0]);
+
+    for (i = 0; i < engine->nworkers; i++) {
+      (void) close(engine->workers[i].job_fd);
+    }
+
+    copy_worker_run(job_fds[0], engine->result_fds[1], engine->nworkers,
+      engine->flags);
+  }
+
+  (void) close(job_fds[0]);
+
+  worker = &(engine->workers[engine->nworkers++]);
+  worker->pid = pid;
+  worker->job_fd = job_fds[1];
+
+  pr_trace_msg(trace_channel, 9, "started copier process %lu (%u of %u)",
+    (unsigned long) pid, engine->nworkers, copy_concurrency);
+  return worker;
+}
+
+/* Finishes the bookkeeping for a copied file, as the serial copy does. */
+static void copy_engine_done(struct copy_engine *engine,
+    struct copy_worker *worker, int res, int xerrno) {
+  cmd_rec *cmd;
+
+  cmd = worker->job_cmd;
+
+  if (res < 0) {
+    pr_log_debug(DEBUG7, MOD_COPY_VERSION
+      ": error copying file '%s' to '%s': %s", worker->src_path,
+      worker->dst_path, strerror(xerrno));
+
+    pr_cmd_dispatch_phase(cmd, POST_CMD_ERR, 0);
+    pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
+    pr_response_clear(&resp_err_list);
+
+    if (engine->xerrno == 0) {
+      engine->xerrno = xerrno;
+    }
+
+  } else {
+    struct stat st;
+    char *abs_path;
+
+    pr_cmd_dispatch_phase(cmd, POST_CMD, 0);
+    pr_cmd_dispatch_phase(cmd, LOG_CMD, 0);
+    pr_response_clear(&resp_list);
+
+    /* Write a TransferLog entry as well. */
+    pr_fs_clear_cache2(worker->dst_path);
+    if (pr_fsio_stat(worker->dst_path, &st) < 0) {
+      st.st_size = 0;
+    }
+
+    abs_path = dir_abs_path(worker->job_pool, worker->dst_path, TRUE);
+
+    if (session.sf_flags & SF_ANON) {
+      xferlog_write(0, session.c->remote_name, st.st_size, abs_path,
+         (session.sf_flags & SF_ASCII ? 'a' : 'b'), 'd', 'a',
+         session.anon_user, 'c', "_");
+
+    } else {
+      xferlog_write(0, session.c->remote_name, st.st_size, abs_path,
+        (session.sf_flags & SF_ASCII ? 'a' : 'b'), 'd', 'r',
+        session.user, 'c', "_");
+    }
+
+    engine->nfiles++;
+    engine->nbytes += st.st_size;
+  }
+
+  destroy_pool(worker->job_pool);
+  worker->job_pool = NULL;
+  worker->job_cmd = NULL;
+  worker->src_path = worker->dst_path = NULL;
+  engine->nbusy--;
+
+  /* A long copy is not an idle session. */
+  (void) pr_timer_reset(PR_TIMER_IDLE, ANY_MODULE);
+  (void) pr_timer_reset(PR_TIMER_NOXFER, ANY_MODULE);
+
+  if (time(NULL) - engine->last_progress >= COPY_PROGRESS_INTERVAL) {
+    engine->last_progress = time(NULL);
+
+    pr_log_debug(DEBUG5, MOD_COPY_VERSION
+      ": copied %lu %s (%" PR_LU " bytes) so far, %u in progress",
+      engine->nfiles, engine->nfiles != 1 ? "files" : "file",
+      (pr_off_t) engine->nbytes, engine->nbusy);
+  }
+}
+
+/* Waits for any one of the busy copiers to finish its file. */
+static int copy_engine_wait(struct copy_engine *engine) {
+  struct copy_result_msg result;
+
+  while (TRUE) {
+    fd_set rfds;
+    struct timeval tv;
+    register unsigned int i;
+    int res;
+
+    pr_signals_handle();
+
+    FD_ZERO(&rfds);
+    FD_SET(engine->result_fds[0], &rfds);
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+
+    res = select(engine->result_fds[0] + 1, &rfds, NULL, NULL, &tv);
+    if (res > 0) {
+      break;
+    }
+
+    if (res < 0 &&
+        errno != EINTR) {
+      return -1;
+    }
+
+    /* Make sure the copiers we are waiting on are still with us. */
+    for (i = 0; i < engine->nworkers; i++) {
+      struct copy_worker *worker;
+
+      worker = &(engine->workers[i]);
+      if (worker->job_cmd == NULL ||
+          worker->pid == 0) {
+        continue;
+      }
+
+      if (waitpid(worker->pid, NULL, WNOHANG) != 0) {
+        pr_log_pri(PR_LOG_WARNING, MOD_COPY_VERSION
+          ": copier process %lu exited unexpectedly while copying '%s'",
+          (unsigned long) worker->pid, worker->src_path);
+
+        worker->pid = 0;
+        (void) close(worker->job_fd);
+        worker->job_fd = -1;
+
+        copy_engine_done(engine, worker, -1, EIO);
+        return 0;
+      }
+    }
+  }
+
+  if (copy_read_msg(engine->result_fds[0], &result, sizeof(result)) < 0 ||
+      result.worker_idx >= engine->nworkers ||
+      engine->workers[result.worker_idx].job_cmd == NULL) {
+    errno = EIO;
+    return -1;
+  }
+
+  copy_engine_done(engine, &(engine->workers[result.worker_idx]), result.res,
+    result.xerrno);
+  return 0;
+}
+
+/* Hands the given file to an idle copier, starting a new one if all are busy
+ * and we are under the configured concurrency.
+ */
+static int copy_engine_submit(struct copy_engine *engine, pool *job_pool,
+    cmd_rec *cmd, const char *src_path, const char *dst_path) {
+  register unsigned int i;
+  struct copy_worker *worker = NULL;
+  struct copy_job_msg job;
+
+  while (worker == NULL) {
+    for (i = 0; i < engine->nworkers; i++) {
+      if (engine->workers[i].job_cmd == NULL &&
+          engine->workers[i].pid != 0) {
+        worker = &(engine->workers[i]);
+        break;
+      }
+    }
+
+    if (worker != NULL) {
+      break;
+    }
+
+    if (engine->nworkers < copy_concurrency) {
+      worker = copy_engine_add_worker(engine);
+      if (worker != NULL) {
+        break;
+      }
+
+      if (engine->nbusy == 0) {
+        return -1;
+      }
+    }
+
+    if (copy_engine_wait(engine) < 0) {
+      return -1;
+    }
+  }
+
+  job.src_len = strlen(src_path);
+  job.dst_len = strlen(dst_path);
+
+  if (copy_write_msg(worker->job_fd, &job, sizeof(job)) < 0 ||
+      copy_write_msg(worker->job_fd, src_path, job.src_len) < 0 ||
+      copy_write_msg(worker->job_fd, dst_path, job.dst_len) < 0) {
+    return -1;
+  }
+
+  worker->job_pool = job_pool;
+  worker->job_cmd = cmd;
+  worker->src_path = src_path;
+  worker->dst_path = dst_path;
+  engine->nbusy++;
+
+  return 0;
+}
+
+/* Waits for all outstanding copies, and stops the copiers. */
+static int copy_engine_finish(struct copy_engine *engine) {
+  register unsigned int i;
+  int res = 0, xerrno = 0;
+
+  while (engine->nbusy > 0) {
+    if (copy_engine_wait(engine) < 0) {
+      xerrno = errno;
+      res = -1;
+      break;
+    }
+  }
+
+  /* Closing the job pipes tells the copiers to exit. */
+  for (i = 0; i < engine->nworkers; i++) {
+    struct copy_worker *worker;
+
+    worker = &(engine->workers[i]);
+    if (worker->job_fd >= 0) {
+      (void) close(worker->job_fd);
+      worker->job_fd = -1;
+    }
+
+    if (worker->pid != 0) {
+      if (res < 0) {
+        (void) kill(worker->pid, SIGTERM);
+      }
+
+      /* The session's SIGCHLD handling may already have reaped it. */
+      (void) waitpid(worker->pid, NULL, 0);
+      worker->pid = 0;
+    }
+  }
+
+  (void) close(engine->result_fds[0]);
+  (void) close(engine->result_fds[1]);
+
+  if (res == 0 &&
+      engine->xerrno != 0) {
+    xerrno = engine->xerrno;
+    res = -1;
+  }
+
+  errno = xerrno;
+  return res;
+}
+
+/* Returns TRUE if any other module handles the PRE_CMD or POST_CMD phases
+ * of SITE commands, and thus possibly those of our fake SITE COPY commands.
+ * Such handlers, e.g. mod_quotatab's, keep per-file state between those
+ * phases, and so need each file to be copied, and its POST_CMD dispatched,
+ * before the next file's PRE_CMD is dispatched.  The handlers of mod_site,
+ * which only deal with SITE HELP, are not a concern.
+ */
+static int copy_have_site_handlers(void) {
+  int idx = -1;
+  unsigned int hash = 0;
+  cmdtable *cmdtab;
+
+  cmdtab = pr_stash_get_symbol2(PR_SYM_CMD, C_SITE, NULL, &idx, &hash);
+  while (cmdtab != NULL) {
+    pr_signals_handle();
+
+    if (cmdtab->m != &copy_module &&
+        strcmp(cmdtab->m->name, "site") != 0 &&
+        (cmdtab->cmd_type == PRE_CMD ||
+         cmdtab->cmd_type == POST_CMD ||
+         cmdtab->cmd_type == POST_CMD_ERR)) {
+      pr_trace_msg(trace_channel, 9,
+        "found SITE %s handler in mod_%s.c",
+        cmdtab->cmd_type == PRE_CMD ? "PRE_CMD" : "POST_CMD",
+        cmdtab->m->name);
+      return TRUE;
+    }
+
+    cmdtab = pr_stash_get_symbol2(PR_SYM_CMD, C_SITE, cmdtab, &idx, &hash);
+  }
+
+  return FALSE;
+}
+
+static int copy_dir(pool *p, const char *src_dir, const char *dst_dir,
+    int flags, struct copy_engine *engine) {
   DIR *dh = NULL;
   struct dirent *dent = NULL;
   int res = 0;
@@ -234,7 +742,7 @@ static int copy_dir(pool *p, const char *src_dir, const char *dst_dir,
         break;
       }
 
-      if (copy_dir(iter_pool, src_path, dst_path, flags) < 0) {
+      if (copy_dir(iter_pool, src_path, dst_path, flags, engine) < 0) {
         res = -1;
         break;
       }
@@ -243,14 +751,46 @@ static int copy_dir(pool *p, const char *src_dir, const char *dst_dir,
     /* Is this path to a regular file? */
     } else if (S_ISREG(st.st_mode)) {
       cmd_rec *cmd;
+      pool *cmd_pool;
+      char *cmd_name;
+
+      /* Files handed to a copier outlive this iteration. */
+      cmd_pool = iter_pool;
+      if (engine != NULL) {
+        cmd_pool = make_sub_pool(engine->pool);
+        pr_pool_tag(cmd_pool, "mod_copy job pool");
+
+        src_path = pstrdup(cmd_pool, src_path);
+        dst_path = pstrdup(cmd_pool, dst_path);
+      }
 
       /* Dispatch fake COPY command, e.g. for mod_quotatab */
-      cmd = pr_cmd_alloc(iter_pool, 4, pstrdup(iter_pool, "SITE"),
-        pstrdup(iter_pool, "COPY"), pstrdup(iter_pool, src_path),
-        pstrdup(iter_pool, dst_path));
-      cmd->arg = pstrcat(iter_pool, "COPY ", src_path, " ", dst_path, NULL);
+      cmd = pr_cmd_alloc(cmd_pool, 4, pstrdup(cmd_pool, "SITE"),
+        pstrdup(cmd_pool, "COPY"), pstrdup(cmd_pool, src_path),
+        pstrdup(cmd_pool, dst_path));
+      cmd->arg = pstrcat(cmd_pool, "COPY ", src_path, " ", dst_path, NULL);
       cmd->cmd_class = CL_WRITE;
 
+      /* Each file is subject to the <Limit>s of its own directories. */
+      cmd_name = cmd->argv[0];
+      pr_cmd_set_name(cmd, "SITE_COPY");
+      if (!dir_check(cmd_pool, cmd, G_READ, src_path, NULL) ||
+          !dir_check(cmd_pool, cmd, G_WRITE, dst_path, NULL)) {
+        pr_cmd_set_name(cmd, cmd_name);
+        pr_log_debug(DEBUG8, MOD_COPY_VERSION
+          ": COPY of '%s' to '%s' denied by <Limit> configuration", src_path,
+          dst_path);
+
+        if (cmd_pool != iter_pool) {
+          destroy_pool(cmd_pool);
+        }
+
+        errno = EPERM;
+        res = -1;
+        break;
+      }
+      pr_cmd_set_name(cmd, cmd_name);
+
       pr_response_clear(&resp_list);
       pr_response_clear(&resp_err_list);
 
@@ -265,10 +805,36 @@ static int copy_dir(pool *p, const char *src_dir, const char *dst_dir,
         pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
         pr_response_clear(&resp_err_list);
 
+        if (cmd_pool != iter_pool) {
+          destroy_pool(cmd_pool);
+        }
+
         errno = xerrno;
         res = -1;
         break;
 
+      } else if (engine != NULL) {
+        if (copy_engine_submit(engine, cmd_pool, cmd, src_path,
+            dst_path) < 0) {
+          int xerrno = errno;
+
+          pr_cmd_dispatch_phase(cmd, POST_CMD_ERR, 0);
+          pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
+          pr_response_clear(&resp_err_list);
+          destroy_pool(cmd_pool);
+
+          errno = xerrno;
+          res = -1;
+          break;
+        }
+
+        /* Stop walking the tree once any copy has failed. */
+        if (engine->xerrno != 0) {
+          errno = engine->xerrno;
+          res = -1;
+          break;
+        }
+
       } else {
         if (pr_fs_copy_file2(src_path, dst_path, flags, NULL) < 0) {
           int xerrno = errno;
@@ -338,7 +904,8 @@ static int copy_dir(pool *p, const char *src_dir, const char *dst_dir,
   return res;
 }
 
-static int copy_paths(pool *p, const char *from, const char *to) {
+static int copy_paths(pool *p, const char *from, const char *to,
+    const char *resp_code) {
   struct stat from_st, to_st;
   int res, flags = 0;
   xaset_t *set;
@@ -445,7 +1012,68 @@ static int copy_paths(pool *p, const char *from, const char *to) {
       return -1;
     }
 
-    res = copy_dir(p, from, to, flags);
+    if (copy_concurrency > 1 &&
+        copy_have_site_handlers() == FALSE) {
+      struct copy_engine *engine;
+
+      engine = copy_engine_create(p, flags);
+      if (engine == NULL) {
+        int xerrno = errno;
+
+        pr_log_debug(DEBUG7, MOD_COPY_VERSION
+          ": error preparing to copy directory '%s': %s", from,
+          strerror(xerrno));
+
+        errno = xerrno;
+        return -1;
+      }
+
+      res = copy_dir(p, from, to, flags, engine);
+      if (res < 0) {
+        int xerrno = errno;
+
+        (void) copy_engine_finish(engine);
+        destroy_pool(engine->pool);
+        errno = xerrno;
+
+      } else {
+        res = copy_engine_finish(engine);
+        if (res == 0) {
+          struct timeval end_tv;
+          float elapsed;
+
+          gettimeofday(&end_tv, NULL);
+          elapsed = (float) (end_tv.tv_sec - engine->start_tv.tv_sec) +
+            ((float) (end_tv.tv_usec - engine->start_tv.tv_usec) / 1000000.0);
+
+          /* Report what was done, as part of a multiline response. */
+          pr_response_add(resp_code,
+            _("Copied %lu %s (%" PR_LU " bytes) in %.3f secs"),
+            engine->nfiles, engine->nfiles != 1 ? "files" : "file",
+            (pr_off_t) engine->nbytes, elapsed);
+        }
+
+        {
+          int xerrno = errno;
+
+          destroy_pool(engine->pool);
+          errno = xerrno;
+        }
+      }
+
+    } else {
+      if (copy_concurrency > 1) {
+        /* Other modules' SITE COPY handlers, e.g. for quotas, need to see
+         * each file copied before the next one is checked.
+         */
+        pr_log_debug(DEBUG5, MOD_COPY_VERSION
+          ": ignoring CopyConcurrency %u for '%s' due to other SITE COPY "
+          "handlers", copy_concurrency, from);
+      }
+
+      res = copy_dir(p, from, to, flags, NULL);
+    }
+
     if (res < 0) {
       int xerrno = errno;
 
@@ -502,6 +1130,38 @@ static int copy_paths(pool *p, const char *from, const char *to) {
 /* Configuration handlers
  */
 
+/* usage: CopyConcurrency count */
+MODRET set_copyconcurrency(cmd_rec *cmd) {
+  int count;
+  char *ptr = NULL;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  count = (int) strtol(cmd->argv[1], &ptr, 10);
+  if (ptr && *ptr) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid count: ",
+      (char *) cmd->argv[1], NULL));
+  }
+
+  if (count < 1 ||
+      count > COPY_MAX_CONCURRENCY) {
+    char max[32];
+
+    memset(max, '\0', sizeof(max));
+    snprintf(max, sizeof(max)-1, "%d", COPY_MAX_CONCURRENCY);
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "count must be between 1 and ",
+      max, NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = (unsigned int) count;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: CopyEngine on|off */
 MODRET set_copyengine(cmd_rec *cmd) {
   int engine = -1;
@@ -659,7 +1319,7 @@ MODRET copy_copy(cmd_rec *cmd) {
     }
     pr_cmd_set_name(cmd, cmd_name);
 
-    if (copy_paths(cmd->tmp_pool, from, to) < 0) {
+    if (copy_paths(cmd->tmp_pool, from, to, R_200) < 0) {
       int xerrno = errno;
 
       pr_log_debug(DEBUG7, MOD_COPY_VERSION
@@ -881,7 +1541,7 @@ MODRET copy_cpto(cmd_rec *cmd) {
   }
   pr_cmd_set_name(cmd, cmd_name);
 
-  if (copy_paths(cmd->tmp_pool, from, resolved_to) < 0) {
+  if (copy_paths(cmd->tmp_pool, from, resolved_to, R_250) < 0) {
     int xerrno = errno;
     const char *err_code = R_550;
 
@@ -970,6 +1630,11 @@ MODRET copy_post_pass(cmd_rec *cmd) {
     c = find_config_next(c, c->next, CONF_PARAM, "CopyOptions", FALSE);
   }
 
+  c = find_config(main_server->conf, CONF_PARAM, "CopyConcurrency", FALSE);
+  if (c != NULL) {
+    copy_concurrency = *((unsigned int *) c->argv[0]);
+  }
+
   return PR_DECLINED(cmd);
 }
 
@@ -997,6 +1662,7 @@ static int copy_sess_init(void) {
  */
 
 static conftable copy_conftab[] = {
+  { "CopyConcurrency",	set_copyconcurrency,	NULL },
   { "CopyEngine",	set_copyengine,		NULL },
   { "CopyOptions",	set_copyoptions,	NULL },
 
@@ -36,6 +36,12 @@
 #include <arpa/nameser.h>
 #include <resolv.h>
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+extern xaset_t *server_list;
+
 module dnsbl_module;
 
 static int dnsbl_engine = FALSE;
@@ -43,6 +49,54 @@ static int dnsbl_logfd = -1;
 
 static const char *trace_channel = "dnsbl";
 
+/* Shared cache of DNSBL lookup results, keyed by client IPv4 address and
+ * DNSBLDomain.  The cache is mapped by the daemon process, and used by all
+ * session processes; entries expire according to the TTLs of the DNS
+ * answers (or, for negative answers, of the SOA record).
+ */
+#define DNSBL_CACHE_SIZE		4096
+#define DNSBL_CACHE_PROBES		4
+#define DNSBL_CACHE_MAX_TTL		3600
+#define DNSBL_CACHE_DEFAULT_NEG_TTL	60
+
+struct dnsbl_cache_entry {
+  /* Odd while a session is updating the entry. */
+  volatile unsigned int seqno;
+
+  uint32_t addr;
+  uint32_t domain_hash;
+  int listed;
+  time_t expires;
+};
+
+static struct dnsbl_cache_entry *dnsbl_cache = NULL;
+
+#if defined(__GNUC__)
+# define DNSBL_CACHE_BARRIER()	__sync_synchronize()
+# define DNSBL_CACHE_LOCK(e, s) \
+  __sync_bool_compare_and_swap(&((e)->seqno), (s), (s) + 1)
+#else
+# define DNSBL_CACHE_BARRIER()
+# define DNSBL_CACHE_LOCK(e, s)	((e)->seqno == (s) ? ((e)->seqno++, 1) : 0)
+#endif /* __GNUC__ */
+
+/* Outstanding DNSBL queries, sent in parallel to the nameserver. */
+#define DNSBL_QUERY_PENDING		0
+#define DNSBL_QUERY_LISTED		1
+#define DNSBL_QUERY_NOT_LISTED		2
+#define DNSBL_QUERY_FAILED		3
+#define DNSBL_QUERY_RETRY_TCP		4
+
+struct dnsbl_query {
+  const char *domain;
+  const char *name;
+  unsigned char pkt[NS_PACKETSZ];
+  int pktlen;
+  unsigned int id;
+  int state;
+  unsigned int ttl;
+};
+
 /* Necessary prototypes. */
 static int dnsbl_sess_init(void);
 
@@ -86,8 +140,9 @@ static const char *reverse_ip_addr(pool *p, const char *ip_addr) {
   return res;
 }
 
-static const char *get_reversed_addr(pool *p) {
+static const char *get_reversed_addr(pool *p, uint32_t *addr) {
   const char *ipstr = NULL;
+  struct in_addr inaddr;
 
   if (pr_netaddr_get_family(session.c->remote_addr) == AF_INET) {
     ipstr = pr_netaddr_get_ipstr(session.c->remote_addr);
@@ -118,9 +173,179 @@ static const char *get_reversed_addr(pool *p) {
 #endif /* PR_USE_IPV6 */
   }
 
+  if (inet_pton(AF_INET, ipstr, &inaddr) == 1) {
+    *addr = (uint32_t) inaddr.s_addr;
+  }
+
   return reverse_ip_addr(p, ipstr);
 }
 
+static uint32_t dnsbl_hash_domain(const char *domain) {
+  uint32_t h = 2166136261UL;
+
+  /* FNV-1a; domain names are compared case-insensitively. */
+  while (*domain) {
+    h ^= (uint32_t) tolower((int) *domain++);
+    h *= 16777619UL;
+  }
+
+  return h;
+}
+
+static int dnsbl_cache_get(uint32_t addr, const char *domain, int *listed) {
+  register unsigned int i;
+  uint32_t domain_hash;
+  time_t now;
+
+  if (dnsbl_cache == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  domain_hash = dnsbl_hash_domain(domain);
+  time(&now);
+
+  for (i = 0; i < DNSBL_CACHE_PROBES; i++) {
+    struct dnsbl_cache_entry *e;
+    unsigned int seqno;
+    int found = FALSE, is_listed = FALSE;
+
+    e = &(dnsbl_cache[((addr ^ domain_hash) + i) & (DNSBL_CACHE_SIZE - 1)]);
+
+    seqno = e->seqno;
+    if (seqno & 1) {
+      continue;
+    }
+
+    DNSBL_CACHE_BARRIER();
+
+    if (e->addr == addr &&
+        e->domain_hash == domain_hash &&
+        e->expires > now) {
+      found = TRUE;
+      is_listed = e->listed;
+    }
+
+    DNSBL_CACHE_BARRIER();
+
+    if (found == TRUE &&
+        e->seqno == seqno) {
+      *listed = is_listed;
+      return 0;
+    }
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+static void dnsbl_cache_set(uint32_t addr, const char *domain, int listed,
+    unsigned int ttl) {
+  register unsigned int i;
+  struct dnsbl_cache_entry *victim = NULL;
+  uint32_t domain_hash;
+  unsigned int seqno;
+  time_t now;
+
+  if (dnsbl_cache == NULL ||
+      ttl == 0) {
+    return;
+  }
+
+  if (ttl > DNSBL_CACHE_MAX_TTL) {
+    ttl = DNSBL_CACHE_MAX_TTL;
+  }
+
+  domain_hash = dnsbl_hash_domain(domain);
+  time(&now);
+
+  /* Reuse the entry for this address/domain if there is one; otherwise use
+   * an expired entry, or the entry expiring soonest.
+   */
+  for (i = 0; i < DNSBL_CACHE_PROBES; i++) {
+    struct dnsbl_cache_entry *e;
+
+    e = &(dnsbl_cache[((addr ^ domain_hash) + i) & (DNSBL_CACHE_SIZE - 1)]);
+    if (e->addr == addr &&
+        e->domain_hash == domain_hash) {
+      victim = e;
+      break;
+    }
+
+    if (victim == NULL ||
+        e->expires < victim->expires) {
+      victim = e;
+    }
+  }
+
+  seqno = victim->seqno;
+  if ((seqno & 1) ||
+      !DNSBL_CACHE_LOCK(victim, seqno)) {
+    /* Another session is updating this entry; let it. */
+    return;
+  }
+
+  DNSBL_CACHE_BARRIER();
+
+  victim->addr = addr;
+  victim->domain_hash = domain_hash;
+  victim->listed = listed;
+  victim->expires = now + ttl;
+
+  DNSBL_CACHE_BARRIER();
+  victim->seqno = seqno + 2;
+
+  pr_trace_msg(trace_channel, 15,
+    "cached %s result for DNSBLDomain '%s' for %u %s",
+    listed ? "listed" : "not listed", domain, ttl, ttl != 1 ? "secs" : "sec");
+}
+
+static void dnsbl_cache_create(void) {
+#if defined(HAVE_SYS_MMAN_H) && \
+    (defined(MAP_ANONYMOUS) || defined(MAP_ANON))
+  void *ptr;
+  size_t cachesz;
+  int flags = MAP_SHARED;
+
+  if (dnsbl_cache != NULL) {
+    return;
+  }
+
+# if defined(MAP_ANONYMOUS)
+  flags |= MAP_ANONYMOUS;
+# else
+  flags |= MAP_ANON;
+# endif /* MAP_ANONYMOUS */
+
+  cachesz = DNSBL_CACHE_SIZE * sizeof(struct dnsbl_cache_entry);
+  ptr = mmap(NULL, cachesz, PROT_READ|PROT_WRITE, flags, -1, 0);
+  if (ptr == MAP_FAILED) {
+    pr_log_debug(DEBUG1, MOD_DNSBL_VERSION
+      ": error mapping %lu bytes for DNSBL cache: %s",
+      (unsigned long) cachesz, strerror(errno));
+    return;
+  }
+
+  memset(ptr, 0, cachesz);
+  dnsbl_cache = ptr;
+
+  pr_trace_msg(trace_channel, 9, "mapped DNSBL cache of %u entries",
+    (unsigned int) DNSBL_CACHE_SIZE);
+#endif /* HAVE_SYS_MMAN_H and MAP_ANON */
+}
+
+static void dnsbl_cache_destroy(void) {
+#if defined(HAVE_SYS_MMAN_H)
+  if (dnsbl_cache == NULL) {
+    return;
+  }
+
+  (void) munmap((void *) dnsbl_cache,
+    DNSBL_CACHE_SIZE * sizeof(struct dnsbl_cache_entry));
+  dnsbl_cache = NULL;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
 static void lookup_reason(pool *p, const char *name) {
   int reasonlen;
   unsigned char reason[NS_PACKETSZ];
@@ -191,11 +416,424 @@ static int lookup_addr(pool *p, const char *addr, const char *domain) {
   return 0;
 }
 
+static unsigned int get_negative_ttl(ns_msg *handle) {
+  int rrno;
+
+  /* Per RFC 2308, negative answers are cached for the lesser of the SOA
+   * record's TTL and its MINIMUM field.
+   */
+  for (rrno = 0; rrno < ns_msg_count(*handle, ns_s_ns); rrno++) {
+    ns_rr rr;
+
+    if (ns_parserr(handle, ns_s_ns, rrno, &rr) < 0) {
+      continue;
+    }
+
+    if (ns_rr_type(rr) == ns_t_soa &&
+        ns_rr_rdlen(rr) >= 20) {
+      const unsigned char *ptr;
+      unsigned int minimum, ttl;
+
+      ptr = ns_rr_rdata(rr) + ns_rr_rdlen(rr) - 4;
+      minimum = ((unsigned int) ptr[0] << 24) |
+        ((unsigned int) ptr[1] << 16) |
+        ((unsigned int) ptr[2] << 8) |
+        (unsigned int) ptr[3];
+
+      ttl = ns_rr_ttl(rr);
+      return (minimum < ttl ? minimum : ttl);
+    }
+  }
+
+  return DNSBL_CACHE_DEFAULT_NEG_TTL;
+}
+
+static int parse_answer(struct dnsbl_query *q, unsigned char *buf,
+    int buflen) {
+  ns_msg handle;
+  ns_rr rr;
+  int rrno, have_addr = FALSE;
+  unsigned int ttl = 0;
+
+  if (ns_initparse(buf, buflen, &handle) < 0) {
+    return -1;
+  }
+
+  /* Make sure that this is the answer to our question. */
+  if (ns_msg_count(handle, ns_s_qd) != 1 ||
+      ns_parserr(&handle, ns_s_qd, 0, &rr) < 0 ||
+      strcasecmp(ns_rr_name(rr), q->name) != 0) {
+    return -1;
+  }
+
+  if (ns_msg_getflag(handle, ns_f_tc)) {
+    q->state = DNSBL_QUERY_RETRY_TCP;
+    return 0;
+  }
+
+  switch (ns_msg_getflag(handle, ns_f_rcode)) {
+    case ns_r_noerror:
+      for (rrno = 0; rrno < ns_msg_count(handle, ns_s_an); rrno++) {
+        if (ns_parserr(&handle, ns_s_an, rrno, &rr) < 0) {
+          continue;
+        }
+
+        if (ns_rr_type(rr) == ns_t_a) {
+          if (have_addr == FALSE ||
+              ns_rr_ttl(rr) < ttl) {
+            ttl = ns_rr_ttl(rr);
+          }
+
+          have_addr = TRUE;
+        }
+      }
+
+      if (have_addr == TRUE) {
+        q->state = DNSBL_QUERY_LISTED;
+        q->ttl = ttl;
+        break;
+      }
+
+      /* No address records; treat this like NXDOMAIN. */
+      q->state = DNSBL_QUERY_NOT_LISTED;
+      q->ttl = get_negative_ttl(&handle);
+      break;
+
+    case ns_r_nxdomain:
+      q->state = DNSBL_QUERY_NOT_LISTED;
+      q->ttl = get_negative_ttl(&handle);
+      break;
+
+    default:
+      q->state = DNSBL_QUERY_FAILED;
+      break;
+  }
+
+  return 0;
+}
+
+static int is_nameserver(struct sockaddr_in *addr, struct sockaddr_in *nsaddrs,
+    unsigned int nnsaddrs) {
+  register unsigned int i;
+
+  for (i = 0; i < nnsaddrs; i++) {
+    if (addr->sin_addr.s_addr == nsaddrs[i].sin_addr.s_addr &&
+        addr->sin_port == nsaddrs[i].sin_port) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Send the A queries for all of the pending DNSBL names at once, rather than
+ * one after the other, and wait for the answers.  Returns the first query
+ * whose name is found to be listed, or NULL.  If the queries cannot be sent
+ * (e.g. there are no IPv4 nameservers), they are left pending, for the
+ * caller to resolve one at a time.
+ */
+static struct dnsbl_query *lookup_addrs(struct dnsbl_query *queries,
+    unsigned int nqueries) {
+  register unsigned int i;
+  struct sockaddr_in nsaddrs[MAXNS];
+  struct dnsbl_query *listed = NULL;
+  unsigned int attempt, attempts, nnsaddrs = 0, npending = 0;
+  int fd, timeout;
+
+  if (!(_res.options & RES_INIT) &&
+      res_init() < 0) {
+    pr_trace_msg(trace_channel, 3, "error initializing resolver: %s",
+      strerror(errno));
+    return NULL;
+  }
+
+  for (i = 0; i < (unsigned int) _res.nscount && i < MAXNS; i++) {
+    if (_res.nsaddr_list[i].sin_family == AF_INET) {
+      memcpy(&(nsaddrs[nnsaddrs++]), &(_res.nsaddr_list[i]),
+        sizeof(struct sockaddr_in));
+    }
+  }
+
+  if (nnsaddrs == 0) {
+    pr_trace_msg(trace_channel, 3, "%s",
+      "no IPv4 nameservers configured, resolving DNSBL names serially");
+    return NULL;
+  }
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    pr_trace_msg(trace_channel, 3, "error opening UDP socket: %s",
+      strerror(errno));
+    return NULL;
+  }
+
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error making UDP socket non-blocking: %s", strerror(errno));
+    (void) close(fd);
+    return NULL;
+  }
+
+  for (i = 0; i < nqueries; i++) {
+    struct dnsbl_query *q;
+
+    q = &(queries[i]);
+    if (q->state != DNSBL_QUERY_PENDING) {
+      continue;
+    }
+
+    q->pktlen = res_mkquery(ns_o_query, q->name, ns_c_in, ns_t_a, NULL, 0,
+      NULL, q->pkt, sizeof(q->pkt));
+    if (q->pktlen < NS_HFIXEDSZ) {
+      (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+        "error building DNS query for '%s'", q->name);
+      q->state = DNSBL_QUERY_FAILED;
+      continue;
+    }
+
+    /* Use our own random query IDs, for matching the answers. */
+    q->id = (unsigned int) pr_random_next(0, 65535);
+    q->pkt[0] = (q->id >> 8) & 0xff;
+    q->pkt[1] = q->id & 0xff;
+
+    (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+      "for DNSBLDomain '%s', resolving DNS name '%s'", q->domain, q->name);
+    npending++;
+  }
+
+  timeout = _res.retrans > 0 ? _res.retrans : RES_TIMEOUT;
+  attempts = _res.retry > 0 ? _res.retry : 1;
+
+  for (attempt = 0; attempt < attempts && npending > 0 && listed == NULL;
+       attempt++) {
+    struct sockaddr_in *nsaddr;
+    time_t deadline;
+
+    /* Each attempt goes to the next nameserver. */
+    nsaddr = &(nsaddrs[attempt % nnsaddrs]);
+
+    for (i = 0; i < nqueries; i++) {
+      struct dnsbl_query *q;
+
+      q = &(queries[i]);
+      if (q->state != DNSBL_QUERY_PENDING) {
+        continue;
+      }
+
+      if (sendto(fd, q->pkt, q->pktlen, 0, (struct sockaddr *) nsaddr,
+          sizeof(struct sockaddr_in)) < 0) {
+        pr_trace_msg(trace_channel, 3, "error sending DNS query for '%s': %s",
+          q->name, strerror(errno));
+      }
+    }
+
+    deadline = time(NULL) + timeout;
+
+    while (npending > 0 &&
+           listed == NULL) {
+      fd_set rfds;
+      struct timeval tv;
+      time_t now;
+      int res;
+
+      now = time(NULL);
+      if (now >= deadline) {
+        break;
+      }
+
+      FD_ZERO(&rfds);
+      FD_SET(fd, &rfds);
+      tv.tv_sec = deadline - now;
+      tv.tv_usec = 0;
+
+      res = select(fd + 1, &rfds, NULL, NULL, &tv);
+      if (res < 0) {
+        if (errno == EINTR) {
+          pr_signals_handle();
+          continue;
+        }
+
+        pr_trace_msg(trace_channel, 3, "error waiting for DNS answers: %s",
+          strerror(errno));
+        break;
+      }
+
+      if (res == 0) {
+        break;
+      }
+
+      /* Read all of the answers that are ready. */
+      while (npending > 0) {
+        unsigned char buf[NS_PACKETSZ];
+        struct sockaddr_in from;
+        socklen_t fromlen;
+        unsigned int id;
+        int buflen;
+
+        fromlen = sizeof(from);
+        buflen = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *) &from,
+          &fromlen);
+        if (buflen < 0) {
+          break;
+        }
+
+        if (buflen < NS_HFIXEDSZ ||
+            is_nameserver(&from, nsaddrs, nnsaddrs) == FALSE) {
+          continue;
+        }
+
+        id = ((unsigned int) buf[0] << 8) | buf[1];
+
+        for (i = 0; i < nqueries; i++) {
+          struct dnsbl_query *q;
+
+          q = &(queries[i]);
+          if (q->state != DNSBL_QUERY_PENDING ||
+              q->id != id) {
+            continue;
+          }
+
+          if (parse_answer(q, buf, buflen) < 0) {
+            break;
+          }
+
+          npending--;
+
+          if (q->state == DNSBL_QUERY_LISTED &&
+              listed == NULL) {
+            /* No need to wait for the other lists. */
+            listed = q;
+          }
+
+          break;
+        }
+      }
+    }
+  }
+
+  (void) close(fd);
+
+  for (i = 0; i < nqueries; i++) {
+    struct dnsbl_query *q;
+
+    q = &(queries[i]);
+    if (q->state == DNSBL_QUERY_PENDING) {
+      if (listed == NULL) {
+        (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+          "timed out resolving DNS name '%s'", q->name);
+      }
+
+      q->state = DNSBL_QUERY_FAILED;
+    }
+  }
+
+  return listed;
+}
+
+/* Returns the first DNSBLDomain listing the client, or NULL. */
+static const char *find_listing(pool *p, uint32_t addr,
+    const char *rev_ip_addr) {
+  config_rec *c;
+  array_header *queries;
+  struct dnsbl_query *q, *elts;
+  unsigned int npending = 0;
+  register unsigned int i;
+
+  queries = make_array(p, 0, sizeof(struct dnsbl_query));
+
+  c = find_config(main_server->conf, CONF_PARAM, "DNSBLDomain", FALSE);
+  while (c != NULL) {
+    const char *domain;
+    int listed = FALSE;
+
+    pr_signals_handle();
+
+    domain = c->argv[0];
+
+    if (dnsbl_cache_get(addr, domain, &listed) == 0) {
+      pr_trace_msg(trace_channel, 9,
+        "using cached result for DNSBLDomain '%s'", domain);
+
+      if (listed == TRUE) {
+        (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+          "found cached record for DNSBLDomain '%s', client address has been "
+          "blacklisted", domain);
+
+        /* The cache only records that the client is listed, not why. */
+        lookup_reason(p, pstrcat(p, rev_ip_addr, ".", domain, NULL));
+        return domain;
+      }
+
+    } else {
+      q = push_array(queries);
+      memset(q, 0, sizeof(struct dnsbl_query));
+      q->domain = domain;
+      q->name = pstrcat(p, rev_ip_addr, ".", domain, NULL);
+      q->state = DNSBL_QUERY_PENDING;
+      npending++;
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, "DNSBLDomain", FALSE);
+  }
+
+  if (npending == 0) {
+    return NULL;
+  }
+
+  elts = queries->elts;
+  q = lookup_addrs(elts, queries->nelts);
+
+  for (i = 0; i < queries->nelts; i++) {
+    switch (elts[i].state) {
+      case DNSBL_QUERY_LISTED:
+        dnsbl_cache_set(addr, elts[i].domain, TRUE, elts[i].ttl);
+        break;
+
+      case DNSBL_QUERY_NOT_LISTED:
+        (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+          "no record returned for DNS name '%s', client address is not "
+          "blacklisted", elts[i].name);
+        dnsbl_cache_set(addr, elts[i].domain, FALSE, elts[i].ttl);
+        break;
+    }
+  }
+
+  if (q != NULL) {
+    (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+      "found record for DNS name '%s', client address has been blacklisted",
+      q->name);
+
+    /* Check for TXT record for this DNS name, to see if the reason for
+     * blacklisting has been configured.
+     */
+    lookup_reason(p, q->name);
+    return q->domain;
+  }
+
+  /* Resolve any names we could not query in parallel (or whose answers
+   * were truncated) the traditional way.
+   */
+  for (i = 0; i < queries->nelts; i++) {
+    if (elts[i].state == DNSBL_QUERY_PENDING ||
+        elts[i].state == DNSBL_QUERY_RETRY_TCP) {
+      pr_signals_handle();
+
+      if (lookup_addr(p, rev_ip_addr, elts[i].domain) < 0) {
+        return elts[i].domain;
+      }
+    }
+  }
+
+  return NULL;
+}
+
 static int dnsbl_reject_conn(void) {
   config_rec *c;
   pool *tmp_pool = NULL;
-  const char *rev_ip_addr = NULL;
-  int reject_conn = FALSE;
+  const char *listed_domain, *rev_ip_addr = NULL;
+  uint32_t addr = 0;
+  int reject_conn = FALSE, saved_nscount = -1;
+  struct sockaddr_in saved_nsaddrs[MAXNS];
   dnsbl_policy_e policy = DNSBL_POLICY_DENY_ALLOW;
 
   c = find_config(main_server->conf, CONF_PARAM, "DNSBLPolicy", FALSE);
@@ -218,7 +856,7 @@ static int dnsbl_reject_conn(void) {
   }
 
   tmp_pool = make_sub_pool(permanent_pool);
-  rev_ip_addr = get_reversed_addr(tmp_pool);
+  rev_ip_addr = get_reversed_addr(tmp_pool, &addr);
   if (rev_ip_addr == NULL) {
     (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
       "client address '%s' is an IPv6 address, skipping",
@@ -227,57 +865,55 @@ static int dnsbl_reject_conn(void) {
     return -1;
   }
 
-  switch (policy) {
-    /* For this policy, the connection will be allowed unless the connecting
-     * client is listed by any of the DNSBLDomain sites.
-     */
-    case DNSBL_POLICY_ALLOW_DENY: {
-      c = find_config(main_server->conf, CONF_PARAM, "DNSBLDomain", FALSE);
-      while (c != NULL) {
-        const char *domain;
-
-        pr_signals_handle();
-
-        domain = c->argv[0];
-
-        if (lookup_addr(tmp_pool, rev_ip_addr, domain) < 0) {
-          (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
-            "client address '%s' is listed by DNSBLDomain '%s', rejecting "
-            "connection", pr_netaddr_get_ipstr(session.c->remote_addr), domain);
-          reject_conn = TRUE;
-          break;
-        }
+  /* Send our queries to the configured nameserver, if any, rather than to
+   * those in resolv.conf, for the duration of the lookups.
+   */
+  c = find_config(main_server->conf, CONF_PARAM, "DNSBLNameserver", FALSE);
+  if (c != NULL) {
+    if ((_res.options & RES_INIT) ||
+        res_init() == 0) {
+      memcpy(saved_nsaddrs, _res.nsaddr_list, sizeof(saved_nsaddrs));
+      saved_nscount = _res.nscount;
 
-        c = find_config_next(c, c->next, CONF_PARAM, "DNSBLDomain", FALSE);
-      }
+      memcpy(&(_res.nsaddr_list[0]), c->argv[0], sizeof(struct sockaddr_in));
+      _res.nscount = 1;
 
-      break;
+    } else {
+      pr_trace_msg(trace_channel, 3, "error initializing resolver: %s",
+        strerror(errno));
     }
+  }
 
-    /* For this policy, the connection will be NOT allowed unless the
-     * connecting client is listed by any of the DNSBLDomain sites.
-     */
-    case DNSBL_POLICY_DENY_ALLOW: {
-      c = find_config(main_server->conf, CONF_PARAM, "DNSBLDomain", FALSE);
-      while (c) {
-        const char *domain;
-
-        pr_signals_handle();
-
-        domain = c->argv[0];
+  listed_domain = find_listing(tmp_pool, addr, rev_ip_addr);
 
-        if (lookup_addr(tmp_pool, rev_ip_addr, domain) < 0) {
-          (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
-            "client address '%s' is listed by DNSBLDomain '%s', allowing "
-            "connection", pr_netaddr_get_ipstr(session.c->remote_addr), domain);
-          reject_conn = FALSE;
-          break;
-        }
+  if (saved_nscount >= 0) {
+    memcpy(_res.nsaddr_list, saved_nsaddrs, sizeof(saved_nsaddrs));
+    _res.nscount = saved_nscount;
+  }
 
-        c = find_config_next(c, c->next, CONF_PARAM, "DNSBLDomain", FALSE);
-      }
+  if (listed_domain != NULL) {
+    switch (policy) {
+      /* For this policy, the connection will be allowed unless the
+       * connecting client is listed by any of the DNSBLDomain sites.
+       */
+      case DNSBL_POLICY_ALLOW_DENY:
+        (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+          "client address '%s' is listed by DNSBLDomain '%s', rejecting "
+          "connection", pr_netaddr_get_ipstr(session.c->remote_addr),
+          listed_domain);
+        reject_conn = TRUE;
+        break;
 
-      break;
+      /* For this policy, the connection will be NOT allowed unless the
+       * connecting client is listed by any of the DNSBLDomain sites.
+       */
+      case DNSBL_POLICY_DENY_ALLOW:
+        (void) pr_log_writefile(dnsbl_logfd, MOD_DNSBL_VERSION,
+          "client address '%s' is listed by DNSBLDomain '%s', allowing "
+          "connection", pr_netaddr_get_ipstr(session.c->remote_addr),
+          listed_domain);
+        reject_conn = FALSE;
+        break;
     }
   }
 
@@ -293,6 +929,26 @@ static int dnsbl_reject_conn(void) {
 /* Configuration handlers
  */
 
+/* usage: DNSBLCache on|off */
+MODRET set_dnsblcache(cmd_rec *cmd) {
+  int use_cache;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  use_cache = get_boolean(cmd, 1);
+  if (use_cache == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = use_cache;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: DNSBLDomain domain */
 MODRET set_dnsbldomain(cmd_rec *cmd) {
   char *domain;
@@ -345,6 +1001,44 @@ MODRET set_dnsbllog(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: DNSBLNameserver address [port] */
+MODRET set_dnsblnameserver(cmd_rec *cmd) {
+  struct sockaddr_in nsaddr;
+  int port = NS_DEFAULTPORT;
+  config_rec *c;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  memset(&nsaddr, 0, sizeof(nsaddr));
+  if (pr_inet_pton(AF_INET, cmd->argv[1], &(nsaddr.sin_addr)) <= 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "'", cmd->argv[1],
+      "' is not an IPv4 address", NULL));
+  }
+
+  if (cmd->argc == 3) {
+    port = atoi(cmd->argv[2]);
+    if (port < 1 ||
+        port > 65535) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid port: ", cmd->argv[2],
+        NULL));
+    }
+  }
+
+  nsaddr.sin_family = AF_INET;
+  nsaddr.sin_port = htons(port);
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(struct sockaddr_in));
+  memcpy(c->argv[0], &nsaddr, sizeof(struct sockaddr_in));
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: DNSBLPolicy "allow,deny"|"deny,allow" */
 MODRET set_dnsblpolicy(cmd_rec *cmd) {
   dnsbl_policy_e policy = DNSBL_POLICY_ALLOW_DENY;
@@ -374,9 +1068,57 @@ MODRET set_dnsblpolicy(cmd_rec *cmd) {
 /* Event listeners
  */
 
+#if defined(PR_SHARED_MODULE)
+static void dnsbl_mod_unload_ev(const void *event_data, void *user_data) {
+  if (strcmp("mod_dnsbl.c", (const char *) event_data) == 0) {
+    pr_event_unregister(&dnsbl_module, NULL, NULL);
+    dnsbl_cache_destroy();
+  }
+}
+#endif /* PR_SHARED_MODULE */
+
+static void dnsbl_postparse_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+  server_rec *s;
+  int engine = FALSE, use_cache = TRUE;
+
+  c = find_config(main_server->conf, CONF_PARAM, "DNSBLCache", FALSE);
+  if (c != NULL) {
+    use_cache = *((int *) c->argv[0]);
+  }
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    c = find_config(s->conf, CONF_PARAM, "DNSBLEngine", FALSE);
+    if (c != NULL &&
+        *((unsigned int *) c->argv[0]) == TRUE) {
+      engine = TRUE;
+      break;
+    }
+  }
+
+  if (engine == TRUE &&
+      use_cache == TRUE) {
+    /* Created once, in the daemon process, and kept across restarts. */
+    dnsbl_cache_create();
+
+  } else {
+    dnsbl_cache_destroy();
+  }
+}
+
 /* Initialization functions
  */
 
+static int dnsbl_init(void) {
+#if defined(PR_SHARED_MODULE)
+  pr_event_register(&dnsbl_module, "core.module-unload", dnsbl_mod_unload_ev,
+    NULL);
+#endif /* PR_SHARED_MODULE */
+  pr_event_register(&dnsbl_module, "core.postparse", dnsbl_postparse_ev, NULL);
+
+  return 0;
+}
+
 static void dnsbl_sess_reinit_ev(const void *event_data, void *user_data) {
   int res;
 
@@ -457,9 +1199,11 @@ static int dnsbl_sess_init(void) {
  */
 
 static conftable dnsbl_conftab[] = {
+  { "DNSBLCache",	set_dnsblcache,		NULL },
   { "DNSBLDomain",	set_dnsbldomain,	NULL },
   { "DNSBLEngine",	set_dnsblengine,	NULL },
   { "DNSBLLog",		set_dnsbllog,		NULL },
+  { "DNSBLNameserver",	set_dnsblnameserver,	NULL },
   { "DNSBLPolicy",	set_dnsblpolicy,	NULL },
   { NULL }
 };
@@ -483,7 +1227,7 @@ module dnsbl_module = {
   NULL,
 
   /* Module initialization function */
-  NULL,
+  dnsbl_init,
 
   /* Session initialization function */
   dnsbl_sess_init,
@@ -73,6 +73,9 @@ static int exec_timeout = 0;
                                          * the command.  Useful for pre-login
                                          * events.
                                          */
+#define EXEC_FL_USE_WORKER	0x0200	/* Command may be run by the exec
+					 * worker, if configured.
+					 */
 
 /* config_rec index for various stashed info */
 #define EXEC_IDX_TRIGGER_CMDS		1
@@ -456,13 +459,13 @@ static void exec_prepare_pipes(void) {
 
 /* Provides a "safe" version of the system(2) call by dropping all special
  * privileges, currently retained by the daemon, before exec()'ing the
- * given command.
+ * given command, with the given (already resolved) arguments and environment.
  */
-static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
+static int exec_run(pool *p, const char *path, array_header *args,
+    char **env, int flags) {
   pid_t pid;
   int status;
-  unsigned int path_idx = EXEC_IDX_LOGFMTS+1;
-  const char *path;
+  uint64_t start_ms = 0, end_ms = 0;
 
   struct sigaction sa_ignore, sa_intr, sa_quit;
   sigset_t set_chldmask, set_save;
@@ -489,7 +492,7 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
   }
 
   exec_prepare_pipes();
-  path = c->argv[path_idx];
+  (void) pr_gettimeofday_millis(&start_ms);
 
   pid = fork();
   if (pid < 0) {
@@ -504,48 +507,14 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
 
   } else if (pid == 0) {
     register unsigned int i = 0;
-    char **env = NULL, *ptr = NULL;
-    pool *tmp_pool;
+    char **argv = NULL, **elts;
+    const char *ptr = NULL;
 
     /* Child process */
 
-    /* Note: there is no need to clean up this temporary pool, as we've
-     * forked.  If the exec call succeeds, this child process will exit
-     * normally, and its process space recovered by the OS.  If the exec
-     * call fails, we still exit, and the process space is recovered by
-     * the OS.  Either way, the memory will be cleaned up without need for
-     * us to do it explicitly (unless one wanted to be pedantic about it,
-     * of course).
-     */
-    tmp_pool = cmd ? cmd->tmp_pool : make_sub_pool(session.pool);
-
     /* Don't forget to update the PID. */
     session.pid = getpid();
 
-    if (!(exec_opts & EXEC_OPT_USE_STDIN)) {
-      register unsigned int j;
-      array_header *logfmts;
-
-      /* Prepare the environment. */
-      env = exec_prepare_environ(tmp_pool, cmd);
-
-      logfmts = c->argv[EXEC_IDX_LOGFMTS];
-
-      /* Perform any required substitution on the command arguments. */
-      for (i = path_idx+1, j = 0; i < c->argc; i++, j++) {
-        unsigned char *logfmt;
-
-        pr_signals_handle();
-
-        logfmt = ((unsigned char **) logfmts->elts)[j];
-        c->argv[i] = (void *) exec_subst_var(tmp_pool, cmd, c->argv[i], logfmt);
-      }
-
-    } else {
-      /* Make sure that env is at least a NULL-terminated array. */
-      env = pcalloc(tmp_pool, sizeof(char **));
-    }
-
     /* Restore previous signal actions. */
     sigaction(SIGINT, &sa_intr, NULL);
     sigaction(SIGQUIT, &sa_quit, NULL);
@@ -589,20 +558,27 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
 
     exec_log("preparing to execute '%s' with uid %s (euid %s), "
       "gid %s (egid %s)", path,
-      pr_uid2str(tmp_pool, getuid()), pr_uid2str(tmp_pool, geteuid()),
-      pr_gid2str(tmp_pool, getgid()), pr_gid2str(tmp_pool, getegid()));
+      pr_uid2str(p, getuid()), pr_uid2str(p, geteuid()),
+      pr_gid2str(p, getgid()), pr_gid2str(p, getegid()));
 
     /* Trim the given path to the command to execute to just the last
      * component; this name will be the first argument to the executed
      * command, as per execve(2) convention.
      */
-    ptr = strrchr(c->argv[path_idx], '/');
-    c->argv[path_idx] = ptr + 1;
+    ptr = strrchr(path, '/');
+
+    argv = pcalloc(p, sizeof(char *) * (args->nelts + 2));
+    argv[0] = (char *) ptr + 1;
 
-    for (i = path_idx+1; i < c->argc; i++) {
-      if (c->argv[i] != NULL) {
-        exec_log(" + '%s': argv[%u] = %s", (const char *) path,
-          i - path_idx, (const char *) c->argv[i]);
+    elts = args->elts;
+    for (i = 0; i < args->nelts; i++) {
+      exec_log(" + '%s': argv[%u] = %s", path, i + 1, elts[i]);
+
+      /* If we are using stdin to convey all of the arguments, they are
+       * written there by the parent instead.
+       */
+      if (!(exec_opts & EXEC_OPT_USE_STDIN)) {
+        argv[i + 1] = elts[i];
       }
     }
 
@@ -616,18 +592,7 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
     }
 
     errno = 0;
-
-    /* If we are using stdin to convey all of the arguments, then we need
-     * not provide any sort of environment variables.
-     */
-    if (exec_opts & EXEC_OPT_USE_STDIN) {
-      char *args[] = { ptr + 1, NULL };
-
-      execve(path, args, env);
-
-    } else {
-      execve(path, (char **) (c->argv + path_idx), env);
-    }
+    execve(path, argv, env);
 
     /* Since all previous file descriptors (including those for log files)
      * have been closed, and root privs have been revoked, there's little
@@ -647,14 +612,11 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
      * stdin before closing that pipe.
      */
     if (exec_opts & EXEC_OPT_USE_STDIN) {
-      register unsigned int i, j;
+      register unsigned int i;
       int maxfd = -1, fds;
       fd_set writefds;
       struct timeval tv;
-      array_header *logfmts;
-      pool *tmp_pool;
-
-      tmp_pool = cmd ? cmd->tmp_pool : make_sub_pool(session.pool);
+      char **elts;
 
       /* Wait for stdin to be available for writing. */
 
@@ -675,33 +637,17 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
         pr_signals_handle();
       }
 
-      logfmts = c->argv[EXEC_IDX_LOGFMTS];
-
-      /* Perform any required substitution on the command arguments. */
-      for (i = path_idx+1, j = 0; i < c->argc; i++, j++) {
-        unsigned char *logfmt;
-
+      elts = args->elts;
+      for (i = 0; i < args->nelts; i++) {
         pr_signals_handle();
 
-        logfmt = ((unsigned char **) logfmts->elts)[j];
-
-        /* Handle the NULL-terminated argv lists here, since we are processing
-         * it manually for sending via stdin.
-         */
-        if (c->argv[i] == NULL ||
-            logfmt == NULL) {
-          break;
-        }
-
-        c->argv[i] = (void *) exec_subst_var(tmp_pool, cmd, c->argv[i], logfmt);
-
         /* Write the argument to stdin, terminated by a newline. */
-        if (write(exec_stdin_pipe[1], c->argv[i], strlen(c->argv[i])) < 0) {
+        if (write(exec_stdin_pipe[1], elts[i], strlen(elts[i])) < 0) {
           exec_log("error writing argument to stdin: %s", strerror(errno));
 
         } else {
-          exec_log("wrote argument %u (%s) to stdin (%d)", i - path_idx,
-            (char *) c->argv[i], exec_stdin_pipe[1]);
+          exec_log("wrote argument %u (%s) to stdin (%d)", i + 1, elts[i],
+            exec_stdin_pipe[1]);
         }
 
         if (write(exec_stdin_pipe[1], "\n", 1) < 0) {
@@ -718,9 +664,9 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
           strerror(errno));
       }
 
-      if (cmd == NULL) {
-        destroy_pool(tmp_pool);
-      }
+      /* Do not leak the pipe; the exec worker runs many commands. */
+      (void) close(exec_stdin_pipe[1]);
+      exec_stdin_pipe[1] = -1;
     }
 
     if (exec_opts & EXEC_OPT_USE_STDIN) {
@@ -742,9 +688,6 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
       fd_set readfds;
       struct timeval tv;
       time_t start_time = time(NULL);
-      pool *tmp_pool;
-
-      tmp_pool = cmd ? cmd->tmp_pool : make_sub_pool(session.pool);
 
       /* We set the result value to zero initially, so that at least one
        * pass through the stdout/stderr reading code happens.
@@ -823,7 +766,7 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
           long buflen, bufsz;
           char *buf;
 
-          buf = pr_fsio_getpipebuf(tmp_pool, exec_stdout_pipe[0], &bufsz);
+          buf = pr_fsio_getpipebuf(p, exec_stdout_pipe[0], &bufsz);
 
           /* The child sent us something.  How thoughtful. */
 
@@ -912,10 +855,6 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
         res = waitpid(pid, &status, WNOHANG);
       }
 
-      if (cmd == NULL) {
-        destroy_pool(tmp_pool);
-      }
-
     } else {
       res = waitpid(pid, &status, 0);
       while (res <= 0) {
@@ -939,6 +878,8 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
   close(exec_stdout_pipe[0]);
   close(exec_stderr_pipe[0]);
 
+  (void) pr_gettimeofday_millis(&end_ms);
+
   /* Restore the previous signal actions. */
   if (sigaction(SIGINT, &sa_intr, NULL) < 0) {
     exec_log("sigaction() error: %s", strerror(errno));
@@ -959,13 +900,14 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
     int exit_status;
 
     exit_status = WEXITSTATUS(status);
-    exec_log("'%s' terminated normally, with exit status %d", path,
-      exit_status);
+    exec_log("'%s' terminated normally, with exit status %d (%lu ms)", path,
+      exit_status, (unsigned long) (end_ms - start_ms));
     return exit_status;
   }
 
   if (WIFSIGNALED(status)) {
-    exec_log("'%s' died from signal %d", path, WTERMSIG(status));
+    exec_log("'%s' died from signal %d (%lu ms)", path, WTERMSIG(status),
+      (unsigned long) (end_ms - start_ms));
 
     if (WCOREDUMP(status)) {
       exec_log("'%s' created a coredump", path);
@@ -977,6 +919,641 @@ static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
   return status;
 }
 
+/* The exec worker.
+ *
+ * When configured via ExecWorker, the Execs which do not need to complete
+ * before the session can carry on (ExecOnCommand, ExecOnError, ExecOnEvent)
+ * are not run by the session process itself.  Instead, their arguments and
+ * environment are resolved in the session, and the job is handed, over a
+ * socketpair, to a long-running worker process forked from the session.  The
+ * worker runs the queued jobs in order, and reports each job's status and
+ * timings back.  The session waits only when the configured number of jobs
+ * are already queued.
+ *
+ * The worker keeps the credentials and root directory the session had when
+ * the worker was started; if those change (e.g. on login), a new worker is
+ * started for subsequent jobs, and the old one exits once it has finished
+ * its queue.
+ */
+
+#define EXEC_WORKER_DEFAULT_QUEUE_SIZE	32
+#define EXEC_WORKER_MAX_QUEUE_SIZE	1024
+
+struct exec_worker {
+  pid_t pid;
+  int fd;
+
+  /* The credentials and root directory with which the worker started. */
+  uid_t ruid, uid, login_uid;
+  gid_t gid, login_gid;
+  int disable_id_switching;
+  const char *chroot_path;
+
+  /* Jobs sent to the worker, but not yet completed. */
+  unsigned int nqueued;
+
+  /* Metrics */
+  unsigned long njobs;
+  unsigned long ncompleted;
+  unsigned long nfull;
+  unsigned int max_queued;
+  uint64_t total_wait_ms, max_wait_ms;
+  uint64_t total_run_ms, max_run_ms;
+};
+
+struct exec_job_msg {
+  uint32_t flags;
+  uint32_t nargs;
+  uint32_t nenv;
+  uint32_t msglen;
+  uint64_t queued_ms;
+
+  /* Followed by msglen bytes of NUL-terminated strings: the hook name, the
+   * path, the nargs arguments, and the nenv environment variables.
+   */
+};
+
+struct exec_result_msg {
+  int32_t status;
+  uint32_t wait_ms;
+  uint32_t run_ms;
+};
+
+static int exec_use_worker = FALSE;
+static unsigned int exec_worker_queue_size = EXEC_WORKER_DEFAULT_QUEUE_SIZE;
+static struct exec_worker exec_worker;
+
+static int exec_read_msg(int fd, void *buf, size_t buflen) {
+  size_t nread = 0;
+
+  while (nread < buflen) {
+    ssize_t res;
+
+    res = read(fd, ((char *) buf) + nread, buflen - nread);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res == 0) {
+      errno = EPIPE;
+      return -1;
+    }
+
+    nread += res;
+  }
+
+  return 0;
+}
+
+static int exec_write_msg(int fd, const void *buf, size_t buflen) {
+  size_t nwritten = 0;
+
+  while (nwritten < buflen) {
+    ssize_t res;
+
+    res = write(fd, ((const char *) buf) + nwritten, buflen - nwritten);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    nwritten += res;
+  }
+
+  return 0;
+}
+
+static char *exec_job_add_str(char *ptr, const char *str) {
+  size_t len;
+
+  len = strlen(str) + 1;
+  memcpy(ptr, str, len);
+
+  return ptr + len;
+}
+
+/* Returns a pointer to the next NUL-terminated string in the job buffer,
+ * or NULL if there is none.
+ */
+static char *exec_job_next_str(char **ptr, char *end) {
+  char *str, *nul;
+
+  if (*ptr >= end) {
+    return NULL;
+  }
+
+  str = *ptr;
+  nul = memchr(str, '\0', end - str);
+  if (nul == NULL) {
+    return NULL;
+  }
+
+  *ptr = nul + 1;
+  return str;
+}
+
+/* Closes the given connection fd, so that the client does not see the
+ * connection held open by the worker.  The standard fds are pointed at
+ * /dev/null instead, lest a later pipe(2) reuse them.
+ */
+static void exec_worker_close_fd(int fd) {
+  int null_fd;
+
+  if (fd < 0) {
+    return;
+  }
+
+  if (fd > STDERR_FILENO) {
+    (void) close(fd);
+    return;
+  }
+
+  null_fd = open("/dev/null", O_RDWR);
+  if (null_fd < 0) {
+    (void) close(fd);
+    return;
+  }
+
+  if (null_fd != fd) {
+    (void) dup2(null_fd, fd);
+    (void) close(null_fd);
+  }
+}
+
+static void exec_worker_run(int fd) {
+  pool *worker_pool;
+  int session_gone = FALSE;
+
+  /* This process only runs Execs; the session's timers, signal handling
+   * and connections are not ours to act upon.
+   */
+  pr_timer_remove(-1, ANY_MODULE);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+  signal(SIGPIPE, SIG_IGN);
+  session.pid = getpid();
+
+  if (session.c != NULL) {
+    exec_worker_close_fd(session.c->rfd);
+    exec_worker_close_fd(session.c->wfd);
+  }
+
+  if (session.d != NULL) {
+    exec_worker_close_fd(session.d->rfd);
+    exec_worker_close_fd(session.d->wfd);
+  }
+
+  worker_pool = make_sub_pool(exec_pool);
+  pr_pool_tag(worker_pool, "exec worker pool");
+
+  while (TRUE) {
+    register unsigned int i;
+    struct exec_job_msg job;
+    struct exec_result_msg result;
+    pool *job_pool;
+    char *buf, *ptr, *end, **env;
+    const char *hook, *path;
+    array_header *args;
+    uint64_t start_ms = 0, end_ms = 0;
+
+    if (exec_read_msg(fd, &job, sizeof(job)) < 0) {
+      /* The session is done with us. */
+      break;
+    }
+
+    job_pool = make_sub_pool(worker_pool);
+    pr_pool_tag(job_pool, "exec worker job pool");
+
+    buf = palloc(job_pool, job.msglen + 1);
+    if (exec_read_msg(fd, buf, job.msglen) < 0) {
+      break;
+    }
+
+    ptr = buf;
+    end = buf + job.msglen;
+
+    hook = exec_job_next_str(&ptr, end);
+    path = exec_job_next_str(&ptr, end);
+    if (hook == NULL ||
+        path == NULL ||
+        *path != '/') {
+      exec_log("exec worker: received malformed job, exiting");
+      break;
+    }
+
+    args = make_array(job_pool, job.nargs, sizeof(char *));
+    for (i = 0; i < job.nargs; i++) {
+      char *arg;
+
+      arg = exec_job_next_str(&ptr, end);
+      if (arg == NULL) {
+        break;
+      }
+
+      *((char **) push_array(args)) = arg;
+    }
+
+    env = pcalloc(job_pool, sizeof(char *) * (job.nenv + 1));
+    for (i = 0; i < job.nenv; i++) {
+      env[i] = exec_job_next_str(&ptr, end);
+      if (env[i] == NULL) {
+        break;
+      }
+    }
+
+    (void) pr_gettimeofday_millis(&start_ms);
+
+    /* There is no client to whom we could send any output. */
+    result.status = exec_run(job_pool, path, args, env,
+      job.flags|EXEC_FL_NO_SEND);
+
+    (void) pr_gettimeofday_millis(&end_ms);
+    result.wait_ms = start_ms > job.queued_ms ? start_ms - job.queued_ms : 0;
+    result.run_ms = end_ms - start_ms;
+
+    if (result.status != 0) {
+      exec_log("%s '%s' failed: %s (queued %lu ms, ran %lu ms)", hook, path,
+        strerror(result.status), (unsigned long) result.wait_ms,
+        (unsigned long) result.run_ms);
+
+    } else {
+      exec_log("%s '%s' succeeded (queued %lu ms, ran %lu ms)", hook, path,
+        (unsigned long) result.wait_ms, (unsigned long) result.run_ms);
+    }
+
+    destroy_pool(job_pool);
+
+    /* Once the session has gone, there is no one to report to; we still run
+     * the jobs it queued, though.
+     */
+    if (session_gone == FALSE &&
+        exec_write_msg(fd, &result, sizeof(result)) < 0) {
+      session_gone = TRUE;
+    }
+  }
+
+  _exit(0);
+}
+
+static void exec_worker_done(struct exec_result_msg *result) {
+  exec_worker.nqueued--;
+  exec_worker.ncompleted++;
+
+  exec_worker.total_wait_ms += result->wait_ms;
+  if (result->wait_ms > exec_worker.max_wait_ms) {
+    exec_worker.max_wait_ms = result->wait_ms;
+  }
+
+  exec_worker.total_run_ms += result->run_ms;
+  if (result->run_ms > exec_worker.max_run_ms) {
+    exec_worker.max_run_ms = result->run_ms;
+  }
+}
+
+/* Reads the results of completed jobs.  If block is TRUE, waits until at
+ * least one job has completed.
+ */
+static int exec_worker_collect(int block) {
+  while (exec_worker.nqueued > 0) {
+    fd_set rfds;
+    struct timeval tv;
+    struct exec_result_msg result;
+    int res;
+
+    pr_signals_handle();
+
+    FD_ZERO(&rfds);
+    FD_SET(exec_worker.fd, &rfds);
+    tv.tv_sec = block ? 1 : 0;
+    tv.tv_usec = 0;
+
+    res = select(exec_worker.fd + 1, &rfds, NULL, NULL, &tv);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res == 0) {
+      if (block == FALSE) {
+        break;
+      }
+
+      /* Make sure the worker we are waiting on is still with us. */
+      if (waitpid(exec_worker.pid, NULL, WNOHANG) != 0) {
+        exec_log("exec worker %lu exited unexpectedly with %u %s queued",
+          (unsigned long) exec_worker.pid, exec_worker.nqueued,
+          exec_worker.nqueued != 1 ? "jobs" : "job");
+        exec_worker.pid = 0;
+        errno = EPIPE;
+        return -1;
+      }
+
+      continue;
+    }
+
+    if (exec_read_msg(exec_worker.fd, &result, sizeof(result)) < 0) {
+      return -1;
+    }
+
+    exec_worker_done(&result);
+    block = FALSE;
+  }
+
+  return 0;
+}
+
+/* Stops handing jobs to the current worker; it exits once it has run the
+ * jobs already queued.
+ */
+static void exec_worker_stop(void) {
+  if (exec_worker.pid == 0 &&
+      exec_worker.fd < 0) {
+    return;
+  }
+
+  /* Account for any jobs which have already completed. */
+  if (exec_worker.fd >= 0) {
+    (void) exec_worker_collect(FALSE);
+  }
+
+  exec_log("exec worker %lu: %lu %s queued, %lu completed, waited on full "
+    "queue %lu %s (max %u queued); queue wait %lu ms avg/%lu ms max, run "
+    "%lu ms avg/%lu ms max", (unsigned long) exec_worker.pid,
+    exec_worker.njobs, exec_worker.njobs != 1 ? "jobs" : "job",
+    exec_worker.ncompleted, exec_worker.nfull,
+    exec_worker.nfull != 1 ? "times" : "time", exec_worker.max_queued,
+    (unsigned long) (exec_worker.ncompleted > 0 ?
+      exec_worker.total_wait_ms / exec_worker.ncompleted : 0),
+    (unsigned long) exec_worker.max_wait_ms,
+    (unsigned long) (exec_worker.ncompleted > 0 ?
+      exec_worker.total_run_ms / exec_worker.ncompleted : 0),
+    (unsigned long) exec_worker.max_run_ms);
+
+  if (exec_worker.fd >= 0) {
+    (void) close(exec_worker.fd);
+  }
+
+  if (exec_worker.pid != 0) {
+    /* Reap it if it is already gone; otherwise, it finishes on its own. */
+    (void) waitpid(exec_worker.pid, NULL, WNOHANG);
+  }
+
+  memset(&exec_worker, 0, sizeof(exec_worker));
+  exec_worker.fd = -1;
+}
+
+static int exec_worker_is_current(void) {
+  const char *chroot_path;
+
+  if (exec_worker.pid == 0) {
+    return FALSE;
+  }
+
+  chroot_path = session.chroot_path != NULL ? session.chroot_path : "";
+
+  if (exec_worker.ruid != getuid() ||
+      exec_worker.uid != session.uid ||
+      exec_worker.gid != session.gid ||
+      exec_worker.login_uid != session.login_uid ||
+      exec_worker.login_gid != session.login_gid ||
+      exec_worker.disable_id_switching != session.disable_id_switching ||
+      strcmp(exec_worker.chroot_path, chroot_path) != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static int exec_worker_start(void) {
+  int fds[2];
+  pid_t pid;
+
+  if (exec_worker_is_current() == TRUE) {
+    return 0;
+  }
+
+  exec_worker_stop();
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    return -1;
+  }
+
+  (void) fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+  pid = fork();
+  if (pid < 0) {
+    int xerrno = errno;
+
+    pr_log_pri(PR_LOG_WARNING, MOD_EXEC_VERSION
+      ": unable to fork exec worker: %s", strerror(xerrno));
+
+    (void) close(fds[0]);
+    (void) close(fds[1]);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (pid == 0) {
+    /* Child process */
+    (void) close(fds[0]);
+    exec_worker_run(fds[1]);
+  }
+
+  (void) close(fds[1]);
+
+  exec_worker.pid = pid;
+  exec_worker.fd = fds[0];
+  exec_worker.ruid = getuid();
+  exec_worker.uid = session.uid;
+  exec_worker.gid = session.gid;
+  exec_worker.login_uid = session.login_uid;
+  exec_worker.login_gid = session.login_gid;
+  exec_worker.disable_id_switching = session.disable_id_switching;
+  exec_worker.chroot_path = pstrdup(exec_pool,
+    session.chroot_path != NULL ? session.chroot_path : "");
+
+  exec_log("started exec worker %lu (queue size %u)", (unsigned long) pid,
+    exec_worker_queue_size);
+  return 0;
+}
+
+static int exec_worker_submit(pool *p, const char *hook, const char *path,
+    array_header *args, char **env, int flags) {
+  register unsigned int i;
+  struct exec_job_msg job;
+  char **elts, *buf, *ptr;
+  size_t buflen;
+
+  if (exec_worker_start() < 0) {
+    return -1;
+  }
+
+  if (exec_worker_collect(FALSE) < 0) {
+    int xerrno = errno;
+
+    exec_worker_stop();
+    errno = xerrno;
+    return -1;
+  }
+
+  if (exec_worker.nqueued >= exec_worker_queue_size) {
+    exec_worker.nfull++;
+    pr_trace_msg(trace_channel, 9, "exec worker queue full (%u queued), "
+      "waiting", exec_worker.nqueued);
+
+    if (exec_worker_collect(TRUE) < 0) {
+      int xerrno = errno;
+
+      exec_worker_stop();
+      errno = xerrno;
+      return -1;
+    }
+  }
+
+  memset(&job, 0, sizeof(job));
+  job.flags = flags;
+  job.nargs = args->nelts;
+  (void) pr_gettimeofday_millis(&job.queued_ms);
+
+  buflen = strlen(hook) + 1 + strlen(path) + 1;
+
+  elts = args->elts;
+  for (i = 0; i < args->nelts; i++) {
+    buflen += strlen(elts[i]) + 1;
+  }
+
+  for (i = 0; env[i] != NULL; i++) {
+    buflen += strlen(env[i]) + 1;
+    job.nenv++;
+  }
+
+  buf = ptr = palloc(p, buflen);
+  ptr = exec_job_add_str(ptr, hook);
+  ptr = exec_job_add_str(ptr, path);
+
+  for (i = 0; i < args->nelts; i++) {
+    ptr = exec_job_add_str(ptr, elts[i]);
+  }
+
+  for (i = 0; env[i] != NULL; i++) {
+    ptr = exec_job_add_str(ptr, env[i]);
+  }
+
+  job.msglen = buflen;
+
+  if (exec_write_msg(exec_worker.fd, &job, sizeof(job)) < 0 ||
+      exec_write_msg(exec_worker.fd, buf, buflen) < 0) {
+    int xerrno = errno;
+
+    exec_worker_stop();
+    errno = xerrno;
+    return -1;
+  }
+
+  exec_worker.nqueued++;
+  exec_worker.njobs++;
+  if (exec_worker.nqueued > exec_worker.max_queued) {
+    exec_worker.max_queued = exec_worker.nqueued;
+  }
+
+  exec_log("%s '%s' queued for exec worker %lu (%u of %u queued)", hook,
+    path, (unsigned long) exec_worker.pid, exec_worker.nqueued,
+    exec_worker_queue_size);
+  return 0;
+}
+
+static array_header *exec_resolve_args(pool *p, cmd_rec *cmd,
+    config_rec *c) {
+  register unsigned int i;
+  unsigned int path_idx = EXEC_IDX_LOGFMTS+1;
+  array_header *args, *logfmts;
+
+  args = make_array(p, 0, sizeof(char *));
+  logfmts = c->argv[EXEC_IDX_LOGFMTS];
+
+  /* Perform any required substitution on the command arguments. */
+  for (i = 0; i < logfmts->nelts; i++) {
+    const char *text;
+    unsigned char *logfmt;
+
+    pr_signals_handle();
+
+    logfmt = ((unsigned char **) logfmts->elts)[i];
+    text = exec_subst_var(p, cmd, c->argv[path_idx + 1 + i], logfmt);
+
+    /* As for execve(2), the arguments end at the first NULL. */
+    if (text == NULL) {
+      break;
+    }
+
+    *((const char **) push_array(args)) = text;
+  }
+
+  return args;
+}
+
+/* Runs the program configured in the given Exec config, either directly or,
+ * if allowed by the flags, via the exec worker.
+ */
+static int exec_ssystem(cmd_rec *cmd, config_rec *c, int flags) {
+  int res;
+  unsigned int path_idx = EXEC_IDX_LOGFMTS+1;
+  const char *path;
+  array_header *args;
+  char **env;
+  pool *tmp_pool;
+
+  path = c->argv[path_idx];
+
+  tmp_pool = make_sub_pool(cmd != NULL ? cmd->tmp_pool : session.pool);
+  pr_pool_tag(tmp_pool, "exec ssystem pool");
+
+  args = exec_resolve_args(tmp_pool, cmd, c);
+
+  if (exec_opts & EXEC_OPT_USE_STDIN) {
+    /* If we are using stdin to convey all of the arguments, then we need
+     * not provide any sort of environment variables.
+     */
+    env = pcalloc(tmp_pool, sizeof(char *));
+
+  } else {
+    env = exec_prepare_environ(tmp_pool, cmd);
+  }
+
+  /* Output to be sent to the client must be read by the session itself. */
+  if (exec_use_worker == TRUE &&
+      (flags & EXEC_FL_USE_WORKER) &&
+      (!(exec_opts & EXEC_OPT_SEND_STDOUT) || (flags & EXEC_FL_NO_SEND))) {
+    const char *hook;
+
+    hook = c->name != NULL ? c->name : "ExecOnEvent";
+
+    res = exec_worker_submit(tmp_pool, hook, path, args, env, flags);
+    if (res == 0) {
+      destroy_pool(tmp_pool);
+      return 0;
+    }
+
+    exec_log("unable to queue %s '%s' for exec worker, running it directly: "
+      "%s", hook, path, strerror(errno));
+  }
+
+  res = exec_run(tmp_pool, path, args, env, flags);
+  destroy_pool(tmp_pool);
+
+  return res;
+}
+
 static void exec_jot_append_text(struct exec_jot_buffer *log, const char *text,
     size_t text_len) {
   if (text == NULL ||
@@ -1366,7 +1943,7 @@ MODRET exec_post_cmd(cmd_rec *cmd) {
       const char *path;
 
       path = c->argv[path_idx];
-      res = exec_ssystem(cmd, c, 0);
+      res = exec_ssystem(cmd, c, EXEC_FL_USE_WORKER);
       if (res != 0) {
         exec_log("%s ExecOnCommand '%s' failed: %s", (char *) cmd->argv[0],
           path, strerror(res));
@@ -1434,7 +2011,7 @@ MODRET exec_post_cmd_err(cmd_rec *cmd) {
       const char *path;
 
       path = c->argv[path_idx];
-      res = exec_ssystem(cmd, c, 0);
+      res = exec_ssystem(cmd, c, EXEC_FL_USE_WORKER);
       if (res != 0) {
         exec_log("%s ExecOnError '%s' failed: %s", (char *) cmd->argv[0],
           path, strerror(res));
@@ -1934,6 +2511,56 @@ MODRET set_exectimeout(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: ExecWorker on|off [queue-size] */
+MODRET set_execworker(cmd_rec *cmd) {
+  int use_worker = -1;
+  unsigned int queue_size = EXEC_WORKER_DEFAULT_QUEUE_SIZE;
+  config_rec *c;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  use_worker = get_boolean(cmd, 1);
+  if (use_worker == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  if (cmd->argc == 3) {
+    char *ptr = NULL;
+    long size;
+
+    size = strtol(cmd->argv[2], &ptr, 10);
+    if (ptr && *ptr) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid queue size: ",
+        (char *) cmd->argv[2], NULL));
+    }
+
+    if (size < 1 ||
+        size > EXEC_WORKER_MAX_QUEUE_SIZE) {
+      char max[32];
+
+      memset(max, '\0', sizeof(max));
+      snprintf(max, sizeof(max)-1, "%d", EXEC_WORKER_MAX_QUEUE_SIZE);
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool,
+        "queue size must be between 1 and ", max, NULL));
+    }
+
+    queue_size = (unsigned int) size;
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = use_worker;
+  c->argv[1] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = queue_size;
+
+  return PR_HANDLED(cmd);
+}
+
 /* Event handlers
  */
 
@@ -1948,7 +2575,7 @@ static void exec_any_ev(const void *event_data, void *user_data) {
   }
 
   path = eed->c->argv[path_idx];
-  res = exec_ssystem(NULL, eed->c, eed->flags);
+  res = exec_ssystem(NULL, eed->c, eed->flags|EXEC_FL_USE_WORKER);
   if (res != 0) {
     exec_log("ExecOnEvent '%s' for %s failed: %s", eed->event,
       path, strerror(res));
@@ -1958,6 +2585,11 @@ static void exec_any_ev(const void *event_data, void *user_data) {
   }
 }
 
+static void exec_exit_ev(const void *event_data, void *user_data) {
+  /* Any queued jobs are still run by the worker, after we are gone. */
+  exec_worker_stop();
+}
+
 #if defined(PR_SHARED_MODULE)
 static void exec_mod_unload_ev(const void *event_data, void *user_data) {
   if (strcmp("mod_exec.c", (const char *) event_data) != 0) {
@@ -2045,10 +2677,15 @@ static void exec_sess_reinit_ev(const void *event_data, void *user_data) {
   /* A HOST command changed the main_server pointer, reinitialize ourselves. */
 
   pr_event_unregister(&exec_module, "core.session-reinit", exec_sess_reinit_ev);
+  pr_event_unregister(&exec_module, "core.exit", exec_exit_ev);
+
+  exec_worker_stop();
 
   exec_engine = FALSE;
   exec_opts = 0U;
   exec_timeout = 0;
+  exec_use_worker = FALSE;
+  exec_worker_queue_size = EXEC_WORKER_DEFAULT_QUEUE_SIZE;
 
   (void) close(exec_logfd);
   exec_logfd = -1;
@@ -2074,6 +2711,9 @@ static int exec_sess_init(void) {
   pr_event_register(&exec_module, "core.session-reinit", exec_sess_reinit_ev,
     NULL);
 
+  memset(&exec_worker, 0, sizeof(exec_worker));
+  exec_worker.fd = -1;
+
   use_exec = get_param_ptr(main_server->conf, "ExecEngine", FALSE);
   if (use_exec != NULL &&
       *use_exec == TRUE) {
@@ -2112,6 +2752,16 @@ static int exec_sess_init(void) {
     exec_timeout = *((int *) c->argv[0]);
   }
 
+  c = find_config(main_server->conf, CONF_PARAM, "ExecWorker", FALSE);
+  if (c != NULL) {
+    exec_use_worker = *((int *) c->argv[0]);
+    exec_worker_queue_size = *((unsigned int *) c->argv[1]);
+
+    if (exec_use_worker == TRUE) {
+      pr_event_register(&exec_module, "core.exit", exec_exit_ev, NULL);
+    }
+  }
+
   exec_closelog();
   exec_openlog();
 
@@ -2189,6 +2839,7 @@ static conftable exec_conftab[] = {
   { "ExecOnRestart",	set_execonrestart,	NULL },
   { "ExecOptions",	set_execoptions,	NULL },
   { "ExecTimeout",	set_exectimeout,	NULL },
+  { "ExecWorker",	set_execworker,		NULL },
   { NULL }
 };
 
@@ -44,13 +44,78 @@
 #include <GeoIP.h>
 #include <GeoIPCity.h>
 
+#if defined(PR_USE_MAXMINDDB)
+# include <maxminddb.h>
+#endif /* PR_USE_MAXMINDDB */
+
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+extern xaset_t *server_list;
+
 module geoip_module;
 
 static int geoip_engine = FALSE;
 static int geoip_logfd = -1;
 
 static pool *geoip_pool = NULL;
-static array_header *static_geoips = NULL;
+
+/* GeoIPTables opened by the daemon process, for all servers, and shared
+ * with the session processes.  Tables which are not cached in memory are
+ * mapped (GEOIP_MMAP_CACHE), so that all sessions share the same pages.
+ */
+struct geoip_table {
+  const char *path;
+  int flags;
+  int use_utf8;
+  GeoIP *gi;
+#if defined(PR_USE_MAXMINDDB)
+  MMDB_s *mmdb;
+#endif /* PR_USE_MAXMINDDB */
+};
+
+static array_header *static_tables = NULL;
+
+/* Shared cache of recent lookup results, keyed by client address and the
+ * set of tables used for the lookup.  The cache is mapped by the daemon
+ * process; each entry holds the looked-up values, packed into a fixed-size
+ * buffer.  When all of the probed entries are in use, the least recently
+ * used entry is replaced.
+ */
+#define GEOIP_CACHE_SIZE		1024
+#define GEOIP_CACHE_PROBES		4
+#define GEOIP_CACHE_DATASZ		448
+#define GEOIP_CACHE_NFIELDS		17
+#define GEOIP_CACHE_NO_VALUE		0xffff
+
+struct geoip_cache_entry {
+  /* Odd while a session is updating the entry. */
+  volatile unsigned int seqno;
+
+  unsigned int generation;
+  uint32_t tables_hash;
+  unsigned char addr[16];
+  time_t last_used;
+  uint16_t offsets[GEOIP_CACHE_NFIELDS];
+  char data[GEOIP_CACHE_DATASZ];
+};
+
+static struct geoip_cache_entry *geoip_cache = NULL;
+
+/* Incremented for each (re)load of the configuration, so that results from
+ * tables of a previous configuration are not used.
+ */
+static unsigned int geoip_cache_generation = 0;
+
+#if defined(__GNUC__)
+# define GEOIP_CACHE_BARRIER()	__sync_synchronize()
+# define GEOIP_CACHE_LOCK(e, s) \
+  __sync_bool_compare_and_swap(&((e)->seqno), (s), (s) + 1)
+#else
+# define GEOIP_CACHE_BARRIER()
+# define GEOIP_CACHE_LOCK(e, s)	((e)->seqno == (s) ? ((e)->seqno++, 1) : 0)
+#endif /* __GNUC__ */
 
 /* The types of data that GeoIP can provide, and that we care about. */
 static const char *geoip_city = NULL;
@@ -71,6 +136,27 @@ static const char *geoip_asn = NULL;
 static const char *geoip_proxy = NULL;
 static const char *geoip_timezone = NULL;
 
+/* The values stored in the shared cache, in cache order. */
+static const char **geoip_cache_fields[GEOIP_CACHE_NFIELDS] = {
+  &geoip_city,
+  &geoip_area_code,
+  &geoip_postal_code,
+  &geoip_latitude,
+  &geoip_longitude,
+  &geoip_isp,
+  &geoip_org,
+  &geoip_country_code2,
+  &geoip_country_code3,
+  &geoip_country_name,
+  &geoip_region_code,
+  &geoip_region_name,
+  &geoip_continent_name,
+  &geoip_network_speed,
+  &geoip_asn,
+  &geoip_proxy,
+  &geoip_timezone
+};
+
 /* Names of supported GeoIP values */
 struct geoip_filter_key {
   const char *filter_name;
@@ -598,36 +684,81 @@ static const char *get_geoip_filter_value(int filter_id) {
   return NULL;
 }
 
-static void get_geoip_tables(array_header *geoips, int filter_flags,
-    int skip_standard) {
-  config_rec *c;
+static int is_mmdb_path(const char *path) {
+  size_t pathlen;
 
-  c = find_config(main_server->conf, CONF_PARAM, "GeoIPTable", FALSE);
-  while (c) {
-    GeoIP *gi;
-    const char *path;
-    int flags, use_utf8 = FALSE;
+  if (path == NULL) {
+    return FALSE;
+  }
 
-    pr_signals_handle();
+  pathlen = strlen(path);
+  if (pathlen > 5 &&
+      strcasecmp(path + pathlen - 5, ".mmdb") == 0) {
+    return TRUE;
+  }
 
-    path = c->argv[0];
-    flags = *((int *) c->argv[1]);
-    use_utf8 = *((int *) c->argv[2]);
+  return FALSE;
+}
+
+static struct geoip_table *open_geoip_table(pool *p, const char *path,
+    int flags, int use_utf8, int shared) {
+  struct geoip_table *table;
+  GeoIP *gi = NULL;
+  int open_flags;
+
+  table = pcalloc(p, sizeof(struct geoip_table));
+  table->path = path;
+  table->flags = flags;
+  table->use_utf8 = use_utf8;
+
+  if (is_mmdb_path(path) == TRUE) {
+#if defined(PR_USE_MAXMINDDB)
+    MMDB_s *mmdb;
+    int res;
 
-    /* Make sure we open tables that are marked with the default
-     * GEOIP_STANDARD flag, which has a value of zero.
+    /* MaxMind DB files are always mapped into memory, and are thus shared
+     * by all of the sessions using them.
      */
-    if (flags == GEOIP_STANDARD && skip_standard == TRUE) {
-      pr_trace_msg(trace_channel, 15,
-        "skipping loading GeoIP table '%s'", path);
-      c = find_config_next(c, c->next, CONF_PARAM, "GeoIPTable", FALSE);
-      continue;
-    }
+    mmdb = pcalloc(p, sizeof(MMDB_s));
 
     PRIVS_ROOT
-    gi = GeoIP_open(path, flags);
+    res = MMDB_open(path, MMDB_MODE_MMAP, mmdb);
+    PRIVS_RELINQUISH
+
+    if (res != MMDB_SUCCESS) {
+      pr_log_pri(PR_LOG_WARNING, MOD_GEOIP_VERSION
+        ": warning: unable to open/use GeoIPTable '%s': %s", path,
+        MMDB_strerror(res));
+      return NULL;
+    }
+
+    table->mmdb = mmdb;
+    pr_trace_msg(trace_channel, 15, "loaded MaxMind DB table '%s': %s", path,
+      mmdb->metadata.database_type);
+    return table;
+#else
+    pr_log_pri(PR_LOG_WARNING, MOD_GEOIP_VERSION
+      ": warning: unable to use GeoIPTable '%s': MaxMind DB support not "
+      "enabled", path);
+    return NULL;
+#endif /* PR_USE_MAXMINDDB */
+  }
+
+  /* Tables opened by the daemon process are shared with the session
+   * processes; any such tables which are not already cached in memory are
+   * mapped, rather than being read from the filesystem for each lookup.
+   */
+  open_flags = flags;
+  if (shared == TRUE &&
+      !(open_flags & GEOIP_MEMORY_CACHE)) {
+    open_flags |= GEOIP_MMAP_CACHE;
+  }
+
+  PRIVS_ROOT
+  if (path != NULL) {
+    gi = GeoIP_open(path, open_flags);
     if (gi == NULL &&
-        (flags & GEOIP_INDEX_CACHE)) {
+        (open_flags & GEOIP_INDEX_CACHE)) {
       /* Per Bug#3975, a common cause of this error is the fact that some
        * of the Maxmind GeoIP Lite database files simply do not have indexes.
        * So try to open them as standard databases as a fallback.
@@ -635,86 +766,237 @@ static void get_geoip_tables(array_header *geoips, int filter_flags,
       pr_log_debug(DEBUG8, MOD_GEOIP_VERSION
         ": unable to open GeoIPTable '%s' using the IndexCache flag "
         "(database lacks index?), retrying without IndexCache flag", path);
-      flags &= ~GEOIP_INDEX_CACHE;
-      gi = GeoIP_open(path, flags);
+      open_flags &= ~GEOIP_INDEX_CACHE;
+      gi = GeoIP_open(path, open_flags);
     }
-    PRIVS_RELINQUISH
 
-    if (gi != NULL) {
-      if (use_utf8) {
-        GeoIP_set_charset(gi, GEOIP_CHARSET_UTF8);
-      }
+  } else {
+    /* Let the library use its own default database file(s). */
+    gi = GeoIP_new(open_flags);
+  }
+  PRIVS_RELINQUISH
 
-      *((GeoIP **) push_array(geoips)) = gi;
+  if (gi == NULL) {
+    /* XXX Sigh.  Stupid libGeoIP library logs to stdout/stderr, rather
+     * than providing a strerror function.  Grr!
+     */
 
-      pr_trace_msg(trace_channel, 15, "loaded GeoIP table '%s': %s (type %d)",
-        path, GeoIP_database_info(gi), GeoIP_database_edition(gi));
+    if (path != NULL) {
+      pr_log_pri(PR_LOG_WARNING, MOD_GEOIP_VERSION
+        ": warning: unable to open/use GeoIPTable '%s'", path);
 
     } else {
-      /* XXX Sigh.  Stupid libGeoIP library logs to stdout/stderr, rather
-       * than providing a strerror function.  Grr!
-       */
-
       pr_log_pri(PR_LOG_WARNING, MOD_GEOIP_VERSION
-        ": warning: unable to open/use GeoIPTable '%s'", path);
+        ": warning: unable to open/use default GeoIP library database "
+        "file(s)");
     }
 
-    c = find_config_next(c, c->next, CONF_PARAM, "GeoIPTable", FALSE);
+    return NULL;
+  }
+
+  if (use_utf8) {
+    GeoIP_set_charset(gi, GEOIP_CHARSET_UTF8);
   }
 
-  if (geoips->nelts == 0 &&
-      static_geoips->nelts == 0 &&
-      ((filter_flags == GEOIP_STANDARD) ||
-       (filter_flags & GEOIP_CHECK_CACHE))) {
-    GeoIP *gi;
+  table->gi = gi;
+
+  if (path != NULL) {
+    pr_trace_msg(trace_channel, 15, "loaded GeoIP table '%s': %s (type %d)",
+      path, GeoIP_database_info(gi), GeoIP_database_edition(gi));
+
+  } else {
+    char *db_info = NULL;
+
+    db_info = GeoIP_database_info(gi);
 
-    /* Let the library use its own default database file(s), if no others
-     * have been configured.
+    pr_trace_msg(trace_channel, 15,
+      "loaded default GeoIP table: %s (type %d)", db_info,
+      GeoIP_database_edition(gi));
+
+    /* We happen to know that GeoIP_database_info() returns a malloc'd
+     * pointer.  The GeoIP API does not provide a free/delete function,
+     * so we do it ourselves.  Sigh.
      */
+    free(db_info);
+  }
 
-    PRIVS_ROOT
-    gi = GeoIP_new(GEOIP_STANDARD);
-    PRIVS_RELINQUISH
+  return table;
+}
 
-    if (gi != NULL) {
-      char *db_info = NULL;
+static struct geoip_table *find_static_table(const char *path, int flags,
+    int use_utf8) {
+  register unsigned int i;
+  struct geoip_table **tables;
 
-      *((GeoIP **) push_array(geoips)) = gi;
+  if (static_tables == NULL) {
+    return NULL;
+  }
 
-      db_info = GeoIP_database_info(gi);
+  tables = static_tables->elts;
+  for (i = 0; i < static_tables->nelts; i++) {
+    struct geoip_table *table;
 
-      pr_trace_msg(trace_channel, 15,
-        "loaded default GeoIP table: %s (type %d)", db_info,
-        GeoIP_database_edition(gi));
+    table = tables[i];
+    if (table == NULL ||
+        table->flags != flags ||
+        table->use_utf8 != use_utf8) {
+      continue;
+    }
 
-      /* We happen to know that GeoIP_database_info() returns a malloc'd
-       * pointer.  The GeoIP API does not provide a free/delete function,
-       * so we do it ourselves.  Sigh.
-       */
-      free(db_info);
+    if ((path == NULL && table->path == NULL) ||
+        (path != NULL && table->path != NULL &&
+         strcmp(path, table->path) == 0)) {
+      return table;
+    }
+  }
+
+  return NULL;
+}
+
+/* Opens the GeoIPTables of all servers in the daemon process, so that the
+ * sessions need not open them for themselves.  Tables configured with the
+ * CheckCache flag are left for the sessions, as they may be reloaded.
+ */
+static void load_static_tables(void) {
+  server_rec *s;
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    config_rec *c;
+    int have_tables = FALSE;
+
+    pr_signals_handle();
+
+    c = find_config(s->conf, CONF_PARAM, "GeoIPTable", FALSE);
+    while (c != NULL) {
+      struct geoip_table *table;
+      const char *path;
+      int flags, use_utf8;
+
+      pr_signals_handle();
+
+      have_tables = TRUE;
+
+      path = c->argv[0];
+      flags = *((int *) c->argv[1]);
+      use_utf8 = *((int *) c->argv[2]);
+
+      if (flags & GEOIP_CHECK_CACHE) {
+        pr_trace_msg(trace_channel, 15,
+          "skipping loading GeoIP table '%s' (CheckCache)", path);
+        c = find_config_next(c, c->next, CONF_PARAM, "GeoIPTable", FALSE);
+        continue;
+      }
+
+      if (find_static_table(path, flags, use_utf8) == NULL) {
+        table = open_geoip_table(geoip_pool, pstrdup(geoip_pool, path), flags,
+          use_utf8, TRUE);
+        if (table != NULL) {
+          *((struct geoip_table **) push_array(static_tables)) = table;
+        }
+      }
+
+      c = find_config_next(c, c->next, CONF_PARAM, "GeoIPTable", FALSE);
+    }
+
+    /* Servers which use mod_geoip without configuring any tables use the
+     * library's default database file(s).
+     */
+    if (have_tables == FALSE &&
+        find_config(s->conf, CONF_PARAM, "GeoIPEngine", TRUE) != NULL &&
+        find_static_table(NULL, GEOIP_STANDARD, FALSE) == NULL) {
+      struct geoip_table *table;
+
+      table = open_geoip_table(geoip_pool, NULL, GEOIP_STANDARD, FALSE, TRUE);
+      if (table != NULL) {
+        *((struct geoip_table **) push_array(static_tables)) = table;
+      }
+    }
+  }
+}
+
+/* Collects the tables to use for this session: those already opened by the
+ * daemon process, and those which the session needs to open itself.  The
+ * latter are also added to the sess_tables list, for closing later.
+ */
+static void get_geoip_tables(pool *p, array_header *tables,
+    array_header *sess_tables) {
+  config_rec *c;
+  struct geoip_table *table;
+
+  c = find_config(main_server->conf, CONF_PARAM, "GeoIPTable", FALSE);
+  if (c == NULL) {
+    table = find_static_table(NULL, GEOIP_STANDARD, FALSE);
+    if (table == NULL) {
+      table = open_geoip_table(p, NULL, GEOIP_STANDARD, FALSE, FALSE);
+      if (table != NULL) {
+        *((struct geoip_table **) push_array(sess_tables)) = table;
+      }
+    }
+
+    if (table != NULL) {
+      *((struct geoip_table **) push_array(tables)) = table;
+    }
+
+    return;
+  }
+
+  while (c != NULL) {
+    const char *path;
+    int flags, use_utf8;
+
+    pr_signals_handle();
+
+    path = c->argv[0];
+    flags = *((int *) c->argv[1]);
+    use_utf8 = *((int *) c->argv[2]);
+
+    table = find_static_table(path, flags, use_utf8);
+    if (table != NULL) {
+      pr_trace_msg(trace_channel, 15, "using shared GeoIP table '%s'", path);
 
     } else {
-      pr_log_pri(PR_LOG_WARNING, MOD_GEOIP_VERSION
-        ": warning: unable to open/use default GeoIP library database file(s)");
+      table = open_geoip_table(p, path, flags, use_utf8, FALSE);
+      if (table != NULL) {
+        *((struct geoip_table **) push_array(sess_tables)) = table;
+      }
     }
+
+    if (table != NULL) {
+      *((struct geoip_table **) push_array(tables)) = table;
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, "GeoIPTable", FALSE);
   }
 }
 
-static void remove_geoip_tables(array_header *geoips) {
+static void remove_geoip_tables(array_header *tables) {
   register unsigned int i;
-  GeoIP **gis;
+  struct geoip_table **elts;
 
-  if (geoips == NULL ||
-      geoips->nelts == 0) {
+  if (tables == NULL ||
+      tables->nelts == 0) {
     return;
   }
 
-  gis = geoips->elts;
-  for (i = 0; i < geoips->nelts; i++) {
-    if (gis[i] != NULL) {
-      GeoIP_delete(gis[i]);
-      gis[i] = NULL;
+  elts = tables->elts;
+  for (i = 0; i < tables->nelts; i++) {
+    if (elts[i] == NULL) {
+      continue;
+    }
+
+    if (elts[i]->gi != NULL) {
+      GeoIP_delete(elts[i]->gi);
+      elts[i]->gi = NULL;
+    }
+
+#if defined(PR_USE_MAXMINDDB)
+    if (elts[i]->mmdb != NULL) {
+      MMDB_close(elts[i]->mmdb);
+      elts[i]->mmdb = NULL;
     }
+#endif /* PR_USE_MAXMINDDB */
+
+    elts[i] = NULL;
   }
 }
 
@@ -1023,13 +1305,445 @@ static void get_geoip_data(array_header *geoips, const char *ip_addr) {
   }
 }
 
-static void get_geoip_info(array_header *sess_geoips) {
+#if defined(PR_USE_MAXMINDDB)
+/* The MaxMind DB data paths of the values we care about; the GeoIP2 and
+ * GeoLite2 databases use the same paths.
+ */
+struct geoip_mmdb_field {
+  const char **value;
+  const char *lookup_path[6];
+};
+
+static struct geoip_mmdb_field geoip_mmdb_fields[] = {
+  { &geoip_continent_name,	{ "continent", "code", NULL } },
+  { &geoip_country_code2,	{ "country", "iso_code", NULL } },
+  { &geoip_country_name,	{ "country", "names", "en", NULL } },
+  { &geoip_region_code,		{ "subdivisions", "0", "iso_code", NULL } },
+  { &geoip_region_name,		{ "subdivisions", "0", "names", "en", NULL } },
+  { &geoip_city,		{ "city", "names", "en", NULL } },
+  { &geoip_postal_code,		{ "postal", "code", NULL } },
+  { &geoip_latitude,		{ "location", "latitude", NULL } },
+  { &geoip_longitude,		{ "location", "longitude", NULL } },
+  { &geoip_timezone,		{ "location", "time_zone", NULL } },
+  { &geoip_isp,			{ "isp", NULL } },
+  { &geoip_org,			{ "organization", NULL } },
+  { &geoip_network_speed,	{ "connection_type", NULL } },
+
+  { NULL, { NULL } }
+};
+
+static const char *get_mmdb_value(MMDB_entry_s *entry,
+    const char *const *lookup_path) {
+  MMDB_entry_data_s data;
+  char buf[64];
+  int res;
+
+  res = MMDB_aget_value(entry, &data, lookup_path);
+  if (res != MMDB_SUCCESS ||
+      data.has_data == FALSE) {
+    return NULL;
+  }
+
+  memset(buf, '\0', sizeof(buf));
+
+  switch (data.type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+      return pstrndup(session.pool, data.utf8_string, data.data_size);
+
+    case MMDB_DATA_TYPE_DOUBLE:
+      pr_snprintf(buf, sizeof(buf)-1, "%f", data.double_value);
+      break;
+
+    case MMDB_DATA_TYPE_UINT16:
+      pr_snprintf(buf, sizeof(buf)-1, "%u", (unsigned int) data.uint16);
+      break;
+
+    case MMDB_DATA_TYPE_UINT32:
+      pr_snprintf(buf, sizeof(buf)-1, "%lu", (unsigned long) data.uint32);
+      break;
+
+    case MMDB_DATA_TYPE_BOOLEAN:
+      return data.boolean ? "true" : "false";
+
+    default:
+      return NULL;
+  }
+
+  return pstrdup(session.pool, buf);
+}
+
+static void get_mmdb_data(array_header *mmdbs, const char *ip_addr) {
+  register unsigned int i;
+  MMDB_s **dbs;
+
+  dbs = mmdbs->elts;
+  for (i = 0; i < mmdbs->nelts; i++) {
+    register unsigned int j;
+    MMDB_lookup_result_s result;
+    int gai_error = 0, mmdb_error = MMDB_SUCCESS;
+    const char *asn, *asn_org, *proxy;
+    const char *asn_path[] = { "autonomous_system_number", NULL };
+    const char *asn_org_path[] = { "autonomous_system_organization", NULL };
+    const char *proxy_path[] = { "traits", "is_anonymous_proxy", NULL };
+
+    result = MMDB_lookup_string(dbs[i], ip_addr, &gai_error, &mmdb_error);
+    if (gai_error != 0) {
+      pr_trace_msg(trace_channel, 2,
+        "unable to look up IP address '%s' in MaxMind DB table: %s", ip_addr,
+        gai_strerror(gai_error));
+      continue;
+    }
+
+    if (mmdb_error != MMDB_SUCCESS) {
+      (void) pr_log_writefile(geoip_logfd, MOD_GEOIP_VERSION,
+        "error looking up IP address '%s' in MaxMind DB table: %s", ip_addr,
+        MMDB_strerror(mmdb_error));
+      continue;
+    }
+
+    if (result.found_entry == FALSE) {
+      pr_trace_msg(trace_channel, 2,
+        "no MaxMind DB record found for IP address '%s'", ip_addr);
+      continue;
+    }
+
+    for (j = 0; geoip_mmdb_fields[j].value != NULL; j++) {
+      const char *value;
+
+      value = get_mmdb_value(&(result.entry),
+        geoip_mmdb_fields[j].lookup_path);
+      if (value != NULL) {
+        *(geoip_mmdb_fields[j].value) = value;
+      }
+    }
+
+    /* Format ASNs the same way as the legacy GeoIP ASN databases, e.g.
+     * "AS15169 Google LLC".
+     */
+    asn = get_mmdb_value(&(result.entry), asn_path);
+    if (asn != NULL) {
+      asn_org = get_mmdb_value(&(result.entry), asn_org_path);
+      geoip_asn = pstrcat(session.pool, "AS", asn,
+        asn_org != NULL ? " " : "", asn_org != NULL ? asn_org : "", NULL);
+    }
+
+    proxy = get_mmdb_value(&(result.entry), proxy_path);
+    if (proxy != NULL &&
+        strcmp(proxy, "true") == 0) {
+      geoip_proxy = "anonymous";
+    }
+  }
+}
+#endif /* PR_USE_MAXMINDDB */
+
+static uint32_t geoip_hash_bytes(uint32_t h, const unsigned char *data,
+    size_t datalen) {
+  register size_t i;
+
+  /* FNV-1a */
+  for (i = 0; i < datalen; i++) {
+    h ^= (uint32_t) data[i];
+    h *= 16777619UL;
+  }
+
+  return h;
+}
+
+static uint32_t geoip_hash_tables(array_header *tables) {
+  register unsigned int i;
+  struct geoip_table **elts;
+  uint32_t h = 2166136261UL;
+
+  elts = tables->elts;
+  for (i = 0; i < tables->nelts; i++) {
+    if (elts[i]->path != NULL) {
+      h = geoip_hash_bytes(h, (const unsigned char *) elts[i]->path,
+        strlen(elts[i]->path) + 1);
+    }
+
+    h = geoip_hash_bytes(h, (const unsigned char *) &(elts[i]->flags),
+      sizeof(int));
+    h = geoip_hash_bytes(h, (const unsigned char *) &(elts[i]->use_utf8),
+      sizeof(int));
+  }
+
+  return h;
+}
+
+/* Cache keys use IPv4-mapped IPv6 addresses for IPv4 clients. */
+static int get_cache_addr(const pr_netaddr_t *addr, unsigned char *key) {
+  const void *inaddr;
+
+  inaddr = pr_netaddr_get_inaddr(addr);
+  if (inaddr == NULL) {
+    return -1;
+  }
+
+  memset(key, '\0', 16);
+
+  switch (pr_netaddr_get_family(addr)) {
+    case AF_INET:
+      key[10] = key[11] = 0xff;
+      memcpy(key + 12, inaddr, 4);
+      break;
+
+#ifdef PR_USE_IPV6
+    case AF_INET6:
+      memcpy(key, inaddr, 16);
+      break;
+#endif /* PR_USE_IPV6 */
+
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  return 0;
+}
+
+static int geoip_cache_get(const unsigned char *addr, uint32_t tables_hash) {
+  register unsigned int i;
+  uint32_t h;
+
+  if (geoip_cache == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  h = geoip_hash_bytes(2166136261UL, addr, 16) ^ tables_hash;
+
+  for (i = 0; i < GEOIP_CACHE_PROBES; i++) {
+    register unsigned int j;
+    struct geoip_cache_entry *e, copy;
+    unsigned int seqno;
+
+    e = &(geoip_cache[(h + i) & (GEOIP_CACHE_SIZE - 1)]);
+
+    seqno = e->seqno;
+    if (seqno & 1) {
+      continue;
+    }
+
+    GEOIP_CACHE_BARRIER();
+    memcpy(&copy, (void *) e, sizeof(copy));
+    GEOIP_CACHE_BARRIER();
+
+    if (e->seqno != seqno ||
+        copy.last_used == 0 ||
+        copy.generation != geoip_cache_generation ||
+        copy.tables_hash != tables_hash ||
+        memcmp(copy.addr, addr, 16) != 0) {
+      continue;
+    }
+
+    /* Note that this entry was used; it is only a hint for replacement,
+     * thus there is no need to lock the entry for it.
+     */
+    e->last_used = time(NULL);
+
+    for (j = 0; j < GEOIP_CACHE_NFIELDS; j++) {
+      if (copy.offsets[j] == GEOIP_CACHE_NO_VALUE ||
+          copy.offsets[j] >= GEOIP_CACHE_DATASZ) {
+        continue;
+      }
+
+      copy.data[GEOIP_CACHE_DATASZ-1] = '\0';
+      *(geoip_cache_fields[j]) = pstrdup(session.pool,
+        copy.data + copy.offsets[j]);
+    }
+
+    return 0;
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+static void geoip_cache_set(const unsigned char *addr, uint32_t tables_hash) {
+  register unsigned int i;
+  struct geoip_cache_entry *victim = NULL;
+  uint16_t offsets[GEOIP_CACHE_NFIELDS];
+  char data[GEOIP_CACHE_DATASZ];
+  size_t datalen = 0;
+  unsigned int seqno;
+  uint32_t h;
+
+  if (geoip_cache == NULL) {
+    return;
+  }
+
+  /* Pack the values; results too large for an entry are not cached. */
+  for (i = 0; i < GEOIP_CACHE_NFIELDS; i++) {
+    const char *value;
+    size_t valuelen;
+
+    value = *(geoip_cache_fields[i]);
+    if (value == NULL) {
+      offsets[i] = GEOIP_CACHE_NO_VALUE;
+      continue;
+    }
+
+    valuelen = strlen(value) + 1;
+    if (datalen + valuelen > sizeof(data)) {
+      pr_trace_msg(trace_channel, 15,
+        "GeoIP data too large for cache, not caching");
+      return;
+    }
+
+    memcpy(data + datalen, value, valuelen);
+    offsets[i] = (uint16_t) datalen;
+    datalen += valuelen;
+  }
+
+  h = geoip_hash_bytes(2166136261UL, addr, 16) ^ tables_hash;
+
+  /* Reuse the entry for this address/tables if there is one; otherwise use
+   * an unused entry, or the least recently used entry.
+   */
+  for (i = 0; i < GEOIP_CACHE_PROBES; i++) {
+    struct geoip_cache_entry *e;
+
+    e = &(geoip_cache[(h + i) & (GEOIP_CACHE_SIZE - 1)]);
+    if (e->tables_hash == tables_hash &&
+        memcmp(e->addr, addr, 16) == 0) {
+      victim = e;
+      break;
+    }
+
+    if (victim == NULL ||
+        e->last_used < victim->last_used) {
+      victim = e;
+    }
+  }
+
+  seqno = victim->seqno;
+  if ((seqno & 1) ||
+      !GEOIP_CACHE_LOCK(victim, seqno)) {
+    /* Another session is updating this entry; let it. */
+    return;
+  }
+
+  GEOIP_CACHE_BARRIER();
+
+  victim->generation = geoip_cache_generation;
+  victim->tables_hash = tables_hash;
+  memcpy(victim->addr, addr, 16);
+  victim->last_used = time(NULL);
+  memcpy(victim->offsets, offsets, sizeof(offsets));
+  memcpy(victim->data, data, datalen);
+
+  GEOIP_CACHE_BARRIER();
+  victim->seqno = seqno + 2;
+
+  pr_trace_msg(trace_channel, 15, "cached GeoIP data (%lu bytes)",
+    (unsigned long) datalen);
+}
+
+static void geoip_cache_create(void) {
+#if defined(HAVE_SYS_MMAN_H) && \
+    (defined(MAP_ANONYMOUS) || defined(MAP_ANON))
+  void *ptr;
+  size_t cachesz;
+  int flags = MAP_SHARED;
+
+  if (geoip_cache != NULL) {
+    return;
+  }
+
+# if defined(MAP_ANONYMOUS)
+  flags |= MAP_ANONYMOUS;
+# else
+  flags |= MAP_ANON;
+# endif /* MAP_ANONYMOUS */
+
+  cachesz = GEOIP_CACHE_SIZE * sizeof(struct geoip_cache_entry);
+  ptr = mmap(NULL, cachesz, PROT_READ|PROT_WRITE, flags, -1, 0);
+  if (ptr == MAP_FAILED) {
+    pr_log_debug(DEBUG1, MOD_GEOIP_VERSION
+      ": error mapping %lu bytes for GeoIP cache: %s",
+      (unsigned long) cachesz, strerror(errno));
+    return;
+  }
+
+  memset(ptr, 0, cachesz);
+  geoip_cache = ptr;
+
+  pr_trace_msg(trace_channel, 9, "mapped GeoIP cache of %u entries",
+    (unsigned int) GEOIP_CACHE_SIZE);
+#endif /* HAVE_SYS_MMAN_H and MAP_ANON */
+}
+
+static void geoip_cache_destroy(void) {
+#if defined(HAVE_SYS_MMAN_H)
+  if (geoip_cache == NULL) {
+    return;
+  }
+
+  (void) munmap((void *) geoip_cache,
+    GEOIP_CACHE_SIZE * sizeof(struct geoip_cache_entry));
+  geoip_cache = NULL;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
+static void get_geoip_info(array_header *tables, int use_cache) {
   const char *ip_addr;
+  unsigned char cache_addr[16];
+  uint32_t tables_hash = 0;
+  int cached = FALSE;
 
   ip_addr = pr_netaddr_get_ipstr(session.c->remote_addr);
 
-  get_geoip_data(static_geoips, ip_addr);
-  get_geoip_data(sess_geoips, ip_addr);
+  /* Results from tables opened by the session itself (e.g. those using
+   * CheckCache) are not cached, as those tables may change.
+   */
+  if (use_cache == TRUE &&
+      geoip_cache != NULL &&
+      get_cache_addr(session.c->remote_addr, cache_addr) == 0) {
+    tables_hash = geoip_hash_tables(tables);
+
+    if (geoip_cache_get(cache_addr, tables_hash) == 0) {
+      pr_trace_msg(trace_channel, 9, "using cached GeoIP data for %s",
+        ip_addr);
+      cached = TRUE;
+    }
+
+  } else {
+    use_cache = FALSE;
+  }
+
+  if (cached == FALSE) {
+    register unsigned int i;
+    struct geoip_table **elts;
+    array_header *geoips;
+#if defined(PR_USE_MAXMINDDB)
+    array_header *mmdbs;
+
+    mmdbs = make_array(session.pool, 0, sizeof(MMDB_s *));
+#endif /* PR_USE_MAXMINDDB */
+    geoips = make_array(session.pool, 0, sizeof(GeoIP *));
+
+    elts = tables->elts;
+    for (i = 0; i < tables->nelts; i++) {
+      if (elts[i]->gi != NULL) {
+        *((GeoIP **) push_array(geoips)) = elts[i]->gi;
+      }
+
+#if defined(PR_USE_MAXMINDDB)
+      if (elts[i]->mmdb != NULL) {
+        *((MMDB_s **) push_array(mmdbs)) = elts[i]->mmdb;
+      }
+#endif /* PR_USE_MAXMINDDB */
+    }
+
+    get_geoip_data(geoips, ip_addr);
+#if defined(PR_USE_MAXMINDDB)
+    get_mmdb_data(mmdbs, ip_addr);
+#endif /* PR_USE_MAXMINDDB */
+
+    if (use_cache == TRUE) {
+      geoip_cache_set(cache_addr, tables_hash);
+    }
+  }
 
   if (geoip_country_code2 != NULL) {
     pr_trace_msg(trace_channel, 8, "%s: 2-Letter country code: %s", ip_addr,
@@ -1433,8 +2147,9 @@ MODRET geoip_post_pass(cmd_rec *cmd) {
 #if defined(PR_SHARED_MODULE)
 static void geoip_mod_unload_ev(const void *event_data, void *user_data) {
   if (strcmp("mod_geoip.c", (const char *) event_data) == 0) {
-    remove_geoip_tables(static_geoips);
+    remove_geoip_tables(static_tables);
     destroy_pool(geoip_pool);
+    geoip_cache_destroy();
 
     /* Unregister ourselves from all events. */
     pr_event_unregister(&geoip_module, NULL, NULL);
@@ -1443,23 +2158,30 @@ static void geoip_mod_unload_ev(const void *event_data, void *user_data) {
 #endif /* PR_SHARED_MODULE */
 
 static void geoip_postparse_ev(const void *event_data, void *user_data) {
-  int filter_flags;
+  pr_log_debug(DEBUG8, MOD_GEOIP_VERSION ": loading static GeoIP tables");
+  load_static_tables();
 
-  filter_flags = GEOIP_MEMORY_CACHE|GEOIP_MMAP_CACHE|GEOIP_INDEX_CACHE;
+  /* The cache is kept across restarts; results from the previous tables
+   * are distinguished by their generation.
+   */
+  geoip_cache_generation++;
+  if (static_tables->nelts > 0) {
+    geoip_cache_create();
 
-  pr_log_debug(DEBUG8, MOD_GEOIP_VERSION ": loading static GeoIP tables");
-  get_geoip_tables(static_geoips, filter_flags, TRUE);
+  } else {
+    geoip_cache_destroy();
+  }
 }
 
 static void geoip_restart_ev(const void *event_data, void *user_data) {
-  remove_geoip_tables(static_geoips);
+  remove_geoip_tables(static_tables);
 
   destroy_pool(geoip_pool);
 
   geoip_pool = make_sub_pool(permanent_pool);
   pr_pool_tag(geoip_pool, MOD_GEOIP_VERSION);
 
-  static_geoips = make_array(geoip_pool, 0, sizeof(GeoIP *));
+  static_tables = make_array(geoip_pool, 0, sizeof(struct geoip_table *));
 }
 
 /* Initialization functions
@@ -1469,7 +2191,7 @@ static int geoip_init(void) {
   geoip_pool = make_sub_pool(permanent_pool);
   pr_pool_tag(geoip_pool, MOD_GEOIP_VERSION);
 
-  static_geoips = make_array(geoip_pool, 0, sizeof(GeoIP *));
+  static_tables = make_array(geoip_pool, 0, sizeof(struct geoip_table *));
 
 #if defined(PR_SHARED_MODULE)
   pr_event_register(&geoip_module, "core.module-unload", geoip_mod_unload_ev,
@@ -1483,7 +2205,7 @@ static int geoip_init(void) {
 
 static int geoip_sess_init(void) {
   config_rec *c;
-  array_header *sess_geoips;
+  array_header *tables, *sess_tables;
   int res;
   pool *tmp_pool;
 
@@ -1534,13 +2256,13 @@ static int geoip_sess_init(void) {
   tmp_pool = make_sub_pool(geoip_pool);
   pr_pool_tag(tmp_pool, "GeoIP Session Pool");
 
-  sess_geoips = make_array(tmp_pool, 0, sizeof(GeoIP *));
+  tables = make_array(tmp_pool, 0, sizeof(struct geoip_table *));
+  sess_tables = make_array(tmp_pool, 0, sizeof(struct geoip_table *));
 
   pr_log_debug(DEBUG8, MOD_GEOIP_VERSION ": loading session GeoIP tables");
-  get_geoip_tables(sess_geoips, GEOIP_CHECK_CACHE, FALSE);
+  get_geoip_tables(tmp_pool, tables, sess_tables);
 
-  if (static_geoips->nelts == 0 &&
-      sess_geoips->nelts == 0) {
+  if (tables->nelts == 0) {
     (void) pr_log_writefile(geoip_logfd, MOD_GEOIP_VERSION,
       "no usable GeoIPTable files found, skipping GeoIP lookups");
 
@@ -1549,7 +2271,7 @@ static int geoip_sess_init(void) {
     return 0;
   }
 
-  get_geoip_info(sess_geoips);
+  get_geoip_info(tables, sess_tables->nelts == 0 ? TRUE : FALSE);
 
   c = find_config(main_server->conf, CONF_PARAM, "GeoIPPolicy", FALSE);
   if (c != NULL) {
@@ -1589,7 +2311,7 @@ static int geoip_sess_init(void) {
   }
 
   set_geoip_values();
-  remove_geoip_tables(sess_geoips);
+  remove_geoip_tables(sess_tables);
 
   destroy_pool(tmp_pool);
   return 0;
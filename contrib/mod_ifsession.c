@@ -46,6 +46,8 @@
 /* mod_ifsession options */
 #define IFSESS_OPT_PER_UNAUTHED_USER	0x001
 
+extern xaset_t *server_list;
+
 module ifsession_module;
 
 static int ifsess_ctx = -1;
@@ -58,6 +60,39 @@ static const char *ifsess_home_dir = NULL;
 /* For supporting DisplayLogin files in <IfUser>/<IfGroup> sections. */
 static pr_fh_t *displaylogin_fh = NULL;
 
+/* Index of the <IfClass>, <IfGroup>, and <IfUser> sections of a server,
+ * built when the configuration is parsed.  Rather than evaluating every such
+ * section at login, only the sections which name the session's class,
+ * group(s), or user, and those sections which cannot be indexed by name
+ * (e.g. regular expressions, or negated names), are evaluated.
+ */
+struct ifsess_section {
+  config_rec *c;
+  config_rec *list;
+  int merged;
+};
+
+struct ifsess_sections {
+  /* All of the sections of one type, in configuration order. */
+  array_header *sections;
+
+  /* Maps a name to the array of the indices of the sections naming it. */
+  pr_table_t *names;
+
+  /* Indices of the sections which are always evaluated. */
+  array_header *unindexed;
+};
+
+struct ifsess_index {
+  server_rec *server;
+  struct ifsess_sections class_sections;
+  struct ifsess_sections group_sections;
+  struct ifsess_sections user_sections;
+};
+
+static pool *ifsess_index_pool = NULL;
+static array_header *ifsess_indices = NULL;
+
 static int ifsess_sess_init(void);
 
 static const char *trace_channel = "ifsession";
@@ -69,9 +104,35 @@ static void ifsess_resolve_server_dirs(server_rec *);
 /* Support routines
  */
 
+/* Removes every matching config_rec from the given set, at any depth, in a
+ * single pass; restarting a recursive find_config() after each removal is
+ * quadratic in the number of <IfUser>/<IfGroup> sections which contain the
+ * same directive.
+ */
+static void ifsess_remove_params(xaset_t *set, int lookup_type,
+    const char *name) {
+  config_rec *c, *next;
+
+  for (c = (config_rec *) set->xas_list; c != NULL; c = next) {
+    next = c->next;
+
+    pr_signals_handle();
+
+    if ((lookup_type == -1 || c->config_type == lookup_type) &&
+        c->name != NULL &&
+        strcmp(c->name, name) == 0) {
+      xaset_remove(c->set, (xasetmember_t *) c);
+      continue;
+    }
+
+    if (c->subset != NULL) {
+      ifsess_remove_params(c->subset, lookup_type, name);
+    }
+  }
+}
+
 static void ifsess_remove_param(xaset_t *set, int config_type,
     const char *name) {
-  config_rec *c = NULL;
   int lookup_type = -1;
 
   if (config_type == CONF_DIR) {
@@ -82,19 +143,7 @@ static void ifsess_remove_param(xaset_t *set, int config_type,
     pr_trace_msg(trace_channel, 9, "removing '%s' config", name);
   }
 
-  c = find_config(set, lookup_type, name, TRUE);
-  while (c != NULL) {
-    xaset_t *fset;
-    xasetmember_t *member;
-
-    pr_signals_handle();
-
-    fset = c->set;
-    member = (xasetmember_t *) c;
-    xaset_remove(fset, member);
-
-    c = find_config(set, lookup_type, name, TRUE);
-  }
+  ifsess_remove_params(set, lookup_type, name);
 }
 
 static void ifsess_dup_param(pool *dst_pool, xaset_t **dst, config_rec *c,
@@ -164,6 +213,20 @@ static void ifsess_dup_param(pool *dst_pool, xaset_t **dst, config_rec *c,
   }
 }
 
+static void ifsess_set_merged(void) {
+  if (ifsess_merged == TRUE) {
+    return;
+  }
+
+  ifsess_merged = TRUE;
+
+  /* Stash a session note indicating that we changed the session's
+   * configuration, for use by e.g. mod_log, which can otherwise rely on
+   * what it precomputed in the daemon process.
+   */
+  (void) pr_table_add_dup(session.notes, "mod_ifsession.merged", "true", 0);
+}
+
 static void ifsess_dup_set(pool *dst_pool, xaset_t *dst, xaset_t *src) {
   config_rec *c, *next;
 
@@ -353,6 +416,183 @@ void ifsess_resolve_server_dirs(server_rec *s) {
   }
 }
 
+static void ifsess_index_add_name(pool *p, struct ifsess_sections *secs,
+    const char *name, unsigned int idx) {
+  array_header *indices;
+
+  indices = (array_header *) pr_table_get(secs->names, name, NULL);
+  if (indices == NULL) {
+    indices = make_array(p, 1, sizeof(unsigned int));
+    (void) pr_table_add(secs->names, name, indices, sizeof(array_header *));
+  }
+
+  *((unsigned int *) push_array(indices)) = idx;
+}
+
+static void ifsess_index_section(pool *p, struct ifsess_sections *secs,
+    config_rec *c, config_rec *list) {
+  struct ifsess_section *sec;
+  unsigned char eval_type;
+  unsigned int idx;
+  char **names;
+  int indexable = TRUE;
+
+  idx = secs->sections->nelts;
+  sec = push_array(secs->sections);
+  sec->c = c;
+  sec->list = list;
+  sec->merged = FALSE;
+
+  /* A section can only match a session whose class, group, or user is named
+   * in its expression if its names are ORed, and none are negated; or if they
+   * are ANDed, and at least one is not negated.
+   */
+  eval_type = *((unsigned char *) list->argv[1]);
+  names = (char **) &list->argv[2];
+
+  if (eval_type == PR_EXPR_EVAL_OR) {
+    register unsigned int i;
+
+    for (i = 0; names[i] != NULL; i++) {
+      if (*names[i] == '!') {
+        indexable = FALSE;
+        break;
+      }
+    }
+
+    if (indexable == TRUE) {
+      for (i = 0; names[i] != NULL; i++) {
+        ifsess_index_add_name(p, secs, names[i], idx);
+      }
+    }
+
+  } else if (eval_type == PR_EXPR_EVAL_AND) {
+    register unsigned int i;
+
+    indexable = FALSE;
+    for (i = 0; names[i] != NULL; i++) {
+      if (*names[i] != '!') {
+        ifsess_index_add_name(p, secs, names[i], idx);
+        indexable = TRUE;
+        break;
+      }
+    }
+
+  } else {
+    indexable = FALSE;
+  }
+
+  if (indexable == FALSE) {
+    *((unsigned int *) push_array(secs->unindexed)) = idx;
+  }
+}
+
+static void ifsess_index_sections(pool *p, struct ifsess_sections *secs,
+    server_rec *s, const char *text, int config_type) {
+  config_rec *c;
+
+  secs->sections = make_array(p, 0, sizeof(struct ifsess_section));
+  secs->names = pr_table_alloc(p, 0);
+  secs->unindexed = make_array(p, 0, sizeof(unsigned int));
+
+  c = find_config(s->conf, -1, text, FALSE);
+  while (c != NULL) {
+    config_rec *list;
+
+    pr_signals_handle();
+
+    list = find_config(c->subset, config_type, NULL, FALSE);
+    if (list != NULL) {
+      ifsess_index_section(p, secs, c, list);
+    }
+
+    c = find_config_next(c, c->next, -1, text, FALSE);
+  }
+}
+
+static struct ifsess_index *ifsess_index_server(server_rec *s) {
+  struct ifsess_index *idx;
+
+  if (ifsess_index_pool == NULL) {
+    ifsess_index_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(ifsess_index_pool, MOD_IFSESSION_VERSION " index pool");
+
+    ifsess_indices = make_array(ifsess_index_pool, 1,
+      sizeof(struct ifsess_index *));
+  }
+
+  idx = pcalloc(ifsess_index_pool, sizeof(struct ifsess_index));
+  idx->server = s;
+
+  ifsess_index_sections(ifsess_index_pool, &(idx->class_sections), s,
+    IFSESS_CLASS_TEXT, IFSESS_CLASS_NUMBER);
+  ifsess_index_sections(ifsess_index_pool, &(idx->group_sections), s,
+    IFSESS_GROUP_TEXT, IFSESS_GROUP_NUMBER);
+  ifsess_index_sections(ifsess_index_pool, &(idx->user_sections), s,
+    IFSESS_USER_TEXT, IFSESS_USER_NUMBER);
+
+  pr_trace_msg(trace_channel, 17, "indexed %d <IfClass>, %d <IfGroup>, "
+    "%d <IfUser> sections for server '%s'",
+    idx->class_sections.sections->nelts, idx->group_sections.sections->nelts,
+    idx->user_sections.sections->nelts, s->ServerName);
+
+  *((struct ifsess_index **) push_array(ifsess_indices)) = idx;
+  return idx;
+}
+
+static struct ifsess_index *ifsess_get_index(server_rec *s) {
+  if (ifsess_indices != NULL) {
+    register unsigned int i;
+    struct ifsess_index **indices;
+
+    indices = ifsess_indices->elts;
+    for (i = 0; i < ifsess_indices->nelts; i++) {
+      if (indices[i]->server == s) {
+        return indices[i];
+      }
+    }
+  }
+
+  /* Not indexed when the configuration was parsed; index it now. */
+  return ifsess_index_server(s);
+}
+
+/* Returns an array of flags, one per section, marking the sections which are
+ * to be evaluated; initially, just the unindexed ones.
+ */
+static unsigned char *ifsess_get_candidates(pool *p,
+    struct ifsess_sections *secs) {
+  register unsigned int i;
+  unsigned char *candidates;
+
+  candidates = pcalloc(p, secs->sections->nelts + 1);
+
+  for (i = 0; i < secs->unindexed->nelts; i++) {
+    candidates[((unsigned int *) secs->unindexed->elts)[i]] = TRUE;
+  }
+
+  return candidates;
+}
+
+static void ifsess_mark_candidates(struct ifsess_sections *secs,
+    unsigned char *candidates, const char *name) {
+  register unsigned int i;
+  const array_header *indices;
+
+  if (name == NULL) {
+    return;
+  }
+
+  indices = pr_table_get(secs->names, name, NULL);
+  if (indices == NULL) {
+    return;
+  }
+
+  for (i = 0; i < indices->nelts; i++) {
+    candidates[((unsigned int *) indices->elts)[i]] = TRUE;
+  }
+}
+
 static int ifsess_sess_merge_authn(pool *p) {
   register unsigned int i = 0;
   config_rec *c = NULL;
@@ -390,7 +630,7 @@ static int ifsess_sess_merge_authn(pool *p) {
       fixup_dirs(main_server, CF_SILENT);
       fixup_dirs(main_server, CF_DEFER|CF_SILENT);
 
-      ifsess_merged = TRUE;
+      ifsess_set_merged();
     }
 
     c = find_config_next(c, c->next, -1, IFSESS_AUTHN_TEXT, FALSE);
@@ -407,77 +647,89 @@ static int ifsess_sess_merge_authn(pool *p) {
 }
 
 static int ifsess_sess_merge_class(pool *p) {
-  register unsigned int i = 0;
+  register unsigned int i = 0, j;
   config_rec *c = NULL;
   pool *tmp_pool;
   array_header *class_remove_list;
+  struct ifsess_sections *secs;
+  unsigned char *candidates;
 
   tmp_pool = make_sub_pool(p);
   pr_pool_tag(tmp_pool, "<IfClass> merge pool");
 
   class_remove_list = make_array(tmp_pool, 1, sizeof(config_rec *));
 
-  c = find_config(main_server->conf, -1, IFSESS_CLASS_TEXT, FALSE);
-  while (c != NULL) {
+  secs = &(ifsess_get_index(main_server)->class_sections);
+  candidates = ifsess_get_candidates(tmp_pool, secs);
+  if (session.conn_class != NULL) {
+    ifsess_mark_candidates(secs, candidates, session.conn_class->cls_name);
+  }
+
+  for (j = 0; j < secs->sections->nelts; j++) {
+    struct ifsess_section *sec;
     config_rec *list = NULL;
+    unsigned char mergein = FALSE;
+
+    sec = ((struct ifsess_section *) secs->sections->elts) + j;
+    if (candidates[j] == FALSE ||
+        sec->merged == TRUE) {
+      continue;
+    }
 
     pr_signals_handle();
 
-    list = find_config(c->subset, IFSESS_CLASS_NUMBER, NULL, FALSE);
-    if (list != NULL) {
-      unsigned char mergein = FALSE;
+    c = sec->c;
+    list = sec->list;
 
 #if defined(PR_USE_REGEX)
-      if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_REGEX) {
-        pr_regex_t *pre = list->argv[2];
+    if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_REGEX) {
+      pr_regex_t *pre = list->argv[2];
 
-        if (session.conn_class != NULL) {
-          pr_log_debug(DEBUG8, MOD_IFSESSION_VERSION
-            ": evaluating regexp pattern '%s' against subject '%s'",
-            pr_regexp_get_pattern(pre), session.conn_class->cls_name);
+      if (session.conn_class != NULL) {
+        pr_log_debug(DEBUG8, MOD_IFSESSION_VERSION
+          ": evaluating regexp pattern '%s' against subject '%s'",
+          pr_regexp_get_pattern(pre), session.conn_class->cls_name);
 
-          if (pr_regexp_exec(pre, session.conn_class->cls_name, 0, NULL, 0, 0,
-              0) == 0) {
-            mergein = TRUE;
-          }
+        if (pr_regexp_exec(pre, session.conn_class->cls_name, 0, NULL, 0, 0,
+            0) == 0) {
+          mergein = TRUE;
         }
+      }
 
-      } else
+    } else
 #endif /* regex support */
 
-      if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_OR &&
-          pr_expr_eval_class_or((char **) &list->argv[2]) == TRUE) {
-        mergein = TRUE;
+    if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_OR &&
+        pr_expr_eval_class_or((char **) &list->argv[2]) == TRUE) {
+      mergein = TRUE;
 
-      } else if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_AND &&
-          pr_expr_eval_class_and((char **) &list->argv[2]) == TRUE) {
-        mergein = TRUE;
-      }
+    } else if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_AND &&
+        pr_expr_eval_class_and((char **) &list->argv[2]) == TRUE) {
+      mergein = TRUE;
+    }
 
-      if (mergein == TRUE) {
-        pr_log_debug(DEBUG2, MOD_IFSESSION_VERSION
-          ": merging <IfClass %s> directives in", (char *) list->argv[0]);
-        ifsess_dup_set(session.pool, main_server->conf, c->subset);
+    if (mergein == TRUE) {
+      pr_log_debug(DEBUG2, MOD_IFSESSION_VERSION
+        ": merging <IfClass %s> directives in", (char *) list->argv[0]);
+      ifsess_dup_set(session.pool, main_server->conf, c->subset);
 
-        /* Add this config_rec pointer to the list of pointers to be
-         * removed later.
-         */
-        *((config_rec **) push_array(class_remove_list)) = c;
+      /* Add this config_rec pointer to the list of pointers to be
+       * removed later.
+       */
+      *((config_rec **) push_array(class_remove_list)) = c;
+      sec->merged = TRUE;
 
-        /* Do NOT call fixup_dirs() here; we need to wait until after
-         * authentication to do so (in which case, mod_auth will handle the
-         * call to fixup_dirs() for us).
-         */
+      /* Do NOT call fixup_dirs() here; we need to wait until after
+       * authentication to do so (in which case, mod_auth will handle the
+       * call to fixup_dirs() for us).
+       */
 
-        ifsess_merged = TRUE;
+      ifsess_set_merged();
 
-      } else {
-        pr_log_debug(DEBUG9, MOD_IFSESSION_VERSION
-          ": <IfClass %s> not matched, skipping", (char *) list->argv[0]);
-      }
+    } else {
+      pr_log_debug(DEBUG9, MOD_IFSESSION_VERSION
+        ": <IfClass %s> not matched, skipping", (char *) list->argv[0]);
     }
-
-    c = find_config_next(c, c->next, -1, IFSESS_CLASS_TEXT, FALSE);
   }
 
   /* Now, remove any <IfClass> config_recs that have been merged in. */
@@ -491,98 +743,106 @@ static int ifsess_sess_merge_class(pool *p) {
 }
 
 static int ifsess_sess_merge_group(pool *p) {
-  register unsigned int i = 0;
+  register unsigned int i = 0, j;
   config_rec *c = NULL;
   pool *tmp_pool;
   array_header *group_remove_list;
+  struct ifsess_sections *secs;
+  unsigned char *candidates;
 
   tmp_pool = make_sub_pool(p);
   pr_pool_tag(tmp_pool, "<IfGroup> merge pool");
 
   group_remove_list = make_array(tmp_pool, 1, sizeof(config_rec *));
 
-  c = find_config(main_server->conf, -1, IFSESS_GROUP_TEXT, FALSE);
-  while (c != NULL) {
+  secs = &(ifsess_get_index(main_server)->group_sections);
+  candidates = ifsess_get_candidates(tmp_pool, secs);
+  ifsess_mark_candidates(secs, candidates, session.group);
+  if (session.groups != NULL) {
+    for (j = 0; j < session.groups->nelts; j++) {
+      ifsess_mark_candidates(secs, candidates,
+        ((char **) session.groups->elts)[j]);
+    }
+  }
+
+  for (j = 0; j < secs->sections->nelts; j++) {
+    struct ifsess_section *sec;
     config_rec *list = NULL;
+    unsigned char mergein = FALSE;
+
+    sec = ((struct ifsess_section *) secs->sections->elts) + j;
+    if (candidates[j] == FALSE ||
+        sec->merged == TRUE) {
+      continue;
+    }
 
     pr_signals_handle();
 
-    list = find_config(c->subset, IFSESS_GROUP_NUMBER, NULL, FALSE);
-    if (list != NULL) {
-      unsigned char mergein = FALSE;
+    c = sec->c;
+    list = sec->list;
 
 #if defined(PR_USE_REGEX)
-      if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_REGEX) {
-        pr_regex_t *pre = list->argv[2];
+    if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_REGEX) {
+      pr_regex_t *pre = list->argv[2];
 
-        if (session.group != NULL) {
-          pr_log_debug(DEBUG8, MOD_IFSESSION_VERSION
-            ": evaluating regexp pattern '%s' against subject '%s'",
-            pr_regexp_get_pattern(pre), session.group);
+      if (session.group != NULL) {
+        pr_log_debug(DEBUG8, MOD_IFSESSION_VERSION
+          ": evaluating regexp pattern '%s' against subject '%s'",
+          pr_regexp_get_pattern(pre), session.group);
 
-          if (pr_regexp_exec(pre, session.group, 0, NULL, 0, 0, 0) == 0) {
-            mergein = TRUE;
-          }
+        if (pr_regexp_exec(pre, session.group, 0, NULL, 0, 0, 0) == 0) {
+          mergein = TRUE;
         }
+      }
 
-        if (mergein == FALSE &&
-            session.groups != NULL) {
-          register int j = 0;
+      if (mergein == FALSE &&
+          session.groups != NULL) {
+        register int k = 0;
 
-          for (j = session.groups->nelts-1; j >= 0; j--) {
-            char *suppl_group;
+        for (k = session.groups->nelts-1; k >= 0; k--) {
+          char *suppl_group;
 
-            suppl_group = *(((char **) session.groups->elts) + j);
+          suppl_group = *(((char **) session.groups->elts) + k);
 
-            pr_log_debug(DEBUG8, MOD_IFSESSION_VERSION
-              ": evaluating regexp pattern '%s' against subject '%s'",
-              pr_regexp_get_pattern(pre), suppl_group);
+          pr_log_debug(DEBUG8, MOD_IFSESSION_VERSION
+            ": evaluating regexp pattern '%s' against subject '%s'",
+            pr_regexp_get_pattern(pre), suppl_group);
 
-            if (pr_regexp_exec(pre, suppl_group, 0, NULL, 0, 0, 0) == 0) {
-              mergein = TRUE;
-              break;
-            }
+          if (pr_regexp_exec(pre, suppl_group, 0, NULL, 0, 0, 0) == 0) {
+            mergein = TRUE;
+            break;
           }
         }
+      }
 
-      } else
+    } else
 #endif /* regex support */
 
-      if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_OR &&
-          pr_expr_eval_group_or((char **) &list->argv[2]) == TRUE) {
-        mergein = TRUE;
-
-      } else if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_AND &&
-          pr_expr_eval_group_and((char **) &list->argv[2]) == TRUE) {
-        mergein = TRUE;
-      }
-
-      if (mergein == TRUE) {
-        pr_log_debug(DEBUG2, MOD_IFSESSION_VERSION
-          ": merging <IfGroup %s> directives in", (char *) list->argv[0]);
-        ifsess_dup_set(session.pool, main_server->conf, c->subset);
+    if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_OR &&
+        pr_expr_eval_group_or((char **) &list->argv[2]) == TRUE) {
+      mergein = TRUE;
 
-        /* Add this config_rec pointer to the list of pointers to be
-         * removed later.
-         */
-        *((config_rec **) push_array(group_remove_list)) = c;
+    } else if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_AND &&
+        pr_expr_eval_group_and((char **) &list->argv[2]) == TRUE) {
+      mergein = TRUE;
+    }
 
-        ifsess_resolve_server_dirs(main_server);
-        resolve_deferred_dirs(main_server);
+    if (mergein == TRUE) {
+      pr_log_debug(DEBUG2, MOD_IFSESSION_VERSION
+        ": merging <IfGroup %s> directives in", (char *) list->argv[0]);
+      ifsess_dup_set(session.pool, main_server->conf, c->subset);
 
-        /* We need to call fixup_dirs() twice: once for any added <Directory>
-         * sections that use absolute paths, and again for any added <Directory>
-         * sections that use deferred-resolution paths (e.g. "~").
-         */
-        fixup_dirs(main_server, CF_SILENT);
-        fixup_dirs(main_server, CF_DEFER|CF_SILENT);
+      /* Add this config_rec pointer to the list of pointers to be
+       * removed later.
+       */
+      *((config_rec **) push_array(group_remove_list)) = c;
+      sec->merged = TRUE;
 
-        ifsess_merged = TRUE;
+      ifsess_set_merged();
 
-      } else {
-        pr_log_debug(DEBUG9, MOD_IFSESSION_VERSION
-          ": <IfGroup %s> not matched, skipping", (char *) list->argv[0]);
-      }
+    } else {
+      pr_log_debug(DEBUG9, MOD_IFSESSION_VERSION
+        ": <IfGroup %s> not matched, skipping", (char *) list->argv[0]);
     }
 
     /* Note: it would be more efficient, memory-wise, to destroy the
@@ -593,8 +853,6 @@ static int ifsess_sess_merge_group(pool *p) {
      * keep the removed config_rec's memory around, rather than calling
      * destroy_pool(c->pool) if removed_c is TRUE.
      */
-
-    c = find_config_next(c, c->next, -1, IFSESS_GROUP_TEXT, FALSE);
   }
 
   /* Now, remove any <IfGroup> config_recs that have been merged in. */
@@ -603,84 +861,99 @@ static int ifsess_sess_merge_group(pool *p) {
     xaset_remove(main_server->conf, (xasetmember_t *) c);
   }
 
+  if (group_remove_list->nelts > 0) {
+    /* Resolve the <Directory> sections once all of the matching sections
+     * have been merged in, rather than once per merged section.
+     */
+    ifsess_resolve_server_dirs(main_server);
+    resolve_deferred_dirs(main_server);
+
+    /* We need to call fixup_dirs() twice: once for any added <Directory>
+     * sections that use absolute paths, and again for any added <Directory>
+     * sections that use deferred-resolution paths (e.g. "~").
+     */
+    fixup_dirs(main_server, CF_SILENT);
+    fixup_dirs(main_server, CF_DEFER|CF_SILENT);
+  }
+
   destroy_pool(tmp_pool);
   return 0;
 }
 
 static int ifsess_sess_merge_user(pool *p) {
-  register unsigned int i = 0;
+  register unsigned int i = 0, j;
   config_rec *c = NULL;
   pool *tmp_pool;
   array_header *user_remove_list;
+  struct ifsess_sections *secs;
+  unsigned char *candidates;
 
   tmp_pool = make_sub_pool(p);
   pr_pool_tag(tmp_pool, "<IfUser> merge pool");
 
   user_remove_list = make_array(tmp_pool, 1, sizeof(config_rec *));
 
-  c = find_config(main_server->conf, -1, IFSESS_USER_TEXT, FALSE);
-  while (c != NULL) {
+  secs = &(ifsess_get_index(main_server)->user_sections);
+  candidates = ifsess_get_candidates(tmp_pool, secs);
+  ifsess_mark_candidates(secs, candidates, session.user);
+
+  for (j = 0; j < secs->sections->nelts; j++) {
+    struct ifsess_section *sec;
     config_rec *list = NULL;
+    unsigned char mergein = FALSE;
+
+    sec = ((struct ifsess_section *) secs->sections->elts) + j;
+    if (candidates[j] == FALSE ||
+        sec->merged == TRUE) {
+      continue;
+    }
 
     pr_signals_handle();
 
-    list = find_config(c->subset, IFSESS_USER_NUMBER, NULL, FALSE);
-    if (list != NULL) {
-      unsigned char mergein = FALSE;
+    c = sec->c;
+    list = sec->list;
 
 #if defined(PR_USE_REGEX)
-      if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_REGEX) {
-        pr_regex_t *pre = list->argv[2];
-
-        pr_log_debug(DEBUG8, MOD_IFSESSION_VERSION
-          ": evaluating regexp pattern '%s' against subject '%s'",
-          pr_regexp_get_pattern(pre), session.user);
-
-        if (pr_regexp_exec(pre, session.user, 0, NULL, 0, 0, 0) == 0) {
-          mergein = TRUE;
-        }
-
-      } else
-#endif /* regex support */
+    if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_REGEX) {
+      pr_regex_t *pre = list->argv[2];
 
-      if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_OR &&
-          pr_expr_eval_user_or((char **) &list->argv[2]) == TRUE) {
-        mergein = TRUE;
+      pr_log_debug(DEBUG8, MOD_IFSESSION_VERSION
+        ": evaluating regexp pattern '%s' against subject '%s'",
+        pr_regexp_get_pattern(pre), session.user);
 
-      } else if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_AND &&
-          pr_expr_eval_user_and((char **) &list->argv[2]) == TRUE) {
+      if (pr_regexp_exec(pre, session.user, 0, NULL, 0, 0, 0) == 0) {
         mergein = TRUE;
       }
 
-      if (mergein == TRUE) {
-        pr_log_debug(DEBUG2, MOD_IFSESSION_VERSION
-          ": merging <IfUser %s> directives in", (char *) list->argv[0]);
-        ifsess_dup_set(session.pool, main_server->conf, c->subset);
+    } else
+#endif /* regex support */
+
+    if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_OR &&
+        pr_expr_eval_user_or((char **) &list->argv[2]) == TRUE) {
+      mergein = TRUE;
 
-        /* Add this config_rec pointer to the list of pointers to be
-         * removed later.
-         */
-        *((config_rec **) push_array(user_remove_list)) = c;
+    } else if (*((unsigned char *) list->argv[1]) == PR_EXPR_EVAL_AND &&
+        pr_expr_eval_user_and((char **) &list->argv[2]) == TRUE) {
+      mergein = TRUE;
+    }
 
-        ifsess_resolve_server_dirs(main_server);
-        resolve_deferred_dirs(main_server);
+    if (mergein == TRUE) {
+      pr_log_debug(DEBUG2, MOD_IFSESSION_VERSION
+        ": merging <IfUser %s> directives in", (char *) list->argv[0]);
+      ifsess_dup_set(session.pool, main_server->conf, c->subset);
 
-        /* We need to call fixup_dirs() twice: once for any added <Directory>
-         * sections that use absolute paths, and again for any added <Directory>
-         * sections that use deferred-resolution paths (e.g. "~").
-         */
-        fixup_dirs(main_server, CF_SILENT);
-        fixup_dirs(main_server, CF_DEFER|CF_SILENT);
+      /* Add this config_rec pointer to the list of pointers to be
+       * removed later.
+       */
+      *((config_rec **) push_array(user_remove_list)) = c;
+      sec->merged = TRUE;
 
-        ifsess_merged = TRUE;
+      ifsess_set_merged();
 
-      } else {
-        pr_log_debug(DEBUG9, MOD_IFSESSION_VERSION
-          ": <IfUser %s> not matched, skipping", (char *) list->argv[0]);
-      }
+    } else {
+      pr_log_debug(DEBUG9, MOD_IFSESSION_VERSION
+        ": <IfUser %s> not matched, skipping", (char *) list->argv[0]);
     }
-
-    c = find_config_next(c, c->next, -1, IFSESS_USER_TEXT, FALSE);
   }
 
   /* Now, remove any <IfUser> config_recs that have been merged in. */
@@ -689,6 +962,21 @@ static int ifsess_sess_merge_user(pool *p) {
     xaset_remove(main_server->conf, (xasetmember_t *) c);
   }
 
+  if (user_remove_list->nelts > 0) {
+    /* Resolve the <Directory> sections once all of the matching sections
+     * have been merged in, rather than once per merged section.
+     */
+    ifsess_resolve_server_dirs(main_server);
+    resolve_deferred_dirs(main_server);
+
+    /* We need to call fixup_dirs() twice: once for any added <Directory>
+     * sections that use absolute paths, and again for any added <Directory>
+     * sections that use deferred-resolution paths (e.g. "~").
+     */
+    fixup_dirs(main_server, CF_SILENT);
+    fixup_dirs(main_server, CF_DEFER|CF_SILENT);
+  }
+
   destroy_pool(tmp_pool);
   return 0;
 }
@@ -1205,7 +1493,19 @@ static void ifsess_postparse_ev(const void *event_data, void *user_data) {
   /* Make sure that all mod_ifsession sections have been properly closed. */
 
   if (ifsess_ctx == -1) {
-    /* All sections properly closed; nothing to do. */
+    server_rec *s;
+
+    /* All sections properly closed; index them, for use by sessions. */
+    if (ifsess_index_pool != NULL) {
+      destroy_pool(ifsess_index_pool);
+      ifsess_index_pool = NULL;
+      ifsess_indices = NULL;
+    }
+
+    for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+      (void) ifsess_index_server(s);
+    }
+
     return;
   }
 
@@ -57,64 +57,79 @@ struct blacklist_header {
 
 static const char *blacklist_path = PR_CONFIG_DIR "/blacklist.dat";
 
+/* Blacklist files are read into memory once, in the daemon process, so that
+ * session processes can check keys without any further I/O (and regardless
+ * of any chroot).  They are read, rather than mapped, so that sessions are
+ * not affected by the file being rewritten or truncated in place.
+ */
+struct blacklist_data {
+  struct blacklist_data *next;
+  const char *path;
+
+  const uint8_t *data;
+  size_t datalen;
+
+  unsigned int bytes;
+  unsigned int records;
+  unsigned int shift;
+};
+
+static pool *blacklist_pool = NULL;
+static struct blacklist_data *blacklist_list = NULL;
+
 static const char *trace_channel = "ssh2";
 
 static unsigned c2u(uint8_t c) {
   return (c >= 'a') ? (c - 'a' + 10) : (c - '0');
 }
 
-static int validate_blacklist(int fd, unsigned int *bytes,
-    unsigned int *records, unsigned int *shift) {
-
+static int validate_blacklist(struct blacklist_data *bl) {
   size_t expected;
-  struct stat st;
   struct blacklist_header hdr;
 
-  if (fstat(fd, &st)) {
-    pr_trace_msg(trace_channel, 3, "error checking SFTPKeyBlacklist '%s': %s",
-      blacklist_path, strerror(errno));
-    return -1;
-  }
-
-  if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+  if (bl->datalen < sizeof(hdr)) {
     pr_trace_msg(trace_channel, 3,
-      "error reading header of SFTPKeyBlacklist '%s': %s", blacklist_path,
-      strerror(errno));
+      "error reading header of SFTPKeyBlacklist '%s': file too short",
+      bl->path);
     return -1;
   }
 
+  memcpy(&hdr, bl->data, sizeof(hdr));
+
   /* Check the header format and version */
   if (memcmp(hdr.version, "SSH-FP", 6) != 0) {
     pr_trace_msg(trace_channel, 2,
-      "SFTPKeyBlacklist '%s' has unknown format", blacklist_path);
+      "SFTPKeyBlacklist '%s' has unknown format", bl->path);
     return -1;
   }
 
   if (hdr.index_size != 16 ||
       hdr.offset_size != 16 ||
-      memcmp(hdr.version, "SSH-FP00", 8) != 0) {
+      memcmp(hdr.version, "SSH-FP00", 8) != 0 ||
+      hdr.record_bits < 24) {
     pr_trace_msg(trace_channel, 2,
-      "SFTPKeyBlacklist '%s' has unsupported format", blacklist_path);
+      "SFTPKeyBlacklist '%s' has unsupported format", bl->path);
     return -1;
   }
 
-  *bytes = (hdr.record_bits >> 3) - 2;
+  bl->bytes = (hdr.record_bits >> 3) - 2;
 
-  *records = (((hdr.records[0] << 8) + hdr.records[1]) << 8) + hdr.records[2];
-  if (*records > SFTP_BLACKLIST_MAX_RECORDS) {
+  bl->records = (((hdr.records[0] << 8) + hdr.records[1]) << 8) +
+    hdr.records[2];
+  if (bl->records > SFTP_BLACKLIST_MAX_RECORDS) {
     pr_trace_msg(trace_channel, 2,
       "SFTPKeyBlacklist '%s' contains %u records > max %u records",
-      blacklist_path, *records, (unsigned int) SFTP_BLACKLIST_MAX_RECORDS);
-    *records = SFTP_BLACKLIST_MAX_RECORDS;
+      bl->path, bl->records, (unsigned int) SFTP_BLACKLIST_MAX_RECORDS);
+    bl->records = SFTP_BLACKLIST_MAX_RECORDS;
   }
 
-  *shift = (hdr.shift[0] << 8) + hdr.shift[1];
+  bl->shift = (hdr.shift[0] << 8) + hdr.shift[1];
 
-  expected = sizeof(hdr) + 0x20000 + ((size_t) (*records) * (*bytes));
-  if (st.st_size != (off_t) expected) {
+  expected = sizeof(hdr) + 0x20000 + ((size_t) bl->records * bl->bytes);
+  if (bl->datalen != expected) {
     pr_trace_msg(trace_channel, 4,
       "unexpected SFTPKeyBlacklist '%s' file size: expected %lu, found %lu",
-      blacklist_path, (unsigned long) expected, (unsigned long) st.st_size);
+      bl->path, (unsigned long) expected, (unsigned long) bl->datalen);
     return -1;
   }
 
@@ -129,90 +144,60 @@ static int expected_offset(uint16_t idx, uint16_t shift,
 /* Returns -1 if there was an error, 1 if the fingerprint was found, and
  * 0 otherwise.
  */
-static int check_fp(int fd, const char *fp_str) {
+static int check_fp(struct blacklist_data *bl, const uint8_t *fp,
+    size_t fplen, const char *fp_str) {
   register unsigned int i;
-  unsigned int bytes, num, records, shift;
-  off_t offset;
-  int off_start, off_end, res;
+  unsigned int num;
+  const uint8_t *index, *rec;
+  int off_start, off_end;
   uint16_t idx;
 
-  /* Max number of bytes stored in record_bits, minus two bytes used for
-   * index.
+  /* The first two bytes of the fingerprint select the index entry; the
+   * records hold the remaining bytes.
    */
-  uint8_t buf[(0xff >> 3) - 2];
-
-  res = validate_blacklist(fd, &bytes, &records, &shift);
-  if (res < 0)
-    return res;
-
-  idx = (((((c2u(fp_str[0]) << 4) | c2u(fp_str[1])) << 4) |
-    c2u(fp_str[2])) << 4) | c2u(fp_str[3]);
-
-  offset = sizeof(struct blacklist_header) + (idx * 2);
-  if (lseek(fd, offset, SEEK_SET) == (off_t) -1) {
-    pr_trace_msg(trace_channel, 3, "error seeking to offset %" PR_LU
-      " in SFTPKeyBlacklist '%s': %s", (pr_off_t) offset, blacklist_path,
-      strerror(errno));
+  if (bl->bytes > fplen - 2) {
+    pr_trace_msg(trace_channel, 4,
+      "SFTPKeyBlacklist '%s' record size (%u bytes) exceeds fingerprint size",
+      bl->path, bl->bytes);
     return -1;
   }
 
-  if (read(fd, buf, 4) != 4) {
-    pr_trace_msg(trace_channel, 3, "error reading SFTPKeyBlacklist '%s': %s",
-      blacklist_path, strerror(errno));
-    return -1;
-  }
+  idx = (fp[0] << 8) | fp[1];
+  index = bl->data + sizeof(struct blacklist_header) + (idx * 2);
 
-  off_start = (buf[0] << 8) + buf[1] + expected_offset(idx, shift, records);
+  off_start = (index[0] << 8) + index[1] +
+    expected_offset(idx, bl->shift, bl->records);
 
   if (off_start < 0 ||
-      (unsigned int) off_start > records) {
+      (unsigned int) off_start > bl->records) {
     pr_trace_msg(trace_channel, 4,
       "SFTPKeyBlacklist '%s' has offset start overflow [%d] for index %#x",
-      blacklist_path, off_start, idx);
+      bl->path, off_start, idx);
     return -1;
   }
 
   if (idx < 0xffff) {
-    off_end = (buf[2] << 8) + buf[3] +
-      expected_offset(idx + 1, shift, records);
+    off_end = (index[2] << 8) + index[3] +
+      expected_offset(idx + 1, bl->shift, bl->records);
 
     if (off_end < off_start ||
-        (unsigned int) off_end > records) {
+        (unsigned int) off_end > bl->records) {
       pr_trace_msg(trace_channel, 4,
         "SFTPKeyBlacklist '%s' has offset end overflow [%d] for index %#x",
-        blacklist_path, off_start, idx);
+        bl->path, off_start, idx);
       return -1;
     }
 
   } else {
-    off_end = records;
-  }
-
-  offset = sizeof(struct blacklist_header) + 0x20000 + (off_start * bytes);
-  if (lseek(fd, offset, SEEK_SET) == (off_t) -1) {
-    pr_trace_msg(trace_channel, 3, "error seeking to offset %" PR_LU
-      " in SFTPKeyBlacklist '%s': %s", (pr_off_t) offset, blacklist_path,
-      strerror(errno));
-    return -1;
+    off_end = bl->records;
   }
 
+  rec = bl->data + sizeof(struct blacklist_header) + 0x20000 +
+    ((size_t) off_start * bl->bytes);
   num = off_end - off_start;
 
-  for (i = 0; i < num; ++i) {
-    register unsigned int j;
-
-    if (read(fd, buf, bytes) != bytes) {
-      pr_trace_msg(trace_channel, 2, "error reading SFTPKeyBlacklist '%s': %s",
-        blacklist_path, strerror(errno));
-      return -1;
-    }
-
-    for (j = 0; j < bytes; ++j) {
-      if (((c2u(fp_str[4 + j * 2]) << 4) | c2u(fp_str[5 + j * 2])) != buf[j])
-        break;
-    }
-
-    if (j >= bytes) {
+  for (i = 0; i < num; ++i, rec += bl->bytes) {
+    if (memcmp(fp + 2, rec, bl->bytes) == 0) {
       pr_trace_msg(trace_channel, 6,
         "fingerprint '%s' blacklisted (offset %u, number %u)", fp_str,
         off_start, i);
@@ -228,12 +213,28 @@ static int check_fp(int fd, const char *fp_str) {
   return 0;
 }
 
+static struct blacklist_data *get_blacklist(const char *path) {
+  struct blacklist_data *bl;
+
+  for (bl = blacklist_list; bl; bl = bl->next) {
+    if (strcmp(bl->path, path) == 0) {
+      return bl;
+    }
+  }
+
+  errno = ENOENT;
+  return NULL;
+}
+
 int sftp_blacklist_reject_key(pool *p, unsigned char *key_data,
     uint32_t key_datalen) {
-  int fd, res;
+  register unsigned int i;
+  int res;
   const char *fp;
   char *digest_name = "none", *hex, *ptr;
-  size_t hex_len, hex_maxlen;
+  size_t fplen, hex_len, hex_maxlen;
+  uint8_t fp_data[20];
+  struct blacklist_data *bl;
 
   if (key_data == NULL ||
       key_datalen == 0) {
@@ -299,20 +300,27 @@ int sftp_blacklist_reject_key(pool *p, unsigned char *key_data,
     return FALSE;
   }
 
-  /* XXX Will this fd need to be cached, for handling keys after the
-   * process has chrooted?
-   */
-  fd = open(blacklist_path, O_RDONLY);
-  if (fd < 0) {
-    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-      "unable to open SFTPKeyBlacklist '%s': %s", blacklist_path,
-      strerror(errno));
-    return FALSE;
+  bl = get_blacklist(blacklist_path);
+  if (bl == NULL) {
+    /* Not loaded by the daemon process (e.g. the file was added later);
+     * load it now, for the rest of this session.
+     */
+    if (sftp_blacklist_load(blacklist_path) < 0) {
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+        "unable to load SFTPKeyBlacklist '%s': %s", blacklist_path,
+        strerror(errno));
+      return FALSE;
+    }
+
+    bl = get_blacklist(blacklist_path);
   }
 
-  res = check_fp(fd, hex);
-  close(fd);
+  fplen = hex_len / 2;
+  for (i = 0; i < fplen; i++) {
+    fp_data[i] = (c2u(hex[i * 2]) << 4) | c2u(hex[(i * 2) + 1]);
+  }
 
+  res = check_fp(bl, fp_data, fplen, hex);
   if (res == 1) {
     return TRUE;
   }
@@ -320,6 +328,102 @@ int sftp_blacklist_reject_key(pool *p, unsigned char *key_data,
   return FALSE;
 }
 
+int sftp_blacklist_load(const char *path) {
+  int fd, res, xerrno;
+  struct stat st;
+  struct blacklist_data *bl;
+  pool *tmp_pool;
+  uint8_t *data;
+  size_t len = 0;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (get_blacklist(path) != NULL) {
+    return 0;
+  }
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    xerrno = errno;
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (blacklist_pool == NULL) {
+    blacklist_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(blacklist_pool, "SFTP KeyBlacklist Pool");
+  }
+
+  tmp_pool = make_sub_pool(blacklist_pool);
+  bl = pcalloc(tmp_pool, sizeof(struct blacklist_data));
+  bl->path = pstrdup(tmp_pool, path);
+  bl->datalen = (size_t) st.st_size;
+
+  data = palloc(tmp_pool, bl->datalen + 1);
+  while (len < bl->datalen) {
+    ssize_t nread;
+
+    nread = read(fd, data + len, bl->datalen - len);
+    if (nread < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      xerrno = errno;
+      (void) close(fd);
+      destroy_pool(tmp_pool);
+      errno = xerrno;
+      return -1;
+    }
+
+    if (nread == 0) {
+      break;
+    }
+
+    len += nread;
+  }
+
+  bl->data = data;
+  bl->datalen = len;
+
+  (void) close(fd);
+
+  res = validate_blacklist(bl);
+  if (res < 0) {
+    destroy_pool(tmp_pool);
+    errno = EINVAL;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "loaded SFTPKeyBlacklist '%s' (%u records, %u bytes per record)", path,
+    bl->records, bl->bytes);
+
+  bl->next = blacklist_list;
+  blacklist_list = bl;
+  return 0;
+}
+
+int sftp_blacklist_free(void) {
+  blacklist_list = NULL;
+
+  if (blacklist_pool != NULL) {
+    destroy_pool(blacklist_pool);
+    blacklist_pool = NULL;
+  }
+
+  return 0;
+}
+
 int sftp_blacklist_set_file(const char *path) {
   if (path == NULL) {
     blacklist_path = NULL;
@@ -33,4 +33,8 @@
 int sftp_blacklist_reject_key(pool *, unsigned char *, uint32_t);
 int sftp_blacklist_set_file(const char *);
 
+/* Load the given blacklist file into memory, for sharing with sessions. */
+int sftp_blacklist_load(const char *);
+int sftp_blacklist_free(void);
+
 #endif /* MOD_SFTP_BLACKLIST_H */
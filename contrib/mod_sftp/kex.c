@@ -314,6 +314,34 @@ static enum sftp_key_type_e kex_used_hostkey_type = SFTP_KEY_UNKNOWN;
  */
 static FILE *kex_dhparams_fp = NULL;
 
+/* The DH groups from SFTPDHParamFiles, read and checked once by the daemon
+ * process (and inherited by session processes), ordered by size.
+ */
+struct kex_dhparam {
+  DH *dh;
+  uint32_t nbits;
+};
+
+struct kex_dhparams {
+  struct kex_dhparams *next;
+  const char *path;
+  array_header *groups;
+};
+
+static pool *kex_dhparams_pool = NULL;
+static struct kex_dhparams *kex_dhparams_list = NULL;
+
+/* The transient RSA keys for the rsa1024-sha1/rsa2048-sha256 exchanges.
+ * RFC 4432 allows a transient key to be used for multiple connections, so
+ * these are generated by the daemon process (inherited by session processes),
+ * and regenerated periodically, rather than in each session.
+ */
+static RSA *kex_transient_rsa1024 = NULL;
+static RSA *kex_transient_rsa2048 = NULL;
+static int kex_transient_rsa_timerno = -1;
+
+#define SFTP_KEXRSA_TRANSIENT_INTERVAL	3600
+
 /* Necessary prototypes. */
 static struct ssh2_packet *read_kex_packet(pool *p, struct sftp_kex *kex,
   int disconnect_code, char *found_msg_type, unsigned int ntypes, ...);
@@ -1338,26 +1366,9 @@ static int finish_dh(struct sftp_kex *kex) {
   return -1;
 }
 
-static int create_kexrsa(struct sftp_kex *kex, int type) {
+static RSA *generate_kexrsa(int type) {
   RSA *rsa = NULL;
 
-  if (type != SFTP_KEXRSA_SHA1 &&
-      type != SFTP_KEXRSA_SHA256) {
-    errno = EINVAL;
-    return -1;
-  }
-
-  if (kex->rsa != NULL) {
-    RSA_free(kex->rsa);
-    kex->rsa = NULL;
-  }
-
-  if (kex->rsa_encrypted != NULL) {
-    pr_memscrub(kex->rsa_encrypted, kex->rsa_encrypted_len);
-    kex->rsa_encrypted = NULL;
-    kex->rsa_encrypted_len = 0;
-  }
-
   if (type == SFTP_KEXRSA_SHA1) {
     BIGNUM *e = NULL;
 
@@ -1366,14 +1377,14 @@ static int create_kexrsa(struct sftp_kex *kex, int type) {
     if (e == NULL) {
       (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
         "error allocated BIGNUM: %s", sftp_crypto_get_errors());
-      return -1;
+      return NULL;
     }
 
     if (BN_set_word(e, 17) != 1) {
       (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
         "error setting BIGNUM word: %s", sftp_crypto_get_errors());
       BN_free(e);
-      return -1;
+      return NULL;
     }
 
     rsa = RSA_new();
@@ -1390,10 +1401,16 @@ static int create_kexrsa(struct sftp_kex *kex, int type) {
         BN_free(e);
       }
 
-      return -1;
+      if (rsa != NULL) {
+        RSA_free(rsa);
+      }
+
+      return NULL;
     }
 
-    kex->hash = EVP_sha1();
+    if (e != NULL) {
+      BN_free(e);
+    }
 
 #if ((OPENSSL_VERSION_NUMBER > 0x000907000L && defined(OPENSSL_FIPS)) || \
      (OPENSSL_VERSION_NUMBER > 0x000908000L)) && \
@@ -1406,14 +1423,14 @@ static int create_kexrsa(struct sftp_kex *kex, int type) {
     if (e == NULL) {
       (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
         "error allocated BIGNUM: %s", sftp_crypto_get_errors());
-      return -1;
+      return NULL;
     }
 
     if (BN_set_word(e, 65537) != 1) {
       (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
         "error setting BIGNUM word: %s", sftp_crypto_get_errors());
       BN_free(e);
-      return -1;
+      return NULL;
     }
 
     rsa = RSA_new();
@@ -1430,9 +1447,105 @@ static int create_kexrsa(struct sftp_kex *kex, int type) {
         BN_free(e);
       }
 
+      if (rsa != NULL) {
+        RSA_free(rsa);
+      }
+
+      return NULL;
+    }
+
+    if (e != NULL) {
+      BN_free(e);
+    }
+#endif
+  }
+
+  if (rsa == NULL) {
+    errno = EINVAL;
+  }
+
+  return rsa;
+}
+
+/* Returns a reference to the transient RSA key for the given exchange, if
+ * one has been generated by the daemon process.
+ */
+static RSA *get_transient_kexrsa(int type) {
+  RSA *rsa;
+
+  rsa = (type == SFTP_KEXRSA_SHA1 ? kex_transient_rsa1024 :
+    kex_transient_rsa2048);
+  if (rsa == NULL) {
+    return NULL;
+  }
+
+  RSA_up_ref(rsa);
+  return rsa;
+}
+
+static int transient_kexrsa_timer_cb(CALLBACK_FRAME) {
+  RSA *rsa;
+
+  if (kex_transient_rsa1024 != NULL) {
+    rsa = generate_kexrsa(SFTP_KEXRSA_SHA1);
+    if (rsa != NULL) {
+      RSA_free(kex_transient_rsa1024);
+      kex_transient_rsa1024 = rsa;
+    }
+  }
+
+  if (kex_transient_rsa2048 != NULL) {
+    rsa = generate_kexrsa(SFTP_KEXRSA_SHA256);
+    if (rsa != NULL) {
+      RSA_free(kex_transient_rsa2048);
+      kex_transient_rsa2048 = rsa;
+    }
+  }
+
+  pr_trace_msg(trace_channel, 9, "regenerated transient RSA keys");
+
+  /* Restart the timer. */
+  return 1;
+}
+
+static int create_kexrsa(struct sftp_kex *kex, int type) {
+  RSA *rsa = NULL;
+
+  if (type != SFTP_KEXRSA_SHA1 &&
+      type != SFTP_KEXRSA_SHA256) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (kex->rsa != NULL) {
+    RSA_free(kex->rsa);
+    kex->rsa = NULL;
+  }
+
+  if (kex->rsa_encrypted != NULL) {
+    pr_memscrub(kex->rsa_encrypted, kex->rsa_encrypted_len);
+    kex->rsa_encrypted = NULL;
+    kex->rsa_encrypted_len = 0;
+  }
+
+  rsa = get_transient_kexrsa(type);
+  if (rsa != NULL) {
+    pr_trace_msg(trace_channel, 12, "using transient RSA key for exchange");
+
+  } else {
+    rsa = generate_kexrsa(type);
+    if (rsa == NULL) {
       return -1;
     }
+  }
 
+  if (type == SFTP_KEXRSA_SHA1) {
+    kex->hash = EVP_sha1();
+
+#if ((OPENSSL_VERSION_NUMBER > 0x000907000L && defined(OPENSSL_FIPS)) || \
+     (OPENSSL_VERSION_NUMBER > 0x000908000L)) && \
+     defined(HAVE_SHA256_OPENSSL)
+  } else {
     kex->hash = EVP_sha256();
 #endif
   }
@@ -1674,6 +1787,90 @@ static const char *get_kexinit_exchange_list(pool *p) {
   return res;
 }
 
+static int use_kex_algo(server_rec *s, const char *algo) {
+  config_rec *c;
+
+  c = find_config(s->conf, CONF_PARAM, "SFTPKeyExchanges", FALSE);
+  if (c != NULL) {
+    char *algos, *ptr;
+
+    algos = pstrdup(s->pool, c->argv[0]);
+    while ((ptr = pr_str_get_token(&algos, ",")) != NULL) {
+      if (strcmp(ptr, algo) == 0) {
+        return TRUE;
+      }
+    }
+
+  } else {
+    register unsigned int i;
+
+    for (i = 0; kex_exchanges[i]; i++) {
+      if (strcmp(kex_exchanges[i], algo) == 0) {
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+int sftp_kex_prepare_kexrsa(server_rec *s) {
+  if (s == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (kex_transient_rsa1024 == NULL &&
+      use_kex_algo(s, "rsa1024-sha1") == TRUE) {
+    kex_transient_rsa1024 = generate_kexrsa(SFTP_KEXRSA_SHA1);
+    if (kex_transient_rsa1024 == NULL) {
+      return -1;
+    }
+
+    pr_trace_msg(trace_channel, 9, "generated transient %u-bit RSA key",
+      SFTP_KEXRSA_SHA1_SIZE);
+  }
+
+  if (kex_transient_rsa2048 == NULL &&
+      use_kex_algo(s, "rsa2048-sha256") == TRUE) {
+    kex_transient_rsa2048 = generate_kexrsa(SFTP_KEXRSA_SHA256);
+    if (kex_transient_rsa2048 == NULL) {
+      return -1;
+    }
+
+    pr_trace_msg(trace_channel, 9, "generated transient %u-bit RSA key",
+      SFTP_KEXRSA_SHA256_SIZE);
+  }
+
+  if (kex_transient_rsa_timerno == -1 &&
+      (kex_transient_rsa1024 != NULL || kex_transient_rsa2048 != NULL)) {
+    kex_transient_rsa_timerno = pr_timer_add(SFTP_KEXRSA_TRANSIENT_INTERVAL,
+      -1, &sftp_module, transient_kexrsa_timer_cb,
+      "SFTP transient RSA key regeneration");
+  }
+
+  return 0;
+}
+
+int sftp_kex_free_kexrsa(void) {
+  if (kex_transient_rsa_timerno > 0) {
+    (void) pr_timer_remove(kex_transient_rsa_timerno, &sftp_module);
+  }
+  kex_transient_rsa_timerno = -1;
+
+  if (kex_transient_rsa1024 != NULL) {
+    RSA_free(kex_transient_rsa1024);
+    kex_transient_rsa1024 = NULL;
+  }
+
+  if (kex_transient_rsa2048 != NULL) {
+    RSA_free(kex_transient_rsa2048);
+    kex_transient_rsa2048 = NULL;
+  }
+
+  return 0;
+}
+
 static const char *get_kexinit_hostkey_algo_list(pool *p) {
   register unsigned int i;
   config_rec *c;
@@ -3326,6 +3523,167 @@ static int read_dh_gex(struct ssh2_packet *pkt, uint32_t *min, uint32_t *pref,
   return 0;
 }
 
+static int dhparam_cmp(const void *a, const void *b) {
+  const struct kex_dhparam *dhp1, *dhp2;
+
+  dhp1 = a;
+  dhp2 = b;
+
+  if (dhp1->nbits < dhp2->nbits) {
+    return -1;
+  }
+
+  if (dhp1->nbits > dhp2->nbits) {
+    return 1;
+  }
+
+  return 0;
+}
+
+static void free_dhparams(array_header *groups) {
+  register unsigned int i;
+  struct kex_dhparam *dhps;
+
+  dhps = groups->elts;
+  for (i = 0; i < groups->nelts; i++) {
+    DH_free(dhps[i].dh);
+  }
+
+  clear_array(groups);
+}
+
+/* Reads all of the DH groups from the given file, skipping any which are
+ * malformed, and returns them ordered by size.
+ */
+static array_header *read_dhparams(pool *p, FILE *fp, const char *path) {
+  array_header *groups;
+
+  groups = make_array(p, 8, sizeof(struct kex_dhparam));
+
+  while (TRUE) {
+    DH *dh;
+    const BIGNUM *dh_p = NULL, *dh_g = NULL;
+    struct kex_dhparam *dhp;
+
+    pr_signals_handle();
+
+    dh = PEM_read_DHparams(fp, NULL, NULL, NULL);
+    if (dh == NULL) {
+      if (!feof(fp)) {
+        pr_trace_msg(trace_channel, 5, "error reading DH params from "
+          "SFTPDHParamFile '%s': %s", path, sftp_crypto_get_errors());
+      }
+
+      break;
+    }
+
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(HAVE_LIBRESSL)) || \
+    (defined(HAVE_LIBRESSL) && LIBRESSL_VERSION_NUMBER >= 0x3050000L)
+    DH_get0_pqg(dh, &dh_p, NULL, &dh_g);
+#else
+    dh_p = dh->p;
+    dh_g = dh->g;
+#endif /* prior to OpenSSL-1.1.0/LibreSSL-3.5.0 */
+
+    /* Reject groups with an even modulus, or a trivial generator. */
+    if (dh_p == NULL ||
+        dh_g == NULL ||
+        !BN_is_odd(dh_p) ||
+        BN_is_zero(dh_g) ||
+        BN_is_one(dh_g) ||
+        BN_cmp(dh_g, dh_p) >= 0) {
+      pr_trace_msg(trace_channel, 5,
+        "skipping invalid DH params from SFTPDHParamFile '%s'", path);
+      DH_free(dh);
+      continue;
+    }
+
+    dhp = push_array(groups);
+    dhp->dh = dh;
+    dhp->nbits = DH_size(dh) * 8;
+  }
+
+  if (groups->nelts > 1) {
+    qsort(groups->elts, groups->nelts, sizeof(struct kex_dhparam),
+      dhparam_cmp);
+  }
+
+  return groups;
+}
+
+static struct kex_dhparams *get_dhparams(const char *path) {
+  struct kex_dhparams *dhparams;
+
+  for (dhparams = kex_dhparams_list; dhparams; dhparams = dhparams->next) {
+    if (strcmp(dhparams->path, path) == 0) {
+      return dhparams;
+    }
+  }
+
+  errno = ENOENT;
+  return NULL;
+}
+
+int sftp_kex_load_dhparams(const char *path) {
+  FILE *fp;
+  struct kex_dhparams *dhparams;
+  int xerrno;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (get_dhparams(path) != NULL) {
+    return 0;
+  }
+
+  PRIVS_ROOT
+  fp = fopen(path, "r");
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fp == NULL) {
+    errno = xerrno;
+    return -1;
+  }
+
+  if (kex_dhparams_pool == NULL) {
+    kex_dhparams_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(kex_dhparams_pool, "SFTP DHParamFile Pool");
+  }
+
+  dhparams = pcalloc(kex_dhparams_pool, sizeof(struct kex_dhparams));
+  dhparams->path = pstrdup(kex_dhparams_pool, path);
+  dhparams->groups = read_dhparams(kex_dhparams_pool, fp, path);
+  (void) fclose(fp);
+
+  dhparams->next = kex_dhparams_list;
+  kex_dhparams_list = dhparams;
+
+  pr_trace_msg(trace_channel, 9, "loaded %u DH %s from SFTPDHParamFile '%s'",
+    dhparams->groups->nelts, dhparams->groups->nelts != 1 ? "groups" : "group",
+    path);
+  return 0;
+}
+
+int sftp_kex_free_dhparams(void) {
+  struct kex_dhparams *dhparams;
+
+  for (dhparams = kex_dhparams_list; dhparams; dhparams = dhparams->next) {
+    free_dhparams(dhparams->groups);
+  }
+
+  kex_dhparams_list = NULL;
+
+  if (kex_dhparams_pool != NULL) {
+    destroy_pool(kex_dhparams_pool);
+    kex_dhparams_pool = NULL;
+  }
+
+  return 0;
+}
+
 static int get_dh_gex_group(struct sftp_kex *kex, uint32_t min,
     uint32_t pref, uint32_t max) {
   const char *dhparam_path;
@@ -3367,31 +3725,44 @@ static int get_dh_gex_group(struct sftp_kex *kex, uint32_t min,
   }
 
   if (dhparam_path != NULL) {
-    if (kex_dhparams_fp != NULL) {
-      /* Rewind to the start of the file. */
-      fseek(kex_dhparams_fp, 0, SEEK_SET);
+    struct kex_dhparams *dhparams;
+    array_header *groups = NULL;
+    pool *tmp_pool;
 
-    } else {
-      kex_dhparams_fp = fopen(dhparam_path, "r");
-    }
-
-    if (kex_dhparams_fp != NULL) {
-      register unsigned int i;
-      pool *tmp_pool;
-      array_header *smaller_dhs, *pref_dhs, *larger_dhs;
-      DH *chosen_dh, **dhs;
-      uint32_t smaller_dh_nbits = 0, larger_dh_nbits = 0;
+    tmp_pool = make_sub_pool(kex->pool);
+    pr_pool_tag(tmp_pool, "Kex DHparams selection pool");
 
+    dhparams = get_dhparams(dhparam_path);
+    if (dhparams != NULL) {
       pr_trace_msg(trace_channel, 15,
-        "using DH parameters from SFTPDHParamFile '%s' for group exchange",
-        dhparam_path);
+        "using preloaded DH parameters from SFTPDHParamFile '%s' for group "
+        "exchange", dhparam_path);
+      groups = dhparams->groups;
+
+    } else {
+      if (kex_dhparams_fp != NULL) {
+        /* Rewind to the start of the file. */
+        fseek(kex_dhparams_fp, 0, SEEK_SET);
 
-      tmp_pool = make_sub_pool(kex->pool);
-      pr_pool_tag(tmp_pool, "Kex DHparams selection pool");
+      } else {
+        kex_dhparams_fp = fopen(dhparam_path, "r");
+      }
 
-      smaller_dhs = make_array(tmp_pool, 1, sizeof(DH *));
-      pref_dhs = make_array(tmp_pool, 1, sizeof(DH *));
-      larger_dhs = make_array(tmp_pool, 1, sizeof(DH *));
+      if (kex_dhparams_fp != NULL) {
+        pr_trace_msg(trace_channel, 15,
+          "using DH parameters from SFTPDHParamFile '%s' for group exchange",
+          dhparam_path);
+        groups = read_dhparams(tmp_pool, kex_dhparams_fp, dhparam_path);
+      }
+    }
+
+    if (groups != NULL) {
+      register unsigned int i;
+      struct kex_dhparam *dhps;
+      DH *chosen_dh = NULL;
+      int pref_idx = -1, top_idx = -1;
+      unsigned int npref = 0, ntop = 0;
+      uint32_t top_nbits = 0;
 
       /* From Section 3 of RFC4419:
        *
@@ -3401,34 +3772,20 @@ static int get_dh_gex_group(struct sftp_kex *kex, uint32_t min,
        *   the largest group it knows.  In all cases, the size of the returned
        *   group SHOULD be at least 1024 bits."
        *
-       * Make lists of DHs in the param file whose size falls within the
-       * bit lengths requested by the client.  Note that DH_size() returns
-       * the sizes _in bytes_, not bits.  We have three lists: one for DHs
-       * which match the client-requested preferred size, one for DHs which
-       * are smaller than the preferred size, and one for DHs which are larger
-       * than the preferred size.  DHs in these last two lists will be of the
-       * same size.  Once the lists are populated, we will randomly choose one
-       * from the preferred DH list (if available), else one from the larger
-       * DH list (if available), else one from the smaller DH list.
+       * Of the DHs in the param file whose size falls within the bit lengths
+       * requested by the client, find those which match the client-requested
+       * preferred size, and those of the largest size.  Note that DH_size()
+       * returns the sizes _in bytes_, not bits.  We will randomly choose one
+       * from the preferred DHs (if available), else one from the largest DHs,
+       * which are either larger or smaller than the preferred size.  The
+       * groups are ordered by size, so each of these is a contiguous run.
        */
 
-      while (TRUE) {
+      dhps = groups->elts;
+      for (i = 0; i < groups->nelts; i++) {
         uint32_t nbits;
 
-        pr_signals_handle();
-
-        chosen_dh = PEM_read_DHparams(kex_dhparams_fp, NULL, NULL, NULL);
-        if (chosen_dh == NULL) {
-          if (!feof(kex_dhparams_fp)) {
-            pr_trace_msg(trace_channel, 5, "error reading DH params from "
-              "SFTPDHParamFile '%s': %s", dhparam_path,
-              sftp_crypto_get_errors());
-          }
-
-          break;
-        }
-
-        nbits = DH_size(chosen_dh) * 8;
+        nbits = dhps[i].nbits;
 
         if (nbits < min ||
             nbits > max) {
@@ -3436,60 +3793,25 @@ static int get_dh_gex_group(struct sftp_kex *kex, uint32_t min,
             "skipping %lu-bit DH from %s (exceeds min %lu, max %lu bits)",
             (unsigned long) nbits, dhparam_path, (unsigned long) min,
             (unsigned long) max);
-          DH_free(chosen_dh);
           continue;
         }
 
         if (nbits == pref) {
-          *((DH **) push_array(pref_dhs)) = chosen_dh;
-
-        } else if (nbits < pref) {
-          if (nbits > smaller_dh_nbits) {
-            if (smaller_dhs->nelts > 0) {
-              dhs = smaller_dhs->elts;
-              for (i = 0; i < smaller_dhs->nelts; i++) {
-                DH_free(dhs[i]);
-              }
-
-              clear_array(smaller_dhs);
-            }
-
-            smaller_dh_nbits = nbits;
-            *((DH **) push_array(smaller_dhs)) = chosen_dh;
-
-          } else if (nbits == smaller_dh_nbits) {
-            *((DH **) push_array(smaller_dhs)) = chosen_dh;
-
-          } else {
-            DH_free(chosen_dh);
+          if (npref == 0) {
+            pref_idx = i;
           }
 
-        } else {
-          /* By process of elimination, nbits here MUST be > pref. */
-
-          if (nbits > larger_dh_nbits) {
-            if (larger_dhs->nelts > 0) {
-              dhs = larger_dhs->elts;
-              for (i = 0; i < larger_dhs->nelts; i++) {
-                DH_free(dhs[i]);
-              }
-
-              clear_array(larger_dhs);
-            }
-
-            larger_dh_nbits = nbits;
-            *((DH **) push_array(larger_dhs)) = chosen_dh;
-
-          } else if (nbits == larger_dh_nbits) {
-            *((DH **) push_array(larger_dhs)) = chosen_dh;
+          npref++;
+        }
 
-          } else {
-            DH_free(chosen_dh);
-          }
+        if (nbits != top_nbits) {
+          top_nbits = nbits;
+          top_idx = i;
+          ntop = 0;
         }
-      }
 
-      chosen_dh = NULL;
+        ntop++;
+      }
 
       /* The use of rand(3) below is NOT intended to be perfect, or even
        * uniformly distributed.  It simply needs to be good enough to pick
@@ -3500,32 +3822,21 @@ static int get_dh_gex_group(struct sftp_kex *kex, uint32_t min,
        * DH is better; if none found there, then we settle for a smaller DH.
        */
 
-      if (pref_dhs->nelts > 0) {
-        int r = (int) (rand() / (RAND_MAX / pref_dhs->nelts + 1));
+      if (npref > 0) {
+        int r = (int) (rand() / (RAND_MAX / npref + 1));
 
         pr_trace_msg(trace_channel, 17,
           "%s DH selection: preferred DHs (count %u, idx %d)", dhparam_path,
-          pref_dhs->nelts, r);
-        dhs = pref_dhs->elts;
-        chosen_dh = dhs[r];
-
-      } else if (larger_dhs->nelts > 0) {
-        int r = (int) (rand() / (RAND_MAX / larger_dhs->nelts + 1));
-
-        pr_trace_msg(trace_channel, 17,
-          "%s DH selection: larger DHs (count %u, idx %d)", dhparam_path,
-          larger_dhs->nelts, r);
-        dhs = larger_dhs->elts;
-        chosen_dh = dhs[r];
+          npref, r);
+        chosen_dh = dhps[pref_idx + r].dh;
 
-      } else if (smaller_dhs->nelts > 0) {
-        int r = (int) (rand() / (RAND_MAX / smaller_dhs->nelts + 1));
+      } else if (ntop > 0) {
+        int r = (int) (rand() / (RAND_MAX / ntop + 1));
 
         pr_trace_msg(trace_channel, 17,
-          "%s DH selection: smaller DHs (count %u, idx %d)", dhparam_path,
-          smaller_dhs->nelts, r);
-        dhs = smaller_dhs->elts;
-        chosen_dh = dhs[r];
+          "%s DH selection: %s DHs (count %u, idx %d)", dhparam_path,
+          top_nbits > pref ? "larger" : "smaller", ntop, r);
+        chosen_dh = dhps[top_idx + r].dh;
 
       } else {
         (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
@@ -3587,27 +3898,11 @@ static int get_dh_gex_group(struct sftp_kex *kex, uint32_t min,
         }
       }
 
-      /* Don't forget to clean up all of the allocated DHs. */
-      dhs = (DH **) smaller_dhs->elts;
-      for (i = 0; i < smaller_dhs->nelts; i++) {
-        pr_signals_handle();
-        DH_free(dhs[i]);
+      /* Don't forget to clean up any DHs read just for this exchange. */
+      if (dhparams == NULL) {
+        free_dhparams(groups);
       }
 
-      dhs = (DH **) pref_dhs->elts;
-      for (i = 0; i < pref_dhs->nelts; i++) {
-        pr_signals_handle();
-        DH_free(dhs[i]);
-      }
-
-      dhs = (DH **) larger_dhs->elts;
-      for (i = 0; i < larger_dhs->nelts; i++) {
-        pr_signals_handle();
-        DH_free(dhs[i]);
-      }
-
-      destroy_pool(tmp_pool);
-
     } else {
       (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
         "WARNING: unable to read SFTPDHParamFile '%s': %s", dhparam_path,
@@ -3616,6 +3911,8 @@ static int get_dh_gex_group(struct sftp_kex *kex, uint32_t min,
         "WARNING: using fixed modulus for DH group exchange");
       use_fixed_modulus = TRUE;
     }
+
+    destroy_pool(tmp_pool);
   }
 
   if (use_fixed_modulus) {
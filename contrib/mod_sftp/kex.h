@@ -37,6 +37,18 @@ int sftp_kex_rekey_set_timeout(int timeout);
 
 int sftp_kex_send_first_kexinit(void);
 
+/* Read the DH groups in the given SFTPDHParamFile, for use by any later
+ * group exchanges.
+ */
+int sftp_kex_load_dhparams(const char *path);
+int sftp_kex_free_dhparams(void);
+
+/* Generate the transient RSA keys used by the given server's RSA key
+ * exchanges, if any.
+ */
+int sftp_kex_prepare_kexrsa(server_rec *s);
+int sftp_kex_free_kexrsa(void);
+
 /* Return the hostkey type used for KEX, as requested by the client. */
 enum sftp_key_type_e sftp_kex_get_hostkey_type(void);
 
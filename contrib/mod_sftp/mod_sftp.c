@@ -2420,6 +2420,7 @@ static void sftp_postparse_ev(const void *event_data, void *user_data) {
   for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
     int supports_hostbased = FALSE, supports_publickey = FALSE;
     int use_sftp = FALSE, use_tls = FALSE;
+    const char *blacklist_path, *dhparam_path;
 
     c = find_config(s->conf, CONF_PARAM, "SFTPEngine", FALSE);
     if (c != NULL) {
@@ -2431,6 +2432,46 @@ static void sftp_postparse_ev(const void *event_data, void *user_data) {
       continue;
     }
 
+    /* Read the DH groups for group exchanges once here, rather than in every
+     * session process.
+     */
+    dhparam_path = PR_CONFIG_DIR "/dhparams.pem";
+    c = find_config(s->conf, CONF_PARAM, "SFTPDHParamFile", FALSE);
+    if (c != NULL) {
+      dhparam_path = c->argv[0];
+    }
+
+    if (sftp_kex_load_dhparams(dhparam_path) < 0) {
+      pr_trace_msg(trace_channel, 3,
+        "Server '%s': unable to load SFTPDHParamFile '%s': %s", s->ServerName,
+        dhparam_path, strerror(errno));
+    }
+
+    if (sftp_kex_prepare_kexrsa(s) < 0) {
+      pr_log_pri(PR_LOG_NOTICE, MOD_SFTP_VERSION
+        ": Server '%s': unable to generate transient RSA keys: %s",
+        s->ServerName, strerror(errno));
+    }
+
+    /* Likewise, load the key blacklist here, so that sessions can check keys
+     * without reading the file.
+     */
+    blacklist_path = PR_CONFIG_DIR "/blacklist.dat";
+    c = find_config(s->conf, CONF_PARAM, "SFTPKeyBlacklist", FALSE);
+    if (c != NULL) {
+      blacklist_path = c->argv[0];
+      if (strncasecmp(blacklist_path, "none", 5) == 0) {
+        blacklist_path = NULL;
+      }
+    }
+
+    if (blacklist_path != NULL &&
+        sftp_blacklist_load(blacklist_path) < 0) {
+      pr_trace_msg(trace_channel, 3,
+        "Server '%s': unable to load SFTPKeyBlacklist '%s': %s", s->ServerName,
+        blacklist_path, strerror(errno));
+    }
+
     c = find_config(s->conf, CONF_PARAM, "TLSEngine", FALSE);
     if (c != NULL) {
       use_tls = *((unsigned char *) c->argv[0]);
@@ -2530,6 +2571,11 @@ static void sftp_restart_ev(const void *event_data, void *user_data) {
   /* Clear the client banner regexes. */
   sftp_interop_free();
 
+  /* Clear the preloaded DH groups, transient RSA keys, and key blacklists. */
+  sftp_kex_free_dhparams();
+  sftp_kex_free_kexrsa();
+  sftp_blacklist_free();
+
 #if defined(HAVE_OSSL_PROVIDER_LOAD_OPENSSL)
   if (legacy_provider != NULL) {
     OSSL_PROVIDER_unload(legacy_provider);
@@ -2540,6 +2586,9 @@ static void sftp_restart_ev(const void *event_data, void *user_data) {
 
 static void sftp_shutdown_ev(const void *event_data, void *user_data) {
   sftp_interop_free();
+  sftp_kex_free_dhparams();
+  sftp_kex_free_kexrsa();
+  sftp_blacklist_free();
   sftp_keystore_free();
   sftp_keys_free();
   sftp_cipher_free();
@@ -44,8 +44,34 @@ struct filestore_data {
   pr_fh_t *fh;
   const char *path;
   unsigned int lineno;
+  struct stat st;
+};
+
+/* The keys parsed from a file, indexed by their key data, so that verifying
+ * a key is a lookup rather than a parse of the entire file; clients often
+ * try several keys per login.  The file is parsed again if it changes.
+ */
+struct filestore_cache {
+  struct filestore_cache *next;
+  pool *pool;
+
+  const char *path;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+
+  /* Maps key data to an array of the keys with that data. */
+  pr_table_t *keys;
+  unsigned int nkeys;
 };
 
+static pool *filestore_cache_pool = NULL;
+static struct filestore_cache *filestore_caches = NULL;
+
+/* Rough number of bytes per key in a file, for sizing the index. */
+#define FILESTORE_CACHE_KEY_SIZE		512
+
 static const char *trace_channel = "ssh2";
 
 /* This getline() function is quite similar to pr_fsio_getline(), except
@@ -379,11 +405,142 @@ static struct filestore_key *filestore_get_key(sftp_keystore_t *store,
   return key;
 }
 
+static int filestore_cache_key_cmp(const void *key1, size_t keysz1,
+    const void *key2, size_t keysz2) {
+  if (keysz1 != keysz2) {
+    return keysz1 < keysz2 ? -1 : 1;
+  }
+
+  return memcmp(key1, key2, keysz1);
+}
+
+static int filestore_rewind(sftp_keystore_t *store) {
+  struct filestore_data *store_data = store->keystore_data;
+
+  if (pr_fsio_lseek(store_data->fh, 0, SEEK_SET) < 0) {
+    int xerrno = errno;
+
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error seeking to start of '%s': %s", store_data->path, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  store_data->lineno = 0;
+  return 0;
+}
+
+static struct filestore_cache *filestore_get_cache(sftp_keystore_t *store) {
+  struct filestore_key *key;
+  struct filestore_data *store_data = store->keystore_data;
+  struct filestore_cache *cache, *prev = NULL;
+  unsigned int nchains;
+  int max_ents = INT_MAX;
+
+  for (cache = filestore_caches; cache; cache = cache->next) {
+    if (strcmp(cache->path, store_data->path) == 0) {
+      break;
+    }
+
+    prev = cache;
+  }
+
+  if (cache != NULL) {
+    if (cache->dev == store_data->st.st_dev &&
+        cache->ino == store_data->st.st_ino &&
+        cache->size == store_data->st.st_size &&
+        cache->mtime == store_data->st.st_mtime) {
+      pr_trace_msg(trace_channel, 17, "using %u cached %s from '%s'",
+        cache->nkeys, cache->nkeys != 1 ? "keys" : "key", cache->path);
+      return cache;
+    }
+
+    pr_trace_msg(trace_channel, 17, "'%s' has changed, reading keys again",
+      cache->path);
+
+    if (prev != NULL) {
+      prev->next = cache->next;
+
+    } else {
+      filestore_caches = cache->next;
+    }
+
+    destroy_pool(cache->pool);
+  }
+
+  if (filestore_cache_pool == NULL) {
+    filestore_cache_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(filestore_cache_pool, "SFTP File-based Keystore Cache Pool");
+  }
+
+  cache = pcalloc(filestore_cache_pool, sizeof(struct filestore_cache));
+  cache->pool = make_sub_pool(filestore_cache_pool);
+  pr_pool_tag(cache->pool, "SFTP File-based Keystore Cache Entry Pool");
+
+  cache->path = pstrdup(cache->pool, store_data->path);
+  cache->dev = store_data->st.st_dev;
+  cache->ino = store_data->st.st_ino;
+  cache->size = store_data->st.st_size;
+  cache->mtime = store_data->st.st_mtime;
+
+  nchains = (unsigned int) (store_data->st.st_size / FILESTORE_CACHE_KEY_SIZE);
+  if (nchains < 32) {
+    nchains = 32;
+  }
+
+  cache->keys = pr_table_nalloc(cache->pool, 0, nchains);
+  (void) pr_table_ctl(cache->keys, PR_TABLE_CTL_SET_KEY_CMP,
+    (void *) filestore_cache_key_cmp);
+  (void) pr_table_ctl(cache->keys, PR_TABLE_CTL_SET_MAX_ENTS, &max_ents);
+
+  key = filestore_get_key(store, cache->pool);
+  while (key != NULL) {
+    pr_signals_handle();
+
+    if (key->key_data != NULL) {
+      array_header *keys;
+
+      keys = (array_header *) pr_table_kget(cache->keys, key->key_data,
+        key->key_datalen, NULL);
+      if (keys == NULL) {
+        keys = make_array(cache->pool, 1, sizeof(struct filestore_key *));
+        (void) pr_table_kadd(cache->keys, key->key_data, key->key_datalen,
+          keys, sizeof(array_header *));
+      }
+
+      *((struct filestore_key **) push_array(keys)) = key;
+      cache->nkeys++;
+    }
+
+    key = filestore_get_key(store, cache->pool);
+  }
+
+  if (filestore_rewind(store) < 0) {
+    int xerrno = errno;
+
+    destroy_pool(cache->pool);
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  pr_trace_msg(trace_channel, 17, "read %u %s from '%s'", cache->nkeys,
+    cache->nkeys != 1 ? "keys" : "key", cache->path);
+
+  cache->next = filestore_caches;
+  filestore_caches = cache;
+  return cache;
+}
+
 static int filestore_verify_host_key(sftp_keystore_t *store, pool *p,
     const char *user, const char *host_fqdn, const char *host_user,
     unsigned char *key_data, uint32_t key_len, pr_table_t *headers) {
-  struct filestore_key *key = NULL;
+  register unsigned int i;
+  struct filestore_key *key = NULL, **keys;
   struct filestore_data *store_data = store->keystore_data;
+  struct filestore_cache *cache;
+  array_header *matches;
   int res = -1;
 
   if (store_data->path == NULL) {
@@ -391,16 +548,25 @@ static int filestore_verify_host_key(sftp_keystore_t *store, pool *p,
     return -1;
   }
 
-  /* XXX Note that this will scan the file from the beginning, each time.
-   * There's room for improvement; perhaps mmap() the file into memory?
-   */
+  cache = filestore_get_cache(store);
+  if (cache == NULL) {
+    return -1;
+  }
 
-  key = filestore_get_key(store, p);
-  while (key != NULL) {
+  matches = (array_header *) pr_table_kget(cache->keys, key_data, key_len,
+    NULL);
+  if (matches == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  keys = matches->elts;
+  for (i = 0; i < matches->nelts; i++) {
     int ok;
 
     pr_signals_handle();
 
+    key = keys[i];
     ok = sftp_keys_compare_keys(p, key_data, key_len, key->key_data,
       key->key_datalen);
     if (ok != TRUE) {
@@ -417,39 +583,31 @@ static int filestore_verify_host_key(sftp_keystore_t *store, pool *p,
       res = 0;
       break;
     }
-
-    key = filestore_get_key(store, p);
   }
 
-  if (res == 0) {
-    pr_trace_msg(trace_channel, 10, "found matching public key for host '%s' "
-      "in '%s'", host_fqdn, store_data->path);
-    if (pr_table_copy(headers, key->headers, 0) < 0) {
-      pr_trace_msg(trace_channel, 19, "error copying verify notes: %s",
-        strerror(errno));
-    }
+  if (res < 0) {
+    errno = ENOENT;
+    return -1;
   }
 
-  if (pr_fsio_lseek(store_data->fh, 0, SEEK_SET) < 0) {
-    int xerrno = errno;
-
-    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-      "error seeking to start of '%s': %s", store_data->path, strerror(xerrno));
-
-    errno = xerrno;
-    return -1;
+  pr_trace_msg(trace_channel, 10, "found matching public key for host '%s' "
+    "in '%s'", host_fqdn, store_data->path);
+  if (pr_table_copy(headers, key->headers, 0) < 0) {
+    pr_trace_msg(trace_channel, 19, "error copying verify notes: %s",
+      strerror(errno));
   }
 
-  store_data->lineno = 0;
-  return res;
+  return 0;
 }
 
 static int filestore_verify_user_key(sftp_keystore_t *store, pool *p,
     const char *user, unsigned char *key_data, uint32_t key_len,
     pr_table_t *headers) {
-  struct filestore_key *key = NULL;
+  register unsigned int i;
+  struct filestore_key *key = NULL, **keys;
   struct filestore_data *store_data = store->keystore_data;
-  unsigned int count = 0;
+  struct filestore_cache *cache;
+  array_header *matches;
   int res = -1;
 
   if (store_data->path == NULL) {
@@ -457,17 +615,28 @@ static int filestore_verify_user_key(sftp_keystore_t *store, pool *p,
     return -1;
   }
 
-  /* XXX Note that this will scan the file from the beginning, each time.
-   * There's room for improvement; perhaps mmap() the file into memory?
-   */
+  cache = filestore_get_cache(store);
+  if (cache == NULL) {
+    return -1;
+  }
 
-  key = filestore_get_key(store, p);
-  while (key != NULL) {
+  matches = (array_header *) pr_table_kget(cache->keys, key_data, key_len,
+    NULL);
+  if (matches == NULL) {
+    pr_trace_msg(trace_channel, 10,
+      "failed to match key with any of %u %s from file '%s'", cache->nkeys,
+      cache->nkeys != 1 ? "keys" : "key", store_data->path);
+    errno = ENOENT;
+    return -1;
+  }
+
+  keys = matches->elts;
+  for (i = 0; i < matches->nelts; i++) {
     int ok;
 
     pr_signals_handle();
-    count++;
 
+    key = keys[i];
     ok = sftp_keys_compare_keys(p, key_data, key_len, key->key_data,
       key->key_datalen);
     if (ok != TRUE) {
@@ -475,10 +644,6 @@ static int filestore_verify_user_key(sftp_keystore_t *store, pool *p,
         (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
           "error comparing keys from '%s': %s", store_data->path,
           strerror(errno));
-
-      } else {
-        pr_trace_msg(trace_channel, 10,
-          "failed to match key #%u from file '%s'", count, store_data->path);
       }
 
     } else {
@@ -504,31 +669,21 @@ static int filestore_verify_user_key(sftp_keystore_t *store, pool *p,
         break;
       }
     }
-
-    key = filestore_get_key(store, p);
   }
 
-  if (res == 0) {
-    pr_trace_msg(trace_channel, 10, "found matching public key for user '%s' "
-      "in '%s'", user, store_data->path);
-    if (pr_table_copy(headers, key->headers, 0) < 0) {
-      pr_trace_msg(trace_channel, 19, "error copying verify notes: %s",
-        strerror(errno));
-    }
+  if (res < 0) {
+    errno = ENOENT;
+    return -1;
   }
 
-  if (pr_fsio_lseek(store_data->fh, 0, SEEK_SET) < 0) {
-    int xerrno = errno;
-
-    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-      "error seeking to start of '%s': %s", store_data->path, strerror(xerrno));
-
-    xerrno = errno;
-    return -1;
+  pr_trace_msg(trace_channel, 10, "found matching public key for user '%s' "
+    "in '%s'", user, store_data->path);
+  if (pr_table_copy(headers, key->headers, 0) < 0) {
+    pr_trace_msg(trace_channel, 19, "error copying verify notes: %s",
+      strerror(errno));
   }
 
-  store_data->lineno = 0;
-  return res;
+  return 0;
 }
 
 static int filestore_close(sftp_keystore_t *store) {
@@ -596,7 +751,9 @@ static sftp_keystore_t *filestore_open(pool *parent_pool,
     return NULL;
   }
 
-  /* Stat the opened file to determine the optimal buffer size for IO. */
+  /* Stat the opened file to determine the optimal buffer size for IO, and
+   * whether any cached keys from it are still current.
+   */
   memset(&st, 0, sizeof(st));
   if (pr_fsio_fstat(fh, &st) < 0) {
     xerrno = errno;
@@ -624,6 +781,7 @@ static sftp_keystore_t *filestore_open(pool *parent_pool,
   store_data->path = path;
   store_data->fh = fh;
   store_data->lineno = 0;
+  memcpy(&store_data->st, &st, sizeof(st));
 
   store->store_ktypes = requested_key_type;
 
@@ -655,5 +813,11 @@ int sftp_rfc4716_free(void) {
   sftp_keystore_unregister_store("file",
     SFTP_SSH2_HOST_KEY_STORE|SFTP_SSH2_USER_KEY_STORE);
 
+  if (filestore_cache_pool != NULL) {
+    destroy_pool(filestore_cache_pool);
+    filestore_cache_pool = NULL;
+    filestore_caches = NULL;
+  }
+
   return 0;
 }
@@ -52,6 +52,25 @@ struct sqlstore_data {
 
 static const char *sqlstore_user = NULL;
 
+/* The user keys returned by the SELECT query, indexed by their key data.
+ * Clients often try several keys per login; caching the keys briefly avoids
+ * querying for and parsing all of them again for each attempt.
+ */
+struct sqlstore_cache {
+  pool *pool;
+  const char *select_query;
+  const char *user;
+  time_t loaded;
+
+  /* Maps key data to an array of the keys with that data. */
+  pr_table_t *keys;
+  unsigned int nkeys;
+};
+
+static struct sqlstore_cache *sqlstore_user_cache = NULL;
+
+#define SFTP_SQL_CACHE_TTL_SECS		60
+
 static const char *trace_channel = "sftp.sql";
 
 static cmd_rec *sqlstore_cmd_create(pool *parent_pool, unsigned int argc, ...) {
@@ -685,19 +704,62 @@ static int sqlstore_verify_host_key(sftp_keystore_t *store, pool *p,
   return -1;
 }
 
-static int sqlstore_verify_user_key(sftp_keystore_t *store, pool *p,
-    const char *user, unsigned char *key_data, uint32_t key_datalen,
-    pr_table_t *headers) {
+static int sqlstore_cache_key_cmp(const void *key1, size_t keysz1,
+    const void *key2, size_t keysz2) {
+  if (keysz1 != keysz2) {
+    return keysz1 < keysz2 ? -1 : 1;
+  }
+
+  return memcmp(key1, key2, keysz1);
+}
+
+static void sqlstore_cache_add_key(struct sqlstore_cache *cache,
+    struct sqlstore_key *key) {
+  array_header *keys;
+
+  keys = (array_header *) pr_table_kget(cache->keys, key->key_data,
+    key->key_datalen, NULL);
+  if (keys == NULL) {
+    keys = make_array(cache->pool, 1, sizeof(struct sqlstore_key *));
+    (void) pr_table_kadd(cache->keys, key->key_data, key->key_datalen, keys,
+      sizeof(array_header *));
+  }
+
+  *((struct sqlstore_key **) push_array(keys)) = key;
+  cache->nkeys++;
+}
+
+static struct sqlstore_cache *sqlstore_get_cache(sftp_keystore_t *store,
+    const char *user) {
   register unsigned int i;
   struct sqlstore_data *store_data;
-  pool *tmp_pool;
+  struct sqlstore_cache *cache;
+  pool *cache_pool, *tmp_pool;
   cmdtable *sql_cmdtab;
   cmd_rec *sql_cmd;
   modret_t *sql_res;
   array_header *sql_data;
   char **values;
+  time_t now;
 
   store_data = store->keystore_data;
+  time(&now);
+
+  cache = sqlstore_user_cache;
+  if (cache != NULL) {
+    if (strcmp(cache->select_query, store_data->select_query) == 0 &&
+        strcmp(cache->user, user) == 0 &&
+        (now - cache->loaded) < SFTP_SQL_CACHE_TTL_SECS) {
+      pr_trace_msg(trace_channel, 17,
+        "using %u cached %s for user '%s' from SQLNamedQuery '%s'",
+        cache->nkeys, cache->nkeys != 1 ? "keys" : "key", user,
+        store_data->select_query);
+      return cache;
+    }
+
+    destroy_pool(cache->pool);
+    sqlstore_user_cache = NULL;
+  }
 
   /* Find the cmdtable for the sql_lookup command. */
   sql_cmdtab = pr_stash_get_symbol2(PR_SYM_HOOK, "sql_lookup", NULL, NULL,
@@ -706,7 +768,7 @@ static int sqlstore_verify_user_key(sftp_keystore_t *store, pool *p,
     (void) pr_log_writefile(sftp_logfd, MOD_SFTP_SQL_VERSION,
       "unable to find SQL hook symbol 'sql_lookup'");
     errno = EPERM;
-    return -1;
+    return NULL;
   }
 
   tmp_pool = make_sub_pool(store->keystore_pool);
@@ -724,71 +786,148 @@ static int sqlstore_verify_user_key(sftp_keystore_t *store, pool *p,
     destroy_pool(tmp_pool);
 
     errno = EPERM;
-    return -1;
+    return NULL;
   }
 
   sql_data = (array_header *) sql_res->data;
 
-  if (sql_data->nelts == 0) {
-    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_SQL_VERSION,
-      "SQLNamedQuery '%s' returned zero results", store_data->select_query);
-    destroy_pool(tmp_pool);
-    errno = ENOENT;
-    return -1;
-  }
-
   (void) pr_log_writefile(sftp_logfd, MOD_SFTP_SQL_VERSION,
     "SQLNamedQuery '%s' returned %d %s", store_data->select_query,
     sql_data->nelts, sql_data->nelts != 1 ? "rows" : "row");
 
   values = (char **) sql_data->elts;
   for (i = 0; i < sql_data->nelts; i++) {
-    int res;
+    if (values[i] == NULL) {
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_SQL_VERSION,
+        "SQLNamedQuery '%s' returned NULL data", store_data->select_query);
+      destroy_pool(tmp_pool);
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+
+  cache_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(cache_pool, "SFTP SQL-based Keystore Cache Pool");
+
+  cache = pcalloc(cache_pool, sizeof(struct sqlstore_cache));
+  cache->pool = cache_pool;
+
+  cache->select_query = pstrdup(cache->pool, store_data->select_query);
+  cache->user = pstrdup(cache->pool, user);
+  cache->loaded = now;
+  cache->keys = pr_table_nalloc(cache->pool, 0, 32);
+  (void) pr_table_ctl(cache->keys, PR_TABLE_CTL_SET_KEY_CMP,
+    (void *) sqlstore_cache_key_cmp);
+
+  for (i = 0; i < sql_data->nelts; i++) {
+    struct sqlstore_key *key;
     char *col_data;
     size_t col_datalen;
+    unsigned int nkeys;
 
     pr_signals_handle();
 
     col_data = values[i];
-    if (col_data == NULL) {
-      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_SQL_VERSION,
-        "SQLNamedQuery '%s' returned NULL data", store_data->select_query);
-      destroy_pool(tmp_pool);
-      errno = EINVAL;
-      return -1;
+    col_datalen = strlen(values[i]);
+    nkeys = cache->nkeys;
+
+    key = sqlstore_get_key_rfc4716(cache->pool, &col_data, &col_datalen);
+    while (key != NULL) {
+      pr_signals_handle();
+
+      sqlstore_cache_add_key(cache, key);
+      key = sqlstore_get_key_rfc4716(cache->pool, &col_data, &col_datalen);
+    }
+
+    if (cache->nkeys > nkeys) {
+      continue;
     }
 
+    /* If no RFC 4716 keys could be read, assume it is because the data did
+     * not actually use the RFC 4716 format.
+     */
+    col_data = values[i];
     col_datalen = strlen(values[i]);
 
-    res = sqlstore_verify_key_rfc4716(p, store_data, i, col_data, col_datalen,
-      key_data, key_datalen, headers);
-    if (res == 0) {
-      pr_trace_msg(trace_channel, 10, "found matching RFC4716 public key "
-        "(row %u) for user '%s' using SQLNamedQuery '%s'", i+1, user,
-        store_data->select_query);
-      destroy_pool(tmp_pool);
-      return 0;
+    key = sqlstore_get_key_raw(cache->pool, &col_data, &col_datalen);
+    if (key == NULL) {
+      pr_trace_msg(trace_channel, 10,
+        "unable to parse data (row %u) as raw data", i+1);
+      continue;
     }
 
-    /* If verification as an RFC 4716 key failed with EINVAL, assume it is
-     * because the key did not actually use the RFC 4716 format.  Otherwise,
-     * verification might have failed because of simple mismatching keys
-     * (wrong RSA key, or comparing RSA and EC keys).
-     */
-    if (errno == EINVAL) {
-      res = sqlstore_verify_key_raw(p, store_data, i, col_data, col_datalen,
-        key_data, key_datalen);
-      if (res == 0) {
-        pr_trace_msg(trace_channel, 10, "found matching public key (row %u) "
-          "for user '%s' using SQLNamedQuery '%s'", i+1, user,
-          store_data->select_query);
-        destroy_pool(tmp_pool);
-        return 0;
+    sqlstore_cache_add_key(cache, key);
+  }
+
+  destroy_pool(tmp_pool);
+
+  sqlstore_user_cache = cache;
+  return cache;
+}
+
+static int sqlstore_verify_user_key(sftp_keystore_t *store, pool *p,
+    const char *user, unsigned char *key_data, uint32_t key_datalen,
+    pr_table_t *headers) {
+  register unsigned int i;
+  struct sqlstore_data *store_data;
+  struct sqlstore_cache *cache;
+  struct sqlstore_key **keys;
+  array_header *matches;
+
+  store_data = store->keystore_data;
+
+  cache = sqlstore_get_cache(store, user);
+  if (cache == NULL) {
+    return -1;
+  }
+
+  if (cache->nkeys == 0) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_SQL_VERSION,
+      "SQLNamedQuery '%s' returned zero results", store_data->select_query);
+    errno = ENOENT;
+    return -1;
+  }
+
+  matches = (array_header *) pr_table_kget(cache->keys, key_data, key_datalen,
+    NULL);
+  if (matches == NULL) {
+    pr_trace_msg(trace_channel, 3,
+      "client-sent key for '%s' does not match any of %u %s from "
+      "SQLNamedQuery '%s'", user, cache->nkeys,
+      cache->nkeys != 1 ? "keys" : "key", store_data->select_query);
+    errno = ENOENT;
+    return -1;
+  }
+
+  keys = matches->elts;
+  for (i = 0; i < matches->nelts; i++) {
+    int res;
+
+    pr_signals_handle();
+
+    res = sftp_keys_compare_keys(p, key_data, key_datalen, keys[i]->key_data,
+      keys[i]->key_datalen);
+    if (res < 0) {
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_SQL_VERSION,
+        "error comparing client-sent key for '%s' with SQL data from "
+        "SQLNamedQuery '%s': %s", user, store_data->select_query,
+        strerror(errno));
+      continue;
+    }
+
+    if (res == TRUE) {
+      pr_trace_msg(trace_channel, 10, "found matching public key for user "
+        "'%s' using SQLNamedQuery '%s'", user, store_data->select_query);
+
+      if (pr_table_copy(headers, keys[i]->headers, 0) < 0) {
+        pr_trace_msg(trace_channel, 19, "error copying verify notes: %s",
+           strerror(errno));
       }
+
+      return 0;
     }
   }
 
-  destroy_pool(tmp_pool);
   errno = ENOENT;
   return -1;
 }
@@ -879,6 +1018,11 @@ static void sftpsql_mod_unload_ev(const void *event_data, void *user_data) {
   }
 
   sqlstore_user = NULL;
+  if (sqlstore_user_cache != NULL) {
+    destroy_pool(sqlstore_user_cache->pool);
+    sqlstore_user_cache = NULL;
+  }
+
   sftp_keystore_unregister_store("sql",
     SFTP_SSH2_HOST_KEY_STORE|SFTP_SSH2_USER_KEY_STORE);
   pr_event_unregister(&sftp_sql_module, NULL, NULL);
@@ -176,115 +176,34 @@ static int site_misc_create_path(pool *p, const char *path) {
   return 0;
 }
 
-static int site_misc_delete_dir(pool *p, const char *dir) {
-  void *dirh;
-  struct dirent *dent;
-  int res, xerrno;
+/* The fake DELE/RMD command for the tree entry currently being removed. */
+struct site_misc_delete {
+  pool *cmd_pool;
   cmd_rec *cmd;
-  pool *sub_pool;
-
-  dirh = pr_fsio_opendir(dir);
-  xerrno = errno;
-
-  if (dirh == NULL) {
-    pr_log_debug(DEBUG2, MOD_SITE_MISC_VERSION
-      ": error reading directory '%s': %s", dir, strerror(xerrno));
-    errno = xerrno;
-    return -1;
-  }
-
-  while ((dent = pr_fsio_readdir(dirh)) != NULL) {
-    struct stat st;
-    char *file;
-
-    pr_signals_handle();
-
-    if (strcmp(dent->d_name, ".") == 0 ||
-        strcmp(dent->d_name, "..") == 0) {
-      continue;
-    }
-
-    file = pdircat(p, dir, dent->d_name, NULL);
-
-    if (pr_fsio_stat(file, &st) < 0) {
-      continue;
-    }
-
-    if (S_ISDIR(st.st_mode)) {
-      res = site_misc_delete_dir(p, file);
-      xerrno = errno;
-
-      if (res < 0) {
-        pr_fsio_closedir(dirh);
-
-        errno = xerrno;
-        return -1;
-      }
-
-    } else {
-      /* Dispatch fake C_DELE command, e.g. for mod_quotatab */
-      sub_pool = pr_pool_create_sz(p, 64);
-      cmd = pr_cmd_alloc(sub_pool, 2, pstrdup(sub_pool, C_DELE),
-        pstrdup(sub_pool, file));
-      cmd->arg = pstrdup(cmd->pool, file);
-      cmd->cmd_class = CL_WRITE;
-
-      pr_response_block(TRUE);
-      res = pr_cmd_dispatch_phase(cmd, PRE_CMD, 0);
-      xerrno = errno;
-
-      if (res < 0) {
-        pr_log_debug(DEBUG3, MOD_SITE_MISC_VERSION
-          ": deleting file '%s' blocked by DELE handler: %s", file,
-          strerror(xerrno));
-
-        pr_cmd_dispatch_phase(cmd, POST_CMD_ERR, 0);
-        pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
-        pr_response_clear(&resp_err_list);
-        pr_response_block(FALSE);
-
-        destroy_pool(sub_pool);
-        pr_fsio_closedir(dirh);
-
-        errno = xerrno;
-        return -1;
-      }
-
-      res = pr_fsio_unlink(file);
-      xerrno = errno;
-
-      if (res < 0) {
-        pr_fsio_closedir(dirh);
+};
 
-        pr_cmd_dispatch_phase(cmd, POST_CMD_ERR, 0);
-        pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
-        pr_response_clear(&resp_err_list);
-        pr_response_block(FALSE);
+static int site_misc_delete_pre_cb(pool *p, const char *path, int is_dir,
+    void *user_data) {
+  struct site_misc_delete *del;
+  cmd_rec *cmd;
+  int res, xerrno;
 
-        destroy_pool(sub_pool);
-        pr_fsio_closedir(dirh);
+  del = user_data;
 
-        errno = xerrno;
-        return -1;
-      }
+  /* Dispatch fake C_DELE/C_RMD command, e.g. for mod_quotatab */
+  del->cmd_pool = pr_pool_create_sz(p, 64);
+  if (is_dir) {
+    cmd = pr_cmd_alloc(del->cmd_pool, 2, pstrdup(del->cmd_pool, C_RMD),
+      pstrdup(del->cmd_pool, path));
+    cmd->cmd_class = CL_DIRS|CL_WRITE;
 
-      pr_response_add(R_250, _("%s command successful"), (char *) cmd->argv[0]);
-      pr_cmd_dispatch_phase(cmd, POST_CMD, 0);
-      pr_cmd_dispatch_phase(cmd, LOG_CMD, 0);
-      pr_response_clear(&resp_list);
-      destroy_pool(sub_pool);
-      pr_response_block(FALSE);
-    }
+  } else {
+    cmd = pr_cmd_alloc(del->cmd_pool, 2, pstrdup(del->cmd_pool, C_DELE),
+      pstrdup(del->cmd_pool, path));
+    cmd->cmd_class = CL_WRITE;
   }
-
-  pr_fsio_closedir(dirh);
-
-  /* Dispatch fake C_RMD command, e.g. for mod_quotatab */
-  sub_pool = pr_pool_create_sz(p, 64);
-  cmd = pr_cmd_alloc(sub_pool, 2, pstrdup(sub_pool, C_RMD),
-    pstrdup(sub_pool, dir));
-  cmd->arg = pstrdup(cmd->pool, dir);
-  cmd->cmd_class = CL_DIRS|CL_WRITE;
+  cmd->arg = pstrdup(cmd->pool, path);
+  del->cmd = cmd;
 
   pr_response_block(TRUE);
   res = pr_cmd_dispatch_phase(cmd, PRE_CMD, 0);
@@ -292,48 +211,77 @@ static int site_misc_delete_dir(pool *p, const char *dir) {
 
   if (res < 0) {
     pr_log_debug(DEBUG3, MOD_SITE_MISC_VERSION
-      ": removing directory '%s' blocked by RMD handler: %s", dir,
-      strerror(xerrno));
-
-    pr_response_add_err(R_550, "%s: %s", cmd->arg, strerror(xerrno));
-    pr_cmd_dispatch_phase(cmd, POST_CMD_ERR, 0);
-    pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
-    pr_response_clear(&resp_err_list);
-    pr_response_block(FALSE);
-
-    destroy_pool(sub_pool);
+      ": %s '%s' blocked by %s handler: %s",
+      is_dir ? "removing directory" : "deleting file", path,
+      (char *) cmd->argv[0], strerror(xerrno));
 
     errno = xerrno;
     return -1;
   }
 
-  res = pr_fsio_rmdir(dir);
-  xerrno = errno;
+  return 0;
+}
+
+static void site_misc_delete_post_cb(pool *p, const char *path, int is_dir,
+    int res, int xerrno, void *user_data) {
+  struct site_misc_delete *del;
+  cmd_rec *cmd;
+
+  del = user_data;
+  cmd = del->cmd;
 
   if (res < 0) {
-    pr_log_debug(DEBUG3, MOD_SITE_MISC_VERSION
-      ": error removing directory '%s': %s", dir,
-      strerror(xerrno));
-    pr_response_add_err(R_550, "%s: %s", cmd->arg, strerror(xerrno));
+    if (is_dir) {
+      pr_response_add_err(R_550, "%s: %s", cmd->arg, strerror(xerrno));
+    }
+
     pr_cmd_dispatch_phase(cmd, POST_CMD_ERR, 0);
     pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
     pr_response_clear(&resp_err_list);
-    pr_response_block(FALSE);
 
-    destroy_pool(sub_pool);
-    errno = xerrno;
-    return -1;
+  } else {
+    if (is_dir) {
+      pr_response_add(R_257, _("\"%s\" - Directory successfully created"),
+        quote_dir(cmd->tmp_pool, (char *) path));
+
+    } else {
+      pr_response_add(R_250, _("%s command successful"),
+        (char *) cmd->argv[0]);
+    }
+
+    pr_cmd_dispatch_phase(cmd, POST_CMD, 0);
+    pr_cmd_dispatch_phase(cmd, LOG_CMD, 0);
+    pr_response_clear(&resp_list);
   }
 
-  pr_response_add(R_257, _("\"%s\" - Directory successfully created"),
-    quote_dir(cmd->tmp_pool, (char *) dir));
-  pr_cmd_dispatch_phase(cmd, POST_CMD, 0);
-  pr_cmd_dispatch_phase(cmd, LOG_CMD, 0);
-  pr_response_clear(&resp_list);
   pr_response_block(FALSE);
-  destroy_pool(sub_pool);
+  destroy_pool(del->cmd_pool);
+  del->cmd_pool = NULL;
+  del->cmd = NULL;
+}
 
-  return 0;
+/* Each file and directory in the tree is removed via a fake DELE or RMD
+ * command, so that e.g. quotas and logging see every removal.  The removal
+ * itself is done by pr_fs_remove_tree(), which avoids resolving the full path
+ * of every entry where it can.
+ */
+static int site_misc_delete_dir(pool *p, const char *dir) {
+  struct site_misc_delete del;
+  int res, xerrno;
+
+  memset(&del, 0, sizeof(del));
+
+  res = pr_fs_remove_tree(p, dir, site_misc_delete_pre_cb,
+    site_misc_delete_post_cb, &del);
+  xerrno = errno;
+
+  if (res < 0) {
+    pr_log_debug(DEBUG2, MOD_SITE_MISC_VERSION
+      ": error removing directory '%s': %s", dir, strerror(xerrno));
+  }
+
+  errno = xerrno;
+  return res;
 }
 
 static int site_misc_delete_path(pool *p, const char *path) {
@@ -35,6 +35,15 @@
 
 #define SNMP_MAX_LOCK_ATTEMPTS		10
 
+/* Counters and gauges are single 32-bit words in shared memory, and so can
+ * be read and updated in place with atomic operations, where the compiler
+ * provides them.  The byte-range locks are then only needed by callers
+ * which want a consistent snapshot of several fields.
+ */
+#if defined(__GNUC__)
+# define SNMP_DB_USE_ATOMICS		1
+#endif
+
 /* Note: Not all database IDs are in this list; only those databases which
  * have on-disk tables are here.  Thus the NOTIFY and CONN database IDs are
  * explicitly NOT here, as they are ephemeral/synthetic databases anyway.
@@ -505,6 +514,18 @@ static int get_field_range(unsigned int field, off_t *field_start,
   return 0;
 }
 
+/* Note that the field start is a byte offset into the table. */
+static volatile uint32_t *get_field_data(int db_id, off_t field_start) {
+  if (snmp_dbs[db_id].db_data == NULL) {
+    /* The table has not been opened, e.g. no SNMPTables configured. */
+    errno = EBADF;
+    return NULL;
+  }
+
+  return (volatile uint32_t *) (((char *) snmp_dbs[db_id].db_data) +
+    field_start);
+}
+
 static const char *get_lock_type(struct flock *lock) {
   const char *lock_type;
 
@@ -993,7 +1014,7 @@ int snmp_db_close(pool *p, int db_id) {
 
 int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
     char **str_value, size_t *str_valuelen) {
-  void *db_data, *field_data;
+  volatile uint32_t *field_data;
   int db_id, res;
   off_t field_start;
   size_t field_len;
@@ -1175,19 +1196,27 @@ int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
     return -1;
   }
 
+  field_data = get_field_data(db_id, field_start);
+  if (field_data == NULL) {
+    return -1;
+  }
+
+#if defined(SNMP_DB_USE_ATOMICS)
+  __sync_synchronize();
+  *int_value = (int32_t) *field_data;
+#else
   res = snmp_db_rlock(field);
   if (res < 0) {
     return -1;
   }
 
-  db_data = snmp_dbs[db_id].db_data;
-  field_data = &(((uint32_t *) db_data)[field_start]);
-  memmove(int_value, field_data, field_len);
+  memmove(int_value, (void *) field_data, field_len);
 
   res = snmp_db_unlock(field);
   if (res < 0) {
     return -1;
   }
+#endif /* SNMP_DB_USE_ATOMICS */
 
   pr_trace_msg(trace_channel, 19,
     "read value %lu for field %s", (unsigned long) *int_value,
@@ -1198,7 +1227,7 @@ int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
 int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr) {
   uint32_t orig_val, new_val;
   int db_id, res;
-  void *db_data, *field_data;
+  volatile uint32_t *field_data;
   off_t field_start;
   size_t field_len;
 
@@ -1211,59 +1240,75 @@ int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr) {
     return -1;
   }
 
-  res = snmp_db_wlock(field);
-  if (res < 0) {
+  field_data = get_field_data(db_id, field_start);
+  if (field_data == NULL) {
     return -1;
   }
 
-  db_data = snmp_dbs[db_id].db_data;
-  field_data = &(((uint32_t *) db_data)[field_start]);
-  memmove(&new_val, field_data, field_len);
-  orig_val = new_val;
+#if defined(SNMP_DB_USE_ATOMICS)
+  if (incr >= 0) {
+    new_val = __sync_add_and_fetch(field_data, (uint32_t) incr);
+    orig_val = new_val - incr;
 
-  if (orig_val == 0 &&
-      incr < 0) {
-    /* If we are in fact decrementing a value, and that value is
-     * already zero, then do nothing.
+  } else {
+    /* Decrements must not take the value below zero, so we compare and
+     * swap until no other process has changed the value under us.
      */
+    while (TRUE) {
+      orig_val = *field_data;
+      if (orig_val == 0) {
+        break;
+      }
 
-    res = snmp_db_unlock(field);
-    if (res < 0) {
-      return -1;
+      new_val = orig_val + incr;
+      if (__sync_bool_compare_and_swap(field_data, orig_val, new_val)) {
+        break;
+      }
     }
+  }
 
-    pr_trace_msg(trace_channel, 19,
-      "value already zero for field %s (%d), not decrementing by %ld",
-      snmp_db_get_fieldstr(p, field), field, (long) incr);
-    return 0;
+  res = 0;
+#else
+  res = snmp_db_wlock(field);
+  if (res < 0) {
+    return -1;
   }
 
-  new_val += incr;
-  memmove(field_data, &new_val, field_len);
+  memmove(&new_val, (void *) field_data, field_len);
+  orig_val = new_val;
 
-#if 0
-  res = msync(field_data, field_len, MS_SYNC);
-  if (res < 0) {
-    pr_trace_msg(trace_channel, 1, "msync(2) error for field %s (%d): %s",
-      snmp_db_get_fieldstr(p, field), field, strerror(errno));
+  if (orig_val != 0 ||
+      incr >= 0) {
+    new_val += incr;
+    memmove((void *) field_data, &new_val, field_len);
   }
-#endif
 
   res = snmp_db_unlock(field);
   if (res < 0) {
     return -1;
   }
+#endif /* SNMP_DB_USE_ATOMICS */
+
+  if (orig_val == 0 &&
+      incr < 0) {
+    /* If we are in fact decrementing a value, and that value is
+     * already zero, then do nothing.
+     */
+    pr_trace_msg(trace_channel, 19,
+      "value already zero for field %s (%d), not decrementing by %ld",
+      snmp_db_get_fieldstr(p, field), field, (long) incr);
+    return res;
+  }
 
   pr_trace_msg(trace_channel, 19,
     "wrote value %lu (was %lu) for field %s (%d)", (unsigned long) new_val,
     (unsigned long) orig_val, snmp_db_get_fieldstr(p, field), field);
-  return 0;
+  return res;
 }
 
 int snmp_db_reset_value(pool *p, unsigned int field) {
-  uint32_t val;
-  int db_id, res;
-  void *db_data, *field_data;
+  int db_id;
+  volatile uint32_t *field_data;
   off_t field_start;
   size_t field_len;
 
@@ -1276,21 +1321,24 @@ int snmp_db_reset_value(pool *p, unsigned int field) {
     return -1;
   }
 
-  res = snmp_db_wlock(field);
-  if (res < 0) {
+  field_data = get_field_data(db_id, field_start);
+  if (field_data == NULL) {
     return -1;
   }
 
-  db_data = snmp_dbs[db_id].db_data;
-  field_data = &(((uint32_t *) db_data)[field_start]);
+#if defined(SNMP_DB_USE_ATOMICS)
+  (void) __sync_fetch_and_and(field_data, 0);
+#else
+  if (snmp_db_wlock(field) < 0) {
+    return -1;
+  }
 
-  val = 0;
-  memmove(field_data, &val, field_len);
+  memset((void *) field_data, 0, field_len);
 
-  res = snmp_db_unlock(field);
-  if (res < 0) {
+  if (snmp_db_unlock(field) < 0) {
     return -1;
   }
+#endif /* SNMP_DB_USE_ATOMICS */
 
   pr_trace_msg(trace_channel, 19,
     "reset value to 0 for field %s", snmp_db_get_fieldstr(p, field));
@@ -223,6 +223,10 @@ int snmp_db_get_field_db_id(unsigned int field);
 
 const char *snmp_db_get_fieldstr(pool *p, unsigned int field);
 
+/* Byte-range locks on a field.  Reading and updating a single field does not
+ * need these, as those are done atomically; they are for callers which need
+ * a consistent view across several fields.
+ */
 int snmp_db_rlock(unsigned int field);
 int snmp_db_wlock(unsigned int field);
 int snmp_db_unlock(unsigned int field);
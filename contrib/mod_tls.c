@@ -85,7 +85,7 @@
 # include <openssl/ecdh.h>
 #endif /* PR_USE_OPENSSL_ECC */
 
-#ifdef HAVE_MLOCK
+#if defined(HAVE_MLOCK) || defined(HAVE_SYS_MMAN_H)
 # include <sys/mman.h>
 #endif
 
@@ -583,6 +583,16 @@ static const char *tls_stapling_responder = NULL;
 
 #define TLS_DEFAULT_STAPLING_TIMEOUT	10
 static unsigned int tls_stapling_timeout = TLS_DEFAULT_STAPLING_TIMEOUT;
+
+static int tls_ocsp_refresh_timerno = -1;
+static pid_t tls_ocsp_refresh_pid = 0;
+
+/* The read end of a pipe whose write end is held only by the OCSP refresh
+ * process; it reads EOF once that process has exited.  The process is reaped
+ * by the daemon's generic SIGCHLD handling, after which its PID may be reused,
+ * so its PID alone cannot tell us whether it is still running.
+ */
+static int tls_ocsp_refresh_fd = -1;
 #endif
 
 static char *tls_passphrase_provider = NULL;
@@ -673,6 +683,11 @@ static unsigned int tls_sscn_mode = TLS_SSCN_MODE_SERVER;
 /* mod_tls OCSP constants */
 #define TLS_OCSP_RESP_MAX_AGE_SECS	300
 
+/* How often the daemon process checks the cached OCSP responses for the
+ * stapled server certificates, refreshing any which are missing or stale.
+ */
+#define TLS_OCSP_REFRESH_INTERVAL	60
+
 /* X509v3 OCSP "must staple" extensions (RFC 7633) */
 #define TLS_X509V3_TLS_FEAT_OID_TEXT		"1.3.6.1.5.5.7.1.24"
 #define TLS_X509V3_TLS_FEAT_STATUS_REQUEST 	{ 0x30, 0x03, 0x02, 0x01, 0x05 }
@@ -795,6 +810,10 @@ static int tls_ctx_set_session_id_context(server_rec *s, SSL_CTX *ctx);
 static int tls_ctx_set_session_tickets(SSL_CTX *ctx);
 static int tls_ctx_set_stapling(SSL_CTX *ctx);
 static int tls_ctx_set_stapling_cache(server_rec *s, SSL_CTX *ctx);
+#if defined(PR_USE_OPENSSL_OCSP)
+static int tls_ocsp_refresh_start(void);
+static int tls_ocsp_refresh_timer_cb(CALLBACK_FRAME);
+#endif /* PR_USE_OPENSSL_OCSP */
 static int tls_ssl_set_all(server_rec *s, SSL *ssl);
 
 static int tls_openlog(void);
@@ -870,6 +889,59 @@ struct tls_ticket_key {
 static xaset_t *tls_ticket_keys = NULL;
 #endif /* TLS_USE_SESSION_TICKETS */
 
+/* Shared memory, mapped by the daemon process and inherited by the session
+ * processes, holding the TLS handshake counters and a copy of the current
+ * session ticket keys.  Only the daemon process generates ticket keys; the
+ * session processes read them from here, so that a rotation (or restart)
+ * is seen by all sessions at once, and tickets issued by one session can be
+ * resumed by any other.
+ */
+struct tls_shm_key {
+  time_t created;
+  unsigned char key_name[16];
+  unsigned char cipher_key[32];
+  unsigned char hmac_key[32];
+};
+
+struct tls_shm {
+  /* Handshake counters. */
+  unsigned long full_handshakes;
+  unsigned long resumed_handshakes;
+  unsigned long psk_handshakes;
+  unsigned long failed_handshakes;
+
+  /* The key generation is odd while the daemon process is updating the
+   * keys; readers retry until they see the same, even generation before
+   * and after their copy.
+   */
+  volatile unsigned int key_gen;
+  unsigned int key_count;
+  unsigned int key_max_count;
+
+  /* Newest key first. */
+  struct tls_shm_key keys[1];
+};
+
+/* How many times to retry reading the shared keys, while the daemon process
+ * is updating them, before giving up.  A daemon which died mid-update
+ * leaves the key generation odd forever.
+ */
+#define TLS_SHM_KEY_MAX_ATTEMPTS	64
+
+static struct tls_shm *tls_shm = NULL;
+static size_t tls_shmsz = 0;
+
+#if defined(__GNUC__)
+# define TLS_SHM_INCR(field)	__sync_fetch_and_add(&(tls_shm->field), 1)
+# define TLS_SHM_BARRIER()	__sync_synchronize()
+#else
+# define TLS_SHM_INCR(field)	(tls_shm->field)++
+# define TLS_SHM_BARRIER()
+#endif /* __GNUC__ */
+
+/* Daemon PID */
+extern pid_t mpid;
+
 #if defined(PR_USE_CTRLS)
 static pool *tls_act_pool = NULL;
 static ctrls_acttab_t tls_acttab[];
@@ -5311,8 +5383,9 @@ static OCSP_RESPONSE *ocsp_send_request(pool *p, BIO *bio, const char *host,
   OCSP_REQ_CTX *ctx = NULL;
   const char *header_name, *header_value;
 
+  /* Note that the socket may well be fd 0, e.g. in the daemon process. */
   res = BIO_get_fd(bio, &fd);
-  if (res <= 0) {
+  if (res < 0) {
     pr_trace_msg(trace_channel, 3,
       "error obtaining OCSP responder socket fd: %s", tls_get_errors());
     return NULL;
@@ -6756,6 +6829,130 @@ static int tls_ocsp_cb(SSL *ssl, void *user_data) {
 }
 #endif /* PR_USE_OPENSSL_OCSP */
 
+static int tls_shm_create(void) {
+#if defined(HAVE_SYS_MMAN_H) && \
+    (defined(MAP_ANONYMOUS) || defined(MAP_ANON))
+  void *ptr;
+  size_t shmsz;
+  unsigned int key_max_count = 1;
+  int flags = MAP_SHARED, xerrno = 0;
+# if defined(HAVE_MLOCK)
+  int res;
+# endif /* HAVE_MLOCK */
+
+  if (tls_shm != NULL) {
+    return 0;
+  }
+
+# if defined(TLS_USE_SESSION_TICKETS)
+  key_max_count = tls_ticket_key_max_count;
+# endif /* TLS_USE_SESSION_TICKETS */
+
+  shmsz = sizeof(struct tls_shm) +
+    ((key_max_count - 1) * sizeof(struct tls_shm_key));
+
+# if defined(MAP_ANONYMOUS)
+  flags |= MAP_ANONYMOUS;
+# else
+  flags |= MAP_ANON;
+# endif /* MAP_ANONYMOUS */
+
+  ptr = mmap(NULL, shmsz, PROT_READ|PROT_WRITE, flags, -1, 0);
+  if (ptr == MAP_FAILED) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG1, MOD_TLS_VERSION
+      ": error mapping %lu bytes of shared memory: %s",
+      (unsigned long) shmsz, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  memset(ptr, 0, shmsz);
+
+# if defined(HAVE_MLOCK)
+  /* The ticket keys in this region should stay in memory; as with the
+   * per-process keys, we only _try_ to lock them.
+   */
+  PRIVS_ROOT
+  res = mlock(ptr, shmsz);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    pr_log_debug(DEBUG1, MOD_TLS_VERSION
+      ": error locking shared memory: %s", strerror(xerrno));
+  }
+# endif /* HAVE_MLOCK */
+
+  tls_shm = ptr;
+  tls_shmsz = shmsz;
+  tls_shm->key_max_count = key_max_count;
+
+  pr_trace_msg(trace_channel, 9,
+    "mapped %lu bytes of shared memory (room for %u ticket %s)",
+    (unsigned long) shmsz, key_max_count, key_max_count != 1 ? "keys" : "key");
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* HAVE_SYS_MMAN_H and MAP_ANON */
+}
+
+static void tls_shm_destroy(void) {
+#if defined(HAVE_SYS_MMAN_H)
+  if (tls_shm == NULL) {
+    return;
+  }
+
+  pr_memscrub(tls_shm, tls_shmsz);
+  if (munmap((void *) tls_shm, tls_shmsz) < 0) {
+    pr_log_debug(DEBUG1, MOD_TLS_VERSION
+      ": error unmapping shared memory: %s", strerror(errno));
+  }
+
+  tls_shm = NULL;
+  tls_shmsz = 0;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
+/* Count a completed (or failed) handshake, by type: full, resumed via
+ * session ID or ticket, or PSK (external PSK, or TLSv1.3 resumption, which
+ * is PSK-based).
+ */
+static void tls_shm_count_handshake(SSL *ssl, int failed) {
+  if (tls_shm == NULL) {
+    return;
+  }
+
+  if (failed == TRUE) {
+    TLS_SHM_INCR(failed_handshakes);
+    return;
+  }
+
+#if defined(PSK_MAX_PSK_LEN)
+  if (SSL_get_psk_identity(ssl) != NULL) {
+    TLS_SHM_INCR(psk_handshakes);
+    return;
+  }
+#endif /* PSK_MAX_PSK_LEN */
+
+  if (SSL_session_reused(ssl) > 0) {
+#if defined(TLS1_3_VERSION)
+    if (SSL_version(ssl) == TLS1_3_VERSION) {
+      TLS_SHM_INCR(psk_handshakes);
+      return;
+    }
+#endif /* TLS1_3_VERSION */
+
+    TLS_SHM_INCR(resumed_handshakes);
+    return;
+  }
+
+  TLS_SHM_INCR(full_handshakes);
+}
+
 #if defined(TLS_USE_SESSION_TICKETS)
 static int tls_ticket_key_cmp(xasetmember_t *a, xasetmember_t *b) {
   struct tls_ticket_key *k1, *k2;
@@ -6974,6 +7171,134 @@ static struct tls_ticket_key *get_ticket_key(unsigned char *key_name,
   return k;
 }
 
+/* Copy the daemon process' ticket keys, newest first, into shared memory,
+ * for use by the session processes.
+ */
+static void publish_ticket_keys(void) {
+  struct tls_ticket_key *k;
+  unsigned int count = 0, prev_count;
+
+  if (tls_shm == NULL ||
+      tls_ticket_keys == NULL ||
+      getpid() != mpid) {
+    return;
+  }
+
+  prev_count = tls_shm->key_count;
+
+  tls_shm->key_gen++;
+  TLS_SHM_BARRIER();
+
+  for (k = (struct tls_ticket_key *) tls_ticket_keys->xas_list;
+       k != NULL && count < tls_shm->key_max_count;
+       k = k->next) {
+    struct tls_shm_key *sk;
+
+    sk = &(tls_shm->keys[count++]);
+    sk->created = k->created;
+    memcpy(sk->key_name, k->key_name, sizeof(sk->key_name));
+    memcpy(sk->cipher_key, k->cipher_key, sizeof(sk->cipher_key));
+    memcpy(sk->hmac_key, k->hmac_key, sizeof(sk->hmac_key));
+  }
+
+  if (count < prev_count) {
+    pr_memscrub(&(tls_shm->keys[count]),
+      (prev_count - count) * sizeof(struct tls_shm_key));
+  }
+
+  tls_shm->key_count = count;
+
+  TLS_SHM_BARRIER();
+  tls_shm->key_gen++;
+
+  pr_trace_msg(trace_channel, 9, "published %u TLS session ticket %s",
+    count, count != 1 ? "keys" : "key");
+}
+
+/* Copy the ticket key with the given name (or the newest key, if no name is
+ * given) into the provided buffer.  Returns 1 if the key found is the newest
+ * key, 0 if it is an older key, and -1 (with ENOENT) if no key is found.
+ */
+static int find_ticket_key(const unsigned char *key_name,
+    struct tls_shm_key *key) {
+  struct tls_ticket_key *k;
+  int res = -1;
+
+  if (tls_shm != NULL &&
+      tls_shm->key_count > 0) {
+    register unsigned int attempt;
+
+    for (attempt = 0; attempt < TLS_SHM_KEY_MAX_ATTEMPTS; attempt++) {
+      register unsigned int i;
+      unsigned int count, gen;
+
+      gen = tls_shm->key_gen;
+      if (gen & 1) {
+        /* The daemon process is in the middle of an update. */
+        continue;
+      }
+
+      TLS_SHM_BARRIER();
+
+      count = tls_shm->key_count;
+      if (count > tls_shm->key_max_count) {
+        count = tls_shm->key_max_count;
+      }
+
+      res = -1;
+      for (i = 0; i < count; i++) {
+        if (key_name == NULL ||
+            memcmp(key_name, tls_shm->keys[i].key_name, 16) == 0) {
+          memcpy(key, &(tls_shm->keys[i]), sizeof(struct tls_shm_key));
+          res = (i == 0 ? 1 : 0);
+          break;
+        }
+      }
+
+      TLS_SHM_BARRIER();
+
+      if (tls_shm->key_gen == gen) {
+        if (res < 0) {
+          errno = ENOENT;
+        }
+
+        return res;
+      }
+    }
+
+    /* Use our own copy of the keys, as inherited from the daemon process,
+     * instead.
+     */
+    pr_trace_msg(trace_channel, 3,
+      "unable to read shared TLS session ticket keys after %u attempts, "
+      "using local keys", attempt);
+  }
+
+  if (tls_ticket_keys == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (key_name != NULL) {
+    k = get_ticket_key((unsigned char *) key_name, 16);
+
+  } else {
+    k = (struct tls_ticket_key *) tls_ticket_keys->xas_list;
+  }
+
+  if (k == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  key->created = k->created;
+  memcpy(key->key_name, k->key_name, sizeof(key->key_name));
+  memcpy(key->cipher_key, k->cipher_key, sizeof(key->cipher_key));
+  memcpy(key->hmac_key, k->hmac_key, sizeof(key->hmac_key));
+
+  return ((void *) k == tls_ticket_keys->xas_list ? 1 : 0);
+}
+
 static int new_ticket_key_timer_cb(CALLBACK_FRAME) {
   struct tls_ticket_key *k;
 
@@ -6987,6 +7312,7 @@ static int new_ticket_key_timer_cb(CALLBACK_FRAME) {
 
   } else {
     add_ticket_key(k);
+    publish_ticket_keys();
   }
 
   /* Always restart this timer. */
@@ -7000,6 +7326,21 @@ static void lock_ticket_keys(void) {
 # ifdef HAVE_MLOCK
   struct tls_ticket_key *k;
 
+  if (tls_shm != NULL) {
+    int res, xerrno = 0;
+
+    PRIVS_ROOT
+    res = mlock((void *) tls_shm, tls_shmsz);
+    xerrno = errno;
+    PRIVS_RELINQUISH
+
+    if (res < 0) {
+      pr_log_debug(DEBUG1, MOD_TLS_VERSION
+        ": error locking shared session ticket keys into memory: %s",
+        strerror(xerrno));
+    }
+  }
+
   if (tls_ticket_keys == NULL) {
     return;
   }
@@ -7049,8 +7390,9 @@ static void scrub_ticket_keys(void) {
 static int tls_ticket_key_cb(SSL *ssl, unsigned char *key_name,
     unsigned char *iv, EVP_CIPHER_CTX *cipher_ctx, HMAC_CTX *hmac_ctx,
     int mode) {
-  struct tls_ticket_key *k;
+  struct tls_shm_key key;
   char *key_name_str;
+  int res;
 
   /* Note: should we have a list of ciphers from which we randomly choose,
    * when creating a key?  I.e. should the keys themselves hold references
@@ -7070,14 +7412,12 @@ static int tls_ticket_key_cb(SSL *ssl, unsigned char *key_name,
   if (mode == 1) {
     int ticket_key_len, sess_key_len;
 
-    if (tls_ticket_keys == NULL) {
+    /* Creating a new session ticket.  Always use the newest key. */
+    if (find_ticket_key(NULL, &key) < 0) {
       return -1;
     }
 
-    /* Creating a new session ticket.  Always use the first key in the set. */
-    k = (struct tls_ticket_key *) tls_ticket_keys->xas_list;
-
-    key_name_str = pr_str_bin2hex(session.pool, k->key_name, 16,
+    key_name_str = pr_str_bin2hex(session.pool, key.key_name, 16,
       PR_STR_FL_HEX_USE_LC);
 
     pr_trace_msg(trace_channel, 3,
@@ -7097,41 +7437,48 @@ static int tls_ticket_key_cb(SSL *ssl, unsigned char *key_name,
         SSL_get_cipher_name(ssl), sess_key_len);
     }
 
+    res = 1;
+
     if (RAND_bytes(iv, EVP_CIPHER_iv_length(cipher)) != 1) {
       pr_trace_msg(trace_channel, 3,
         "unable to initialize session ticket key IV: %s", tls_get_errors());
-      return -1;
-    }
+      res = -1;
 
-    if (EVP_EncryptInit_ex(cipher_ctx, cipher, NULL, k->cipher_key, iv) != 1) {
+    } else if (EVP_EncryptInit_ex(cipher_ctx, cipher, NULL, key.cipher_key,
+        iv) != 1) {
       pr_trace_msg(trace_channel, 3,
         "unable to initialize session ticket key cipher: %s", tls_get_errors());
-      return -1;
-    }
+      res = -1;
 
+    } else {
 # if OPENSSL_VERSION_NUMBER >= 0x10000001L
-    if (HMAC_Init_ex(hmac_ctx, k->hmac_key, 32, md, NULL) != 1) {
-      pr_trace_msg(trace_channel, 3,
-        "unable to initialize session ticket key HMAC: %s", tls_get_errors());
-      return -1;
-    }
+      if (HMAC_Init_ex(hmac_ctx, key.hmac_key, 32, md, NULL) != 1) {
+        pr_trace_msg(trace_channel, 3,
+          "unable to initialize session ticket key HMAC: %s", tls_get_errors());
+        res = -1;
+      }
 # else
-    HMAC_Init_ex(hmac_ctx, k->hmac_key, 32, md, NULL);
+      HMAC_Init_ex(hmac_ctx, key.hmac_key, 32, md, NULL);
 # endif /* OpenSSL-1.0.0 and later */
+    }
 
-    memcpy(key_name, k->key_name, 16);
-    return 1;
+    if (res == 1) {
+      memcpy(key_name, key.key_name, 16);
+    }
+
+    pr_memscrub(&key, sizeof(key));
+    return res;
   }
 
   if (mode == 0) {
-    struct tls_ticket_key *newest_key;
+    int newest;
     time_t key_age, now;
 
     key_name_str = pr_str_bin2hex(session.pool, key_name, 16,
       PR_STR_FL_HEX_USE_LC);
 
-    k = get_ticket_key(key_name, 16);
-    if (k == NULL) {
+    newest = find_ticket_key(key_name, &key);
+    if (newest < 0) {
       /* No matching key found. */
       pr_trace_msg(trace_channel, 3,
         "TLS session ticket: decrypting ticket using key name '%s': "
@@ -7143,19 +7490,31 @@ static int tls_ticket_key_cb(SSL *ssl, unsigned char *key_name,
       "TLS session ticket: decrypting ticket using key name '%s'",
       key_name_str);
 
+    res = 1;
+
 # if OPENSSL_VERSION_NUMBER >= 0x10000001L
-    if (HMAC_Init_ex(hmac_ctx, k->hmac_key, 32, md, NULL) != 1) {
+    if (HMAC_Init_ex(hmac_ctx, key.hmac_key, 32, md, NULL) != 1) {
       pr_trace_msg(trace_channel, 3,
         "unable to initialize session ticket key HMAC: %s", tls_get_errors());
-      return 0;
+      res = 0;
     }
 # else
-    HMAC_Init_ex(hmac_ctx, k->hmac_key, 32, md, NULL);
+    HMAC_Init_ex(hmac_ctx, key.hmac_key, 32, md, NULL);
 # endif /* OpenSSL-1.0.0 and later */
 
-    if (EVP_DecryptInit_ex(cipher_ctx, cipher, NULL, k->cipher_key, iv) != 1) {
+    if (res == 1 &&
+        EVP_DecryptInit_ex(cipher_ctx, cipher, NULL, key.cipher_key,
+          iv) != 1) {
       pr_trace_msg(trace_channel, 3,
         "unable to initialize session ticket key cipher: %s", tls_get_errors());
+      res = 0;
+    }
+
+    time(&now);
+    key_age = now - key.created;
+    pr_memscrub(&key, sizeof(key));
+
+    if (res == 0) {
       return 0;
     }
 
@@ -7163,14 +7522,12 @@ static int tls_ticket_key_cb(SSL *ssl, unsigned char *key_name,
      * get a new ticket.  This helps to reduce the window of time a given
      * ticket key is used.
      */
-    time(&now);
-    key_age = now - k->created;
-
-    newest_key = (struct tls_ticket_key *) tls_ticket_keys->xas_list;
-    if (k != newest_key) {
+    if (newest == 0 &&
+        find_ticket_key(NULL, &key) > 0) {
       time_t newest_age;
 
-      newest_age = now - newest_key->created;
+      newest_age = now - key.created;
+      pr_memscrub(&key, sizeof(key));
 
       pr_trace_msg(trace_channel, 3,
         "key '%s' age (%lu %s) older than newest key (%lu %s), requesting "
@@ -7599,8 +7956,18 @@ static SSL_CTX *tls_init_ctx(server_rec *s) {
 #if defined(TLS_USE_SESSION_TICKETS)
   c = find_config(s->conf, CONF_PARAM, "TLSSessionTicketKeys", FALSE);
   if (c != NULL) {
-    tls_ticket_key_max_age = *((unsigned int *) c->argv[0]);
-    tls_ticket_key_max_count = *((unsigned int *) c->argv[1]);
+    int max_age, max_count;
+
+    /* Either parameter may have been omitted (-1), keeping the default. */
+    max_age = *((int *) c->argv[0]);
+    if (max_age > 0) {
+      tls_ticket_key_max_age = max_age;
+    }
+
+    max_count = *((int *) c->argv[1]);
+    if (max_count > 0) {
+      tls_ticket_key_max_count = max_count;
+    }
   }
 
   /* Generate a random session ticket key, if necessary.  Maybe this list
@@ -7641,11 +8008,12 @@ static SSL_CTX *tls_init_ctx(server_rec *s) {
     pr_timer_add(new_ticket_key_intvl, -1, &tls_module, new_ticket_key_timer_cb,
       "New TLS Session Ticket Key");
 
-  } else {
+  } else if (getpid() == mpid) {
     struct tls_ticket_key *k;
 
     /* Generate a new key on restart, as part of a good cryptographic
-     * hygiene.
+     * hygiene.  Session processes (e.g. when switching contexts for SNI)
+     * keep using the daemon's keys.
      */
     pr_log_debug(DEBUG9, MOD_TLS_VERSION ": generating TLS session ticket key");
 
@@ -8241,6 +8609,7 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
       pr_event_generate("mod_tls.ctrl-handshake-failed", &errcode);
     }
 
+    tls_shm_count_handshake(ssl, TRUE);
     tls_end_sess(ssl, on_data ? session.d : session.c, 0);
     return -3;
   }
@@ -8248,6 +8617,7 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
   pr_trace_msg(trace_channel, 17,
     "TLS handshake on %s conn fd %d COMPLETED", on_data ? "data" : "ctrl",
     conn->rfd);
+  tls_shm_count_handshake(ssl, FALSE);
 
   if (on_data == TRUE) {
     if (conn->use_nodelay == FALSE) {
@@ -12070,6 +12440,37 @@ static int tls_handle_ocspcache(pr_ctrls_t *ctrl, int reqargc, char **reqargv) {
   return PR_CTRLS_STATUS_UNSUPPORTED_OPERATION;
 }
 
+static int tls_handle_stats(pr_ctrls_t *ctrl, int reqargc, char **reqargv) {
+  unsigned long full, resumed, psk, failed;
+
+  if (tls_shm == NULL) {
+    pr_ctrls_add_response(ctrl, "tls stats: handshake stats not available");
+    return PR_CTRLS_STATUS_INTERNAL_ERROR;
+  }
+
+  full = tls_shm->full_handshakes;
+  resumed = tls_shm->resumed_handshakes;
+  psk = tls_shm->psk_handshakes;
+  failed = tls_shm->failed_handshakes;
+
+  pr_ctrls_add_response(ctrl, "Full handshakes: %lu", full);
+  pr_ctrls_add_response(ctrl, "Resumed handshakes: %lu", resumed);
+  pr_ctrls_add_response(ctrl, "PSK handshakes: %lu", psk);
+  pr_ctrls_add_response(ctrl, "Failed handshakes: %lu", failed);
+
+  if (full + resumed + psk > 0) {
+    pr_ctrls_add_response(ctrl, "Abbreviated handshake ratio: %.1f%%",
+      ((double) (resumed + psk) * 100.0) / (double) (full + resumed + psk));
+  }
+
+#if defined(TLS_USE_SESSION_TICKETS)
+  pr_ctrls_add_response(ctrl, "Shared session ticket keys: %u (max %u)",
+    tls_shm->key_count, tls_shm->key_max_count);
+#endif /* TLS_USE_SESSION_TICKETS */
+
+  return PR_CTRLS_STATUS_OK;
+}
+
 /* Our main ftpdctl action handler */
 static int tls_handle_tls(pr_ctrls_t *ctrl, int reqargc, char **reqargv) {
 
@@ -12100,6 +12501,16 @@ static int tls_handle_tls(pr_ctrls_t *ctrl, int reqargc, char **reqargv) {
     return tls_handle_ocspcache(ctrl, --reqargc, ++reqargv);
   }
 
+  if (strcmp(reqargv[0], "stats") == 0) {
+    /* Check the ACLs. */
+    if (pr_ctrls_check_acl(ctrl, tls_acttab, "stats") != TRUE) {
+      pr_ctrls_add_response(ctrl, "access denied");
+      return PR_CTRLS_STATUS_ACCESS_DENIED;
+    }
+
+    return tls_handle_stats(ctrl, --reqargc, ++reqargv);
+  }
+
   pr_ctrls_add_response(ctrl, "unknown tls action: '%s'", reqargv[0]);
   return PR_CTRLS_STATUS_UNSUPPORTED_OPERATION;
 }
@@ -12441,9 +12852,11 @@ static pr_netio_stream_t *tls_netio_open_cb(pr_netio_stream_t *nstrm, int fd,
 }
 
 static int tls_netio_poll_cb(pr_netio_stream_t *nstrm) {
+  int res, maxfd, timer_fd;
   fd_set rfds, wfds;
   struct timeval tval;
 
+  polling:
   FD_ZERO(&rfds);
   FD_ZERO(&wfds);
 
@@ -12454,11 +12867,40 @@ static int tls_netio_poll_cb(pr_netio_stream_t *nstrm) {
     FD_SET(nstrm->strm_fd, &wfds);
   }
 
+  maxfd = nstrm->strm_fd;
+
+  timer_fd = pr_timer_get_fd();
+  if (timer_fd >= 0) {
+    FD_SET(timer_fd, &rfds);
+
+    if (timer_fd > maxfd) {
+      maxfd = timer_fd;
+    }
+  }
+
   tval.tv_sec = (nstrm->strm_flags & PR_NETIO_SESS_INTR) ?
     nstrm->strm_interval : 10;
   tval.tv_usec = 0;
 
-  return select(nstrm->strm_fd + 1, &rfds, &wfds, NULL, &tval);
+  res = select(maxfd + 1, &rfds, &wfds, NULL, &tval);
+  if (res > 0 &&
+      timer_fd >= 0 &&
+      FD_ISSET(timer_fd, &rfds)) {
+    pr_timer_process();
+
+    res--;
+    if (res == 0) {
+      if (!(nstrm->strm_flags & (PR_NETIO_SESS_INTR|PR_NETIO_SESS_ABORT))) {
+        goto polling;
+      }
+
+      /* Only the timer fired; treat this as an interrupted poll. */
+      errno = EINTR;
+      res = -1;
+    }
+  }
+
+  return res;
 }
 
 static int tls_netio_postopen_cb(pr_netio_stream_t *nstrm) {
@@ -15783,6 +16225,7 @@ static void tls_mod_unload_ev(const void *event_data, void *user_data) {
 # if defined(TLS_USE_SESSION_TICKETS)
     scrub_ticket_keys();
 # endif /* TLS_USE_SESSION_TICKETS */
+    tls_shm_destroy();
 
 # ifdef PR_USE_CTRLS
     /* Unregister any control actions. */
@@ -15851,15 +16294,13 @@ static void tls_sess_reinit_ev(const void *event_data, void *user_data) {
   }
 }
 
-/* Daemon PID */
-extern pid_t mpid;
-
 static void tls_shutdown_ev(const void *event_data, void *user_data) {
   if (mpid == getpid()) {
     tls_scrub_pkeys();
 #if defined(TLS_USE_SESSION_TICKETS)
     scrub_ticket_keys();
 #endif /* TLS_USE_SESSION_TICKETS */
+    tls_shm_destroy();
     destroy_pool(tls_pool);
     tls_pool = NULL;
   }
@@ -15929,6 +16370,20 @@ static void tls_restart_ev(const void *event_data, void *user_data) {
   tls_closelog();
 }
 
+static void tls_startup_ev(const void *event_data, void *user_data) {
+#if defined(PR_USE_OPENSSL_OCSP)
+  /* Only the standalone daemon process keeps the stapled OCSP responses
+   * fresh; inetd-run sessions query the responders themselves, as needed.
+   */
+  if (ServerType == SERVER_STANDALONE) {
+    (void) tls_ocsp_refresh_start();
+
+    tls_ocsp_refresh_timerno = pr_timer_add(TLS_OCSP_REFRESH_INTERVAL, -1,
+      &tls_module, tls_ocsp_refresh_timer_cb, "OCSP response refresh");
+  }
+#endif /* PR_USE_OPENSSL_OCSP */
+}
+
 static void tls_exit_ev(const void *event_data, void *user_data) {
 
   if (ssl_ctx != NULL) {
@@ -16442,6 +16897,27 @@ static void tls_postparse_ev(const void *event_data, void *user_data) {
   tls_ctx_set_stapling_cache(main_server, ssl_ctx);
   tls_ctx_set_session_id_context(main_server, ssl_ctx);
 
+  /* Map the shared memory for the handshake counters and ticket keys; the
+   * mapping is kept across restarts.
+   */
+  if (tls_shm_create() < 0) {
+    pr_log_debug(DEBUG3, MOD_TLS_VERSION
+      ": unable to share TLS handshake stats/session ticket keys with "
+      "sessions: %s", strerror(errno));
+  }
+#if defined(TLS_USE_SESSION_TICKETS)
+  publish_ticket_keys();
+#endif /* TLS_USE_SESSION_TICKETS */
+
+#if defined(PR_USE_OPENSSL_OCSP)
+  /* If the daemon is already running, i.e. this is a restart, refresh the
+   * OCSP responses for the possibly changed certificates now.
+   */
+  if (tls_ocsp_refresh_timerno > 0) {
+    (void) tls_ocsp_refresh_start();
+  }
+#endif /* PR_USE_OPENSSL_OCSP */
+
   /* We can only get the passphrases for certs once OpenSSL has been
    * initialized.
    */
@@ -18901,6 +19377,315 @@ static int tls_ctx_set_stapling_cache(server_rec *s, SSL_CTX *ctx) {
   return 0;
 }
 
+#if defined(PR_USE_OPENSSL_OCSP)
+static X509 *ocsp_read_cert(const char *path) {
+  BIO *bio;
+  X509 *cert;
+
+  PRIVS_ROOT
+  bio = BIO_new_file(path, "r");
+  PRIVS_RELINQUISH
+
+  if (bio == NULL) {
+    pr_trace_msg(trace_channel, 3, "unable to read certificate '%s': %s",
+      path, tls_get_errors());
+    return NULL;
+  }
+
+  cert = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+  BIO_free(bio);
+
+  if (cert == NULL) {
+    pr_trace_msg(trace_channel, 3, "no certificate found in '%s': %s",
+      path, tls_get_errors());
+  }
+
+  return cert;
+}
+
+/* Make sure that the TLSStaplingCache holds a fresh OCSP response for the
+ * server certificate in the given file, querying the OCSP responder if not.
+ */
+static int ocsp_refresh_cert(pool *p, const char *path) {
+  int res = 0, stale = FALSE;
+  X509 *cert;
+  SSL_CTX *ctx;
+  SSL *ssl;
+  const char *fingerprint, *ocsp_url;
+  OCSP_RESPONSE *cached_resp, *resp;
+
+  cert = ocsp_read_cert(path);
+  if (cert == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  fingerprint = tls_get_fingerprint(p, cert);
+  if (fingerprint == NULL) {
+    X509_free(cert);
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* The issuing certificate is found, and the response is verified, using
+   * the CA certificates and certificate chain of an SSL_CTX, just as during
+   * the handshake.
+   */
+  ctx = SSL_CTX_new(SSLv23_server_method());
+  if (ctx == NULL) {
+    pr_trace_msg(trace_channel, 3, "error allocating SSL_CTX: %s",
+      tls_get_errors());
+    X509_free(cert);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  if (SSL_CTX_use_certificate(ctx, cert) != 1 ||
+      tls_ctx_set_ca_certs(ctx) < 0 ||
+      tls_ctx_set_cert_chain(ctx, NULL, NULL, cert) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error preparing SSL_CTX for certificate '%s': %s", path,
+      tls_get_errors());
+    SSL_CTX_free(ctx);
+    X509_free(cert);
+    errno = EINVAL;
+    return -1;
+  }
+
+  ssl = SSL_new(ctx);
+  if (ssl == NULL) {
+    pr_trace_msg(trace_channel, 3, "error allocating SSL: %s",
+      tls_get_errors());
+    SSL_CTX_free(ctx);
+    X509_free(cert);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  cached_resp = ocsp_get_cached_response(p, fingerprint, cert, ssl, &stale);
+  if (cached_resp != NULL &&
+      stale == FALSE &&
+      OCSP_response_status(cached_resp) == OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+    pr_trace_msg(trace_channel, 15,
+      "cached OCSP response for certificate '%s' (fingerprint '%s') is fresh",
+      path, fingerprint);
+    OCSP_RESPONSE_free(cached_resp);
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    X509_free(cert);
+    return 0;
+  }
+
+  ocsp_url = tls_stapling_responder;
+  if (ocsp_url == NULL) {
+    ocsp_url = ocsp_get_responder_url(p, cert);
+  }
+
+  if (ocsp_url != NULL) {
+    pr_trace_msg(trace_channel, 8,
+      "refreshing OCSP response for certificate '%s' (fingerprint '%s') "
+      "using responder URL '%s'", path, fingerprint, ocsp_url);
+
+    resp = ocsp_request_response(p, cert, ssl, ocsp_url, tls_stapling_timeout);
+    if (resp != NULL) {
+      if (cached_resp != NULL) {
+        if ((tls_ocsp_cache->delete)(tls_ocsp_cache, fingerprint) < 0) {
+          pr_trace_msg(trace_channel, 3,
+            "error deleting OCSP response from '%s' cache for "
+            "fingerprint '%s': %s", tls_ocsp_cache->cache_name,
+            fingerprint, strerror(errno));
+        }
+      }
+
+      res = ocsp_add_cached_response(p, fingerprint, resp);
+      OCSP_RESPONSE_free(resp);
+
+    } else {
+      /* Leave any cached response in place, for the sessions to handle. */
+      res = -1;
+    }
+
+  } else {
+    pr_trace_msg(trace_channel, 5,
+      "no OCSP responder URL found in certificate '%s' (fingerprint '%s')",
+      path, fingerprint);
+    res = -1;
+    errno = ENOENT;
+  }
+
+  if (cached_resp != NULL) {
+    OCSP_RESPONSE_free(cached_resp);
+  }
+
+  SSL_free(ssl);
+  SSL_CTX_free(ctx);
+  X509_free(cert);
+  return res;
+}
+
+static void ocsp_refresh_responses(void) {
+  server_rec *s;
+  pool *tmp_pool;
+
+  tmp_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(tmp_pool, "TLS OCSP refresh pool");
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    unsigned char *engine;
+    const char *cert_files[3];
+    register unsigned int i;
+
+    pr_signals_handle();
+
+    engine = get_param_ptr(s->conf, "TLSEngine", FALSE);
+    if (engine == NULL ||
+        *engine == FALSE) {
+      continue;
+    }
+
+    tls_lookup_all(s);
+    if (tls_stapling == FALSE) {
+      continue;
+    }
+
+    cert_files[0] = tls_rsa_cert_file;
+    cert_files[1] = tls_ec_cert_file;
+    cert_files[2] = tls_dsa_cert_file;
+
+    for (i = 0; i < 3; i++) {
+      if (cert_files[i] == NULL) {
+        continue;
+      }
+
+      if (ocsp_refresh_cert(tmp_pool, cert_files[i]) < 0) {
+        pr_trace_msg(trace_channel, 5,
+          "Server '%s': unable to refresh OCSP response for '%s': %s",
+          s->ServerName, cert_files[i], strerror(errno));
+      }
+    }
+  }
+
+  destroy_pool(tmp_pool);
+}
+
+/* Forget about the OCSP refresh process, closing our end of its pipe. */
+static void tls_ocsp_refresh_close(void) {
+  if (tls_ocsp_refresh_fd >= 0) {
+    (void) close(tls_ocsp_refresh_fd);
+    tls_ocsp_refresh_fd = -1;
+  }
+
+  tls_ocsp_refresh_pid = 0;
+}
+
+/* Returns TRUE if the OCSP refresh process has not yet exited. */
+static int tls_ocsp_refresh_running(void) {
+  char buf;
+  ssize_t res;
+
+  if (tls_ocsp_refresh_fd < 0) {
+    return FALSE;
+  }
+
+  res = read(tls_ocsp_refresh_fd, &buf, 1);
+  if (res < 0 &&
+      (errno == EAGAIN ||
+#if defined(EWOULDBLOCK) && EWOULDBLOCK != EAGAIN
+       errno == EWOULDBLOCK ||
+#endif
+       errno == EINTR)) {
+    return TRUE;
+  }
+
+  pr_trace_msg(trace_channel, 17, "OCSP refresh process (PID %lu) has exited",
+    (unsigned long) tls_ocsp_refresh_pid);
+  tls_ocsp_refresh_close();
+  return FALSE;
+}
+
+/* Fetch any missing or stale OCSP responses in a helper process, so that the
+ * daemon process is not blocked by slow OCSP responders, and the sessions
+ * find fresh responses to staple in the (shared) TLSStaplingCache.
+ */
+static int tls_ocsp_refresh_start(void) {
+  pid_t pid;
+  int fds[2];
+
+  if (tls_ocsp_cache == NULL) {
+    return 0;
+  }
+
+  if (tls_ocsp_refresh_running() == TRUE) {
+    pr_trace_msg(trace_channel, 9,
+      "OCSP refresh process (PID %lu) still running, skipping refresh",
+      (unsigned long) tls_ocsp_refresh_pid);
+    return 0;
+  }
+
+  if (pipe(fds) < 0) {
+    int xerrno = errno;
+
+    pr_log_pri(PR_LOG_WARNING, MOD_TLS_VERSION
+      ": unable to create pipe for OCSP refresh process: %s",
+      strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  pid = fork();
+  switch (pid) {
+    case -1: {
+      int xerrno = errno;
+
+      (void) close(fds[0]);
+      (void) close(fds[1]);
+
+      pr_log_pri(PR_LOG_WARNING, MOD_TLS_VERSION
+        ": unable to fork OCSP refresh process: %s", strerror(xerrno));
+      errno = xerrno;
+      return -1;
+    }
+
+    case 0:
+      /* Child process; the write end is closed when we exit. */
+      (void) close(fds[0]);
+
+      session.pid = getpid();
+      pr_proctitle_set("(refreshing OCSP responses)");
+
+      ocsp_refresh_responses();
+
+      /* Avoid any exit handlers, which would clean up the daemon's state,
+       * e.g. the TLSStaplingCache.
+       */
+      _exit(0);
+
+    default:
+      break;
+  }
+
+  (void) close(fds[1]);
+  (void) fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  if (fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error setting O_NONBLOCK on OCSP refresh pipe: %s", strerror(errno));
+  }
+
+  tls_ocsp_refresh_fd = fds[0];
+  tls_ocsp_refresh_pid = pid;
+  pr_trace_msg(trace_channel, 17, "started OCSP refresh process (PID %lu)",
+    (unsigned long) pid);
+  return 0;
+}
+
+static int tls_ocsp_refresh_timer_cb(CALLBACK_FRAME) {
+  (void) tls_ocsp_refresh_start();
+
+  /* Always restart this timer. */
+  return 1;
+}
+#endif /* PR_USE_OPENSSL_OCSP */
+
 static int tls_ctx_set_verify(SSL_CTX *ctx) {
   int verify_mode = 0;
 
@@ -19091,6 +19876,7 @@ static int tls_init(void) {
   pr_event_register(&tls_module, "core.postparse", tls_postparse_ev, NULL);
   pr_event_register(&tls_module, "core.restart", tls_restart_ev, NULL);
   pr_event_register(&tls_module, "core.shutdown", tls_shutdown_ev, NULL);
+  pr_event_register(&tls_module, "core.startup", tls_startup_ev, NULL);
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
   OPENSSL_config(NULL);
@@ -19137,6 +19923,11 @@ static int tls_sess_init(void) {
   lock_ticket_keys();
 #endif /* TLS_USE_SESSION_TICKETS */
 
+#if defined(PR_USE_OPENSSL_OCSP)
+  /* Sessions have no need for the daemon's OCSP refresh pipe. */
+  tls_ocsp_refresh_close();
+#endif /* PR_USE_OPENSSL_OCSP */
+
   pr_event_register(&tls_module, "core.session-reinit", tls_sess_reinit_ev,
     NULL);
 
@@ -19400,6 +20191,7 @@ static ctrls_acttab_t tls_acttab[] = {
   { "info", NULL, NULL, NULL },
   { "ocspcache", NULL, NULL, NULL },
   { "sesscache", NULL, NULL, NULL },
+  { "stats", NULL, NULL, NULL },
 
   { NULL, NULL, NULL, NULL }
 };
@@ -27,6 +27,12 @@
 #include <rpcsvc/ypclnt.h>
 #endif /* WRAP2_USE_NIS */
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+extern xaset_t *server_list;
+
 typedef struct regtab_obj {
   struct regtab_obj *prev, *next;
 
@@ -1116,335 +1122,1550 @@ static int wrap2_handle_opts(array_header *options, wrap2_conn_t *conn) {
 #define WRAP2_TAB_MATCH	1
 #define WRAP2_TAB_DENY	-1
 
-static int wrap2_match_table(wrap2_table_t *tab, wrap2_conn_t *conn) {
-  register unsigned int i;
-  int res;
-  array_header *daemon_list = NULL, *client_list = NULL, *options_list = NULL;
+/* Compiled tables.
+ *
+ * The client list of a table is compiled into one segment per EXCEPT
+ * clause.  Address patterns (addresses, address prefixes, net/masks) become
+ * entries in binary radix trees, so that checking the client address against
+ * them takes at most one step per address bit; hostname patterns become
+ * lookup tables of names and of name suffixes.  Patterns which need more than
+ * the client address and name (user@host, KNOWN, LOCAL, @netgroup) are kept
+ * as tokens, and matched as they always have been.
+ *
+ * Tables whose contents do not depend on the session ("file:" tables with
+ * fixed paths, and "builtin" tables) are compiled once, by the daemon
+ * process.  Sessions use them for as long as the files from which they were
+ * compiled are unchanged; the daemon recompiles any changed tables
+ * periodically.
+ */
 
-  /* Build daemon list. */
-  daemon_list = tab->tab_fetch_daemons(tab, wrap2_service_name);
-  if (daemon_list == NULL ||
-      daemon_list->nelts == 0) {
-    wrap2_log("%s", "daemon list is empty");
-    return 0;
-  }
+struct wrap2_addr_node {
+  struct wrap2_addr_node *child[2];
 
-  wrap2_log("table daemon list:");
-  for (i = 0; i < daemon_list->nelts; i++) {
-    char **daemons = daemon_list->elts;
-    wrap2_log("  %s", daemons[i] ? daemons[i] : "<null>");
-  }
+  /* The pattern ending at this node, if any. */
+  const char *token;
 
-  /* Build client list. */
-  client_list = tab->tab_fetch_clients(tab, wrap2_client_name);
-  if (client_list == NULL ||
-      client_list->nelts == 0) {
-    wrap2_log("%s", "client list is empty");
-    return 0;
-  }
+  /* Whether the pattern also matches IPv4-mapped IPv6 clients. */
+  int mapped;
+};
 
-  wrap2_log("table client list:");
-  for (i = 0; i < client_list->nelts; i++) {
-    char **clients = client_list->elts;
-    wrap2_log("  %s", clients[i] ? clients[i] : "<null>");
-  }
+struct wrap2_segment {
+  int match_all;
 
-  /* Build options list. */
-  options_list = tab->tab_fetch_options(tab, wrap2_client_name);
-  if (options_list &&
-      options_list->nelts > 0) {
-    wrap2_log("table options list:");
-    for (i = 0; i < options_list->nelts; i++) {
-      char **opts = options_list->elts;
-      wrap2_log("  %s", opts[i] ? opts[i] : "<null>");
-    }
-  }
+  struct wrap2_addr_node *v4_root;
+  struct wrap2_addr_node *v6_root;
 
-  res = wrap2_match_list(daemon_list, conn, wrap2_match_daemon, 0);
-  if (res == FALSE) {
-    return 0;
-  }
+  /* Lowercased hostnames, and hostname suffixes (with the leading period). */
+  pr_table_t *names;
+  pr_table_t *suffixes;
 
-  res = wrap2_match_list(client_list, conn, wrap2_match_client, 0);
-  if (res == FALSE) {
-    return 0;
-  }
+  /* Hostnames whose addresses are compared against the client address. */
+  array_header *fwd_names;
 
-#if defined(WRAP2_USE_OPTIONS)
-  res = wrap2_handle_opts(options_list, conn);
-  if (res == WRAP2_OPT_ALLOW) {
-    return WRAP2_TAB_ALLOW;
-  }
+  /* Patterns handled by wrap2_match_host() and wrap2_match_client(). */
+  array_header *host_tokens;
+  array_header *client_tokens;
+};
 
-  if (res == WRAP2_OPT_DENY) {
-    return WRAP2_TAB_DENY;
-  }
-#endif /* WRAP2_USE_OPTIONS */
+struct wrap2_dep {
+  const char *path;
+  int is_table;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+  time_t ctime;
+};
 
-  return WRAP2_TAB_MATCH;
-}
+typedef struct wrap2_ctab_rec {
+  pool *pool;
+  const char *name;
+  const char *service;
 
-static unsigned char wrap2_allow_access(wrap2_conn_t *conn) {
-  wrap2_table_t *allow_tab = NULL, *deny_tab = NULL;
-  int res;
+  array_header *daemons;
+  array_header *clients;
+  array_header *options;
 
-  /* If the (daemon, client) pair is matched by an entry in the allow
-   * table, access is granted. Otherwise, if the (daemon, client) pair is
-   * matched by an entry in the deny table, access is denied. Otherwise,
-   * access is granted. A non-existent access-control table is treated as an
-   * empty table.
-   */
+  /* The compiled client list: one struct wrap2_segment * per EXCEPT. */
+  array_header *segments;
 
-  /* Open allow table. */
-  allow_tab = wrap2_open_table(wrap2_allow_table);
-  if (allow_tab != NULL) {
-    /* Check the allow table. */
-    wrap2_log("%s", "checking allow table rules");
-    res = wrap2_match_table(allow_tab, conn);
+  /* Files the table was compiled from; only tracked for daemon tables. */
+  array_header *deps;
 
-    /* Close allow table. */
-    wrap2_close_table(allow_tab);
-    destroy_pool(allow_tab->tab_pool);
-    allow_tab = NULL;
+} wrap2_ctab_t;
 
-    /* No need to check the deny table if the verdict is to explicitly allow. */
-    if (res == WRAP2_TAB_ALLOW ||
-        res == WRAP2_TAB_MATCH) {
-      wrap2_allow_table = wrap2_deny_table = NULL;
-      return TRUE;
-    }
+/* Tables compiled by the daemon process. */
+static array_header *wrap2_static_tabs = NULL;
 
-    if (res == WRAP2_TAB_DENY) {
-      wrap2_allow_table = wrap2_deny_table = NULL;
-      return FALSE;
-    }
+#define WRAP2_REFRESH_INTERVAL		30
+static int wrap2_refresh_timerno = -1;
 
-  } else {
-    wrap2_log("error opening allow table: %s", strerror(errno));
-  }
+/* Shared cache of the lists fetched from other table sources (e.g. SQL),
+ * keyed by table, service name, and client name.  The cache is mapped by
+ * the daemon process, and used by all session processes; see WrapCache.
+ */
+#define WRAP2_CACHE_SIZE		256
+#define WRAP2_CACHE_PROBES		4
+#define WRAP2_CACHE_DATASZ		4000
 
-  /* Open deny table. */
-  deny_tab = wrap2_open_table(wrap2_deny_table);
-  if (deny_tab != NULL) {
+struct wrap2_cache_entry {
+  /* Odd while a session is updating the entry. */
+  volatile unsigned int seqno;
 
-    /* Check the deny table. */
-    wrap2_log("%s", "checking deny table rules");
-    res = wrap2_match_table(deny_tab, conn);
+  unsigned int generation;
+  uint32_t key_hash;
+  time_t expires;
 
-    /* Close the deny table. */
-    wrap2_close_table(deny_tab);
-    destroy_pool(deny_tab->tab_pool);
-    deny_tab = NULL;
+  /* Number of daemon, client, and option tokens. */
+  unsigned int counts[3];
 
-    if (res == WRAP2_TAB_DENY ||
-        res == WRAP2_TAB_MATCH) {
-      wrap2_allow_table = wrap2_deny_table = NULL;
-      return FALSE;
-    }
+  /* The key, then the tokens, each NUL-terminated. */
+  size_t datalen;
+  char data[WRAP2_CACHE_DATASZ];
+};
 
-  } else {
-    wrap2_log("error opening deny table: %s", strerror(errno));
+static struct wrap2_cache_entry *wrap2_cache = NULL;
+static unsigned int wrap2_cache_generation = 0;
+static unsigned int wrap2_cache_ttl = 0;
+
+#if defined(__GNUC__)
+# define WRAP2_CACHE_BARRIER()	__sync_synchronize()
+# define WRAP2_CACHE_LOCK(e, s) \
+  __sync_bool_compare_and_swap(&((e)->seqno), (s), (s) + 1)
+#else
+# define WRAP2_CACHE_BARRIER()
+# define WRAP2_CACHE_LOCK(e, s)	((e)->seqno == (s) ? ((e)->seqno++, 1) : 0)
+#endif /* __GNUC__ */
+
+static void wrap2_addr_add(pool *p, struct wrap2_addr_node **root,
+    const unsigned char *addr, unsigned int nbits, const char *token,
+    int mapped) {
+  register unsigned int i;
+  struct wrap2_addr_node *node;
+
+  if (*root == NULL) {
+    *root = pcalloc(p, sizeof(struct wrap2_addr_node));
   }
 
-  wrap2_allow_table = wrap2_deny_table = NULL;
-  return TRUE;
-}
+  node = *root;
+  for (i = 0; i < nbits; i++) {
+    int bit;
 
-/* Boolean OR expression evaluation, returning TRUE if any element in the
- * expression matches, FALSE otherwise.
- */
-static unsigned char wrap2_eval_or_expression(char **acl, array_header *creds) {
-  unsigned char found = FALSE;
-  char *elem = NULL, **list = NULL;
+    bit = (addr[i / 8] >> (7 - (i % 8))) & 1;
+    if (node->child[bit] == NULL) {
+      node->child[bit] = pcalloc(p, sizeof(struct wrap2_addr_node));
+    }
 
-  if (!acl || !*acl || !creds) {
-    return FALSE;
+    node = node->child[bit];
   }
 
-  list = (char **) creds->elts;
+  if (node->token == NULL) {
+    node->token = token;
+  }
 
-  for (; *acl; acl++) {
-    register unsigned int i = 0;
-    elem = *acl;
-    found = FALSE;
+  if (mapped == TRUE) {
+    node->mapped = TRUE;
+  }
+}
 
-    if (*elem == '!') {
-      found = !found;
-      elem++;
-    }
+static const char *wrap2_addr_lookup(struct wrap2_addr_node *node,
+    const unsigned char *addr, unsigned int nbits, int mapped) {
+  register unsigned int i;
 
-    for (i = 0; i < creds->nelts; i++) {
-      if (strcmp(elem, "*") == 0 || (list[i] && strcmp(elem, list[i]) == 0)) {
-        found = !found;
-        break;
-      }
+  for (i = 0; node != NULL; i++) {
+    if (node->token != NULL &&
+        (mapped == FALSE || node->mapped == TRUE)) {
+      return node->token;
     }
 
-    if (found) {
-      return TRUE;
+    if (i == nbits) {
+      break;
     }
+
+    node = node->child[(addr[i / 8] >> (7 - (i % 8))) & 1];
   }
 
-  return FALSE;
+  return NULL;
 }
 
-/* Boolean AND expression evaluation, returning TRUE if every element in the
- * expression matches, FALSE otherwise.
+/* Parses an IPv4 address prefix such as "192.168.", which is matched as a
+ * string prefix of the client address.  Only the canonical (decimal, no
+ * leading zeros) forms can be compiled.
  */
-static unsigned char wrap2_eval_and_expression(char **acl,
-    array_header *creds) {
-  unsigned char found = FALSE;
-  char *elem = NULL, **list = NULL;
-
-  if (!acl || !*acl || !creds) {
-    return FALSE;
-  }
+static int wrap2_parse_v4_prefix(const char *tok, unsigned char *addr,
+    unsigned int *nbits) {
+  unsigned int noctets = 0;
+  const char *ptr = tok;
 
-  list = (char **) creds->elts;
+  memset(addr, 0, 4);
 
-  for (; *acl; acl++) {
-    register unsigned int i = 0;
-    elem = *acl;
-    found = FALSE;
+  while (*ptr) {
+    unsigned int octet = 0, ndigits = 0;
 
-    if (*elem == '!') {
-      found = !found;
-      elem++;
+    while (PR_ISDIGIT(*ptr) &&
+           ndigits < 4) {
+      octet = (octet * 10) + (*ptr - '0');
+      ndigits++;
+      ptr++;
     }
 
-    for (i = 0; i < creds->nelts; i++) {
-      if (list[i] && strcmp(list[i], elem) == 0) {
-        found = !found;
-        break;
-      }
+    if (ndigits == 0 ||
+        ndigits > 3 ||
+        *ptr != '.' ||
+        octet > 255 ||
+        (ndigits > 1 && *(ptr - ndigits) == '0') ||
+        noctets == 3) {
+      return -1;
     }
 
-    if (!found) {
-      return FALSE;
-    }
+    addr[noctets++] = (unsigned char) octet;
+    ptr++;
   }
 
-  return TRUE;
-}
-
-int wrap2_register(const char *srcname,
-    wrap2_table_t *(*srcopen)(pool *, const char *)) {
-
-  /* Note: I know that use of permanent_pool is discouraged as much as
-   * possible, but in this particular instance, I need a pool that
-   * persists across rehashes.
-   *
-   * Ideally, the wrap2_regtab_t struct would have a subpool member;
-   * the objects would have their own pools which could then be
-   * destroyed upon unregistration.
-   */
-  wrap2_regtab_t *regtab = pcalloc(permanent_pool, sizeof(wrap2_regtab_t));
-
-  regtab->regtab_name = pstrdup(permanent_pool, srcname);
-  regtab->regtab_open = srcopen;
-
-  /* Add this object to the list. */
-  if (wrap2_regtab_list) {
-    wrap2_regtab_list->prev = regtab;
-    regtab->next = wrap2_regtab_list;
+  if (noctets == 0) {
+    return -1;
   }
 
-  wrap2_regtab_list = regtab;
+  *nbits = noctets * 8;
   return 0;
 }
 
-int wrap2_unregister(const char *srcname) {
-  if (wrap2_regtab_list) {
-    register wrap2_regtab_t *regtab = NULL;
-
-    for (regtab = wrap2_regtab_list; regtab; regtab = regtab->next) {
-      if (strcmp(regtab->regtab_name, srcname) == 0) {
-
-        if (regtab->prev) {
-          regtab->prev->next = regtab->next;
-
-        } else {
-          wrap2_regtab_list = regtab->next;
-        }
+static int wrap2_parse_netmask(char *tok, unsigned char *addr,
+    unsigned int *nbits) {
+  char *mask_tok;
+  unsigned long net, mask;
+  unsigned int n;
 
-        if (regtab->next) {
-          regtab->next->prev = regtab->prev;
-        }
+  mask_tok = wrap2_strsplit(tok, '/');
+  if (mask_tok == NULL) {
+    return -1;
+  }
 
-        regtab->prev = regtab->next = NULL;
+  net = wrap2_addr_a2n(tok);
+  mask = wrap2_addr_a2n(mask_tok);
+  if (net == INADDR_NONE ||
+      mask == INADDR_NONE) {
+    return -1;
+  }
 
-        /* NOTE: a counter should be kept of the number of unregistrations,
-         * as the memory for a registration is not freed on unregistration.
-         */
-        return 0;
-      }
-    }
+  net = ntohl(net);
+  mask = ntohl(mask);
 
-    errno = ENOENT;
+  /* Only contiguous masks, of networks with no host bits set, map onto a
+   * single prefix.
+   */
+  for (n = 0; n < 32 && (mask & (0x80000000UL >> n)); n++);
+  if ((mask & 0xffffffffUL) != (n == 0 ? 0UL :
+       ((0xffffffffUL << (32 - n)) & 0xffffffffUL)) ||
+      (net & ~mask & 0xffffffffUL) != 0) {
     return -1;
   }
 
-  errno = EPERM;
-  return -1;
-}
-
-/* "builtin" source callbacks. */
+  addr[0] = (net >> 24) & 0xff;
+  addr[1] = (net >> 16) & 0xff;
+  addr[2] = (net >> 8) & 0xff;
+  addr[3] = net & 0xff;
 
-static int builtin_close_cb(wrap2_table_t *tab) {
+  *nbits = n;
   return 0;
 }
 
-static array_header *builtin_fetch_clients_cb(wrap2_table_t *tab,
-    const char *name) {
-  array_header *list = make_array(tab->tab_pool, 1, sizeof(char *));
-
-  *((char **) push_array(list)) = pstrdup(tab->tab_pool, "ALL");
-  return list;
-}
-
-static array_header *builtin_fetch_daemons_cb(wrap2_table_t *tab,
-    const char *name) {
-  array_header *list = make_array(tab->tab_pool, 1, sizeof(char *));
+static char *wrap2_strlower(pool *p, const char *str) {
+  char *lower, *ptr;
 
-  *((char **) push_array(list)) = pstrdup(tab->tab_pool, name);
-  return list;
-}
+  lower = pstrdup(p, str);
+  for (ptr = lower; *ptr; ptr++) {
+    *ptr = tolower((int) *ptr);
+  }
 
-static array_header *builtin_fetch_options_cb(wrap2_table_t *tab,
-    const char *name) {
-  return NULL;
+  return lower;
 }
 
-static wrap2_table_t *builtin_open_cb(pool *parent_pool, const char *srcinfo) {
-  wrap2_table_t *tab = NULL;
-  pool *tab_pool = make_sub_pool(parent_pool);
+static void wrap2_ctab_add_dep(wrap2_ctab_t *ctab, const char *path,
+    struct stat *st, int is_table) {
+  struct wrap2_dep *dep;
 
-  /* Do not allow any parameters other than 'all. */
-  if (strcasecmp(srcinfo, "all") != 0) {
-    wrap2_log("error: unknown builtin parameter: '%s'", srcinfo);
-    destroy_pool(tab_pool);
-    errno = EINVAL;
-    return NULL;
+  if (ctab->deps == NULL) {
+    return;
   }
 
-  tab = (wrap2_table_t *) pcalloc(tab_pool, sizeof(wrap2_table_t));
-  tab->tab_pool = tab_pool;
+  dep = push_array(ctab->deps);
+  dep->path = pstrdup(ctab->pool, path);
+  dep->is_table = is_table;
+  dep->ino = st->st_ino;
+  dep->size = st->st_size;
+  dep->mtime = st->st_mtime;
+  dep->ctime = st->st_ctime;
+}
 
-  tab->tab_name = "builtin";
+static void wrap2_compile_host(wrap2_ctab_t *ctab, struct wrap2_segment *seg,
+    char *tok, int from_include);
 
-  /* Set the necessary callbacks. */
-  tab->tab_close = builtin_close_cb;
-  tab->tab_fetch_clients = builtin_fetch_clients_cb;
-  tab->tab_fetch_daemons = builtin_fetch_daemons_cb;
-  tab->tab_fetch_options = builtin_fetch_options_cb;
+static void wrap2_compile_includes(wrap2_ctab_t *ctab,
+    struct wrap2_segment *seg, char *tok) {
+  pr_fh_t *fh;
+  struct stat st;
+  char buf[PR_TUNABLE_BUFFER_SIZE+1], *line;
 
-  return tab;
-}
+  PRIVS_ROOT
+  fh = pr_fsio_open(tok, O_RDONLY);
+  PRIVS_RELINQUISH
 
-/* Configuration handlers
- */
+  if (fh == NULL) {
+    /* Leave it to wrap2_match_includes() to report the error, at match
+     * time.
+     */
+    *((char **) push_array(seg->host_tokens)) = tok;
+    return;
+  }
 
-/* usage: Wrap{Allow,Deny}Msg mesg */
+  if (pr_fsio_fstat(fh, &st) == 0) {
+    wrap2_ctab_add_dep(ctab, tok, &st, FALSE);
+  }
+
+  memset(buf, '\0', sizeof(buf));
+  line = pr_fsio_getline(buf, sizeof(buf)-1, fh, NULL);
+  while (line != NULL) {
+    pr_signals_handle();
+
+    /* As in wrap2_match_includes(), lines starting with `/' are ignored. */
+    if (*line != '/') {
+      char *next;
+
+      next = strsep(&line, " \t\r\n");
+      while (next != NULL) {
+        if (*next != '\0') {
+          wrap2_compile_host(ctab, seg, pstrdup(ctab->pool, next), TRUE);
+        }
+
+        next = strsep(&line, " \t\r\n");
+      }
+    }
+
+    memset(buf, '\0', sizeof(buf));
+    line = pr_fsio_getline(buf, sizeof(buf)-1, fh, NULL);
+  }
+
+  pr_fsio_close(fh);
+}
+
+/* Compiles a host pattern, in the same order of precedence as used by
+ * wrap2_match_host().  Patterns which cannot be compiled are kept as
+ * tokens.
+ */
+static void wrap2_compile_host(wrap2_ctab_t *ctab, struct wrap2_segment *seg,
+    char *tok, int from_include) {
+  unsigned char addr[16];
+  unsigned int nbits = 0;
+  size_t len;
+
+  tok = wrap2_skip_whitespace(tok);
+  len = strlen(tok);
+  if (len == 0) {
+    return;
+  }
+
+  if (tok[0] == '@' ||
+      strcasecmp(tok, "KNOWN") == 0 ||
+      strcasecmp(tok, "LOCAL") == 0) {
+    *((char **) push_array(seg->host_tokens)) = tok;
+    return;
+  }
+
+  if (strcasecmp(tok, "ALL") == 0) {
+    seg->match_all = TRUE;
+    return;
+  }
+
+  if (tok[len-1] == '.') {
+    /* Address prefix */
+    if (wrap2_parse_v4_prefix(tok, addr, &nbits) == 0) {
+      wrap2_addr_add(ctab->pool, &(seg->v4_root), addr, nbits, tok, FALSE);
+
+    } else {
+      *((char **) push_array(seg->host_tokens)) = tok;
+    }
+
+    return;
+  }
+
+  if (tok[0] == '.') {
+    /* Hostname suffix */
+    if (seg->suffixes == NULL) {
+      seg->suffixes = pr_table_alloc(ctab->pool, 0);
+    }
+
+    if (pr_table_add(seg->suffixes, wrap2_strlower(ctab->pool, tok), tok,
+        0) < 0) {
+      *((char **) push_array(seg->host_tokens)) = tok;
+    }
+
+    return;
+  }
+
+  if (tok[0] == '[') {
+#if defined(PR_USE_IPV6)
+    char *copy, *ptr;
+
+    if (pr_netaddr_use_ipv6()) {
+      copy = pstrdup(ctab->pool, tok + 1);
+      ptr = strchr(copy, ']');
+
+      if (ptr != NULL) {
+        *ptr++ = '\0';
+
+        if (pr_inet_pton(AF_INET6, copy, addr) == 1) {
+          if (*ptr == '\0') {
+            wrap2_addr_add(ctab->pool, &(seg->v6_root), addr, 128, tok,
+              FALSE);
+            return;
+          }
+
+          if (*ptr == '/' &&
+              *(ptr + 1) != '\0' &&
+              strspn(ptr + 1, "0123456789") == strlen(ptr + 1) &&
+              strlen(ptr + 1) <= 3 &&
+              atoi(ptr + 1) <= 128) {
+            wrap2_addr_add(ctab->pool, &(seg->v6_root), addr, atoi(ptr + 1),
+              tok, FALSE);
+            return;
+          }
+        }
+      }
+    }
+#endif /* PR_USE_IPV6 */
+
+    *((char **) push_array(seg->host_tokens)) = tok;
+    return;
+  }
+
+  if (tok[0] == '/') {
+    /* Include file */
+    if (from_include == FALSE) {
+      wrap2_compile_includes(ctab, seg, tok);
+
+    } else {
+      *((char **) push_array(seg->host_tokens)) = tok;
+    }
+
+    return;
+  }
+
+  if (strchr(tok, '/') != NULL) {
+    /* Net/mask */
+    if (wrap2_parse_netmask(pstrdup(ctab->pool, tok), addr, &nbits) == 0) {
+      wrap2_addr_add(ctab->pool, &(seg->v4_root), addr, nbits, tok, FALSE);
+
+    } else {
+      *((char **) push_array(seg->host_tokens)) = tok;
+    }
+
+    return;
+  }
+
+  if (!WRAP2_IS_NOT_INADDR(tok)) {
+    /* IPv4 address; like pr_netaddr_cmp(), this also matches IPv4-mapped
+     * IPv6 clients.
+     */
+    if (pr_inet_pton(AF_INET, tok, addr) == 1) {
+      wrap2_addr_add(ctab->pool, &(seg->v4_root), addr, 32, tok, TRUE);
+
+    } else {
+      *((char **) push_array(seg->host_tokens)) = tok;
+    }
+
+    return;
+  }
+
+  if (strchr(tok, ':') != NULL) {
+    /* Bare IPv6 addresses are left to pr_netaddr_get_addr(). */
+    *((char **) push_array(seg->host_tokens)) = tok;
+    return;
+  }
+
+  /* Hostname: matches either the client name, or (via DNS) the client
+   * address.
+   */
+  if (seg->names == NULL) {
+    seg->names = pr_table_alloc(ctab->pool, 0);
+  }
+
+  if (pr_table_add(seg->names, wrap2_strlower(ctab->pool, tok), tok, 0) < 0) {
+    *((char **) push_array(seg->host_tokens)) = tok;
+    return;
+  }
+
+  *((char **) push_array(seg->fwd_names)) = tok;
+}
+
+static struct wrap2_segment *wrap2_segment_create(wrap2_ctab_t *ctab) {
+  struct wrap2_segment *seg;
+
+  seg = pcalloc(ctab->pool, sizeof(struct wrap2_segment));
+  seg->fwd_names = make_array(ctab->pool, 0, sizeof(char *));
+  seg->host_tokens = make_array(ctab->pool, 0, sizeof(char *));
+  seg->client_tokens = make_array(ctab->pool, 0, sizeof(char *));
+
+  *((struct wrap2_segment **) push_array(ctab->segments)) = seg;
+  return seg;
+}
+
+static void wrap2_compile_clients(wrap2_ctab_t *ctab) {
+  register unsigned int i;
+  struct wrap2_segment *seg;
+  char **tokens;
+
+  seg = wrap2_segment_create(ctab);
+
+  tokens = ctab->clients->elts;
+  for (i = 0; i < ctab->clients->nelts; i++) {
+    char *token;
+
+    if (tokens[i] == NULL) {
+      continue;
+    }
+
+    token = wrap2_skip_whitespace(pstrdup(ctab->pool, tokens[i]));
+    if (*token == '\0') {
+      continue;
+    }
+
+    if (strcasecmp(token, "EXCEPT") == 0) {
+      seg = wrap2_segment_create(ctab);
+      continue;
+    }
+
+    if (strchr(token + 1, '@') != NULL) {
+      /* user@host */
+      *((char **) push_array(seg->client_tokens)) = token;
+      continue;
+    }
+
+    wrap2_compile_host(ctab, seg, token, FALSE);
+  }
+}
+
+static array_header *wrap2_copy_list(pool *p, array_header *list) {
+  register unsigned int i;
+  array_header *copy;
+
+  copy = make_array(p, list != NULL ? list->nelts : 0, sizeof(char *));
+  if (list != NULL) {
+    char **elts;
+
+    elts = list->elts;
+    for (i = 0; i < list->nelts; i++) {
+      *((char **) push_array(copy)) = elts[i] ? pstrdup(p, elts[i]) : NULL;
+    }
+  }
+
+  return copy;
+}
+
+static wrap2_ctab_t *wrap2_ctab_create(pool *parent_pool, const char *name,
+    const char *service, array_header *daemons, array_header *clients,
+    array_header *options, int track_deps) {
+  pool *ctab_pool;
+  wrap2_ctab_t *ctab;
+
+  ctab_pool = make_sub_pool(parent_pool);
+  pr_pool_tag(ctab_pool, "wrap2 compiled table pool");
+
+  ctab = pcalloc(ctab_pool, sizeof(wrap2_ctab_t));
+  ctab->pool = ctab_pool;
+  ctab->name = pstrdup(ctab_pool, name);
+  ctab->service = pstrdup(ctab_pool, service);
+  ctab->daemons = wrap2_copy_list(ctab_pool, daemons);
+  ctab->clients = wrap2_copy_list(ctab_pool, clients);
+  ctab->options = wrap2_copy_list(ctab_pool, options);
+  ctab->segments = make_array(ctab_pool, 1, sizeof(struct wrap2_segment *));
+
+  if (track_deps == TRUE) {
+    ctab->deps = make_array(ctab_pool, 1, sizeof(struct wrap2_dep));
+  }
+
+  wrap2_compile_clients(ctab);
+  return ctab;
+}
+
+/* Opens the named table, fetches its lists, and compiles them. */
+static wrap2_ctab_t *wrap2_ctab_load(pool *parent_pool, const char *name,
+    const char *service, const char *client_name, int track_deps) {
+  wrap2_table_t *tab;
+  wrap2_ctab_t *ctab;
+  array_header *daemons = NULL, *clients = NULL, *options = NULL;
+  struct stat st;
+  int have_st = FALSE;
+  pool *tmp_pool;
+
+  /* Stat the table file before reading it, so that any later change is
+   * noticed.
+   */
+  if (track_deps == TRUE &&
+      strncmp(name, "file:", 5) == 0) {
+    if (pr_fsio_stat(name + 5, &st) < 0) {
+      return NULL;
+    }
+
+    have_st = TRUE;
+  }
+
+  tmp_pool = make_sub_pool(wrap2_pool);
+  tab = wrap2_open_table(pstrdup(tmp_pool, name));
+  if (tab == NULL) {
+    int xerrno = errno;
+
+    destroy_pool(tmp_pool);
+    errno = xerrno;
+    return NULL;
+  }
+
+  daemons = tab->tab_fetch_daemons(tab, service);
+  if (daemons != NULL &&
+      daemons->nelts > 0) {
+    clients = tab->tab_fetch_clients(tab, client_name);
+    if (clients != NULL &&
+        clients->nelts > 0) {
+      options = tab->tab_fetch_options(tab, client_name);
+    }
+  }
+
+  ctab = wrap2_ctab_create(parent_pool, name, service, daemons, clients,
+    options, track_deps);
+
+  wrap2_close_table(tab);
+  destroy_pool(tab->tab_pool);
+  destroy_pool(tmp_pool);
+
+  if (have_st == TRUE) {
+    wrap2_ctab_add_dep(ctab, name + 5, &st, TRUE);
+  }
+
+  return ctab;
+}
+
+/* Checks whether the files a table was compiled from are unchanged.  The
+ * table file itself is opened, rather than just stat'd, so that the caller
+ * must still be able to read it.
+ */
+static int wrap2_ctab_is_current(wrap2_ctab_t *ctab) {
+  register unsigned int i;
+  struct wrap2_dep *deps;
+
+  deps = ctab->deps->elts;
+  for (i = 0; i < ctab->deps->nelts; i++) {
+    struct stat st;
+    int res;
+
+    if (deps[i].is_table == TRUE) {
+      pr_fh_t *fh;
+
+      fh = pr_fsio_open(deps[i].path, O_RDONLY);
+      if (fh == NULL) {
+        return FALSE;
+      }
+
+      res = pr_fsio_fstat(fh, &st);
+      pr_fsio_close(fh);
+
+    } else {
+      PRIVS_ROOT
+      res = pr_fsio_stat(deps[i].path, &st);
+      PRIVS_RELINQUISH
+    }
+
+    if (res < 0 ||
+        st.st_ino != deps[i].ino ||
+        st.st_size != deps[i].size ||
+        st.st_mtime != deps[i].mtime ||
+        st.st_ctime != deps[i].ctime) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Tables which do not depend on the session, and so can be compiled by the
+ * daemon process.
+ */
+static int wrap2_is_static_table(const char *name) {
+  if (strncmp(name, "builtin:", 8) == 0) {
+    return TRUE;
+  }
+
+  if (strncmp(name, "file:", 5) == 0 &&
+      name[5] == '/' &&
+      strstr(name, "%U") == NULL) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void wrap2_precompile_table(const char *name, const char *service) {
+  register unsigned int i;
+  wrap2_ctab_t *ctab, **tabs;
+
+  if (wrap2_is_static_table(name) == FALSE) {
+    return;
+  }
+
+  tabs = wrap2_static_tabs->elts;
+  for (i = 0; i < wrap2_static_tabs->nelts; i++) {
+    if (strcmp(tabs[i]->name, name) == 0 &&
+        strcmp(tabs[i]->service, service) == 0) {
+      return;
+    }
+  }
+
+  ctab = wrap2_ctab_load(wrap2_pool, name, service, "", TRUE);
+  if (ctab == NULL) {
+    pr_trace_msg(trace_channel, 3, "unable to precompile table '%s': %s",
+      name, strerror(errno));
+    return;
+  }
+
+  *((wrap2_ctab_t **) push_array(wrap2_static_tabs)) = ctab;
+  pr_trace_msg(trace_channel, 9,
+    "precompiled table '%s' for service '%s' (%d %s)", name, service,
+    ctab->segments->nelts, ctab->segments->nelts != 1 ? "segments" :
+    "segment");
+}
+
+static void wrap2_precompile_tables(void) {
+  server_rec *s;
+
+  wrap2_static_tabs = make_array(wrap2_pool, 0, sizeof(wrap2_ctab_t *));
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    register unsigned int i;
+    config_rec *c;
+    const char *service;
+    const char *directives[] = {
+      "WrapTables", "WrapUserTables", "WrapGroupTables", NULL
+    };
+
+    c = find_config(s->conf, CONF_PARAM, "WrapEngine", FALSE);
+    if (c == NULL ||
+        *((int *) c->argv[0]) == FALSE) {
+      continue;
+    }
+
+    service = get_param_ptr(s->conf, "WrapServiceName", FALSE);
+    if (service == NULL) {
+      service = WRAP2_DEFAULT_SERVICE_NAME;
+    }
+
+    for (i = 0; directives[i] != NULL; i++) {
+      c = find_config(s->conf, CONF_PARAM, directives[i], TRUE);
+      while (c != NULL) {
+        pr_signals_handle();
+
+        wrap2_precompile_table(c->argv[0], service);
+        wrap2_precompile_table(c->argv[1], service);
+
+        c = find_config_next(c, c->next, CONF_PARAM, directives[i], TRUE);
+      }
+    }
+  }
+}
+
+static int wrap2_refresh_timer_cb(CALLBACK_FRAME) {
+  register unsigned int i;
+  wrap2_ctab_t **tabs;
+
+  if (wrap2_static_tabs == NULL) {
+    return 0;
+  }
+
+  tabs = wrap2_static_tabs->elts;
+  for (i = 0; i < wrap2_static_tabs->nelts; i++) {
+    wrap2_ctab_t *ctab;
+
+    pr_signals_handle();
+
+    if (wrap2_ctab_is_current(tabs[i]) == TRUE) {
+      continue;
+    }
+
+    ctab = wrap2_ctab_load(wrap2_pool, tabs[i]->name, tabs[i]->service, "",
+      TRUE);
+    if (ctab == NULL) {
+      /* Sessions will notice the stale table, and load it themselves. */
+      pr_trace_msg(trace_channel, 3, "unable to recompile table '%s': %s",
+        tabs[i]->name, strerror(errno));
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 9, "recompiled changed table '%s'",
+      ctab->name);
+    destroy_pool(tabs[i]->pool);
+    tabs[i] = ctab;
+  }
+
+  /* Always restart this timer. */
+  return 1;
+}
+
+static uint32_t wrap2_hash_key(const char *key) {
+  uint32_t h = 2166136261UL;
+
+  /* FNV-1a */
+  while (*key) {
+    h ^= (uint32_t) ((unsigned char) *key++);
+    h *= 16777619UL;
+  }
+
+  return h;
+}
+
+static wrap2_ctab_t *wrap2_cache_get(pool *p, const char *key,
+    const char *name) {
+  register unsigned int i;
+  struct wrap2_cache_entry *copy;
+  uint32_t key_hash;
+  size_t keysz;
+  time_t now;
+
+  if (wrap2_cache == NULL) {
+    return NULL;
+  }
+
+  key_hash = wrap2_hash_key(key);
+  keysz = strlen(key) + 1;
+  copy = palloc(p, sizeof(struct wrap2_cache_entry));
+  time(&now);
+
+  for (i = 0; i < WRAP2_CACHE_PROBES; i++) {
+    register unsigned int j;
+    struct wrap2_cache_entry *e;
+    array_header *lists[3];
+    unsigned int seqno;
+    char *ptr, *end;
+
+    e = &(wrap2_cache[(key_hash + i) & (WRAP2_CACHE_SIZE - 1)]);
+
+    seqno = e->seqno;
+    if (seqno & 1) {
+      continue;
+    }
+
+    WRAP2_CACHE_BARRIER();
+
+    if (e->key_hash != key_hash ||
+        e->generation != wrap2_cache_generation ||
+        e->expires <= now) {
+      continue;
+    }
+
+    memcpy((void *) copy, (const void *) e, sizeof(struct wrap2_cache_entry));
+
+    WRAP2_CACHE_BARRIER();
+
+    if (e->seqno != seqno ||
+        copy->datalen > sizeof(copy->data) ||
+        copy->datalen < keysz ||
+        memcmp(copy->data, key, keysz) != 0) {
+      continue;
+    }
+
+    ptr = copy->data + keysz;
+    end = copy->data + copy->datalen;
+
+    for (j = 0; j < 3; j++) {
+      register unsigned int k;
+
+      lists[j] = make_array(p, copy->counts[j], sizeof(char *));
+      for (k = 0; k < copy->counts[j] && ptr < end; k++) {
+        *((char **) push_array(lists[j])) = ptr;
+        ptr += strlen(ptr) + 1;
+      }
+    }
+
+    return wrap2_ctab_create(p, name, wrap2_service_name, lists[0], lists[1],
+      lists[2], FALSE);
+  }
+
+  return NULL;
+}
+
+static void wrap2_cache_set(const char *key, wrap2_ctab_t *ctab) {
+  register unsigned int i;
+  struct wrap2_cache_entry *victim = NULL;
+  array_header *lists[3];
+  uint32_t key_hash;
+  unsigned int seqno, counts[3];
+  size_t datalen;
+  time_t now;
+  char *ptr;
+
+  if (wrap2_cache == NULL ||
+      wrap2_cache_ttl == 0) {
+    return;
+  }
+
+  lists[0] = ctab->daemons;
+  lists[1] = ctab->clients;
+  lists[2] = ctab->options;
+
+  datalen = strlen(key) + 1;
+  for (i = 0; i < 3; i++) {
+    register unsigned int j;
+    char **elts;
+
+    counts[i] = 0;
+    elts = lists[i]->elts;
+    for (j = 0; j < lists[i]->nelts; j++) {
+      if (elts[j] != NULL) {
+        datalen += strlen(elts[j]) + 1;
+        counts[i]++;
+      }
+    }
+  }
+
+  if (datalen > WRAP2_CACHE_DATASZ) {
+    pr_trace_msg(trace_channel, 9,
+      "table '%s' lists too large (%lu bytes) to cache", ctab->name,
+      (unsigned long) datalen);
+    return;
+  }
+
+  key_hash = wrap2_hash_key(key);
+  time(&now);
+
+  /* Reuse the entry for this key if there is one; otherwise use an expired
+   * entry, or the entry expiring soonest.
+   */
+  for (i = 0; i < WRAP2_CACHE_PROBES; i++) {
+    struct wrap2_cache_entry *e;
+
+    e = &(wrap2_cache[(key_hash + i) & (WRAP2_CACHE_SIZE - 1)]);
+    if (e->key_hash == key_hash &&
+        e->generation == wrap2_cache_generation) {
+      victim = e;
+      break;
+    }
+
+    if (victim == NULL ||
+        e->expires < victim->expires) {
+      victim = e;
+    }
+  }
+
+  seqno = victim->seqno;
+  if ((seqno & 1) ||
+      !WRAP2_CACHE_LOCK(victim, seqno)) {
+    /* Another session is updating this entry; let it. */
+    return;
+  }
+
+  WRAP2_CACHE_BARRIER();
+
+  victim->generation = wrap2_cache_generation;
+  victim->key_hash = key_hash;
+  victim->expires = now + wrap2_cache_ttl;
+  victim->datalen = datalen;
+
+  ptr = victim->data;
+  sstrncpy(ptr, key, strlen(key) + 1);
+  ptr += strlen(key) + 1;
+
+  for (i = 0; i < 3; i++) {
+    register unsigned int j;
+    char **elts;
+
+    victim->counts[i] = counts[i];
+    elts = lists[i]->elts;
+    for (j = 0; j < lists[i]->nelts; j++) {
+      if (elts[j] != NULL) {
+        size_t len;
+
+        len = strlen(elts[j]) + 1;
+        memcpy(ptr, elts[j], len);
+        ptr += len;
+      }
+    }
+  }
+
+  WRAP2_CACHE_BARRIER();
+  victim->seqno = seqno + 2;
+
+  pr_trace_msg(trace_channel, 15, "cached lists of table '%s' for %u %s",
+    ctab->name, wrap2_cache_ttl, wrap2_cache_ttl != 1 ? "secs" : "sec");
+}
+
+static void wrap2_cache_create(void) {
+#if defined(HAVE_SYS_MMAN_H) && \
+    (defined(MAP_ANONYMOUS) || defined(MAP_ANON))
+  void *ptr;
+  size_t cachesz;
+  int flags = MAP_SHARED;
+
+  if (wrap2_cache != NULL) {
+    return;
+  }
+
+# if defined(MAP_ANONYMOUS)
+  flags |= MAP_ANONYMOUS;
+# else
+  flags |= MAP_ANON;
+# endif /* MAP_ANONYMOUS */
+
+  cachesz = WRAP2_CACHE_SIZE * sizeof(struct wrap2_cache_entry);
+  ptr = mmap(NULL, cachesz, PROT_READ|PROT_WRITE, flags, -1, 0);
+  if (ptr == MAP_FAILED) {
+    pr_log_debug(DEBUG1, MOD_WRAP2_VERSION
+      ": error mapping %lu bytes for table cache: %s",
+      (unsigned long) cachesz, strerror(errno));
+    return;
+  }
+
+  memset(ptr, 0, cachesz);
+  wrap2_cache = ptr;
+
+  pr_trace_msg(trace_channel, 9, "mapped table cache of %u entries",
+    (unsigned int) WRAP2_CACHE_SIZE);
+#endif /* HAVE_SYS_MMAN_H and MAP_ANON */
+}
+
+static void wrap2_cache_destroy(void) {
+#if defined(HAVE_SYS_MMAN_H)
+  if (wrap2_cache == NULL) {
+    return;
+  }
+
+  (void) munmap((void *) wrap2_cache,
+    WRAP2_CACHE_SIZE * sizeof(struct wrap2_cache_entry));
+  wrap2_cache = NULL;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
+/* Returns the compiled form of the named table: the daemon's precompiled
+ * table if still current, else a cached or freshly loaded one, allocated
+ * from the given pool.
+ */
+static wrap2_ctab_t *wrap2_get_ctab(pool *p, const char *name) {
+  register unsigned int i;
+  wrap2_ctab_t *ctab = NULL;
+  const char *key = NULL;
+
+  if (wrap2_static_tabs != NULL) {
+    wrap2_ctab_t **tabs;
+
+    tabs = wrap2_static_tabs->elts;
+    for (i = 0; i < wrap2_static_tabs->nelts; i++) {
+      if (strcmp(tabs[i]->name, name) != 0 ||
+          strcmp(tabs[i]->service, wrap2_service_name) != 0) {
+        continue;
+      }
+
+      if (wrap2_ctab_is_current(tabs[i]) == TRUE) {
+        wrap2_log("using precompiled table '%s'", name);
+        return tabs[i];
+      }
+
+      wrap2_log("precompiled table '%s' is out of date, reloading", name);
+      break;
+    }
+  }
+
+  if (wrap2_cache != NULL &&
+      wrap2_is_static_table(name) == FALSE &&
+      strncmp(name, "file:", 5) != 0) {
+    key = pstrcat(p, name, "\n", wrap2_service_name, "\n",
+      wrap2_client_name ? wrap2_client_name : "", NULL);
+
+    ctab = wrap2_cache_get(p, key, name);
+    if (ctab != NULL) {
+      wrap2_log("using cached lists for table '%s'", name);
+      return ctab;
+    }
+  }
+
+  ctab = wrap2_ctab_load(p, name, wrap2_service_name, wrap2_client_name,
+    FALSE);
+  if (ctab != NULL &&
+      key != NULL &&
+      ctab->daemons->nelts > 0 &&
+      ctab->clients->nelts > 0) {
+    wrap2_cache_set(key, ctab);
+  }
+
+  return ctab;
+}
+
+static const char *wrap2_match_names(pool *p, struct wrap2_segment *seg,
+    const char *name) {
+  const char *token = NULL;
+  char *lname, *ptr;
+
+  lname = wrap2_strlower(p, name);
+
+  if (seg->names != NULL) {
+    token = pr_table_get(seg->names, lname, NULL);
+    if (token != NULL) {
+      return token;
+    }
+  }
+
+  if (seg->suffixes != NULL) {
+    for (ptr = lname + 1; *ptr; ptr++) {
+      if (*ptr == '.') {
+        token = pr_table_get(seg->suffixes, ptr, NULL);
+        if (token != NULL) {
+          return token;
+        }
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static unsigned char wrap2_match_segment(pool *p, struct wrap2_segment *seg,
+    wrap2_conn_t *conn) {
+  register unsigned int i;
+  const pr_netaddr_t *remote_addr;
+  const char *token = NULL;
+  char **tokens;
+
+  if (seg->match_all == TRUE) {
+    wrap2_log("%s", "client matches 'ALL'");
+    return TRUE;
+  }
+
+  remote_addr = session.c->remote_addr;
+
+  switch (pr_netaddr_get_family(remote_addr)) {
+    case AF_INET:
+      token = wrap2_addr_lookup(seg->v4_root,
+        pr_netaddr_get_inaddr(remote_addr), 32, FALSE);
+      break;
+
+#if defined(PR_USE_IPV6)
+    case AF_INET6: {
+      const unsigned char *inaddr;
+
+      inaddr = pr_netaddr_get_inaddr(remote_addr);
+      token = wrap2_addr_lookup(seg->v6_root, inaddr, 128, FALSE);
+      if (token == NULL &&
+          pr_netaddr_is_v4mappedv6(remote_addr) == TRUE) {
+        token = wrap2_addr_lookup(seg->v4_root, inaddr + 12, 32, TRUE);
+      }
+      break;
+    }
+#endif /* PR_USE_IPV6 */
+  }
+
+  if (token != NULL) {
+    wrap2_log("client matches '%s'", token);
+    return TRUE;
+  }
+
+  tokens = seg->host_tokens->elts;
+  for (i = 0; i < seg->host_tokens->nelts; i++) {
+    if (wrap2_match_host(pstrdup(p, tokens[i]), conn->client)) {
+      wrap2_log("client matches '%s'", tokens[i]);
+      return TRUE;
+    }
+  }
+
+  tokens = seg->client_tokens->elts;
+  for (i = 0; i < seg->client_tokens->nelts; i++) {
+    if (wrap2_match_client(pstrdup(p, tokens[i]), conn)) {
+      return TRUE;
+    }
+  }
+
+  if (seg->names != NULL ||
+      seg->suffixes != NULL) {
+    token = wrap2_match_names(p, seg, wrap2_get_hostname(conn->client));
+
+    if (token == NULL &&
+        (wrap2_opts & WRAP_OPT_CHECK_ALL_NAMES)) {
+      array_header *dns_names;
+
+      dns_names = pr_netaddr_get_dnsstr_list(session.pool, remote_addr);
+      if (dns_names != NULL) {
+        char **names;
+
+        names = dns_names->elts;
+        for (i = 0; token == NULL && i < dns_names->nelts; i++) {
+          if (names[i] != NULL) {
+            token = wrap2_match_names(p, seg, names[i]);
+          }
+        }
+      }
+    }
+
+    if (token != NULL) {
+      wrap2_log("client matches '%s'", token);
+      return TRUE;
+    }
+  }
+
+  tokens = seg->fwd_names->elts;
+  for (i = 0; i < seg->fwd_names->nelts; i++) {
+    const pr_netaddr_t *acl_addr;
+
+    acl_addr = pr_netaddr_get_addr(p, tokens[i], NULL);
+    if (acl_addr == NULL) {
+      wrap2_log("unable to handle address '%s'", tokens[i]);
+      continue;
+    }
+
+    if (pr_netaddr_cmp(remote_addr, acl_addr) == 0) {
+      wrap2_log("client matches '%s'", tokens[i]);
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Same semantics as wrap2_match_list(): a segment matches if any of its
+ * patterns match, and the following (EXCEPT) segment does not.
+ */
+static unsigned char wrap2_match_segments(pool *p, array_header *segments,
+    unsigned int idx, wrap2_conn_t *conn) {
+  struct wrap2_segment **segs;
+
+  if (idx >= segments->nelts) {
+    return FALSE;
+  }
+
+  segs = segments->elts;
+  if (wrap2_match_segment(p, segs[idx], conn) == FALSE) {
+    return FALSE;
+  }
+
+  if (idx + 1 < segments->nelts) {
+    return (wrap2_match_segments(p, segments, idx + 1, conn) == FALSE);
+  }
+
+  return TRUE;
+}
+
+static int wrap2_match_ctab(pool *p, wrap2_ctab_t *ctab, wrap2_conn_t *conn) {
+  register unsigned int i;
+  int res;
+  char **elts;
+
+  if (ctab->daemons->nelts == 0) {
+    wrap2_log("%s", "daemon list is empty");
+    return 0;
+  }
+
+  wrap2_log("table daemon list:");
+  elts = ctab->daemons->elts;
+  for (i = 0; i < ctab->daemons->nelts; i++) {
+    wrap2_log("  %s", elts[i] ? elts[i] : "<null>");
+  }
+
+  if (ctab->clients->nelts == 0) {
+    wrap2_log("%s", "client list is empty");
+    return 0;
+  }
+
+  wrap2_log("table client list:");
+  elts = ctab->clients->elts;
+  for (i = 0; i < ctab->clients->nelts; i++) {
+    wrap2_log("  %s", elts[i] ? elts[i] : "<null>");
+  }
+
+  if (ctab->options->nelts > 0) {
+    wrap2_log("table options list:");
+    elts = ctab->options->elts;
+    for (i = 0; i < ctab->options->nelts; i++) {
+      wrap2_log("  %s", elts[i] ? elts[i] : "<null>");
+    }
+  }
+
+  /* Matching modifies the tokens, so use copies of the lists. */
+  res = wrap2_match_list(wrap2_copy_list(p, ctab->daemons), conn,
+    wrap2_match_daemon, 0);
+  if (res == FALSE) {
+    return 0;
+  }
+
+  res = wrap2_match_segments(p, ctab->segments, 0, conn);
+  if (res == FALSE) {
+    return 0;
+  }
+
+#if defined(WRAP2_USE_OPTIONS)
+  res = wrap2_handle_opts(wrap2_copy_list(p, ctab->options), conn);
+  if (res == WRAP2_OPT_ALLOW) {
+    return WRAP2_TAB_ALLOW;
+  }
+
+  if (res == WRAP2_OPT_DENY) {
+    return WRAP2_TAB_DENY;
+  }
+#endif /* WRAP2_USE_OPTIONS */
+
+  return WRAP2_TAB_MATCH;
+}
+
+static unsigned char wrap2_allow_access(wrap2_conn_t *conn) {
+  wrap2_ctab_t *allow_tab = NULL, *deny_tab = NULL;
+  pool *tmp_pool;
+  int res;
+
+  /* If the (daemon, client) pair is matched by an entry in the allow
+   * table, access is granted. Otherwise, if the (daemon, client) pair is
+   * matched by an entry in the deny table, access is denied. Otherwise,
+   * access is granted. A non-existent access-control table is treated as an
+   * empty table.
+   */
+
+  tmp_pool = make_sub_pool(wrap2_pool);
+  pr_pool_tag(tmp_pool, "wrap2 access check pool");
+
+  /* Get the allow table. */
+  allow_tab = wrap2_get_ctab(tmp_pool, wrap2_allow_table);
+  if (allow_tab != NULL) {
+    /* Check the allow table. */
+    wrap2_log("%s", "checking allow table rules");
+    res = wrap2_match_ctab(tmp_pool, allow_tab, conn);
+
+    /* No need to check the deny table if the verdict is to explicitly allow. */
+    if (res == WRAP2_TAB_ALLOW ||
+        res == WRAP2_TAB_MATCH) {
+      destroy_pool(tmp_pool);
+      wrap2_allow_table = wrap2_deny_table = NULL;
+      return TRUE;
+    }
+
+    if (res == WRAP2_TAB_DENY) {
+      destroy_pool(tmp_pool);
+      wrap2_allow_table = wrap2_deny_table = NULL;
+      return FALSE;
+    }
+
+  } else {
+    wrap2_log("error opening allow table: %s", strerror(errno));
+  }
+
+  /* Get the deny table. */
+  deny_tab = wrap2_get_ctab(tmp_pool, wrap2_deny_table);
+  if (deny_tab != NULL) {
+
+    /* Check the deny table. */
+    wrap2_log("%s", "checking deny table rules");
+    res = wrap2_match_ctab(tmp_pool, deny_tab, conn);
+
+    if (res == WRAP2_TAB_DENY ||
+        res == WRAP2_TAB_MATCH) {
+      destroy_pool(tmp_pool);
+      wrap2_allow_table = wrap2_deny_table = NULL;
+      return FALSE;
+    }
+
+  } else {
+    wrap2_log("error opening deny table: %s", strerror(errno));
+  }
+
+  destroy_pool(tmp_pool);
+  wrap2_allow_table = wrap2_deny_table = NULL;
+  return TRUE;
+}
+
+/* Boolean OR expression evaluation, returning TRUE if any element in the
+ * expression matches, FALSE otherwise.
+ */
+static unsigned char wrap2_eval_or_expression(char **acl, array_header *creds) {
+  unsigned char found = FALSE;
+  char *elem = NULL, **list = NULL;
+
+  if (!acl || !*acl || !creds) {
+    return FALSE;
+  }
+
+  list = (char **) creds->elts;
+
+  for (; *acl; acl++) {
+    register unsigned int i = 0;
+    elem = *acl;
+    found = FALSE;
+
+    if (*elem == '!') {
+      found = !found;
+      elem++;
+    }
+
+    for (i = 0; i < creds->nelts; i++) {
+      if (strcmp(elem, "*") == 0 || (list[i] && strcmp(elem, list[i]) == 0)) {
+        found = !found;
+        break;
+      }
+    }
+
+    if (found) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Boolean AND expression evaluation, returning TRUE if every element in the
+ * expression matches, FALSE otherwise.
+ */
+static unsigned char wrap2_eval_and_expression(char **acl,
+    array_header *creds) {
+  unsigned char found = FALSE;
+  char *elem = NULL, **list = NULL;
+
+  if (!acl || !*acl || !creds) {
+    return FALSE;
+  }
+
+  list = (char **) creds->elts;
+
+  for (; *acl; acl++) {
+    register unsigned int i = 0;
+    elem = *acl;
+    found = FALSE;
+
+    if (*elem == '!') {
+      found = !found;
+      elem++;
+    }
+
+    for (i = 0; i < creds->nelts; i++) {
+      if (list[i] && strcmp(list[i], elem) == 0) {
+        found = !found;
+        break;
+      }
+    }
+
+    if (!found) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+int wrap2_register(const char *srcname,
+    wrap2_table_t *(*srcopen)(pool *, const char *)) {
+
+  /* Note: I know that use of permanent_pool is discouraged as much as
+   * possible, but in this particular instance, I need a pool that
+   * persists across rehashes.
+   *
+   * Ideally, the wrap2_regtab_t struct would have a subpool member;
+   * the objects would have their own pools which could then be
+   * destroyed upon unregistration.
+   */
+  wrap2_regtab_t *regtab = pcalloc(permanent_pool, sizeof(wrap2_regtab_t));
+
+  regtab->regtab_name = pstrdup(permanent_pool, srcname);
+  regtab->regtab_open = srcopen;
+
+  /* Add this object to the list. */
+  if (wrap2_regtab_list) {
+    wrap2_regtab_list->prev = regtab;
+    regtab->next = wrap2_regtab_list;
+  }
+
+  wrap2_regtab_list = regtab;
+  return 0;
+}
+
+int wrap2_unregister(const char *srcname) {
+  if (wrap2_regtab_list) {
+    register wrap2_regtab_t *regtab = NULL;
+
+    for (regtab = wrap2_regtab_list; regtab; regtab = regtab->next) {
+      if (strcmp(regtab->regtab_name, srcname) == 0) {
+
+        if (regtab->prev) {
+          regtab->prev->next = regtab->next;
+
+        } else {
+          wrap2_regtab_list = regtab->next;
+        }
+
+        if (regtab->next) {
+          regtab->next->prev = regtab->prev;
+        }
+
+        regtab->prev = regtab->next = NULL;
+
+        /* NOTE: a counter should be kept of the number of unregistrations,
+         * as the memory for a registration is not freed on unregistration.
+         */
+        return 0;
+      }
+    }
+
+    errno = ENOENT;
+    return -1;
+  }
+
+  errno = EPERM;
+  return -1;
+}
+
+/* "builtin" source callbacks. */
+
+static int builtin_close_cb(wrap2_table_t *tab) {
+  return 0;
+}
+
+static array_header *builtin_fetch_clients_cb(wrap2_table_t *tab,
+    const char *name) {
+  array_header *list = make_array(tab->tab_pool, 1, sizeof(char *));
+
+  *((char **) push_array(list)) = pstrdup(tab->tab_pool, "ALL");
+  return list;
+}
+
+static array_header *builtin_fetch_daemons_cb(wrap2_table_t *tab,
+    const char *name) {
+  array_header *list = make_array(tab->tab_pool, 1, sizeof(char *));
+
+  *((char **) push_array(list)) = pstrdup(tab->tab_pool, name);
+  return list;
+}
+
+static array_header *builtin_fetch_options_cb(wrap2_table_t *tab,
+    const char *name) {
+  return NULL;
+}
+
+static wrap2_table_t *builtin_open_cb(pool *parent_pool, const char *srcinfo) {
+  wrap2_table_t *tab = NULL;
+  pool *tab_pool = make_sub_pool(parent_pool);
+
+  /* Do not allow any parameters other than 'all. */
+  if (strcasecmp(srcinfo, "all") != 0) {
+    wrap2_log("error: unknown builtin parameter: '%s'", srcinfo);
+    destroy_pool(tab_pool);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  tab = (wrap2_table_t *) pcalloc(tab_pool, sizeof(wrap2_table_t));
+  tab->tab_pool = tab_pool;
+
+  tab->tab_name = "builtin";
+
+  /* Set the necessary callbacks. */
+  tab->tab_close = builtin_close_cb;
+  tab->tab_fetch_clients = builtin_fetch_clients_cb;
+  tab->tab_fetch_daemons = builtin_fetch_daemons_cb;
+  tab->tab_fetch_options = builtin_fetch_options_cb;
+
+  return tab;
+}
+
+/* Configuration handlers
+ */
+
+/* usage: Wrap{Allow,Deny}Msg mesg */
 MODRET set_wrapmsg(cmd_rec *cmd) {
   config_rec *c = NULL;
 
@@ -1458,6 +2679,32 @@ MODRET set_wrapmsg(cmd_rec *cmd) {
 }
 
 /* usage: WrapEngine on|off */
+/* usage: WrapCache off|ttl */
+MODRET set_wrapcache(cmd_rec *cmd) {
+  config_rec *c;
+  int ttl = 0;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (strcasecmp(cmd->argv[1], "off") != 0) {
+    char *ptr = NULL;
+
+    ttl = (int) strtol(cmd->argv[1], &ptr, 10);
+    if ((ptr && *ptr) ||
+        ttl < 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted TTL '",
+        cmd->argv[1], "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = ttl;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_wrapengine(cmd_rec *cmd) {
   int engine = -1;
   config_rec *c = NULL;
@@ -1971,6 +3218,10 @@ static void wrap2_mod_unload_ev(const void *event_data, void *user_data) {
 
   wrap2_unregister("builtin");
 
+  pr_timer_remove(-1, &wrap2_module);
+  wrap2_cache_destroy();
+  wrap2_static_tabs = NULL;
+
   if (wrap2_pool != NULL) {
     destroy_pool(wrap2_pool);
     wrap2_pool = NULL;
@@ -1981,12 +3232,52 @@ static void wrap2_mod_unload_ev(const void *event_data, void *user_data) {
 }
 #endif /* PR_SHARED_MODULE */
 
+static void wrap2_postparse_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+
+  /* The cache is created once, in the daemon process, and kept across
+   * restarts; entries from before a restart are not used.
+   */
+  wrap2_cache_ttl = 0;
+  wrap2_cache_generation++;
+
+  c = find_config(main_server->conf, CONF_PARAM, "WrapCache", FALSE);
+  if (c != NULL) {
+    wrap2_cache_ttl = *((unsigned int *) c->argv[0]);
+  }
+
+  if (wrap2_cache_ttl > 0) {
+    wrap2_cache_create();
+
+  } else {
+    wrap2_cache_destroy();
+  }
+
+  wrap2_precompile_tables();
+
+  if (wrap2_static_tabs->nelts > 0 &&
+      ServerType == SERVER_STANDALONE) {
+    wrap2_refresh_timerno = pr_timer_add(WRAP2_REFRESH_INTERVAL, -1,
+      &wrap2_module, wrap2_refresh_timer_cb, "wrap2 table refresh");
+  }
+}
+
 static void wrap2_restart_ev(const void *event_data, void *user_data) {
 
   /* Bounce the log file descriptor. */
   wrap2_closelog();
   wrap2_openlog();
 
+  /* The precompiled tables are allocated from the module pool; they will be
+   * compiled again once the configuration has been reparsed.
+   */
+  if (wrap2_refresh_timerno > 0) {
+    pr_timer_remove(wrap2_refresh_timerno, &wrap2_module);
+    wrap2_refresh_timerno = -1;
+  }
+
+  wrap2_static_tabs = NULL;
+
   /* Reset the module's memory pool. */
   destroy_pool(wrap2_pool);
   wrap2_pool = make_sub_pool(permanent_pool);
@@ -2035,6 +3326,8 @@ static int wrap2_init(void) {
   pr_event_register(&wrap2_module, "core.module-unload", wrap2_mod_unload_ev,
     NULL);
 #endif /* PR_SHARED_MODULE */
+  pr_event_register(&wrap2_module, "core.postparse", wrap2_postparse_ev,
+    NULL);
   pr_event_register(&wrap2_module, "core.restart", wrap2_restart_ev, NULL);
 
   /* Initialize the source object for type "builtin". */
@@ -2135,6 +3428,7 @@ static int wrap2_sess_init(void) {
 
 static conftable wrap2_conftab[] = {
   { "WrapAllowMsg",		set_wrapmsg,		NULL },
+  { "WrapCache",		set_wrapcache,		NULL },
   { "WrapDenyMsg",		set_wrapmsg,		NULL },
   { "WrapEngine",		set_wrapengine,		NULL },
   { "WrapGroupTables",		set_wrapgrouptables,	NULL },
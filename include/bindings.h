@@ -50,12 +50,16 @@ typedef struct ipbind_rec {
    */
   conn_t *ib_listener;
 
-  /* List of name-based servers bound to the above IP address.  Note that
-   * if this functionality becomes widely adopted and used, a more efficient
-   * search-and-lookup mechanism will be needed, for performance reasons.
+  /* List of name-based servers bound to the above IP address, in the order
+   * in which they were created.
    */
   array_header *ib_namebinds;
 
+  /* Index of the above namebinds, for lookups by name without scanning
+   * the entire list.
+   */
+  struct namebind_index_rec *ib_namebind_index;
+
   /* If this binding is the DefaultServer binding */
   unsigned char ib_isdefault;
 
@@ -75,6 +79,13 @@ typedef struct namebind_rec {
   server_rec *nb_server;
   unsigned int nb_server_port;
 
+  /* Internal use: the creation order of this namebind, and its place in
+   * the namebind index of its ipbind.
+   */
+  unsigned int nb_idx;
+  unsigned int nb_hash;
+  struct namebind_rec *nb_hash_next;
+
 } pr_namebind_t;
 
 /* Define the size of the hash table used to store server configurations.
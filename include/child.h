@@ -35,6 +35,10 @@ typedef struct child {
   int ch_pipefd;
 
   unsigned char ch_dead;
+
+  /* For the PID index, and the list of reaped children. */
+  struct child *ch_hash_next;
+  struct child *ch_dead_next;
 } pr_child_t;
 
 int child_add(pid_t, int);
@@ -79,6 +79,20 @@ void pr_event_generate(const char *event, const void *event_data);
  */
 int pr_event_listening(const char *event);
 
+/* Returns the ID for the given event name, interning the name if it has
+ * not been seen before, or -1 (with errno set appropriately) if there was
+ * an error.  Event IDs remain valid for the lifetime of the process, and
+ * so may be looked up once and cached by callers which generate an event
+ * often, e.g. for every read or write.
+ */
+int pr_event_get_id(const char *event);
+
+/* As pr_event_generate() and pr_event_listening(), using an event ID
+ * obtained from pr_event_get_id(), rather than the event name.
+ */
+void pr_event_generate_id(int event_id, const void *event_data);
+int pr_event_listening_id(int event_id);
+
 /* Dump Events information. */
 void pr_event_dump(void (*)(const char *, ...));
 
@@ -412,6 +412,23 @@ int pr_fs_copy_file2(const char *src, const char *dst, int flags,
   void (*progress_cb)(int));
 #define PR_FSIO_COPY_FILE_FL_NO_DELETE_ON_FAILURE	0x0001
 
+/* Remove the given directory, and everything beneath it.  Symlinks are
+ * removed, not followed.  A directory's contents are removed before the
+ * directory itself.
+ *
+ * The optional pre_cb is invoked with the path of each entry, and whether
+ * it is a directory, just before that entry is removed; returning -1 from
+ * it (with errno set) stops the removal.  The optional post_cb is then
+ * invoked with the result, and errno, of the removal (or of the pre_cb).
+ *
+ * Returns 0 if the entire tree was removed, otherwise -1 and errno,
+ * stopping at the first failure.
+ */
+int pr_fs_remove_tree(pool *p, const char *path,
+  int (*pre_cb)(pool *, const char *, int, void *),
+  void (*post_cb)(pool *, const char *, int, int, int, void *),
+  void *user_data);
+
 int pr_fs_setcwd(const char *);
 const char *pr_fs_getcwd(void);
 const char *pr_fs_getvwd(void);
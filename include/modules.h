@@ -167,6 +167,24 @@ void modules_list2(int (*listf)(const char *, ...), int flags);
 
 int modules_session_init(void);
 
+/* Session templates are per-server, module-specific data which a module
+ * computes once in the daemon process, typically when handling the
+ * 'core.postparse' event, rather than in each session process.  Session
+ * processes inherit the templates at fork, and can look them up in their
+ * sess_init callbacks, using the main_server for that session.
+ *
+ * The template data must be allocated from a pool which lasts as long as
+ * the configuration, e.g. the server_rec pool.  All templates are cleared
+ * when the daemon restarts.
+ */
+int pr_module_set_session_template(module *m, server_rec *s, void *tmpl);
+void *pr_module_get_session_template(module *m, server_rec *s);
+
+/* Clears the session templates for the given module, or for all modules
+ * if NULL.
+ */
+int pr_module_clear_session_templates(module *m);
+
 unsigned char pr_module_exists(const char *);
 module *pr_module_get(const char *);
 int pr_module_load(module *m);
@@ -106,6 +106,14 @@
 # define PR_TUNABLE_XFER_BUFFER_SIZE	PR_TUNABLE_BUFFER_SIZE
 #endif
 
+/* How much data to ask copy_file_range(2) to copy at a time, when copying
+ * files on the server.  Progress callbacks, which keep the session's idle
+ * timers from firing, are invoked after each such chunk.
+ */
+#ifndef PR_TUNABLE_COPY_FILE_RANGE_SIZE
+# define PR_TUNABLE_COPY_FILE_RANGE_SIZE	(4 * 1024 * 1024)
+#endif
+
 /* Maximum FTP command size.  For details on this size of 512KB, see
  * the Bug#4014 discussion.
  */
@@ -198,6 +206,17 @@
 # define PR_TUNABLE_XFER_SCOREBOARD_UPDATES	10
 #endif
 
+/* Minimum number of milliseconds between checks of the control connection
+ * for commands (e.g. ABOR, STAT) during a data transfer.  Checking before
+ * every chunk of data costs a select(2) per chunk; a longer interval means
+ * fewer such calls, at the cost of slower responses to those commands.  Set
+ * this to zero to check before every chunk.
+ */
+
+#ifndef PR_TUNABLE_XFER_POLL_CTRL_INTERVAL
+# define PR_TUNABLE_XFER_POLL_CTRL_INTERVAL	100
+#endif
+
 #ifndef PR_TUNABLE_CALLER_DEPTH
 /* Max depth of call stack if stacktrace support is enabled. */
 # define PR_TUNABLE_CALLER_DEPTH	32
@@ -63,6 +63,13 @@ int pr_privs_user(const char *, int);
 int pr_privs_relinquish(const char *, int);
 int pr_privs_revoke(const char *, int);
 
+/* The PRIVS_ macros remember the effective UID/GID they last switched to,
+ * and skip switches to the IDs already in effect.  Code which changes the
+ * process IDs directly (e.g. via setgid(2) or setreuid(2)) must call this
+ * afterward, so that the next PRIVS_ macro does not trust stale IDs.
+ */
+void pr_privs_clear_cache(void);
+
 /* For internal use only. */
 int init_privs(void);
 int set_nonroot_daemon(int);
@@ -40,6 +40,12 @@
 int pr_timer_add(int secs, int timerno, module *m, callback_t cb,
   const char *desc);
 
+/* Like pr_timer_add(), but the interval is given in milliseconds.  The
+ * interval and elapsed time passed to the callback are also in milliseconds.
+ */
+int pr_timer_add_ms(long msecs, int timerno, module *m, callback_t cb,
+  const char *desc);
+
 /* Remove the timer indicated by the timerno parameter, and owned by the
  * given module.  Note that if the caller does not know the module,
  * the value ANY_MODULE can be given.  Return 0 on success, -1 on failure.
@@ -72,6 +78,17 @@ int pr_timer_sleep(int secs);
  */
 int pr_timer_usleep(unsigned long usecs);
 
+/* Returns a file descriptor which polls as readable when a timer is due,
+ * or -1 if there are no timers, or if the platform does not support this.
+ * When the descriptor is readable, the caller should call
+ * pr_timer_process().  Timers are still handled via SIGALRM if the process
+ * is not watching the descriptor.
+ */
+int pr_timer_get_fd(void);
+
+/* Invokes the callbacks of any expired timers. */
+void pr_timer_process(void);
+
 /* For internal use only. */
 void handle_alarm(void);
 void timers_init(void);
@@ -368,6 +368,8 @@ MODRET cap_post_pass(cmd_rec *cmd) {
 
     return PR_DECLINED(cmd);
   }
+
+  pr_privs_clear_cache();
 #endif /* PR_DEVEL_COREDUMP */
 
   /* The only capability we need is CAP_NET_BIND_SERVICE (bind
@@ -461,6 +463,7 @@ MODRET cap_post_pass(cmd_rec *cmd) {
     pr_signals_unblock();
     pr_session_disconnect(&cap_module, PR_SESS_DISCONNECT_BY_APPLICATION, NULL);
   }
+  pr_privs_clear_cache();
   pr_signals_unblock();
 
   pr_log_debug(DEBUG9, MOD_CAP_VERSION
@@ -46,6 +46,11 @@ extern modret_t *site_dispatch(cmd_rec*);
 #define PR_BYTES_BAD_UNITS	-1
 #define PR_BYTES_BAD_FORMAT	-2
 
+/* Maximum number of <VirtualHost> addresses tracked for the
+ * AddressCollisionCheck.
+ */
+#define PR_CORE_VHOST_ADDR_MAX_ENTS	1048576
+
 /* Maximum number of parameters for OPTS commands (see Bug#3870). */
 #define PR_OPTS_MAX_PARAM_COUNT		8
 
@@ -53,6 +58,14 @@ module core_module;
 char AddressCollisionCheck = TRUE;
 
 static int core_scrub_timer_id = -1;
+
+/* For the AddressCollisionCheck: the address/port combinations of the
+ * <VirtualHost> sections parsed so far, keyed by "address#port", and the
+ * resolved address of the main server.
+ */
+static pool *vhost_addr_pool = NULL;
+static pr_table_t *vhost_addr_tab = NULL;
+static const pr_netaddr_t *vhost_main_addr = NULL;
 static pr_fh_t *displayquit_fh = NULL;
 
 #ifdef PR_USE_TRACE
@@ -3559,7 +3572,6 @@ MODRET add_virtualhost(cmd_rec *cmd) {
 }
 
 MODRET end_virtualhost(cmd_rec *cmd) {
-  server_rec *s = NULL, *next_s = NULL;
   const pr_netaddr_t *addr = NULL;
   const char *address = NULL;
   unsigned int addr_flags = PR_NETADDR_GET_ADDR_FL_INCL_DEVICE|PR_NETADDR_GET_ADDR_FL_EXCL_CACHE;
@@ -3589,57 +3601,90 @@ MODRET end_virtualhost(cmd_rec *cmd) {
       "warning: unable to determine IP address of '%s'", address);
   }
 
-  if (AddressCollisionCheck) {
-    /* Check if this server's address/port combination is already being used. */
-    for (s = (server_rec *) server_list->xas_list; addr && s; s = next_s) {
-      next_s = s->next;
+  if (AddressCollisionCheck &&
+      addr != NULL) {
+    char port_str[32];
+    const char *addr_key;
+    server_rec *existing = NULL;
+
+    /* Check if this server's address/port combination is already being used.
+     * Rather than resolving the address of every other server, for every
+     * <VirtualHost> (which is prohibitively slow for configurations with
+     * thousands of <VirtualHost> sections), we look up the address/port
+     * combinations recorded for the previously parsed <VirtualHost>
+     * sections.
+     */
+    if (vhost_addr_tab == NULL) {
+      unsigned int max_ents = PR_CORE_VHOST_ADDR_MAX_ENTS;
+
+      vhost_addr_pool = make_sub_pool(permanent_pool);
+      pr_pool_tag(vhost_addr_pool, "VirtualHost addresses pool");
+
+      vhost_addr_tab = pr_table_nalloc(vhost_addr_pool, 0, 1024);
+      (void) pr_table_ctl(vhost_addr_tab, PR_TABLE_CTL_SET_MAX_ENTS, &max_ents);
+    }
 
+    if (vhost_main_addr == NULL) {
       /* Have to resort to duplicating some of fixup_servers()'s functionality
        * here, to do this check The Right Way(tm).
        */
-      if (s != cmd->server) {
-        const char *serv_addrstr = NULL;
-        const pr_netaddr_t *serv_addr = NULL;
+      if (main_server->addr != NULL) {
+        vhost_main_addr = main_server->addr;
 
-        if (s->addr) {
-          serv_addr = s->addr;
+      } else {
+        const char *main_addrstr;
 
-        } else {
-          serv_addrstr = s->ServerAddress ? s->ServerAddress :
-            pr_netaddr_get_localaddr_str(cmd->tmp_pool);
+        main_addrstr = main_server->ServerAddress ?
+          main_server->ServerAddress :
+          pr_netaddr_get_localaddr_str(cmd->tmp_pool);
 
-          serv_addr = pr_netaddr_get_addr2(cmd->tmp_pool, serv_addrstr, NULL,
-            addr_flags);
+        vhost_main_addr = pr_netaddr_get_addr2(vhost_addr_pool, main_addrstr,
+          NULL, addr_flags);
+        if (vhost_main_addr == NULL) {
+          pr_log_pri(PR_LOG_WARNING,
+            "warning: unable to determine IP address of '%s'", main_addrstr);
         }
+      }
+    }
 
-        if (serv_addr == NULL) {
-          pr_log_pri(PR_LOG_WARNING,
-            "warning: unable to determine IP address of '%s'", serv_addrstr);
+    memset(port_str, '\0', sizeof(port_str));
+    pr_snprintf(port_str, sizeof(port_str)-1, "%u", cmd->server->ServerPort);
+    addr_key = pstrcat(cmd->tmp_pool, pr_netaddr_get_ipstr(addr), "#",
+      port_str, NULL);
 
-        } else if (pr_netaddr_cmp(addr, serv_addr) == 0 &&
-            cmd->server->ServerPort == s->ServerPort) {
-          config_rec *c;
+    if (vhost_main_addr != NULL &&
+        main_server != cmd->server &&
+        pr_netaddr_cmp(addr, vhost_main_addr) == 0 &&
+        cmd->server->ServerPort == main_server->ServerPort) {
+      existing = main_server;
 
-          /* If this server has a ServerAlias, it means it's a named vhost and
-           * can be used for name-based virtual hosting.  Which, in turn, means
-           * that this collision is expected, even wanted.
-           */
-          c = find_config(cmd->server->conf, CONF_PARAM, "ServerAlias", FALSE);
-          if (c == NULL) {
-            pr_log_pri(PR_LOG_WARNING,
-              "warning: \"%s\" address/port (%s:%d) already in use by \"%s\"",
-              cmd->server->ServerName ? cmd->server->ServerName : "ProFTPD",
-              pr_netaddr_get_ipstr(addr), cmd->server->ServerPort,
-              s->ServerName ? s->ServerName : "ProFTPD");
-
-            if (xaset_remove(server_list, (xasetmember_t *) cmd->server) == 1) {
-              destroy_pool(cmd->server->pool);
-            }
-          }
-        }
+    } else {
+      existing = (server_rec *) pr_table_get(vhost_addr_tab, addr_key, NULL);
+    }
 
-        continue;
+    if (existing != NULL) {
+      config_rec *c;
+
+      /* If this server has a ServerAlias, it means it's a named vhost and
+       * can be used for name-based virtual hosting.  Which, in turn, means
+       * that this collision is expected, even wanted.
+       */
+      c = find_config(cmd->server->conf, CONF_PARAM, "ServerAlias", FALSE);
+      if (c == NULL) {
+        pr_log_pri(PR_LOG_WARNING,
+          "warning: \"%s\" address/port (%s:%d) already in use by \"%s\"",
+          cmd->server->ServerName ? cmd->server->ServerName : "ProFTPD",
+          pr_netaddr_get_ipstr(addr), cmd->server->ServerPort,
+          existing->ServerName ? existing->ServerName : "ProFTPD");
+
+        if (xaset_remove(server_list, (xasetmember_t *) cmd->server) == 1) {
+          destroy_pool(cmd->server->pool);
+        }
       }
+
+    } else {
+      (void) pr_table_add(vhost_addr_tab, pstrdup(vhost_addr_pool, addr_key),
+        cmd->server, sizeof(server_rec *));
     }
   }
 
@@ -7020,6 +7065,18 @@ static void core_postparse_ev(const void *event_data, void *user_data) {
   }
 }
 
+static void core_preparse_ev(const void *event_data, void *user_data) {
+  /* The VirtualHost addresses seen are only for the file about to be
+   * parsed.
+   */
+  if (vhost_addr_pool != NULL) {
+    destroy_pool(vhost_addr_pool);
+    vhost_addr_pool = NULL;
+    vhost_addr_tab = NULL;
+    vhost_main_addr = NULL;
+  }
+}
+
 static void core_restart_ev(const void *event_data, void *user_data) {
   pr_fs_statcache_reset();
   pr_scoreboard_scrub();
@@ -7123,6 +7180,7 @@ static int core_init(void) {
 
   pr_event_register(&core_module, "core.connected", core_connected_ev, NULL);
   pr_event_register(&core_module, "core.postparse", core_postparse_ev, NULL);
+  pr_event_register(&core_module, "core.preparse", core_preparse_ev, NULL);
   pr_event_register(&core_module, "core.restart", core_restart_ev, NULL);
   pr_event_register(&core_module, "core.startup", core_startup_ev, NULL);
 
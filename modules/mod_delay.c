@@ -101,8 +101,20 @@ module delay_module;
 
 struct delay_vals_rec {
   char dv_proto[16];
+
+  /* Odd while a session is adding a value. */
+  volatile unsigned int dv_seqno;
+
   unsigned int dv_nvals;
+
+  /* The values, in the order recorded; dv_next is the slot for the next
+   * value, which once the row is full is also the oldest value.
+   */
+  unsigned int dv_next;
   long dv_vals[DELAY_NVALUES];
+
+  /* The same values, kept in ascending order for the median. */
+  long dv_sorted[DELAY_NVALUES];
 };
 
 struct delay_rec {
@@ -156,151 +168,142 @@ static unsigned long delay_pass_max_delay = 0UL;
 static int delay_sess_init(void);
 static void delay_table_reset(void);
 
-#define delay_swap(a, b) \
-  tmp = (a); \
-  (a) = (b); \
-  (b) = tmp;
-
 static const char *trace_channel = "delay";
 
-static long delay_select_k(unsigned long k, array_header *values) {
-  unsigned long l, ir, tmp = 0;
-  long *elts = (long *) values->elts;
-  unsigned int nelts = values->nelts;
-
-  /* This is from "Numeric Recipes in C", Ch. 8.5, as the select()
-   * algorithm, an in-place sorting algorithm for finding the Kth
-   * element in an array, where all elements to the left of K are
-   * smaller than K, and all elements to the right are larger.
-   */
-
-  l = 1;
-  ir = values->nelts - 1;
-
-  while (TRUE) {
-    unsigned int i, j;
-    long p;
-    unsigned long mid;
-
-    pr_signals_handle();
-
-    if (ir <= l+1) {
-      if (ir == l+1 &&
-          elts[ir] < elts[l]) {
-        delay_swap(elts[l], elts[ir]);
-      }
+/* Each set of per-protocol values is guarded by a sequence lock: a session
+ * adding a value makes the sequence number odd for the duration of the
+ * update, and readers retry if the number changed underneath them.  This
+ * lets sessions share the mapped table without any fcntl(2) locking.
+ */
+#if defined(__GNUC__)
+# define DELAY_TABLE_BARRIER()	__sync_synchronize()
+# define DELAY_TABLE_LOCK(dv, s) \
+  __sync_bool_compare_and_swap(&((dv)->dv_seqno), (s), (s) + 1)
+#else
+# define DELAY_TABLE_BARRIER()
+# define DELAY_TABLE_LOCK(dv, s) \
+  ((dv)->dv_seqno == (s) ? ((dv)->dv_seqno++, 1) : 0)
+#endif /* __GNUC__ */
 
-      return elts[k];
-    }
+/* How many times to retry a contended read or update before giving up. */
+#define DELAY_TABLE_MAX_ATTEMPTS	64
 
-    mid = (l + ir) >> 1;
+static struct delay_vals_rec *delay_table_get_vals(unsigned int rownum,
+    const char *protocol) {
+  register unsigned int i;
+  struct delay_rec *row;
 
-    delay_swap(elts[mid], elts[l+1]);
-    if (elts[l] > elts[ir]) {
-      delay_swap(elts[l], elts[ir]);
-    }
+  row = &((struct delay_rec *) delay_tab.dt_data)[rownum];
 
-    if (elts[l+1] > elts[ir]) {
-      delay_swap(elts[l+1], elts[ir]);
-    }
+  for (i = 0; i < DELAY_NPROTO; i++) {
+    struct delay_vals_rec *dv;
 
-    if (elts[l] > elts[l+1]) {
-      delay_swap(elts[l], elts[l+1]);
+    dv = &(row->d_vals[i]);
+    if (strcmp(dv->dv_proto, protocol) == 0) {
+      return dv;
     }
+  }
 
-    i = l + 1;
-    j = ir;
-    p = elts[l+1];
-
-    while (TRUE) {
-      pr_signals_handle();
+  return NULL;
+}
 
-      do {
-        i++;
-      } while (i < nelts && elts[i] < p);
+/* Returns the number of the first nvals sorted values less than val. */
+static unsigned int delay_lower_bound(const long *vals, unsigned int nvals,
+    long val) {
+  unsigned int lo = 0, hi = nvals;
 
-      do {
-        j--;
-      } while (elts[j] > p);
+  while (lo < hi) {
+    unsigned int mid;
 
-      if (j < i) {
-        break;
-      }
+    mid = lo + ((hi - lo) >> 1);
+    if (vals[mid] < val) {
+      lo = mid + 1;
 
-      delay_swap(elts[i], elts[j]);
+    } else {
+      hi = mid;
     }
+  }
 
-    elts[l+1] = elts[j];
-    elts[j] = p;
+  return lo;
+}
 
-    if ((unsigned long) p >= k) {
-      ir = j - 1;
-    }
+static int delay_cmp_vals(const void *a, const void *b) {
+  long v1, v2;
 
-    if ((unsigned long) p <= k) {
-      l = i;
-    }
+  v1 = *((const long *) a);
+  v2 = *((const long *) b);
 
-    if (l >= (nelts - 1) ||
-        ir >= nelts) {
-      break;
-    }
+  if (v1 < v2) {
+    return -1;
   }
 
-  return -1;
+  return v1 > v2 ? 1 : 0;
 }
 
-static long delay_get_median(pool *p, unsigned int rownum, const char *protocol,
+static long delay_get_median(unsigned int rownum, const char *protocol,
     long interval) {
   register unsigned int i;
-  struct delay_rec *row;
-  struct delay_vals_rec *dv = NULL;
-  long *tab_vals = NULL, median;
-  array_header *list = make_array(p, 1, sizeof(long));
+  struct delay_vals_rec *dv;
+  long median = interval;
 
   /* Calculate the median value of the current command's recorded values,
    * taking the protocol (e.g. "ftp", "ftps", "ssh2") into account.
    *
    * When calculating the median, we use the current interval as well
-   * as the recorded intervals in the table, giving us an odd number of
-   * values.
-   *
-   * If the number of values in this row is less than the watermark
-   * value, we'll actually return the maximum value, rather than the
-   * median.  Below the watermark, the server is "cold" and has not
-   * yet accumulated enough data to make the median a useful value.
+   * as the recorded intervals in the table.  The recorded intervals are
+   * kept sorted as they are added, so the median is found by locating
+   * where the current interval would fall in that sorted list; no copying
+   * or selection is needed.
    */
 
-  row = &((struct delay_rec *) delay_tab.dt_data)[rownum];
+  dv = delay_table_get_vals(rownum, protocol);
+  if (dv != NULL) {
+    for (i = 0; i < DELAY_TABLE_MAX_ATTEMPTS; i++) {
+      unsigned int nvals, pos, r, seqno;
 
-  /* Find the list of delay values that match the given protocol. */
-  for (i = 0; i < DELAY_NPROTO; i++) {
-    dv = &(row->d_vals[i]);
-    if (strcmp(dv->dv_proto, protocol) == 0) {
-      tab_vals = dv->dv_vals;
-      break;
-    }
-  }
+      seqno = dv->dv_seqno;
+      if (seqno & 1) {
+        continue;
+      }
 
-  /* Start at the end of the row and work backward, as values are
-   * always added at the end of the row, shifting everything to the left.
-   */
-  if (tab_vals != NULL) {
-    for (i = 1; i < dv->dv_nvals; i++) {
-      /* Ignore any possible garbage (i.e. negative) values in the
-       * DelayTable.
+      DELAY_TABLE_BARRIER();
+
+      nvals = dv->dv_nvals;
+      if (nvals > DELAY_NVALUES) {
+        nvals = DELAY_NVALUES;
+      }
+
+      /* The median of the nvals + 1 values, including the current interval,
+       * is the value of rank r in the merged list.
        */
-      if (tab_vals[DELAY_NVALUES - 1 - i] >= 0) {
-        *((long *) push_array(list)) = tab_vals[DELAY_NVALUES - 1 - i];
+      r = (nvals + 1) / 2;
+      pos = delay_lower_bound(dv->dv_sorted, nvals, interval);
+
+      if (r < pos) {
+        median = dv->dv_sorted[r];
+
+      } else if (r == pos) {
+        median = interval;
+
+      } else {
+        median = dv->dv_sorted[r - 1];
+      }
+
+      DELAY_TABLE_BARRIER();
+
+      if (dv->dv_seqno == seqno) {
+        pr_trace_msg(trace_channel, 6, "selected median interval from %u %s",
+          nvals + 1, nvals != 0 ? "values" : "value");
+        break;
       }
     }
   }
-  *((long *) push_array(list)) = interval;
 
-  pr_trace_msg(trace_channel, 6, "selecting median interval from %d %s",
-    list->nelts, list->nelts != 1 ? "values" : "value");
+  /* Ignore any possible garbage (i.e. negative) values in the DelayTable. */
+  if (median < 0) {
+    median = interval;
+  }
 
-  median = delay_select_k(((list->nelts + 1) / 2), list);
   if (median >= 0) {
 
     /* Enforce an additional restriction: no delays over a hard limit. */
@@ -640,33 +643,91 @@ static unsigned int delay_get_pass_rownum(unsigned int sid) {
 static void delay_table_add_interval(unsigned int rownum, const char *protocol,
     long interval) {
   register unsigned int i;
-  struct delay_rec *row;
-  struct delay_vals_rec *dv = NULL;
+  struct delay_vals_rec *dv;
+  unsigned int nvals, pos, seqno = 0;
 
-  row = &((struct delay_rec *) delay_tab.dt_data)[rownum];
+  dv = delay_table_get_vals(rownum, protocol);
+  if (dv == NULL) {
+    return;
+  }
 
-  for (i = 0; i < DELAY_NPROTO; i++) {
-    dv = &(row->d_vals[i]);
-    if (strcmp(dv->dv_proto, protocol) == 0) {
+  if (interval > DELAY_MAX_DELAY_USECS) {
+    /* Truncate the interval to the maximum allowed value. */
+    interval = DELAY_MAX_DELAY_USECS;
+
+  } else if (interval < 0) {
+    interval = 0;
+  }
+
+  for (i = 0; i < DELAY_TABLE_MAX_ATTEMPTS; i++) {
+    seqno = dv->dv_seqno;
+    if ((seqno & 1) == 0 &&
+        DELAY_TABLE_LOCK(dv, seqno)) {
       break;
     }
   }
 
-  /* Shift all existing values to the left one position. */
-  memmove(&(dv->dv_vals[0]), &(dv->dv_vals[1]),
-    sizeof(long) * (DELAY_NVALUES - 1));
+  if (i == DELAY_TABLE_MAX_ATTEMPTS) {
+    /* Another session is busy with this row; losing one sample is
+     * preferable to making this session wait.
+     */
+    pr_trace_msg(trace_channel, 8,
+      "row %u busy, not adding %ld usecs", rownum + 1, interval);
+    return;
+  }
 
-  /* Add the given value to the end. */
+  DELAY_TABLE_BARRIER();
 
-  if (interval > DELAY_MAX_DELAY_USECS) {
-    /* Truncate the interval to the maximum allowed value. */
-    interval = DELAY_MAX_DELAY_USECS;
+  nvals = dv->dv_nvals;
+  if (nvals > DELAY_NVALUES ||
+      dv->dv_next >= DELAY_NVALUES) {
+    nvals = dv->dv_next = 0;
   }
 
-  dv->dv_vals[DELAY_NVALUES-1] = interval;
-  if (dv->dv_nvals < DELAY_NVALUES) {
-    dv->dv_nvals++;
+  if (nvals == DELAY_NVALUES) {
+    long oldest;
+
+    /* The row is full; drop the oldest value from the sorted list. */
+    oldest = dv->dv_vals[dv->dv_next];
+    pos = delay_lower_bound(dv->dv_sorted, nvals, oldest);
+
+    if (pos < nvals &&
+        dv->dv_sorted[pos] == oldest) {
+      memmove(&(dv->dv_sorted[pos]), &(dv->dv_sorted[pos+1]),
+        sizeof(long) * (nvals - pos - 1));
+
+    } else {
+      /* The sorted list no longer matches the recorded values (e.g. a
+       * session died mid-update); rebuild it from them.
+       */
+      unsigned int j, k = 0;
+
+      pr_trace_msg(trace_channel, 3, "rebuilding sorted values for row %u",
+        rownum + 1);
+      for (j = 0; j < nvals; j++) {
+        if (j != dv->dv_next) {
+          dv->dv_sorted[k++] = dv->dv_vals[j];
+        }
+      }
+
+      qsort(dv->dv_sorted, k, sizeof(long), delay_cmp_vals);
+    }
+
+    nvals--;
   }
+
+  /* Insert the new value into its place in the sorted list. */
+  pos = delay_lower_bound(dv->dv_sorted, nvals, interval);
+  memmove(&(dv->dv_sorted[pos+1]), &(dv->dv_sorted[pos]),
+    sizeof(long) * (nvals - pos));
+  dv->dv_sorted[pos] = interval;
+
+  dv->dv_vals[dv->dv_next] = interval;
+  dv->dv_next = (dv->dv_next + 1) % DELAY_NVALUES;
+  dv->dv_nvals = nvals + 1;
+
+  DELAY_TABLE_BARRIER();
+  dv->dv_seqno = seqno + 2;
 }
 
 /* Create a lookup table, of SID to USER/PASS row number.  We do this
@@ -782,10 +843,14 @@ static int delay_table_init(void) {
     return -1;
   }
 
-  if (st.st_size != tab_size) {
+  if (st.st_size < tab_size) {
     /* This check is for cases when the ServerType is inetd, and the
-     * current DelayTable has the wrong size, which can happen if the
-     * configuration has changed by having vhosts added or removed.
+     * current DelayTable is too small, which can happen if the configuration
+     * has changed by having vhosts added.
+     *
+     * Note that we only ever grow the table, never shrink it: on a restart,
+     * existing session processes may still have the table mapped, and
+     * truncating it underneath them would get them killed with SIGBUS.
      */
 
     pr_trace_msg(trace_channel, 3,
@@ -866,9 +931,6 @@ static int delay_table_init(void) {
       return -1;
     }
 
-    /* Truncate the table, in case we're shrinking an existing table. */
-    pr_fsio_ftruncate(fh, tab_size);
-
     lock.l_type = F_UNLCK;
 
     pr_trace_msg(trace_channel, 8, "unlocking DelayTable '%s'", fh->fh_path);
@@ -976,46 +1038,6 @@ static int delay_table_init(void) {
       return -1;
     }
 
-    /* Seek to the desired table size (actually, one byte less than the
-     * desired size) and write a single byte, so that there's enough
-     * allocated backing store on the filesystem to support the ensuing
-     * mmap() call.
-     */
-    if (lseek(fh->fh_fd, tab_size-1, SEEK_SET) < 0) {
-      xerrno = errno;
-
-      pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-        ": error seeking to %lu in DelayTable '%s': %s",
-        (unsigned long) tab_size-1, fh->fh_path, strerror(xerrno));
-      pr_trace_msg(trace_channel, 1,
-        "error seeking to %lu in DelayTable '%s': %s",
-        (unsigned long) tab_size-1, fh->fh_path, strerror(xerrno));
-
-      pr_fsio_close(fh);
-
-      errno = xerrno;
-      return -1;
-    }
-
-    if (write(fh->fh_fd, "", 1) != 1) {
-      xerrno = errno;
-
-      pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-        ": error writing single byte to DelayTable '%s': %s", fh->fh_path,
-        strerror(xerrno));
-      pr_trace_msg(trace_channel, 1,
-        "error writing single byte to DelayTable '%s': %s", fh->fh_path,
-        strerror(xerrno));
-
-      pr_fsio_close(fh);
-
-      errno = xerrno;
-      return -1;
-    }
-
-    /* Truncate the table, in case we're shrinking an existing table. */
-    pr_fsio_ftruncate(fh, tab_size);
-
     pr_trace_msg(trace_channel, 6, "resetting DelayTable '%s'",
       delay_tab.dt_path);
     delay_table_reset();
@@ -1029,24 +1051,9 @@ static int delay_table_init(void) {
     }
   }
 
-  /* Done */
-  pr_trace_msg(trace_channel, 8, "unmapping DelayTable '%s' from memory",
-    delay_tab.dt_path);
-  if (munmap(delay_tab.dt_data, delay_tab.dt_size) < 0) {
-    xerrno = errno;
-    pr_fsio_close(fh);
-
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": error unmapping DelayTable '%s': %s", delay_tab.dt_path,
-      strerror(xerrno));
-    pr_trace_msg(trace_channel, 1, "error unmapping DelayTable '%s': %s",
-      delay_tab.dt_path, strerror(xerrno));
-
-    errno = xerrno;
-    return -1;
-  }
-
-  delay_tab.dt_data = NULL;
+  /* Done.  The mapping stays in place, to be inherited by the session
+   * processes; we no longer need the descriptor itself.
+   */
   delay_tab.dt_fd = -1;
 
   if (pr_fsio_close(fh) < 0) {
@@ -1057,70 +1064,80 @@ static int delay_table_init(void) {
       strerror(xerrno));
     pr_trace_msg(trace_channel, 1, "error closing DelayTable '%s': %s",
       delay_tab.dt_path, strerror(xerrno));
-
-    errno = xerrno;
-    return -1;
   }
 
   return 0;
 }
 
-static int delay_table_load(int lock_table) {
-  struct flock lock;
-
-  if (lock_table == TRUE) {
-    lock.l_type = F_WRLCK;
-    lock.l_whence = 0;
-    lock.l_start = 0;
-    lock.l_len = 0;
-
-    pr_trace_msg(trace_channel, 8, "write-locking DelayTable '%s'",
+static int delay_table_unmap(void) {
+  if (delay_tab.dt_data != NULL) {
+    pr_trace_msg(trace_channel, 8, "unmapping DelayTable '%s' from memory",
       delay_tab.dt_path);
-    while (fcntl(delay_tab.dt_fd, F_SETLKW, &lock) < 0) {
-      if (errno == EINTR) {
-        pr_signals_handle();
-        continue;
-      }
+    if (munmap(delay_tab.dt_data, delay_tab.dt_size) < 0) {
+      int xerrno = errno;
+
+      pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
+        ": error unmapping DelayTable '%s': %s", delay_tab.dt_path,
+        strerror(xerrno));
+      pr_trace_msg(trace_channel, 1, "error unmapping DelayTable '%s': %s",
+        delay_tab.dt_path, strerror(xerrno));
 
+      errno = xerrno;
       return -1;
     }
-  }
 
-  if (delay_tab.dt_data == NULL) {
-    pr_trace_msg(trace_channel, 8, "mapping DelayTable '%s' (%lu bytes, fd %d) "
-      "into memory", delay_tab.dt_path, (unsigned long) delay_tab.dt_size,
-      delay_tab.dt_fd);
-    delay_tab.dt_data = mmap(NULL, delay_tab.dt_size, PROT_READ|PROT_WRITE,
-      MAP_SHARED, delay_tab.dt_fd, 0);
+    delay_tab.dt_data = NULL;
+  }
 
-    if (delay_tab.dt_data == MAP_FAILED) {
-      int xerrno = errno;
+  return 0;
+}
 
-      delay_tab.dt_data = NULL;
-
-      if (lock_table) {
-        /* Make sure we release the lock before returning. */
-        lock.l_type = F_UNLCK;
-        lock.l_whence = 0;
-        lock.l_start = 0;
-        lock.l_len = 0;
-
-        pr_trace_msg(trace_channel, 8, "unlocking DelayTable '%s'",
-          delay_tab.dt_path);
-        while (fcntl(delay_tab.dt_fd, F_SETLKW, &lock) < 0) {
-          if (errno == EINTR) {
-            pr_signals_handle();
-            continue;
-          }
-        }
-      }
+static void delay_table_reset_vals(struct delay_vals_rec *dv,
+    const char *protocol) {
+  register unsigned int i;
+  unsigned int seqno = 0;
 
-      errno = xerrno;
-      return -1;
+  /* Sessions may have the table mapped while we reset it (e.g. via the
+   * "delay reset" control action), so take the row's sequence lock like any
+   * other writer.  A row which stays locked belonged to a session which died
+   * mid-update; we take it over, since we are about to clear it anyway.
+   */
+  for (i = 0; i < DELAY_TABLE_MAX_ATTEMPTS; i++) {
+    seqno = dv->dv_seqno;
+    if ((seqno & 1) == 0 &&
+        DELAY_TABLE_LOCK(dv, seqno)) {
+      break;
     }
   }
 
-  return 0;
+  if (i == DELAY_TABLE_MAX_ATTEMPTS) {
+    seqno = dv->dv_seqno & ~1U;
+    dv->dv_seqno = seqno + 1;
+  }
+
+  DELAY_TABLE_BARRIER();
+
+  memset(dv->dv_proto, 0, sizeof(dv->dv_proto));
+  sstrcat(dv->dv_proto, protocol, sizeof(dv->dv_proto));
+  dv->dv_nvals = 0;
+  dv->dv_next = 0;
+  memset(dv->dv_vals, -1, sizeof(dv->dv_vals));
+  memset(dv->dv_sorted, 0, sizeof(dv->dv_sorted));
+
+  DELAY_TABLE_BARRIER();
+  dv->dv_seqno = seqno + 2;
+}
+
+static void delay_table_reset_row(struct delay_rec *row, server_rec *s,
+    const char *ip_str) {
+  row->d_sid = s->sid;
+  sstrncpy(row->d_addr, ip_str, sizeof(row->d_addr));
+  row->d_port = s->ServerPort;
+
+  /* Initialize value subsets for "ftp", "ftps", and "ssh2". */
+  delay_table_reset_vals(&(row->d_vals[0]), "ftp");
+  delay_table_reset_vals(&(row->d_vals[1]), "ftps");
+  delay_table_reset_vals(&(row->d_vals[2]), "ssh2");
 }
 
 static void delay_table_reset(void) {
@@ -1129,7 +1146,6 @@ static void delay_table_reset(void) {
   for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
     unsigned int r;
     struct delay_rec *row;
-    struct delay_vals_rec *dv;
     const char *ip_str;
 
     ip_str = pr_netaddr_get_ipstr(s->addr);
@@ -1140,197 +1156,101 @@ static void delay_table_reset(void) {
     /* Row for USER values */
     r = delay_get_user_rownum(s->sid);
     row = &((struct delay_rec *) delay_tab.dt_data)[r];
-    row->d_sid = s->sid;
-    sstrncpy(row->d_addr, ip_str, sizeof(row->d_addr));
-    row->d_port = s->ServerPort;
-    memset(row->d_vals, 0, sizeof(row->d_vals));
-
-    /* Initialize value subsets for "ftp", "ftps", and "ssh2". */
-    dv = &(row->d_vals[0]);
-    memset(dv->dv_proto, 0, sizeof(dv->dv_proto));
-    sstrcat(dv->dv_proto, "ftp", sizeof(dv->dv_proto));
-    dv->dv_nvals = 0;
-    memset(dv->dv_vals, -1, sizeof(dv->dv_vals));
-
-    dv = &(row->d_vals[1]);
-    memset(dv->dv_proto, 0, sizeof(dv->dv_proto));
-    sstrcat(dv->dv_proto, "ftps", sizeof(dv->dv_proto));
-    dv->dv_nvals = 0;
-    memset(dv->dv_vals, -1, sizeof(dv->dv_vals));
-
-    dv = &(row->d_vals[2]);
-    memset(dv->dv_proto, 0, sizeof(dv->dv_proto));
-    sstrcat(dv->dv_proto, "ssh2", sizeof(dv->dv_proto));
-    dv->dv_nvals = 0;
-    memset(dv->dv_vals, -1, sizeof(dv->dv_vals));
+    delay_table_reset_row(row, s, ip_str);
 
     /* Row for PASS values */
     r = delay_get_pass_rownum(s->sid);
     row = &((struct delay_rec *) delay_tab.dt_data)[r];
-    row->d_sid = s->sid;
-    sstrncpy(row->d_addr, ip_str, sizeof(row->d_addr));
-    row->d_port = s->ServerPort;
-    memset(row->d_vals, 0, sizeof(row->d_vals));
-
-    dv = &(row->d_vals[0]);
-    memset(dv->dv_proto, 0, sizeof(dv->dv_proto));
-    sstrcat(dv->dv_proto, "ftp", sizeof(dv->dv_proto));
-    dv->dv_nvals = 0;
-    memset(dv->dv_vals, -1, sizeof(dv->dv_vals));
-
-    dv = &(row->d_vals[1]);
-    memset(dv->dv_proto, 0, sizeof(dv->dv_proto));
-    sstrcat(dv->dv_proto, "ftps", sizeof(dv->dv_proto));
-    dv->dv_nvals = 0;
-    memset(dv->dv_vals, -1, sizeof(dv->dv_vals));
-
-    dv = &(row->d_vals[2]);
-    memset(dv->dv_proto, 0, sizeof(dv->dv_proto));
-    sstrcat(dv->dv_proto, "ssh2", sizeof(dv->dv_proto));
-    dv->dv_nvals = 0;
-    memset(dv->dv_vals, -1, sizeof(dv->dv_vals));
+    delay_table_reset_row(row, s, ip_str);
   }
 }
 
-static int delay_table_wlock(unsigned int rownum) {
-  struct flock lock;
-
-  lock.l_type = F_WRLCK;
-  lock.l_whence = 0;
-  lock.l_start = sizeof(struct delay_rec) * rownum;
-  lock.l_len = sizeof(struct delay_rec);
-
-  pr_trace_msg(trace_channel, 8, "write-locking DelayTable '%s', row %u",
-    delay_tab.dt_path, rownum + 1);
-  while (fcntl(delay_tab.dt_fd, F_SETLKW, &lock) < 0) {
-    int xerrno = errno;
+#if defined(PR_USE_CTRLS)
 
-    if (xerrno == EINTR) {
-      pr_signals_handle();
-      continue;
-    }
+/* Control handlers
+ */
 
-    pr_trace_msg(trace_channel, 1, "error locking row: %s", strerror(xerrno));
+static void delay_add_row_response(pr_ctrls_t *ctrl, pool *p,
+    struct delay_rec *row) {
+  register unsigned int i;
 
-    errno = xerrno;
-    return -1;
-  }
+  for (i = 0; i < DELAY_NPROTO; i++) {
+    struct delay_vals_rec *dv;
+    register unsigned int j;
+    unsigned int nvals = 0, next = 0, seqno;
+    long *vals;
+    char *text;
 
-  return 0;
-}
+    dv = &(row->d_vals[i]);
 
-static int delay_table_unload(int unlock_table) {
+    if ((dv->dv_proto)[0] == '\0') {
+      continue;
+    }
 
-  if (delay_tab.dt_data != NULL) {
-    pr_trace_msg(trace_channel, 8, "unmapping DelayTable '%s' from memory",
-      delay_tab.dt_path);
-    if (munmap(delay_tab.dt_data, delay_tab.dt_size) < 0) {
-      int xerrno = errno;
+    /* Take a consistent snapshot of the values; sessions may be adding
+     * values to the row while we read it.
+     */
+    vals = palloc(p, sizeof(dv->dv_vals));
 
-      pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-        ": error unmapping DelayTable '%s': %s", delay_tab.dt_path,
-        strerror(xerrno));
-      pr_trace_msg(trace_channel, 1, "error unmapping DelayTable '%s': %s",
-        delay_tab.dt_path, strerror(xerrno));
+    for (j = 0; j < DELAY_TABLE_MAX_ATTEMPTS; j++) {
+      seqno = dv->dv_seqno;
+      if (seqno & 1) {
+        continue;
+      }
 
-      errno = xerrno;
-      return -1;
-    }
+      DELAY_TABLE_BARRIER();
 
-    delay_tab.dt_data = NULL;
-  }
+      nvals = dv->dv_nvals;
+      next = dv->dv_next;
+      memcpy(vals, dv->dv_vals, sizeof(dv->dv_vals));
 
-  if (unlock_table == TRUE) {
-    struct flock lock;
-    lock.l_type = F_UNLCK;
-    lock.l_whence = SEEK_SET;
-    lock.l_start = 0;
-    lock.l_len = 0;
+      DELAY_TABLE_BARRIER();
 
-    pr_trace_msg(trace_channel, 8, "unlocking DelayTable '%s'",
-      delay_tab.dt_path);
-    while (fcntl(delay_tab.dt_fd, F_SETLK, &lock) < 0) {
-      if (errno == EINTR) {
-        pr_signals_handle();
-        continue;
+      if (dv->dv_seqno == seqno) {
+        break;
       }
+    }
 
-      return -1;
+    if (nvals > DELAY_NVALUES ||
+        next >= DELAY_NVALUES) {
+      nvals = next = 0;
     }
-  }
 
-  return 0;
-}
+    pr_ctrls_add_response(ctrl, " + Protocol %s, %u values:", dv->dv_proto,
+      nvals);
 
-static int delay_table_unlock(unsigned int rownum) {
-  struct flock lock;
+    /* Start with the most recently added value and work backward. */
+    text = "";
+    for (j = 0; j < nvals; j++) {
+      char buf[80];
 
-  lock.l_type = F_UNLCK;
-  lock.l_whence = 0;
-  lock.l_start = sizeof(struct delay_rec) * rownum;
-  lock.l_len = sizeof(struct delay_rec);
+      memset(buf, '\0', sizeof(buf));
+      pr_snprintf(buf, sizeof(buf)-1, "%10ld",
+        vals[(next + DELAY_NVALUES - 1 - j) % DELAY_NVALUES]);
 
-  pr_trace_msg(trace_channel, 8, "unlocking DelayTable '%s', row %u",
-    delay_tab.dt_path, rownum + 1);
-  while (fcntl(delay_tab.dt_fd, F_SETLKW, &lock) < 0) {
-    int xerrno = errno;
+      text = pstrcat(p, text, " ", buf, NULL);
 
-    if (xerrno == EINTR) {
-      pr_signals_handle();
-      continue;
+      if (j != 0 &&
+          j % 4 == 0) {
+        pr_ctrls_add_response(ctrl, "    %s", text);
+        text = "";
+      }
     }
 
-    pr_trace_msg(trace_channel, 1, "error unlocking row: %s", strerror(xerrno));
-
-    errno = xerrno;
-    return -1;
+    if (strlen(text) > 0) {
+      pr_ctrls_add_response(ctrl, "    %s", text);
+    }
   }
-
-  return 0;
 }
 
-#if defined(PR_USE_CTRLS)
-
-/* Control handlers
- */
-
 static int delay_handle_info(pr_ctrls_t *ctrl, int reqargc,
     char **reqargv) {
   register server_rec *s;
   pool *tmp_pool;
-  pr_fh_t *fh;
-  char *vals;
-  int xerrno = 0;
-
-  PRIVS_ROOT
-  fh = pr_fsio_open(delay_tab.dt_path, O_RDWR);
-  xerrno = errno;
-  PRIVS_RELINQUISH
-
-  if (fh == NULL) {
-    pr_ctrls_add_response(ctrl,
-      "warning: unable to open DelayTable '%s': %s", delay_tab.dt_path,
-      strerror(xerrno));
-    return PR_CTRLS_STATUS_INTERNAL_ERROR;
-  }
-
-  delay_tab.dt_fd = fh->fh_fd;
-  delay_tab.dt_data = NULL;
-
-  if (delay_table_load(TRUE) < 0) {
-    xerrno = errno;
-
-    pr_ctrls_add_response(ctrl,
-      "unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-    pr_trace_msg(trace_channel, 1,
-      "unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-
-    pr_fsio_close(fh);
-    delay_tab.dt_fd = -1;
-    delay_tab.dt_data = NULL;
 
+  if (delay_tab.dt_data == NULL) {
+    pr_ctrls_add_response(ctrl, "DelayTable '%s' not loaded",
+      delay_tab.dt_path);
     return PR_CTRLS_STATUS_INTERNAL_ERROR;
   }
 
@@ -1338,7 +1258,6 @@ static int delay_handle_info(pr_ctrls_t *ctrl, int reqargc,
 
   for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
     unsigned int r;
-    register unsigned int i;
     struct delay_rec *row;
 
     /* Row for USER values */
@@ -1346,45 +1265,7 @@ static int delay_handle_info(pr_ctrls_t *ctrl, int reqargc,
     row = &((struct delay_rec *) delay_tab.dt_data)[r];
     pr_ctrls_add_response(ctrl, "Address %s#%u: USER values (usecs):",
       row->d_addr, row->d_port);
-
-    for (i = 0; i < DELAY_NPROTO; i++) {
-      struct delay_vals_rec *dv;
-      register unsigned int j;
-
-      dv = &(row->d_vals[i]);
-
-      if ((dv->dv_proto)[0] == '\0') {
-        continue;
-      }
-
-      pr_ctrls_add_response(ctrl, " + Protocol %s, %u values:", dv->dv_proto,
-        dv->dv_nvals);
-
-      /* Start at the end of the row and work backward, as values are
-       * always added at the end of the row, shifting everything to the left.
-       */
-      vals = "";
-      for (j = 0; j < dv->dv_nvals; j++) {
-        char buf[80];
-
-        memset(buf, '\0', sizeof(buf));
-        pr_snprintf(buf, sizeof(buf)-1, "%10ld",
-          dv->dv_vals[DELAY_NVALUES - 1 - j]);
-
-        vals = pstrcat(tmp_pool, vals, " ", buf, NULL);
-
-        if (j != 0 &&
-            j % 4 == 0) {
-          pr_ctrls_add_response(ctrl, "    %s", vals);
-          vals = "";
-        }
-      }
-
-      if (strlen(vals) > 0) {
-        pr_ctrls_add_response(ctrl, "    %s", vals);
-      }
-    }
-
+    delay_add_row_response(ctrl, tmp_pool, row);
     pr_ctrls_add_response(ctrl, "%s", "");
 
     /* Row for PASS values */
@@ -1392,124 +1273,27 @@ static int delay_handle_info(pr_ctrls_t *ctrl, int reqargc,
     row = &((struct delay_rec *) delay_tab.dt_data)[r];
     pr_ctrls_add_response(ctrl, "Address %s#%u: PASS values (usecs):",
       row->d_addr, row->d_port);
-
-    for (i = 0; i < DELAY_NPROTO; i++) {
-      struct delay_vals_rec *dv;
-      register unsigned int j;
-
-      dv = &(row->d_vals[i]);
-
-      if ((dv->dv_proto)[0] == '\0') {
-        continue;
-      }
-
-      pr_ctrls_add_response(ctrl, " + Protocol %s, %u values:", dv->dv_proto,
-        dv->dv_nvals);
-
-      vals = "";
-      for (j = 0; j < dv->dv_nvals; j++) {
-        char buf[80];
-
-        memset(buf, '\0', sizeof(buf));
-        pr_snprintf(buf, sizeof(buf)-1, "%10ld",
-          dv->dv_vals[DELAY_NVALUES - 1 - j]);
-
-        vals = pstrcat(tmp_pool, vals, " ", buf, NULL);
-
-        if (j != 0 &&
-            j % 4 == 0) {
-          pr_ctrls_add_response(ctrl, "    %s", vals);
-          vals = "";
-        }
-      }
-
-      if (strlen(vals) > 0) {
-        pr_ctrls_add_response(ctrl, "    %s", vals);
-      }
-    }
-
+    delay_add_row_response(ctrl, tmp_pool, row);
     pr_ctrls_add_response(ctrl, "%s", "");
   }
 
-  if (delay_table_unload(TRUE) < 0) {
-    pr_ctrls_add_response(ctrl,
-      "unable to unload DelayTable '%s' from memory: %s",
-      delay_tab.dt_path, strerror(errno));
-  }
-
-  pr_fsio_close(fh);
-
-  delay_tab.dt_fd = -1;
-  delay_tab.dt_data = NULL;
-
   destroy_pool(tmp_pool);
   return PR_CTRLS_STATUS_OK;
 }
 
 static int delay_handle_reset(pr_ctrls_t *ctrl, int reqargc,
     char **reqarg) {
-  struct flock lock;
-  pr_fh_t *fh;
-  int xerrno = 0;
-
-  PRIVS_ROOT
-  fh = pr_fsio_open(delay_tab.dt_path, O_RDWR);
-  xerrno = errno;
-  PRIVS_RELINQUISH
-
-  if (fh == NULL) {
-    pr_ctrls_add_response(ctrl,
-      "unable to open DelayTable '%s': %s", delay_tab.dt_path,
-      strerror(xerrno));
-    return PR_CTRLS_STATUS_INTERNAL_ERROR;
-  }
-
-  lock.l_type = F_WRLCK;
-  lock.l_whence = 0;
-  lock.l_start = 0;
-  lock.l_len = 0;
-
-  while (fcntl(fh->fh_fd, F_SETLKW, &lock) < 0) {
-    xerrno = errno;
-
-    if (xerrno == EINTR) {
-      pr_signals_handle();
-      continue;
-    }
-
-    pr_ctrls_add_response(ctrl,
-      "unable to obtain write lock on DelayTable '%s': %s",
-       fh->fh_path, strerror(xerrno));
-    pr_fsio_close(fh);
-
-    return PR_CTRLS_STATUS_INTERNAL_ERROR;
-  }
-
-  if (pr_fsio_ftruncate(fh, 0) < 0) {
-    xerrno = errno;
-
-    pr_ctrls_add_response(ctrl,
-      "error truncating DelayTable '%s': %s", fh->fh_path, strerror(xerrno));
-    pr_fsio_close(fh);
 
+  if (delay_tab.dt_data == NULL) {
+    pr_ctrls_add_response(ctrl, "DelayTable '%s' not loaded",
+      delay_tab.dt_path);
     return PR_CTRLS_STATUS_INTERNAL_ERROR;
   }
 
-  lock.l_type = F_UNLCK;
-  if (fcntl(fh->fh_fd, F_SETLK, &lock) < 0) {
-    pr_trace_msg(trace_channel, 3,
-      "error unlocking fd %d: %s", fh->fh_fd, strerror(errno));
-  }
-
-  if (pr_fsio_close(fh) < 0) {
-    xerrno = errno;
-
-    pr_ctrls_add_response(ctrl,
-      "error closing DelayTable '%s': %s", delay_tab.dt_path,
-      strerror(xerrno));
-
-    return PR_CTRLS_STATUS_INTERNAL_ERROR;
-  }
+  /* Reset the rows in place, rather than truncating the file out from
+   * under the sessions which have it mapped.
+   */
+  delay_table_reset();
 
   pr_ctrls_add_response(ctrl, "DelayTable '%s' reset", delay_tab.dt_path);
   return PR_CTRLS_STATUS_OK;
@@ -1687,6 +1471,12 @@ MODRET set_delaytable(cmd_rec *cmd) {
  */
 
 MODRET delay_log_pass(cmd_rec *cmd) {
+  /* The client has authenticated; the session has no further need for the
+   * DelayTable, so unmap it.  After a failed login, the table stays mapped;
+   * the client may send another set of USER/PASS commands.
+   */
+  (void) delay_table_unmap();
+
   if (delay_engine == FALSE) {
     return PR_DECLINED(cmd);
   }
@@ -1769,7 +1559,8 @@ MODRET delay_post_pass(cmd_rec *cmd) {
   unsigned char *authenticated;
 
   if (delay_engine == FALSE ||
-      delay_tab.dt_enabled == FALSE) {
+      delay_tab.dt_enabled == FALSE ||
+      delay_tab.dt_data == NULL) {
     return PR_DECLINED(cmd);
   }
 
@@ -1782,26 +1573,9 @@ MODRET delay_post_pass(cmd_rec *cmd) {
 
   rownum = delay_get_pass_rownum(main_server->sid);
 
-  /* Prepare for manipulating the table. */
-  if (delay_table_load(FALSE) < 0) {
-    int xerrno = errno;
-
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-    pr_trace_msg(trace_channel, 1,
-      "unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-
-    errno = xerrno;
-    return PR_DECLINED(cmd);
-  }
-
   memset(&tv, 0, sizeof(tv));
   gettimeofday(&tv, NULL);
 
-  delay_table_wlock(rownum);
-
   interval = (tv.tv_sec - delay_tv.tv_sec) * 1000000 +
     (tv.tv_usec - delay_tv.tv_usec);
   pr_trace_msg(trace_channel, 9,
@@ -1810,7 +1584,7 @@ MODRET delay_post_pass(cmd_rec *cmd) {
   proto = pr_session_get_protocol(0);
 
   /* Get the median interval value. */
-  median = delay_get_median(cmd->tmp_pool, rownum, proto, interval);
+  median = delay_get_median(rownum, proto, interval);
 
   /* Add the interval to the table. Only allow a single session to
    * add a portion of the cache size, to prevent a single client from
@@ -1828,23 +1602,6 @@ MODRET delay_post_pass(cmd_rec *cmd) {
     pr_event_generate("mod_delay.max-pass", session.c);
   }
 
-  /* Done with the table. */
-  delay_table_unlock(rownum);
-  if (delay_table_unload(FALSE) < 0) {
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to unload DelayTable '%s' from memory: %s",
-      delay_tab.dt_path, strerror(errno));
-  }
-
-  /* If this is a POST_CMD phase, then close the table.  If the phase is
-   * POST_CMD_ERR, then leave the table open; the client may send another
-   * set of USER/PASS commands.
-   */
-  if (session.curr_phase == POST_CMD) {
-    (void) close(delay_tab.dt_fd);
-    delay_tab.dt_fd = -1;
-  }
-
   /* If the current interval is less than the median interval (and a valid
    * median interval was selected), we need to delay ourselves a little.
    */
@@ -1884,7 +1641,8 @@ MODRET delay_post_user(cmd_rec *cmd) {
   unsigned char *authenticated;
 
   if (delay_engine == FALSE ||
-      delay_tab.dt_enabled == FALSE) {
+      delay_tab.dt_enabled == FALSE ||
+      delay_tab.dt_data == NULL) {
     return PR_DECLINED(cmd);
   }
 
@@ -1897,26 +1655,9 @@ MODRET delay_post_user(cmd_rec *cmd) {
 
   rownum = delay_get_user_rownum(main_server->sid);
 
-  /* Prepare for manipulating the table. */
-  if (delay_table_load(FALSE) < 0) {
-    int xerrno = errno;
-
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-    pr_trace_msg(trace_channel, 1,
-      "unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-
-    errno = xerrno;
-    return PR_DECLINED(cmd);
-  }
-
   memset(&tv, 0, sizeof(tv));
   gettimeofday(&tv, NULL);
 
-  delay_table_wlock(rownum);
-
   interval = (tv.tv_sec - delay_tv.tv_sec) * 1000000 +
     (tv.tv_usec - delay_tv.tv_usec);
 
@@ -1936,7 +1677,7 @@ MODRET delay_post_user(cmd_rec *cmd) {
   proto = pr_session_get_protocol(0);
 
   /* Get the median interval value. */
-  median = delay_get_median(cmd->tmp_pool, rownum, proto, interval);
+  median = delay_get_median(rownum, proto, interval);
 
   /* Add the interval to the table. Only allow a single session to
    * add a portion of the cache size, to prevent a single client from
@@ -1954,14 +1695,6 @@ MODRET delay_post_user(cmd_rec *cmd) {
     pr_event_generate("mod_delay.max-user", session.c);
   }
 
-  /* Done with the table. */
-  delay_table_unlock(rownum);
-  if (delay_table_unload(FALSE) < 0) {
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to unload DelayTable '%s' from memory: %s",
-      delay_tab.dt_path, strerror(errno));
-  }
-
   /* If the current interval is less than the median interval (and a valid
    * median interval was selected), we need to delay ourselves a little.
    */
@@ -2038,6 +1771,8 @@ static void delay_mod_unload_ev(const void *event_data, void *user_data) {
 # if defined(PR_USE_CTRLS)
   pr_ctrls_unregister(&delay_module, "delay");
 # endif /* PR_USE_CTRLS */
+
+  (void) delay_table_unmap();
 }
 #endif /* PR_SHARED_MODULE */
 
@@ -2069,7 +1804,10 @@ static void delay_postparse_ev(const void *event_data, void *user_data) {
   }
 
   if (delay_tab.dt_enabled == TRUE) {
-    (void) delay_table_init();
+    if (delay_table_init() < 0) {
+      /* Sessions will find no table, and will skip it. */
+      (void) delay_table_unmap();
+    }
   }
 }
 
@@ -2078,8 +1816,9 @@ static void delay_restart_ev(const void *event_data, void *user_data) {
     register unsigned int i;
 #endif /* PR_USE_CTRLS */
 
+  (void) delay_table_unmap();
+
   delay_tab.dt_path = PR_RUN_DIR "/proftpd.delay";
-  delay_tab.dt_data = NULL;
   delay_tab.dt_lookup = NULL;
   delay_tab.dt_enabled = TRUE;
 
@@ -2108,11 +1847,6 @@ static void delay_sess_reinit_ev(const void *event_data, void *user_data) {
 
   delay_engine = TRUE;
 
-  if (delay_tab.dt_fd > 0) {
-    close(delay_tab.dt_fd);
-    delay_tab.dt_fd = -1;
-  }
-
   delay_nuser = 0;
   delay_npass = 0;
 
@@ -2130,7 +1864,8 @@ static void delay_shutdown_ev(const void *event_data, void *user_data) {
   int xerrno = 0;
 
   if (delay_engine == FALSE ||
-      delay_tab.dt_enabled == FALSE) {
+      delay_tab.dt_enabled == FALSE ||
+      delay_tab.dt_data == NULL) {
     return;
   }
 
@@ -2151,24 +1886,6 @@ static void delay_shutdown_ev(const void *event_data, void *user_data) {
     return;
   }
 
-  delay_tab.dt_fd = fh->fh_fd;
-  delay_tab.dt_data = NULL;
-
-  if (delay_table_load(TRUE) < 0) {
-    xerrno = errno;
-    pr_fsio_close(fh);
-
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-    pr_trace_msg(trace_channel, 1,
-      "unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-
-    errno = xerrno;
-    return;
-  }
-
   datalen = delay_tab.dt_size;
   data = palloc(delay_pool, datalen);
   if (data != NULL &&
@@ -2176,11 +1893,7 @@ static void delay_shutdown_ev(const void *event_data, void *user_data) {
     memcpy(data, delay_tab.dt_data, datalen);
   }
 
-  if (delay_table_unload(TRUE) < 0) {
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": error unloading DelayTable '%s' from memory: %s",
-      delay_tab.dt_path, strerror(errno));
-  }
+  (void) delay_table_unmap();
 
   if (data != NULL &&
       datalen > 0) {
@@ -2191,7 +1904,6 @@ static void delay_shutdown_ev(const void *event_data, void *user_data) {
     }
   }
 
-  delay_tab.dt_fd = -1;
   if (pr_fsio_close(fh) < 0) {
     pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
       ": error writing DelayTable '%s': %s", delay_tab.dt_path,
@@ -2239,9 +1951,7 @@ static int delay_init(void) {
 }
 
 static int delay_sess_init(void) {
-  pr_fh_t *fh;
   config_rec *c;
-  int xerrno;
 
   pr_event_register(&delay_module, "core.session-reinit", delay_sess_reinit_ev,
     NULL);
@@ -2315,40 +2025,15 @@ static int delay_sess_init(void) {
   delay_nuser = 0;
   delay_npass = 0;
 
-  pr_trace_msg(trace_channel, 6, "opening DelayTable '%s'", delay_tab.dt_path);
-
-  PRIVS_ROOT
-  fh = pr_fsio_open(delay_tab.dt_path, O_RDWR);
-  xerrno = errno;
-  PRIVS_RELINQUISH
-
-  if (fh == NULL) {
+  /* The DelayTable is mapped by the daemon process, and inherited by us. */
+  if (delay_tab.dt_data == NULL) {
     pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to open DelayTable '%s': %s", delay_tab.dt_path,
-      strerror(xerrno));
-    pr_trace_msg(trace_channel, 1, "unable to open DelayTable '%s': %s",
-      delay_tab.dt_path, strerror(xerrno));
+      ": DelayTable '%s' not loaded, disabling module", delay_tab.dt_path);
+    pr_trace_msg(trace_channel, 1, "DelayTable '%s' not loaded",
+      delay_tab.dt_path);
     delay_engine = FALSE;
-    return 0;
   }
 
-  /* Find a usable fd for the just-opened DelayTable fd. */
-  if (pr_fs_get_usable_fd2(&(fh->fh_fd)) < 0) {
-    pr_log_debug(DEBUG0, MOD_DELAY_VERSION
-      ": warning: unable to find good fd for DelayTable %d: %s",
-      fh->fh_fd, strerror(errno));
-  }
-
-  /* Set the close-on-exec flag, for safety. */
-  if (fcntl(fh->fh_fd, F_SETFD, FD_CLOEXEC) < 0) {
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to set CLO_EXEC on DelayTable fd %d: %s", fh->fh_fd,
-      strerror(errno));
-  }
-
-  delay_tab.dt_fd = fh->fh_fd;
-  delay_tab.dt_data = NULL;
-
   return 0;
 }
 
@@ -49,6 +49,16 @@ static const char *trace_channel = "facl";
 # include <acl/libacl.h>
 #endif
 
+#if defined(HAVE_LINUX_POSIX_ACL) && \
+    defined(HAVE_SYS_XATTR_H)
+# include <sys/xattr.h>
+
+/* Linux stores extended access ACLs in this extended attribute; files
+ * without one have only the ACL implied by their mode bits.
+ */
+# define FACL_XATTR_ACCESS		"system.posix_acl_access"
+#endif
+
 static int is_errno_eperm(int xerrno) {
   if (xerrno == EPERM) {
     return TRUE;
@@ -976,22 +986,290 @@ static int check_facl(pool *p, const char *path, int mode, void *acl, int nents,
 
 # if defined(PR_USE_FACL)
 
+/* Access check cache
+ *
+ * ACL evaluation needs the ACL to be fetched from the filesystem and walked
+ * for every check, and directory listings check every entry.  Results are
+ * thus cached per session, keyed by the file's device, inode and ctime.
+ * Any change to a file's ACL, mode or ownership updates its ctime, and so
+ * invalidates the cached results.
+ */
+
+/* Size of the per-session cache of access check results. */
+#define FACL_CACHE_SIZE			256
+
+struct facl_cache_entry {
+  dev_t dev;
+  ino_t ino;
+  time_t ctime;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+
+  /* Bitmasks, indexed by access(2) mode, of the modes checked and of
+   * the modes allowed.
+   */
+  unsigned char checked;
+  unsigned char allowed;
+};
+
+static struct facl_cache_entry facl_cache[FACL_CACHE_SIZE];
+
+/* The identity for which the cached results were computed. */
+static pool *facl_cache_pool = NULL;
+static int facl_cache_have_ids = FALSE;
+static uid_t facl_cache_uid;
+static gid_t facl_cache_gid;
+static array_header *facl_cache_gids = NULL;
+
+static void facl_cache_clear(void) {
+  memset(facl_cache, 0, sizeof(facl_cache));
+  facl_cache_have_ids = FALSE;
+
+  if (facl_cache_pool != NULL) {
+    destroy_pool(facl_cache_pool);
+    facl_cache_pool = NULL;
+    facl_cache_gids = NULL;
+  }
+}
+
+static int facl_cache_ids_match(uid_t uid, gid_t gid,
+    array_header *suppl_gids) {
+  unsigned int ngids, cached_ngids;
+
+  if (facl_cache_have_ids == FALSE ||
+      facl_cache_uid != uid ||
+      facl_cache_gid != gid) {
+    return FALSE;
+  }
+
+  ngids = suppl_gids != NULL ? suppl_gids->nelts : 0;
+  cached_ngids = facl_cache_gids != NULL ? facl_cache_gids->nelts : 0;
+
+  if (ngids != cached_ngids) {
+    return FALSE;
+  }
+
+  if (ngids > 0 &&
+      memcmp(suppl_gids->elts, facl_cache_gids->elts,
+        ngids * sizeof(gid_t)) != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Makes the cache hold results for the given identity, discarding any
+ * results cached for a different identity.
+ */
+static void facl_cache_set_ids(uid_t uid, gid_t gid,
+    array_header *suppl_gids) {
+  if (facl_cache_ids_match(uid, gid, suppl_gids) == TRUE) {
+    return;
+  }
+
+  facl_cache_clear();
+
+  facl_cache_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(facl_cache_pool, "mod_facl cache pool");
+
+  facl_cache_uid = uid;
+  facl_cache_gid = gid;
+  if (suppl_gids != NULL) {
+    facl_cache_gids = copy_array(facl_cache_pool, suppl_gids);
+  }
+
+  facl_cache_have_ids = TRUE;
+}
+
+static struct facl_cache_entry *facl_cache_slot(struct stat *st) {
+  unsigned long h;
+
+  h = ((unsigned long) st->st_ino * 2654435761UL) ^
+    (unsigned long) st->st_dev;
+  return &(facl_cache[h % FACL_CACHE_SIZE]);
+}
+
+static int facl_cache_entry_matches(struct facl_cache_entry *ent,
+    struct stat *st) {
+  if (ent->checked == 0 ||
+      ent->dev != st->st_dev ||
+      ent->ino != st->st_ino ||
+      ent->ctime != st->st_ctime ||
+      ent->mode != st->st_mode ||
+      ent->uid != st->st_uid ||
+      ent->gid != st->st_gid) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Returns TRUE, and the cached result in res, if the result of checking
+ * the given mode on the given file is cached; FALSE otherwise.
+ */
+static int facl_cache_get(struct stat *st, int mode, uid_t uid, gid_t gid,
+    array_header *suppl_gids, int *res) {
+  struct facl_cache_entry *ent;
+  unsigned char mode_bit;
+
+  if (mode & ~(R_OK|W_OK|X_OK)) {
+    return FALSE;
+  }
+
+  if (facl_cache_ids_match(uid, gid, suppl_gids) == FALSE) {
+    return FALSE;
+  }
+
+  ent = facl_cache_slot(st);
+  mode_bit = (unsigned char) (1 << mode);
+
+  if (facl_cache_entry_matches(ent, st) == FALSE ||
+      !(ent->checked & mode_bit)) {
+    return FALSE;
+  }
+
+  *res = (ent->allowed & mode_bit) ? 0 : -1;
+  return TRUE;
+}
+
+static void facl_cache_add(struct stat *st, int mode, uid_t uid, gid_t gid,
+    array_header *suppl_gids, int res) {
+  struct facl_cache_entry *ent;
+  unsigned char mode_bit;
+
+  if (mode & ~(R_OK|W_OK|X_OK)) {
+    return;
+  }
+
+  /* A file changed within the current second could change again without
+   * its ctime changing, so do not cache results for it yet.
+   */
+  if (st->st_ctime >= time(NULL)) {
+    return;
+  }
+
+  facl_cache_set_ids(uid, gid, suppl_gids);
+
+  ent = facl_cache_slot(st);
+  if (facl_cache_entry_matches(ent, st) == FALSE) {
+    ent->dev = st->st_dev;
+    ent->ino = st->st_ino;
+    ent->ctime = st->st_ctime;
+    ent->mode = st->st_mode;
+    ent->uid = st->st_uid;
+    ent->gid = st->st_gid;
+    ent->checked = ent->allowed = 0;
+  }
+
+  mode_bit = (unsigned char) (1 << mode);
+  ent->checked |= mode_bit;
+  if (res == 0) {
+    ent->allowed |= mode_bit;
+
+  } else {
+    ent->allowed &= ~mode_bit;
+  }
+}
+
+#  if defined(FACL_XATTR_ACCESS)
+/* Returns FALSE if the file, given either by path or by fd, definitely has
+ * no extended access ACL, and TRUE otherwise.
+ */
+static int facl_have_extended_acl(const char *path, int fd) {
+  ssize_t res;
+
+  if (path != NULL) {
+    res = getxattr(path, FACL_XATTR_ACCESS, NULL, 0);
+
+  } else {
+    res = fgetxattr(fd, FACL_XATTR_ACCESS, NULL, 0);
+  }
+
+  if (res < 0 &&
+      errno == ENODATA) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Checks access for a file which has no extended ACL, i.e. whose ACL has
+ * only the owner, group owner and other entries given by its mode bits,
+ * the same way that check_bsd_facl() would check that minimal ACL.
+ */
+static int facl_check_mode_bits(struct stat *st, int mode, uid_t uid,
+    gid_t gid, array_header *suppl_gids) {
+  mode_t user_bit, group_bit, other_bit;
+
+  switch (mode) {
+    case R_OK:
+      user_bit = S_IRUSR;
+      group_bit = S_IRGRP;
+      other_bit = S_IROTH;
+      break;
+
+    case W_OK:
+      user_bit = S_IWUSR;
+      group_bit = S_IWGRP;
+      other_bit = S_IWOTH;
+      break;
+
+    case X_OK:
+      user_bit = S_IXUSR;
+      group_bit = S_IXGRP;
+      other_bit = S_IXOTH;
+      break;
+
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  if (uid == st->st_uid) {
+    if (st->st_mode & user_bit) {
+      return 0;
+    }
+
+    errno = EACCES;
+    return -1;
+  }
+
+  if (st->st_mode & group_bit) {
+    if (gid == st->st_gid) {
+      return 0;
+    }
+
+    if (suppl_gids != NULL) {
+      register unsigned int i;
+
+      for (i = 0; i < suppl_gids->nelts; i++) {
+        if (((gid_t *) suppl_gids->elts)[i] == st->st_gid) {
+          return 0;
+        }
+      }
+    }
+  }
+
+  if (st->st_mode & other_bit) {
+    return 0;
+  }
+
+  errno = EACCES;
+  return -1;
+}
+#  endif /* FACL_XATTR_ACCESS */
+
 /* FSIO handlers
  */
 
-static int facl_fsio_access(pr_fs_t *fs, const char *path, int mode,
-    uid_t uid, gid_t gid, array_header *suppl_gids) {
+static int facl_check_path(pr_fs_t *fs, const char *path, int mode,
+    uid_t uid, gid_t gid, array_header *suppl_gids, struct stat *st) {
   const char *real_path = NULL;
   int nents = 0, res, xerrno;
-  struct stat st;
   void *acls;
   pool *tmp_pool = NULL;
 
-  pr_fs_clear_cache2(path);
-  if (pr_fsio_stat(path, &st) < 0) {
-    return -1;
-  }
-
   tmp_pool = make_sub_pool(fs->fs_pool);
   pr_pool_tag(tmp_pool, "mod_facl access(2) pool");
 
@@ -1104,7 +1382,7 @@ static int facl_fsio_access(pr_fs_t *fs, const char *path, int mode,
   }
 # endif
 
-  res = check_facl(tmp_pool, path, mode, acls, nents, &st, uid, gid,
+  res = check_facl(tmp_pool, path, mode, acls, nents, st, uid, gid,
     suppl_gids);
   xerrno = errno;
 
@@ -1119,18 +1397,57 @@ static int facl_fsio_access(pr_fs_t *fs, const char *path, int mode,
   return res;
 }
 
-static int facl_fsio_faccess(pr_fh_t *fh, int mode, uid_t uid, gid_t gid,
-    array_header *suppl_gids) {
-  const char *real_path = NULL;
-  int nents = 0, res, xerrno;
+static int facl_fsio_access(pr_fs_t *fs, const char *path, int mode,
+    uid_t uid, gid_t gid, array_header *suppl_gids) {
+  int res, xerrno;
   struct stat st;
-  void *acls;
-  pool *tmp_pool = NULL;
 
-  if (pr_fsio_fstat(fh, &st) < 0) {
+  pr_fs_clear_cache2(path);
+  if (pr_fsio_stat(path, &st) < 0) {
     return -1;
   }
 
+  if (facl_cache_get(&st, mode, uid, gid, suppl_gids, &res) == TRUE) {
+    pr_trace_msg(trace_channel, 15, "using cached %s access check result "
+      "for '%s'", res == 0 ? "allowed" : "denied", path);
+    if (res < 0) {
+      errno = EACCES;
+    }
+
+    return res;
+  }
+
+#  if defined(FACL_XATTR_ACCESS)
+  if ((mode == R_OK || mode == W_OK || mode == X_OK) &&
+      facl_have_extended_acl(path, -1) == FALSE) {
+    pr_trace_msg(trace_channel, 15, "no extended ACL for '%s', checking "
+      "mode bits", path);
+    res = facl_check_mode_bits(&st, mode, uid, gid, suppl_gids);
+
+  } else {
+    res = facl_check_path(fs, path, mode, uid, gid, suppl_gids, &st);
+  }
+#  else
+  res = facl_check_path(fs, path, mode, uid, gid, suppl_gids, &st);
+#  endif /* FACL_XATTR_ACCESS */
+  xerrno = errno;
+
+  if (res == 0 ||
+      xerrno == EACCES) {
+    facl_cache_add(&st, mode, uid, gid, suppl_gids, res);
+  }
+
+  errno = xerrno;
+  return res;
+}
+
+static int facl_check_fh(pr_fh_t *fh, int mode, uid_t uid, gid_t gid,
+    array_header *suppl_gids, struct stat *st) {
+  const char *real_path = NULL;
+  int nents = 0, res, xerrno;
+  void *acls;
+  pool *tmp_pool = NULL;
+
   /* Look up the acl for this fd. */
 # if defined(HAVE_BSD_POSIX_ACL) || \
      defined(HAVE_LINUX_POSIX_ACL) || \
@@ -1242,7 +1559,7 @@ static int facl_fsio_faccess(pr_fh_t *fh, int mode, uid_t uid, gid_t gid,
     real_path = fh->fh_path;
   }
 
-  res = check_facl(tmp_pool, real_path, mode, acls, nents, &st, uid, gid,
+  res = check_facl(tmp_pool, real_path, mode, acls, nents, st, uid, gid,
     suppl_gids);
   xerrno = errno;
 
@@ -1256,6 +1573,49 @@ static int facl_fsio_faccess(pr_fh_t *fh, int mode, uid_t uid, gid_t gid,
   errno = xerrno;
   return res;
 }
+
+static int facl_fsio_faccess(pr_fh_t *fh, int mode, uid_t uid, gid_t gid,
+    array_header *suppl_gids) {
+  int res, xerrno;
+  struct stat st;
+
+  if (pr_fsio_fstat(fh, &st) < 0) {
+    return -1;
+  }
+
+  if (facl_cache_get(&st, mode, uid, gid, suppl_gids, &res) == TRUE) {
+    pr_trace_msg(trace_channel, 15, "using cached %s access check result "
+      "for '%s'", res == 0 ? "allowed" : "denied", fh->fh_path);
+    if (res < 0) {
+      errno = EACCES;
+    }
+
+    return res;
+  }
+
+#  if defined(FACL_XATTR_ACCESS)
+  if ((mode == R_OK || mode == W_OK || mode == X_OK) &&
+      facl_have_extended_acl(NULL, PR_FH_FD(fh)) == FALSE) {
+    pr_trace_msg(trace_channel, 15, "no extended ACL for '%s', checking "
+      "mode bits", fh->fh_path);
+    res = facl_check_mode_bits(&st, mode, uid, gid, suppl_gids);
+
+  } else {
+    res = facl_check_fh(fh, mode, uid, gid, suppl_gids, &st);
+  }
+#  else
+  res = facl_check_fh(fh, mode, uid, gid, suppl_gids, &st);
+#  endif /* FACL_XATTR_ACCESS */
+  xerrno = errno;
+
+  if (res == 0 ||
+      xerrno == EACCES) {
+    facl_cache_add(&st, mode, uid, gid, suppl_gids, res);
+  }
+
+  errno = xerrno;
+  return res;
+}
 # endif /* !PR_USE_FACL */
 #endif /* HAVE_POSIX_ACL */
 
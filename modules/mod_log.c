@@ -33,6 +33,7 @@
 #define MOD_LOG_VERSION				"mod_log/1.0"
 
 module log_module;
+extern xaset_t *server_list;
 
 /* Max path length plus 128 bytes for additional info. */
 #define EXTENDED_LOG_BUFFER_SIZE		(PR_TUNABLE_PATH_MAX + 128)
@@ -64,6 +65,14 @@ struct logfile_struc {
   config_rec		*lf_conf;
 };
 
+/* The ExtendedLogs precomputed for a server, and the ExtendedLog config_recs
+ * from which they were made.
+ */
+struct extlog_template {
+  array_header		*extlogs;
+  array_header		*configs;
+};
+
 /* Value for lf_fd signalling that data should be logged via syslog, rather
  * than written to a file.
  */
@@ -132,6 +141,7 @@ static const char *trace_channel = "extlog";
 */
 
 /* Necessary prototypes */
+static array_header *get_extendedlogs(pool *, server_rec *, array_header *);
 static int log_sess_init(void);
 static void log_xfer_stalled_ev(const void *, void *);
 
@@ -872,6 +882,24 @@ static void log_exit_ev(const void *event_data, void *user_data) {
 
 static void log_postparse_ev(const void *event_data, void *user_data) {
   config_rec *c;
+  server_rec *s;
+
+  /* Precompute the ExtendedLogs for each server, so that session processes
+   * need not search the entire configuration for them.
+   */
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    struct extlog_template *tmpl;
+
+    tmpl = pcalloc(log_pool, sizeof(struct extlog_template));
+    tmpl->configs = make_array(log_pool, 0, sizeof(config_rec *));
+    tmpl->extlogs = get_extendedlogs(log_pool, s, tmpl->configs);
+
+    if (pr_module_set_session_template(&log_module, s, tmpl) < 0) {
+      pr_trace_msg(trace_channel, 3,
+        "error setting session template for server '%s': %s", s->ServerName,
+        strerror(errno));
+    }
+  }
 
   c = find_config(main_server->conf, CONF_PARAM, "SystemLog", FALSE);
   if (c != NULL) {
@@ -997,13 +1025,21 @@ static int log_init(void) {
   return 0;
 }
 
-static void find_extendedlogs(void) {
+/* Finds all of the ExtendedLog configurations for the given server, returning
+ * them as a list of logfile_t templates, allocated from the given pool.  If
+ * provided, the ExtendedLog config_recs found are added to the configs list.
+ */
+static array_header *get_extendedlogs(pool *p, server_rec *s,
+    array_header *configs) {
   config_rec *c;
   char *logfname, *logfmt_name = NULL;
   logformat_t *logfmt;
   logfile_t *extlog = NULL;
+  array_header *extlogs;
   unsigned long config_flags = (PR_CONFIG_FIND_FL_SKIP_DIR|PR_CONFIG_FIND_FL_SKIP_LIMIT|PR_CONFIG_FIND_FL_SKIP_DYNDIR);
 
+  extlogs = make_array(p, 0, sizeof(logfile_t *));
+
   /* We DO actually want the recursion here.  The reason is that we want
    * to find ALL_ ExtendedLog directives in the configuration, including
    * those in <Anonymous> sections.  We have the ability to use root privs
@@ -1017,13 +1053,16 @@ static void find_extendedlogs(void) {
    * in the top-level (CONF_ROOT, CONF_VIRTUAL) and <Anonymous> sections.
    */
 
-  c = find_config2(main_server->conf, CONF_PARAM, "ExtendedLog", TRUE,
-    config_flags);
+  c = find_config2(s->conf, CONF_PARAM, "ExtendedLog", TRUE, config_flags);
   while (c != NULL) {
     pr_jot_filters_t *jot_filters = NULL;
 
     pr_signals_handle();
 
+    if (configs != NULL) {
+      *((config_rec **) push_array(configs)) = c;
+    }
+
     logfname = c->argv[0];
     logfmt_name = NULL;
 
@@ -1079,24 +1118,108 @@ static void find_extendedlogs(void) {
       logfmt = formats;
     }
 
-    extlog = (logfile_t *) pcalloc(session.pool, sizeof(logfile_t));
+    extlog = (logfile_t *) pcalloc(p, sizeof(logfile_t));
 
-    extlog->lf_filename = pstrdup(session.pool, logfname);
+    extlog->lf_filename = pstrdup(p, logfname);
     extlog->lf_fd = -1;
     extlog->lf_syslog_level = -1;
     extlog->lf_jot_filters = jot_filters;
     extlog->lf_format = logfmt;
     extlog->lf_conf = c->parent;
+
+    *((logfile_t **) push_array(extlogs)) = extlog;
+
+loop_extendedlogs:
+    c = find_config_next2(c, c->next, CONF_PARAM, "ExtendedLog", TRUE,
+      config_flags);
+  }
+
+  return extlogs;
+}
+
+/* Returns TRUE if the session's ExtendedLog configuration still matches the
+ * given template, i.e. it has not been changed since the daemon precomputed
+ * the template, e.g. by mod_ifsession merging in <IfClass>, <IfGroup>, or
+ * <IfUser> sections.
+ */
+static int extendedlogs_match(struct extlog_template *tmpl) {
+  config_rec *c;
+  unsigned int count = 0;
+  unsigned long config_flags = (PR_CONFIG_FIND_FL_SKIP_DIR|PR_CONFIG_FIND_FL_SKIP_LIMIT|PR_CONFIG_FIND_FL_SKIP_DYNDIR);
+
+  c = find_config2(main_server->conf, CONF_PARAM, "ExtendedLog", TRUE,
+    config_flags);
+  while (c != NULL) {
+    register unsigned int i;
+    config_rec **configs;
+    int found = FALSE;
+
+    pr_signals_handle();
+
+    configs = tmpl->configs->elts;
+    for (i = 0; i < tmpl->configs->nelts; i++) {
+      if (configs[i] == c) {
+        found = TRUE;
+        break;
+      }
+    }
+
+    if (found == FALSE) {
+      return FALSE;
+    }
+
+    count++;
+    c = find_config_next2(c, c->next, CONF_PARAM, "ExtendedLog", TRUE,
+      config_flags);
+  }
+
+  return count == tmpl->configs->nelts ? TRUE : FALSE;
+}
+
+static void find_extendedlogs(void) {
+  register unsigned int i;
+  struct extlog_template *tmpl;
+  array_header *extlogs = NULL;
+  logfile_t **elts;
+
+  /* Use the ExtendedLogs precomputed for this server in the daemon process,
+   * if available, and if the configuration has not since been changed for
+   * this session.  Only mod_ifsession changes the configuration before now,
+   * and it leaves a note when it does; only then do we need to check.
+   */
+  tmpl = pr_module_get_session_template(&log_module, main_server);
+  if (tmpl != NULL) {
+    if (pr_table_get(session.notes, "mod_ifsession.merged", NULL) == NULL ||
+        extendedlogs_match(tmpl) == TRUE) {
+      extlogs = tmpl->extlogs;
+
+    } else {
+      pr_trace_msg(trace_channel, 9,
+        "ExtendedLog configuration changed for session, ignoring template");
+    }
+  }
+
+  if (extlogs == NULL) {
+    extlogs = get_extendedlogs(session.pool, main_server, NULL);
+  }
+
+  elts = extlogs->elts;
+  for (i = 0; i < extlogs->nelts; i++) {
+    logfile_t *extlog;
+
+    /* The templates are shared; each session gets its own copy, for its own
+     * file descriptors.
+     */
+    extlog = (logfile_t *) pcalloc(session.pool, sizeof(logfile_t));
+    memcpy(extlog, elts[i], sizeof(logfile_t));
+    extlog->next = extlog->prev = NULL;
+
     if (log_set == NULL) {
       log_set = xaset_create(session.pool, NULL);
     }
 
     xaset_insert(log_set, (xasetmember_t *) extlog);
     logs = (logfile_t *) log_set->xas_list;
-
-loop_extendedlogs:
-    c = find_config_next2(c, c->next, CONF_PARAM, "ExtendedLog", TRUE,
-      config_flags);
   }
 }
 
@@ -1949,6 +1949,11 @@ int set_groups(pool *p, gid_t primary_gid, array_header *suppl_gids) {
   char *strgids = "";
   int have_root_privs = TRUE;
 
+  /* Setting the primary GID changes our effective GID out from under the
+   * PRIVS_ macros.
+   */
+  pr_privs_clear_cache();
+
   /* First, check to see whether we even CAN set the process GIDs, which
    * requires root privileges.
    */
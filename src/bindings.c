@@ -950,6 +950,282 @@ int pr_ipbind_open(const pr_netaddr_t *addr, unsigned int port,
   return 0;
 }
 
+/* Namebind index.
+ *
+ * Namebinds for exact names are kept in a hash table, keyed by the
+ * (case-insensitive) name.  Namebinds for wildcards of the form "*.domain",
+ * by far the most common wildcards, are kept in a separate hash table, keyed
+ * by the domain; a name is then matched against these by looking up each of
+ * its parent domains.  Any other wildcard patterns are kept in a list, and
+ * matched in order.
+ *
+ * Lookups return the earliest created matching namebind, just as a scan of
+ * the ipbind's namebind list would.
+ */
+
+struct namebind_hash {
+  pr_namebind_t **chains;
+  unsigned int nchains;
+  unsigned int count;
+};
+
+struct namebind_index_rec {
+  struct namebind_hash exact;
+  struct namebind_hash suffix;
+  array_header *globs;
+};
+
+#define NAMEBIND_INDEX_MIN_NCHAINS	32
+
+/* Returns TRUE if the given wildcard pattern is of the form "*.domain", where
+ * the domain itself has no wildcard characters.
+ */
+static int namebind_is_suffix_pattern(const char *name) {
+  if (strncmp(name, "*.", 2) != 0) {
+    return FALSE;
+  }
+
+  name += 2;
+  if (*name == '\0' ||
+      strpbrk(name, "*?[]\\") != NULL) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Returns the key by which the namebind is indexed. */
+static const char *namebind_get_key(pr_namebind_t *nb) {
+  if (nb->nb_iswildcard == TRUE) {
+    /* Skip the leading "*." of suffix patterns. */
+    return nb->nb_name + 2;
+  }
+
+  return nb->nb_name;
+}
+
+/* Case-insensitive FNV-1a hash, since DNS names are case-insensitive. */
+static unsigned int namebind_hash_key(const char *key, size_t keylen) {
+  register unsigned int i;
+  unsigned int h = 2166136261U;
+
+  for (i = 0; i < keylen; i++) {
+    h ^= (unsigned char) tolower((int) key[i]);
+    h *= 16777619U;
+  }
+
+  return h;
+}
+
+static void namebind_hash_resize(struct namebind_hash *nh,
+    unsigned int nchains) {
+  register unsigned int i;
+  pr_namebind_t **chains;
+
+  chains = pcalloc(binding_pool, sizeof(pr_namebind_t *) * nchains);
+
+  for (i = 0; i < nh->nchains; i++) {
+    pr_namebind_t *nb, *next_nb;
+
+    for (nb = nh->chains[i]; nb; nb = next_nb) {
+      unsigned int idx;
+
+      next_nb = nb->nb_hash_next;
+
+      idx = nb->nb_hash & (nchains - 1);
+      nb->nb_hash_next = chains[idx];
+      chains[idx] = nb;
+    }
+  }
+
+  /* Note: by not freeing the memory of the previously allocated chains,
+   * this constitutes a minor leak of the binding pool, until restart.
+   */
+  nh->chains = chains;
+  nh->nchains = nchains;
+}
+
+static pr_namebind_t *namebind_hash_get(struct namebind_hash *nh,
+    const char *key, size_t keylen) {
+  unsigned int h;
+  pr_namebind_t *nb;
+
+  if (nh->count == 0) {
+    return NULL;
+  }
+
+  h = namebind_hash_key(key, keylen);
+  for (nb = nh->chains[h & (nh->nchains - 1)]; nb; nb = nb->nb_hash_next) {
+    const char *nb_key;
+
+    if (nb->nb_hash != h) {
+      continue;
+    }
+
+    nb_key = namebind_get_key(nb);
+    if (strncasecmp(nb_key, key, keylen) == 0 &&
+        nb_key[keylen] == '\0') {
+      return nb;
+    }
+  }
+
+  return NULL;
+}
+
+static void namebind_hash_add(struct namebind_hash *nh, pr_namebind_t *nb) {
+  const char *key;
+  unsigned int idx;
+
+  if (nh->chains == NULL) {
+    namebind_hash_resize(nh, NAMEBIND_INDEX_MIN_NCHAINS);
+
+  } else if (nh->count >= (nh->nchains * 2)) {
+    /* Keep the chains short, even for many thousands of names. */
+    namebind_hash_resize(nh, nh->nchains * 4);
+  }
+
+  key = namebind_get_key(nb);
+  nb->nb_hash = namebind_hash_key(key, strlen(key));
+
+  idx = nb->nb_hash & (nh->nchains - 1);
+  nb->nb_hash_next = nh->chains[idx];
+  nh->chains[idx] = nb;
+  nh->count++;
+}
+
+/* Returns the indexed namebind with the same name as the given name, if any.
+ */
+static pr_namebind_t *namebind_index_get_dup(struct namebind_index_rec *idx,
+    const char *name) {
+  register unsigned int i;
+  pr_namebind_t **globs;
+
+  if (pr_str_is_fnmatch(name) == FALSE) {
+    return namebind_hash_get(&(idx->exact), name, strlen(name));
+  }
+
+  if (namebind_is_suffix_pattern(name) == TRUE) {
+    return namebind_hash_get(&(idx->suffix), name + 2, strlen(name + 2));
+  }
+
+  globs = idx->globs->elts;
+  for (i = 0; i < idx->globs->nelts; i++) {
+    if (strcasecmp(globs[i]->nb_name, name) == 0) {
+      return globs[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void namebind_index_add(pr_ipbind_t *ipbind, pr_namebind_t *nb) {
+  struct namebind_index_rec *idx;
+
+  idx = ipbind->ib_namebind_index;
+  if (idx == NULL) {
+    idx = pcalloc(binding_pool, sizeof(struct namebind_index_rec));
+    idx->globs = make_array(binding_pool, 0, sizeof(pr_namebind_t *));
+    ipbind->ib_namebind_index = idx;
+  }
+
+  if (nb->nb_iswildcard == FALSE) {
+    namebind_hash_add(&(idx->exact), nb);
+
+  } else if (namebind_is_suffix_pattern(nb->nb_name) == TRUE) {
+    namebind_hash_add(&(idx->suffix), nb);
+
+  } else {
+    /* Note that glob namebinds are never looked up via hash, so we leave
+     * nb_hash unset for them.
+     */
+    *((pr_namebind_t **) push_array(idx->globs)) = nb;
+  }
+}
+
+static int namebind_is_candidate(pr_namebind_t *nb, pr_namebind_t *best,
+    unsigned char skip_inactive) {
+  if (nb == NULL) {
+    return FALSE;
+  }
+
+  if (skip_inactive == TRUE &&
+      nb->nb_isactive == FALSE) {
+    pr_trace_msg(trace_channel, 17,
+      "namebind #%u: %s is inactive, skipping", nb->nb_idx, nb->nb_name);
+    return FALSE;
+  }
+
+  if (best != NULL &&
+      best->nb_idx < nb->nb_idx) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static pr_namebind_t *namebind_index_find(struct namebind_index_rec *idx,
+    const char *name, unsigned char skip_inactive) {
+  register unsigned int i;
+  size_t namelen;
+  pr_namebind_t *nb, *best = NULL, **globs;
+
+  namelen = strlen(name);
+
+  nb = namebind_hash_get(&(idx->exact), name, namelen);
+  if (namebind_is_candidate(nb, best, skip_inactive) == TRUE) {
+    best = nb;
+  }
+
+  /* Check each of the parent domains of the given name against the
+   * "*.domain" wildcards.  Note that the wildcard also matches a name which
+   * starts with the dot, e.g. ".domain".
+   */
+  if (idx->suffix.count > 0) {
+    for (i = 0; i < namelen; i++) {
+      if (name[i] != '.') {
+        continue;
+      }
+
+      nb = namebind_hash_get(&(idx->suffix), name + i + 1, namelen - i - 1);
+      if (namebind_is_candidate(nb, best, skip_inactive) == TRUE) {
+        pr_trace_msg(trace_channel, 9,
+          "matched name '%s' against pattern '%s'", name, nb->nb_name);
+        best = nb;
+      }
+    }
+  }
+
+  /* Finally, any remaining wildcards which were created before the best
+   * match so far.
+   */
+  globs = idx->globs->elts;
+  for (i = 0; i < idx->globs->nelts; i++) {
+    int match_flags = PR_FNM_NOESCAPE|PR_FNM_CASEFOLD;
+
+    nb = globs[i];
+    if (best != NULL &&
+        best->nb_idx < nb->nb_idx) {
+      break;
+    }
+
+    if (namebind_is_candidate(nb, best, skip_inactive) == FALSE) {
+      continue;
+    }
+
+    if (pr_fnmatch(nb->nb_name, name, match_flags) == 0) {
+      pr_trace_msg(trace_channel, 9,
+        "matched name '%s' against pattern '%s'", name, nb->nb_name);
+      best = nb;
+      break;
+    }
+
+    pr_trace_msg(trace_channel, 9,
+      "failed to match name '%s' against pattern '%s'", name, nb->nb_name);
+  }
+
+  return best;
+}
+
 int pr_namebind_close(const char *name, const pr_netaddr_t *addr) {
   pr_namebind_t *namebind = NULL;
   unsigned int port;
@@ -973,7 +1249,7 @@ int pr_namebind_close(const char *name, const pr_netaddr_t *addr) {
 
 int pr_namebind_create(server_rec *server, const char *name,
     pr_ipbind_t *ipbind, const pr_netaddr_t *addr, unsigned int server_port) {
-  pr_namebind_t *namebind = NULL, **namebinds = NULL;
+  pr_namebind_t *namebind = NULL;
   unsigned int port;
 
   if (server == NULL ||
@@ -1028,30 +1304,16 @@ int pr_namebind_create(server_rec *server, const char *name,
   if (ipbind->ib_namebinds == NULL) {
     ipbind->ib_namebinds = make_array(binding_pool, 0, sizeof(pr_namebind_t *));
 
-  } else {
-    register unsigned int i = 0;
-    namebinds = (pr_namebind_t **) ipbind->ib_namebinds->elts;
-
-    /* See if there is already a namebind for the given name. */
-    for (i = 0; i < ipbind->ib_namebinds->nelts; i++) {
-      pr_signals_handle();
-
-      namebind = namebinds[i];
-      if (namebind != NULL &&
-          namebind->nb_name != NULL) {
-
-        /* DNS names are case-insensitive, hence the case-insensitive check
-         * here.
-         *
-         * XXX Ideally, we should check whether any existing namebinds which
-         * are globs will match the newly added namebind as well.
-         */
-
-        if (strcasecmp(namebind->nb_name, name) == 0) {
-          errno = EEXIST;
-          return -1;
-        }
-      }
+  } else if (ipbind->ib_namebind_index != NULL) {
+    /* See if there is already a namebind for the given name.  DNS names are
+     * case-insensitive, hence the case-insensitive index.
+     *
+     * XXX Ideally, we should check whether any existing namebinds which
+     * are globs will match the newly added namebind as well.
+     */
+    if (namebind_index_get_dup(ipbind->ib_namebind_index, name) != NULL) {
+      errno = EEXIST;
+      return -1;
     }
   }
 
@@ -1060,6 +1322,7 @@ int pr_namebind_create(server_rec *server, const char *name,
   namebind->nb_server = server;
   namebind->nb_server_port = server_port;
   namebind->nb_isactive = FALSE;
+  namebind->nb_idx = ipbind->ib_namebinds->nelts;
 
   if (pr_str_is_fnmatch(name) == TRUE) {
     namebind->nb_iswildcard = TRUE;
@@ -1078,6 +1341,7 @@ int pr_namebind_create(server_rec *server, const char *name,
    */
 
   *((pr_namebind_t **) push_array(ipbind->ib_namebinds)) = namebind;
+  namebind_index_add(ipbind, namebind);
   return 0;
 }
 
@@ -1135,71 +1399,37 @@ pr_namebind_t *pr_namebind_find(const char *name, const pr_netaddr_t *addr,
    */
 
   for (iter = ipbind; iter; iter = iter->ib_next) {
-    register unsigned int i = 0;
-    pr_namebind_t *namebind = NULL, **namebinds = NULL;
+    pr_namebind_t *namebind = NULL;
 
     pr_signals_handle();
 
-    if (iter->ib_namebinds == NULL) {
+    if (iter->ib_namebinds == NULL ||
+        iter->ib_namebind_index == NULL) {
       pr_trace_msg(trace_channel, 17,
         "ipbind %p (server %p) for %s#%u has no namebinds", iter,
         iter->ib_server, pr_netaddr_get_ipstr(addr), port);
       continue;
     }
 
-    namebinds = (pr_namebind_t **) iter->ib_namebinds->elts;
     pr_trace_msg(trace_channel, 17,
       "ipbind %p (server %p) for %s#%u has namebinds (%d)", iter,
       iter->ib_server, pr_netaddr_get_ipstr(addr), port,
       iter->ib_namebinds->nelts);
 
-    for (i = 0; i < iter->ib_namebinds->nelts; i++) {
-      pr_signals_handle();
-
-      namebind = namebinds[i];
-      if (namebind == NULL) {
-        continue;
-      }
-
-      /* Skip inactive namebinds */
-      if (skip_inactive == TRUE &&
-          namebind->nb_isactive == FALSE) {
-        pr_trace_msg(trace_channel, 17,
-          "namebind #%u: %s is inactive, skipping", i, namebind->nb_name);
-        continue;
-      }
-
-      /* At present, this looks for an exactly matching name.  In the future,
-       * we may want to have something like Apache's matching scheme, which
-       * looks for the most specific domain to the most general.  Note that
-       * that scheme, however, is specific to DNS; should any other naming
-       * scheme be desired, that sort of matching will be unnecessary.
-       */
-      if (namebind->nb_name != NULL) {
-        pr_trace_msg(trace_channel, 17,
-          "namebind #%u: %s (%s)", i, namebind->nb_name,
-          namebind->nb_isactive ? "active" : "inactive");
-
-        if (namebind->nb_iswildcard == FALSE) {
-          if (strcasecmp(namebind->nb_name, name) == 0) {
-            return namebind;
-          }
-
-        } else {
-          int match_flags = PR_FNM_NOESCAPE|PR_FNM_CASEFOLD;
-
-          if (pr_fnmatch(namebind->nb_name, name, match_flags) == 0) {
-            pr_trace_msg(trace_channel, 9,
-              "matched name '%s' against pattern '%s'", name,
-              namebind->nb_name);
-            return namebind;
-          }
-
-          pr_trace_msg(trace_channel, 9,
-            "failed to match name '%s' against pattern '%s'", name,
-            namebind->nb_name);
-        }
-      }
+    /* At present, this looks for the first created namebind whose name
+     * matches, exactly or via wildcard.  In the future, we may want to have
+     * something like Apache's matching scheme, which looks for the most
+     * specific domain to the most general.  Note that that scheme, however,
+     * is specific to DNS; should any other naming scheme be desired, that
+     * sort of matching will be unnecessary.
+     */
+    namebind = namebind_index_find(iter->ib_namebind_index, name,
+      skip_inactive);
+    if (namebind != NULL) {
+      pr_trace_msg(trace_channel, 17,
+        "namebind #%u: %s (%s)", namebind->nb_idx, namebind->nb_name,
+        namebind->nb_isactive ? "active" : "inactive");
+      return namebind;
     }
   }
 
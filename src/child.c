@@ -29,19 +29,82 @@ static pool *child_pool = NULL;
 static xaset_t *child_list = NULL;
 static unsigned long child_listlen = 0;
 
+/* Children are also indexed by PID, so that reaping a child (which happens
+ * for every SIGCHLD) does not need to walk the entire list.  Reaped children
+ * are kept on their own list until child_update() removes them.
+ */
+static pool *child_index_pool = NULL;
+static pr_child_t **child_index = NULL;
+static unsigned int child_index_size = 0;
+static pr_child_t *child_dead_list = NULL;
+
+#define PR_CHILD_INDEX_MIN_SIZE		64
+
+static void child_pool_cleanup(void *user_data) {
+  child_pool = NULL;
+}
+
 static void child_list_cleanup(void *user_data) {
   child_list = NULL;
   child_listlen = 0;
+
+  /* The index pool is a subpool of the list pool. */
+  child_index_pool = NULL;
+  child_index = NULL;
+  child_index_size = 0;
+  child_dead_list = NULL;
+}
+
+static unsigned int child_index_key(pid_t pid) {
+  /* The index size is always a power of two. */
+  return ((unsigned int) pid) & (child_index_size - 1);
+}
+
+static void child_index_resize(unsigned int size) {
+  register unsigned int i;
+  pool *index_pool;
+  pr_child_t **index, **old_index;
+  unsigned int old_size;
+
+  index_pool = make_sub_pool(child_list->pool);
+  pr_pool_tag(index_pool, "Child Index Pool");
+  index = pcalloc(index_pool, size * sizeof(pr_child_t *));
+
+  old_index = child_index;
+  old_size = child_index_size;
+
+  child_index = index;
+  child_index_size = size;
+
+  for (i = 0; i < old_size; i++) {
+    pr_child_t *ch, *chn;
+
+    for (ch = old_index[i]; ch; ch = chn) {
+      unsigned int key;
+
+      chn = ch->ch_hash_next;
+      key = child_index_key(ch->ch_pid);
+      ch->ch_hash_next = child_index[key];
+      child_index[key] = ch;
+    }
+  }
+
+  if (child_index_pool != NULL) {
+    destroy_pool(child_index_pool);
+  }
+  child_index_pool = index_pool;
 }
 
 int child_add(pid_t pid, int fd) {
   pool *p;
   pr_child_t *ch;
+  unsigned int key;
 
   /* If no child-tracking list has been allocated, create one. */
   if (child_pool == NULL) {
     child_pool = make_sub_pool(permanent_pool);
     pr_pool_tag(child_pool, "Child Pool");
+    register_cleanup2(child_pool, NULL, child_pool_cleanup);
   }
 
   if (child_list == NULL) {
@@ -52,6 +115,11 @@ int child_add(pid_t pid, int fd) {
     register_cleanup2(list_pool, NULL, child_list_cleanup);
 
     child_list = xaset_create(list_pool, NULL);
+    child_index_resize(PR_CHILD_INDEX_MIN_SIZE);
+  }
+
+  if (child_listlen >= (child_index_size * 2)) {
+    child_index_resize(child_index_size * 4);
   }
 
   p = make_sub_pool(child_pool);
@@ -67,6 +135,10 @@ int child_add(pid_t pid, int fd) {
   xaset_insert(child_list, (xasetmember_t *) ch);
   child_listlen++;
 
+  key = child_index_key(pid);
+  ch->ch_hash_next = child_index[key];
+  child_index[key] = ch;
+
   return 0;
 }
 
@@ -83,19 +155,34 @@ pr_child_t *child_get(pr_child_t *ch) {
 }
 
 int child_remove(pid_t pid) {
-  pr_child_t *ch;
+  pr_child_t *ch, *prev = NULL;
+  unsigned int key;
 
   if (child_list == NULL) {
     errno = EPERM;
     return -1;
   }
 
-  for (ch = (pr_child_t *) child_list->xas_list; ch; ch = ch->next) {
+  key = child_index_key(pid);
+  for (ch = child_index[key]; ch; ch = ch->ch_hash_next) {
     if (ch->ch_pid == pid) {
+      if (prev != NULL) {
+        prev->ch_hash_next = ch->ch_hash_next;
+
+      } else {
+        child_index[key] = ch->ch_hash_next;
+      }
+
+      ch->ch_hash_next = NULL;
       ch->ch_dead = TRUE;
+      ch->ch_dead_next = child_dead_list;
+      child_dead_list = ch;
+
       child_listlen--;
       return 0;
     }
+
+    prev = ch;
   }
 
   errno = ENOENT;
@@ -124,19 +211,18 @@ void child_update(void) {
     return;
   }
 
-  /* Scan the child list, removing those entries marked as 'dead'. */
-  for (ch = (pr_child_t *) child_list->xas_list; ch; ch = chn) {
-    chn = ch->next;
-
-    if (ch->ch_dead) {
-      if (ch->ch_pipefd != -1) {
-        (void) close(ch->ch_pipefd);
-      }
+  /* Remove those entries which have been reaped. */
+  for (ch = child_dead_list; ch; ch = chn) {
+    chn = ch->ch_dead_next;
 
-      xaset_remove(child_list, (xasetmember_t *) ch);
-      destroy_pool(ch->ch_pool);
+    if (ch->ch_pipefd != -1) {
+      (void) close(ch->ch_pipefd);
     }
+
+    xaset_remove(child_list, (xasetmember_t *) ch);
+    destroy_pool(ch->ch_pool);
   }
+  child_dead_list = NULL;
 
   /* If the child list is empty, recover the list pool memory. */
   if (child_list->xas_list == NULL) {
@@ -44,6 +44,9 @@ static uint64_t data_start_ms = 0L;
 static int data_first_byte_read = FALSE;
 static int data_first_byte_written = FALSE;
 
+/* When the control connection was last polled during the current transfer. */
+static uint64_t data_poll_ctrl_ms = 0;
+
 /* local macro */
 
 #define MODE_STRING	(session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE) ? \
@@ -104,6 +107,8 @@ static void data_new_xfer(char *filename, int direction) {
     (unsigned long) session.xfer.bufsize);
   session.xfer.buf++;	/* leave room for ascii translation */
   session.xfer.buflen = 0;
+
+  data_poll_ctrl_ms = 0;
 }
 
 static int data_passive_open(const char *reason, off_t size) {
@@ -1021,6 +1026,30 @@ static int peek_is_abor_cmd(void) {
   return FALSE;
 }
 
+/* Returns TRUE if the control connection is due to be polled, i.e. if it
+ * has not been polled within the last PR_TUNABLE_XFER_POLL_CTRL_INTERVAL
+ * milliseconds of this transfer.  An ABOR sent as TCP OOB data is noticed
+ * via SIGURG regardless.
+ */
+static int poll_ctrl_due(void) {
+  uint64_t now_ms = 0;
+
+  if (PR_TUNABLE_XFER_POLL_CTRL_INTERVAL == 0 ||
+      pr_gettimeofday_millis(&now_ms) < 0) {
+    return TRUE;
+  }
+
+  /* Note that we allow for the clock going backwards. */
+  if (data_poll_ctrl_ms != 0 &&
+      now_ms >= data_poll_ctrl_ms &&
+      now_ms - data_poll_ctrl_ms < PR_TUNABLE_XFER_POLL_CTRL_INTERVAL) {
+    return FALSE;
+  }
+
+  data_poll_ctrl_ms = now_ms;
+  return TRUE;
+}
+
 static void poll_ctrl(void) {
   int res;
 
@@ -1028,6 +1057,10 @@ static void poll_ctrl(void) {
     return;
   }
 
+  if (poll_ctrl_due() == FALSE) {
+    return;
+  }
+
   pr_trace_msg(trace_channel, 4, "polling for commands on control channel");
   pr_netio_set_poll_interval(session.c->instrm, 0);
   res = pr_netio_poll(session.c->instrm);
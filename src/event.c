@@ -25,11 +25,6 @@
 
 #include "conf.h"
 
-/* Note: as more events are added, and as this API grows more and more used
- * by the core code, look into using a different ADT for storage/retrieval
- * of these objects, such as hash tables.
- */
-
 struct event_handler {
   struct event_handler *next, *prev;
   module *module;
@@ -43,15 +38,44 @@ struct event_list {
   pool *pool;
   const char *event;
   size_t event_len;
+  int event_id;
   struct event_handler *handlers;
+
+  /* The handlers, in dispatch order, as an array; rebuilt whenever the
+   * handlers list changes.
+   */
+  struct event_handler **handler_list;
+  unsigned int handler_count;
 };
 
 static pool *event_pool = NULL;
 static struct event_list *events = NULL;
 
-static const char *curr_event = NULL;
-static struct event_list *curr_evl = NULL;
-static struct event_handler *curr_evh = NULL;
+/* Event lists, indexed by event ID. */
+static struct event_list **event_lists = NULL;
+static unsigned int event_listsz = 0;
+
+static int curr_event_id = -1;
+static struct event_handler **curr_evh_list = NULL;
+static unsigned int curr_evh_count = 0, curr_evh_idx = 0;
+
+/* Interned event names.  An event's ID is its index in the event_names
+ * list.  These are allocated from their own pool, rather than from the
+ * permanent_pool, so that IDs remain valid for the lifetime of the process,
+ * and callers may look up an ID once and cache it.
+ */
+struct event_name {
+  struct event_name *next;
+  const char *name;
+  size_t namelen;
+  int id;
+};
+
+#define EVENT_NAME_TABSZ	128
+
+static pool *event_name_pool = NULL;
+static struct event_name *event_name_tab[EVENT_NAME_TABSZ];
+static array_header *event_names = NULL;
 
 /* Certain events are NOT logged via Trace logging (in order to prevent
  * event/trace loops).
@@ -67,6 +91,7 @@ static const char *untraced_events[] = {
 };
 
 #define PR_EVENT_FL_UNTRACED		0x001
+#define PR_EVENT_FL_REMOVED		0x002
 
 static const char *trace_channel = "event";
 
@@ -75,10 +100,124 @@ static const char *trace_channel = "event";
 static void event_cleanup_cb(void *user_data) {
   event_pool = NULL;
   events = NULL;
+  event_lists = NULL;
+  event_listsz = 0;
+
+  curr_event_id = -1;
+  curr_evh_list = NULL;
+  curr_evh_count = curr_evh_idx = 0;
+}
+
+static unsigned int event_name_hash(const char *name, size_t *namelen) {
+  register const char *ptr;
+  unsigned int h = 2166136261U;
+
+  /* FNV-1a */
+  for (ptr = name; *ptr; ptr++) {
+    h ^= (unsigned char) *ptr;
+    h *= 16777619U;
+  }
+
+  *namelen = ptr - name;
+  return h;
+}
+
+/* Returns the ID for the given event name, or -1 if the name has not been
+ * interned and the caller did not ask for it to be.
+ */
+static int event_name_lookup(const char *event, int intern) {
+  struct event_name *evn;
+  unsigned int idx;
+  size_t namelen = 0;
+
+  idx = event_name_hash(event, &namelen) % EVENT_NAME_TABSZ;
+
+  for (evn = event_name_tab[idx]; evn; evn = evn->next) {
+    if (evn->namelen == namelen &&
+        memcmp(evn->name, event, namelen) == 0) {
+      return evn->id;
+    }
+  }
+
+  if (intern == FALSE) {
+    return -1;
+  }
+
+  if (event_name_pool == NULL) {
+    event_name_pool = make_sub_pool(NULL);
+    pr_pool_tag(event_name_pool, "Event Name Pool");
+
+    event_names = make_array(event_name_pool, 32, sizeof(const char *));
+  }
+
+  evn = pcalloc(event_name_pool, sizeof(struct event_name));
+  evn->name = pstrndup(event_name_pool, event, namelen);
+  evn->namelen = namelen;
+  evn->id = event_names->nelts;
+  evn->next = event_name_tab[idx];
+  event_name_tab[idx] = evn;
+
+  *((const char **) push_array(event_names)) = evn->name;
+  return evn->id;
+}
+
+static struct event_list *event_get_list(int event_id) {
+  if (event_id < 0 ||
+      (unsigned int) event_id >= event_listsz) {
+    return NULL;
+  }
 
-  curr_event = NULL;
-  curr_evl = NULL;
-  curr_evh = NULL;
+  return event_lists[event_id];
+}
+
+static void event_set_list(struct event_list *evl) {
+  unsigned int id;
+
+  id = (unsigned int) evl->event_id;
+  if (id >= event_listsz) {
+    struct event_list **lists;
+    unsigned int listsz;
+
+    listsz = event_listsz > 0 ? event_listsz : 32;
+    while (listsz <= id) {
+      listsz *= 2;
+    }
+
+    lists = pcalloc(event_pool, listsz * sizeof(struct event_list *));
+    if (event_lists != NULL) {
+      memcpy(lists, event_lists, event_listsz * sizeof(struct event_list *));
+    }
+
+    event_lists = lists;
+    event_listsz = listsz;
+  }
+
+  event_lists[id] = evl;
+}
+
+/* Rebuild the handler array for the given list.  A new array is allocated
+ * each time, so that a dispatch already in progress (when a handler
+ * registers or unregisters a handler) continues to use its own copy.
+ */
+static void event_list_rebuild(struct event_list *evl) {
+  struct event_handler *evh, **handler_list = NULL;
+  unsigned int count = 0;
+
+  for (evh = evl->handlers; evh; evh = evh->next) {
+    count++;
+  }
+
+  if (count > 0) {
+    unsigned int i = 0;
+
+    handler_list = palloc(evl->pool, count * sizeof(struct event_handler *));
+    for (evh = evl->handlers; evh; evh = evh->next) {
+      handler_list[i++] = evh;
+    }
+  }
+
+  evl->handler_list = handler_list;
+  evl->handler_count = count;
 }
 
 int pr_event_register(module *m, const char *event,
@@ -88,6 +227,7 @@ int pr_event_register(module *m, const char *event,
   struct event_list *evl;
   pool *evl_pool;
   unsigned long flags = 0;
+  int event_id;
 
   if (event == NULL ||
       cb == NULL) {
@@ -122,63 +262,65 @@ int pr_event_register(module *m, const char *event,
 
   evh->flags = flags;
 
-  /* Scan the currently registered lists, looking for where to add this
+  /* Find the list for this event, if any, to which to add this
    * registration.
    */
+  event_id = event_name_lookup(event, TRUE);
+
+  evl = event_get_list(event_id);
+  if (evl != NULL) {
+    struct event_handler *evhi, *evhl = NULL;
+
+    evhi = evl->handlers;
+    if (evhi) {
+      /* Make sure this event handler is added to the START of the list,
+       * in order to preserve module load order handling of events (i.e.
+       * last module loaded, first module handled).  The exception to this
+       * rule are core callbacks (i.e. where m == NULL); these will always
+       * be invoked last.
+       *
+       * Before that, though, check for duplicate registration/subscription.
+       */
+      while (evhi) {
+        pr_signals_handle();
 
-  for (evl = events; evl; evl = evl->next) {
-    if (strncmp(evl->event, event, evl->event_len + 1) == 0) {
-      struct event_handler *evhi, *evhl = NULL;
-
-      evhi = evl->handlers;
-      if (evhi) {
-        /* Make sure this event handler is added to the START of the list,
-         * in order to preserve module load order handling of events (i.e.
-         * last module loaded, first module handled).  The exception to this
-         * rule are core callbacks (i.e. where m == NULL); these will always
-         * be invoked last.
-         *
-         * Before that, though, check for duplicate registration/subscription.
-         */
-        while (evhi) {
-          pr_signals_handle();
-
-          if (evhi->cb == evh->cb) {
-            /* Duplicate callback */
-            errno = EEXIST;
-            return -1;
-          }
-
-          evhl = evhi;
-
-          if (evhi->next == NULL) {
-            break;
-          }
-
-          evhi = evhi->next;
+        if (evhi->cb == evh->cb) {
+          /* Duplicate callback */
+          errno = EEXIST;
+          return -1;
         }
 
-        if (evh->module != NULL) {
-          if (evl->handlers != NULL) {
-            evl->handlers->prev = evh;
-          }
+        evhl = evhi;
 
-          evh->next = evl->handlers;
-          evl->handlers = evh;
+        if (evhi->next == NULL) {
+          break;
+        }
 
-        } else {
-          /* Core event listeners go at the end. */
-          evhl->next = evh;
-          evh->prev = evhl;
+        evhi = evhi->next;
+      }
+
+      if (evh->module != NULL) {
+        if (evl->handlers != NULL) {
+          evl->handlers->prev = evh;
         }
 
-      } else {
+        evh->next = evl->handlers;
         evl->handlers = evh;
+
+      } else {
+        /* Core event listeners go at the end. */
+        evhl->next = evh;
+        evh->prev = evhl;
       }
 
-      /* All done */
-      return 0;
+    } else {
+      evl->handlers = evh;
     }
+
+    event_list_rebuild(evl);
+
+    /* All done */
+    return 0;
   }
 
   evl_pool = pr_pool_create_sz(event_pool, EVENT_POOL_SZ);
@@ -188,15 +330,18 @@ int pr_event_register(module *m, const char *event,
   evl->pool = evl_pool;
   evl->event = pstrdup(evl->pool, event);
   evl->event_len = strlen(evl->event);
+  evl->event_id = event_id;
   evl->handlers = evh;
   evl->next = events;
 
   events = evl;
+  event_set_list(evl);
+  event_list_rebuild(evl);
 
   /* Clear any cached data. */
-  curr_event = NULL;
-  curr_evl = NULL;
-  curr_evh = NULL;
+  curr_event_id = -1;
+  curr_evh_list = NULL;
+  curr_evh_count = curr_evh_idx = 0;
 
   return 0;
 }
@@ -220,53 +365,65 @@ int pr_event_unregister(module *m, const char *event,
    * grow unnecessarily.
    */
 
-  for (evl = events; evl; evl = evl->next) {
-    pr_signals_handle();
+  if (event != NULL) {
+    evl = event_get_list(event_name_lookup(event, FALSE));
 
-    if (event == NULL ||
-        strncmp(evl->event, event, evl->event_len + 1) == 0) {
-      struct event_handler *evh;
+  } else {
+    evl = events;
+  }
 
-      /* If there are no handlers for this event, there is nothing to
-       * unregister.  Skip on to the next list.
-       */
-      if (evl->handlers == NULL) {
-        continue;
-      }
+  for (; evl; evl = event != NULL ? NULL : evl->next) {
+    struct event_handler *evh;
+    int modified = FALSE;
 
-      for (evh = evl->handlers; evh;) {
+    pr_signals_handle();
 
-        if ((m == NULL || evh->module == m) &&
-            (cb == NULL || evh->cb == cb)) {
-          struct event_handler *tmp = evh->next;
+    /* If there are no handlers for this event, there is nothing to
+     * unregister.  Skip on to the next list.
+     */
+    if (evl->handlers == NULL) {
+      continue;
+    }
 
-          if (evh->next) {
-            evh->next->prev = evh->prev;
-          }
+    for (evh = evl->handlers; evh;) {
 
-          if (evh->prev) {
-            evh->prev->next = evh->next;
+      if ((m == NULL || evh->module == m) &&
+          (cb == NULL || evh->cb == cb)) {
+        struct event_handler *tmp = evh->next;
 
-          } else {
-            /* This is the head of the list. */
-            evl->handlers = evh->next;
-          }
+        if (evh->next) {
+          evh->next->prev = evh->prev;
+        }
 
-          evh->module = NULL;
-          evh = tmp;
-          unregistered = TRUE;
+        if (evh->prev) {
+          evh->prev->next = evh->next;
 
         } else {
-          evh = evh->next;
+          /* This is the head of the list. */
+          evl->handlers = evh->next;
         }
+
+        /* Make sure a dispatch already in progress skips this handler. */
+        evh->flags |= PR_EVENT_FL_REMOVED;
+
+        evh->module = NULL;
+        evh = tmp;
+        unregistered = modified = TRUE;
+
+      } else {
+        evh = evh->next;
       }
     }
+
+    if (modified == TRUE) {
+      event_list_rebuild(evl);
+    }
   }
 
   /* Clear any cached data. */
-  curr_event = NULL;
-  curr_evl = NULL;
-  curr_evh = NULL;
+  curr_event_id = -1;
+  curr_evh_list = NULL;
+  curr_evh_count = curr_evh_idx = 0;
 
   if (!unregistered) {
     errno = ENOENT;
@@ -276,10 +433,16 @@ int pr_event_unregister(module *m, const char *event,
   return 0;
 }
 
-int pr_event_listening(const char *event) {
-  struct event_list *evl;
-  int count = 0;
+int pr_event_get_id(const char *event) {
+  if (event == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return event_name_lookup(event, TRUE);
+}
 
+int pr_event_listening(const char *event) {
   if (event == NULL) {
     errno = EINVAL;
     return -1;
@@ -290,31 +453,22 @@ int pr_event_listening(const char *event) {
     return 0;
   }
 
-  /* Lookup callbacks for this event. */
-  for (evl = events; evl; evl = evl->next) {
-
-    if (strncmp(evl->event, event, evl->event_len + 1) == 0) {
-      struct event_handler *evh;
-
-      /* If there are no registered callbacks for this event, be done. */
-      if (evl->handlers == NULL) {
-        return 0;
-      }
+  return pr_event_listening_id(event_name_lookup(event, FALSE));
+}
 
-      for (evh = evl->handlers; evh; evh = evh->next) {
-        count++;
-      }
+int pr_event_listening_id(int event_id) {
+  struct event_list *evl;
 
-      break;
-    }
+  evl = event_get_list(event_id);
+  if (evl == NULL) {
+    return 0;
   }
 
-  return count;
+  return (int) evl->handler_count;
 }
 
 void pr_event_generate(const char *event, const void *event_data) {
-  int use_cache = FALSE;
-  struct event_list *evl;
+  int event_id;
 
   if (event == NULL) {
     return;
@@ -325,61 +479,91 @@ void pr_event_generate(const char *event, const void *event_data) {
     return;
   }
 
+  event_id = event_name_lookup(event, FALSE);
+  if (event_id < 0) {
+    return;
+  }
+
+  pr_event_generate_id(event_id, event_data);
+}
+
+void pr_event_generate_id(int event_id, const void *event_data) {
+  register unsigned int i;
+  int use_cache = FALSE;
+  struct event_list *evl;
+  struct event_handler **evh_list;
+  unsigned int evh_count;
+  const char *event;
+
+  evl = event_get_list(event_id);
+  if (evl == NULL) {
+    return;
+  }
+
+  event = evl->event;
+
+  /* If there are no registered callbacks for this event, be done. */
+  if (evl->handler_count == 0) {
+    pr_trace_msg(trace_channel, 8, "no event handlers registered for '%s'",
+      event);
+    return;
+  }
+
   /* If there is a cached event, see if the given event matches. */
-  if (curr_event != NULL &&
-      strcmp(curr_event, event) == 0) {
+  if (curr_event_id == event_id &&
+      curr_evh_list != NULL) {
     use_cache = TRUE;
+    evh_list = curr_evh_list;
+    evh_count = curr_evh_count;
+    i = curr_evh_idx;
+
+  } else {
+    evh_list = evl->handler_list;
+    evh_count = evl->handler_count;
+    i = 0;
   }
 
-  /* Lookup callbacks for this event. */
-  for (evl = use_cache ? curr_evl : events; evl; evl = evl->next) {
+  curr_event_id = event_id;
+  curr_evh_list = evh_list;
+  curr_evh_count = evh_count;
 
-    if (strncmp(evl->event, event, evl->event_len + 1) == 0) {
-      struct event_handler *evh;
+  for (; i < evh_count; i++) {
+    struct event_handler *evh;
 
-      /* If there are no registered callbacks for this event, be done. */
-      if (!evl->handlers) {
-        pr_trace_msg(trace_channel, 8, "no event handlers registered for '%s'",
-          event);
-        return;
-      }
+    evh = evh_list[i];
 
-      curr_event = event;
-      curr_evl = evl;
-
-      for (evh = use_cache ? curr_evh : evl->handlers; evh; evh = evh->next) {
-        /* Make sure that if the same event is generated by the current
-         * listener, the next time through we go to the next listener, rather
-         * sending the same event against to the same listener (Bug#3619).
-         */
-        curr_evh = evh->next;
-
-        if (!(evh->flags & PR_EVENT_FL_UNTRACED)) {
-          if (evh->module) {
-            pr_trace_msg(trace_channel, 8,
-              "dispatching event '%s' to mod_%s (at %p, use cache = %s)", event,
-              evh->module->name, evh->cb, use_cache ? "true" : "false");
-
-          } else {
-            pr_trace_msg(trace_channel, 8,
-              "dispatching event '%s' to core (at %p, use cache = %s)", event,
-              evh->cb, use_cache ? "true" : "false");
-          }
-        }
+    /* Make sure that if the same event is generated by the current
+     * listener, the next time through we go to the next listener, rather
+     * sending the same event against to the same listener (Bug#3619).
+     */
+    curr_evh_idx = i + 1;
 
-        evh->cb(event_data, evh->user_data);
-      }
+    if (evh->flags & PR_EVENT_FL_REMOVED) {
+      continue;
+    }
 
-      break;
+    if (!(evh->flags & PR_EVENT_FL_UNTRACED)) {
+      if (evh->module) {
+        pr_trace_msg(trace_channel, 8,
+          "dispatching event '%s' to mod_%s (at %p, use cache = %s)", event,
+          evh->module->name, evh->cb, use_cache ? "true" : "false");
+
+      } else {
+        pr_trace_msg(trace_channel, 8,
+          "dispatching event '%s' to core (at %p, use cache = %s)", event,
+          evh->cb, use_cache ? "true" : "false");
+      }
     }
+
+    evh->cb(event_data, evh->user_data);
   }
 
   /* Clear any cached data after publishing the event to all interested
    * listeners.
    */
-  curr_event = NULL;
-  curr_evl = NULL;
-  curr_evh = NULL;
+  curr_event_id = -1;
+  curr_evh_list = NULL;
+  curr_evh_count = curr_evh_idx = 0;
 }
 
 void pr_event_dump(void (*dumpf)(const char *, ...)) {
@@ -1845,6 +1845,37 @@ void pr_fs_clear_cache(void) {
 
 /* FS functions proper */
 
+#if defined(HAVE_COPY_FILE_RANGE)
+/* The kernel can only copy the data for us if no custom FS module needs to
+ * see it.
+ */
+static int fs_copy_uses_sys_io(pr_fh_t *src_fh, pr_fh_t *dst_fh) {
+  pr_fs_t *fs;
+
+  fs = src_fh->fh_fs;
+  while (fs && fs->fs_next && !fs->read) {
+    fs = fs->fs_next;
+  }
+
+  if (fs == NULL ||
+      fs->read != sys_read) {
+    return FALSE;
+  }
+
+  fs = dst_fh->fh_fs;
+  while (fs && fs->fs_next && !fs->write) {
+    fs = fs->fs_next;
+  }
+
+  if (fs == NULL ||
+      fs->write != sys_write) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+#endif /* HAVE_COPY_FILE_RANGE */
+
 int pr_fs_copy_file2(const char *src, const char *dst, int flags,
     void (*progress_cb)(int)) {
   pr_fh_t *src_fh, *dst_fh;
@@ -2009,6 +2040,80 @@ int pr_fs_copy_file2(const char *src, const char *dst, int flags,
   }
 #endif
 
+#if defined(HAVE_COPY_FILE_RANGE)
+  /* Let the kernel copy the data, or share the extents on filesystems which
+   * support reflinks, rather than bouncing it through our buffer.  If the
+   * kernel cannot do this for these files, we carry on with read/write from
+   * wherever it got to.
+   */
+  if (fs_copy_uses_sys_io(src_fh, dst_fh) == TRUE) {
+    while (TRUE) {
+      ssize_t copied;
+      int xerrno;
+
+      copied = copy_file_range(PR_FH_FD(src_fh), NULL, PR_FH_FD(dst_fh), NULL,
+        PR_TUNABLE_COPY_FILE_RANGE_SIZE, 0);
+      if (copied > 0) {
+        pr_signals_handle();
+
+        if (progress_cb != NULL) {
+          (progress_cb)((int) copied);
+
+        } else {
+          copy_progress_cb((int) copied);
+        }
+
+        continue;
+      }
+
+      if (copied == 0) {
+        /* End of the source file; the read loop below will see that, too. */
+        break;
+      }
+
+      xerrno = errno;
+      if (xerrno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (xerrno == ENOSYS ||
+          xerrno == EXDEV ||
+          xerrno == EINVAL ||
+          xerrno == EBADF ||
+# if defined(ENOTSUP)
+          xerrno == ENOTSUP ||
+# endif /* ENOTSUP */
+          xerrno == EOPNOTSUPP) {
+        pr_trace_msg(trace_channel, 9,
+          "copy_file_range(2) unavailable for '%s' to '%s' (%s), "
+          "using read/write", src, dst, strerror(xerrno));
+        break;
+      }
+
+      (void) pr_fsio_close(src_fh);
+      (void) pr_fsio_close(dst_fh);
+
+      /* Don't unlink the destination file if it already existed. */
+      if (!dst_existed) {
+        if (!(flags & PR_FSIO_COPY_FILE_FL_NO_DELETE_ON_FAILURE)) {
+          if (pr_fsio_unlink(dst) < 0) {
+            pr_trace_msg(trace_channel, 12,
+              "error deleting failed copy of '%s': %s", dst, strerror(errno));
+          }
+        }
+      }
+
+      pr_log_pri(PR_LOG_WARNING, "error copying to '%s': %s", dst,
+        strerror(xerrno));
+      free(buf);
+
+      errno = xerrno;
+      return -1;
+    }
+  }
+#endif /* HAVE_COPY_FILE_RANGE */
+
   while ((res = pr_fsio_read(src_fh, buf, bufsz)) > 0) {
     size_t datalen;
     off_t offset;
@@ -2234,6 +2339,388 @@ int pr_fs_copy_file(const char *src, const char *dst) {
   return pr_fs_copy_file2(src, dst, 0, NULL);
 }
 
+/* Tree removal */
+
+#if defined(HAVE_OPENAT) && defined(HAVE_UNLINKAT) && \
+    defined(HAVE_FDOPENDIR) && defined(HAVE_FSTATAT) && \
+    defined(AT_REMOVEDIR) && defined(AT_SYMLINK_NOFOLLOW)
+# define FS_REMOVE_TREE_USE_AT		1
+#endif
+
+struct fs_remove_tree {
+  int (*pre_cb)(pool *, const char *, int, void *);
+  void (*post_cb)(pool *, const char *, int, int, int, void *);
+  void *user_data;
+};
+
+/* Removes a single entry, given either its directory fd and name, or (if the
+ * fd is -1) its path.
+ */
+static int fs_remove_tree_entry(pool *p, struct fs_remove_tree *tree,
+    const char *path, int is_dir, int dir_fd, const char *name) {
+  int res = 0, xerrno = 0;
+
+  if (tree->pre_cb != NULL) {
+    res = (tree->pre_cb)(p, path, is_dir, tree->user_data);
+    xerrno = errno;
+  }
+
+  if (res == 0) {
+#ifdef FS_REMOVE_TREE_USE_AT
+    if (dir_fd != -1) {
+      res = unlinkat(dir_fd, name, is_dir ? AT_REMOVEDIR : 0);
+      xerrno = errno;
+
+      if (res == 0) {
+        pr_fs_clear_cache2(path);
+      }
+
+    } else
+#endif /* FS_REMOVE_TREE_USE_AT */
+    if (is_dir) {
+      res = pr_fsio_rmdir(path);
+      xerrno = errno;
+
+    } else {
+      res = pr_fsio_unlink(path);
+      xerrno = errno;
+    }
+
+    if (res < 0) {
+      pr_trace_msg(trace_channel, 3, "error removing %s '%s': %s",
+        is_dir ? "directory" : "file", path, strerror(xerrno));
+    }
+  }
+
+  if (tree->post_cb != NULL) {
+    (tree->post_cb)(p, path, is_dir, res, xerrno, tree->user_data);
+  }
+
+  errno = xerrno;
+  return res;
+}
+
+/* Removes the tree using the FSIO API, path by path; this honors any custom
+ * FS handlers.
+ */
+static int fs_remove_tree_paths(pool *p, struct fs_remove_tree *tree,
+    const char *path) {
+  void *dirh;
+  struct dirent *dent;
+  pool *iter_pool = NULL;
+  int res = 0, xerrno = 0;
+
+  dirh = pr_fsio_opendir(path);
+  if (dirh == NULL) {
+    return -1;
+  }
+
+  while ((dent = pr_fsio_readdir(dirh)) != NULL) {
+    struct stat st;
+    char *entry_path;
+
+    pr_signals_handle();
+
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+
+    if (iter_pool != NULL) {
+      destroy_pool(iter_pool);
+    }
+
+    iter_pool = pr_pool_create_sz(p, 128);
+    entry_path = pdircat(iter_pool, path, dent->d_name, NULL);
+
+    if (pr_fsio_lstat(entry_path, &st) < 0) {
+      continue;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+      res = fs_remove_tree_paths(iter_pool, tree, entry_path);
+
+    } else {
+      res = fs_remove_tree_entry(iter_pool, tree, entry_path, FALSE, -1, NULL);
+    }
+
+    if (res < 0) {
+      xerrno = errno;
+      break;
+    }
+  }
+
+  if (iter_pool != NULL) {
+    destroy_pool(iter_pool);
+  }
+
+  pr_fsio_closedir(dirh);
+
+  if (res < 0) {
+    errno = xerrno;
+    return -1;
+  }
+
+  return fs_remove_tree_entry(p, tree, path, TRUE, -1, NULL);
+}
+
+#ifdef FS_REMOVE_TREE_USE_AT
+/* Removes the tree relative to the fd of each directory, rather than by
+ * resolving the full path of each entry.  Most entry types are known from
+ * readdir(3) alone, without needing to stat each entry.  Opening each
+ * directory with O_NOFOLLOW also means that a directory replaced by a
+ * symlink during the walk is not followed.
+ */
+static int fs_remove_tree_at(pool *p, struct fs_remove_tree *tree,
+    int parent_fd, const char *name, const char *path) {
+  int fd, flags, res = 0, xerrno = 0;
+  DIR *dirh;
+  struct dirent *dent;
+  pool *iter_pool = NULL;
+
+  flags = O_RDONLY;
+#ifdef O_DIRECTORY
+  flags |= O_DIRECTORY;
+#endif /* O_DIRECTORY */
+#ifdef O_NOFOLLOW
+  flags |= O_NOFOLLOW;
+#endif /* O_NOFOLLOW */
+#ifdef O_CLOEXEC
+  flags |= O_CLOEXEC;
+#endif /* O_CLOEXEC */
+
+  fd = openat(parent_fd, name, flags);
+  if (fd < 0) {
+    return -1;
+  }
+
+  dirh = fdopendir(fd);
+  if (dirh == NULL) {
+    xerrno = errno;
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    int is_dir = FALSE;
+    char *entry_path;
+
+    pr_signals_handle();
+
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+
+#if defined(_DIRENT_HAVE_D_TYPE) || defined(DT_DIR)
+    if (dent->d_type == DT_DIR) {
+      is_dir = TRUE;
+
+    } else if (dent->d_type == DT_UNKNOWN) {
+#else
+    {
+#endif /* DT_DIR */
+      struct stat st;
+
+      if (fstatat(fd, dent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+        continue;
+      }
+
+      is_dir = S_ISDIR(st.st_mode) ? TRUE : FALSE;
+    }
+
+    if (iter_pool != NULL) {
+      destroy_pool(iter_pool);
+    }
+
+    iter_pool = pr_pool_create_sz(p, 128);
+    entry_path = pdircat(iter_pool, path, dent->d_name, NULL);
+
+    if (is_dir) {
+      res = fs_remove_tree_at(iter_pool, tree, fd, dent->d_name, entry_path);
+
+    } else {
+      res = fs_remove_tree_entry(iter_pool, tree, entry_path, FALSE, fd,
+        dent->d_name);
+    }
+
+    if (res < 0) {
+      xerrno = errno;
+      break;
+    }
+  }
+
+  if (iter_pool != NULL) {
+    destroy_pool(iter_pool);
+  }
+
+  /* This closes the directory fd as well. */
+  closedir(dirh);
+
+  if (res < 0) {
+    errno = xerrno;
+    return -1;
+  }
+
+  return fs_remove_tree_entry(p, tree, path, TRUE, parent_fd, name);
+}
+
+/* Determines whether every operation involved in removing the given tree
+ * would be handled by the system FS handlers, in which case it is safe to
+ * bypass the FSIO API and work relative to directory fds.
+ */
+static int fs_remove_tree_uses_sys_io(const char *path) {
+  char tmp_path[PR_TUNABLE_PATH_MAX + 1];
+  size_t tmp_pathlen;
+  pr_fs_t *fs, *dir_fs, *file_fs;
+
+  /* The chroot guard checks the full path of each removal. */
+  if (fsio_guard_chroot) {
+    return FALSE;
+  }
+
+  memset(tmp_path, '\0', sizeof(tmp_path));
+  if (pr_fs_valid_path(path) < 0) {
+    if (pr_fs_dircat(tmp_path, sizeof(tmp_path), cwd, path) < 0) {
+      return FALSE;
+    }
+
+  } else {
+    sstrncpy(tmp_path, path, sizeof(tmp_path));
+  }
+
+  tmp_pathlen = strlen(tmp_path);
+  if (tmp_pathlen == 0 ||
+      tmp_pathlen >= sizeof(tmp_path) - 1) {
+    return FALSE;
+  }
+
+  if (tmp_path[tmp_pathlen - 1] != '/') {
+    sstrcat(tmp_path, "/", sizeof(tmp_path));
+    tmp_pathlen++;
+  }
+
+  dir_fs = lookup_dir_fs(tmp_path, FSIO_DIR_RMDIR);
+  file_fs = lookup_dir_fs(tmp_path, FSIO_FILE_UNLINK);
+  if (dir_fs == NULL ||
+      file_fs == NULL) {
+    return FALSE;
+  }
+
+  /* Find the handlers that FSIO would use for each operation. */
+  fs = dir_fs;
+  while (fs->fs_next && !fs->opendir) {
+    fs = fs->fs_next;
+  }
+  if (fs->opendir != sys_opendir) {
+    return FALSE;
+  }
+
+  fs = dir_fs;
+  while (fs->fs_next && !fs->readdir) {
+    fs = fs->fs_next;
+  }
+  if (fs->readdir != sys_readdir) {
+    return FALSE;
+  }
+
+  fs = dir_fs;
+  while (fs->fs_next && !fs->closedir) {
+    fs = fs->fs_next;
+  }
+  if (fs->closedir != sys_closedir) {
+    return FALSE;
+  }
+
+  fs = dir_fs;
+  while (fs->fs_next && !fs->rmdir) {
+    fs = fs->fs_next;
+  }
+  if (fs->rmdir != sys_rmdir) {
+    return FALSE;
+  }
+
+  fs = file_fs;
+  while (fs->fs_next && !fs->lstat) {
+    fs = fs->fs_next;
+  }
+  if (fs->lstat != sys_lstat) {
+    return FALSE;
+  }
+
+  fs = file_fs;
+  while (fs->fs_next && !fs->unlink) {
+    fs = fs->fs_next;
+  }
+  if (fs->unlink != sys_unlink) {
+    return FALSE;
+  }
+
+  /* Lastly, no other FS may be registered anywhere beneath this path. */
+  if (fs_map != NULL) {
+    register unsigned int i;
+    pr_fs_t **fs_objs = (pr_fs_t **) fs_map->elts;
+
+    for (i = 0; i < fs_map->nelts; i++) {
+      const char *fs_path;
+
+      fs_path = fs_objs[i]->fs_path;
+      if (strlen(fs_path) > tmp_pathlen &&
+          strncmp(fs_path, tmp_path, tmp_pathlen) == 0) {
+        return FALSE;
+      }
+    }
+  }
+
+  return TRUE;
+}
+#endif /* FS_REMOVE_TREE_USE_AT */
+
+int pr_fs_remove_tree(pool *p, const char *path,
+    int (*pre_cb)(pool *, const char *, int, void *),
+    void (*post_cb)(pool *, const char *, int, int, int, void *),
+    void *user_data) {
+  struct fs_remove_tree tree;
+  pool *tmp_pool;
+  int res, xerrno;
+
+  if (p == NULL ||
+      path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tree.pre_cb = pre_cb;
+  tree.post_cb = post_cb;
+  tree.user_data = user_data;
+
+  tmp_pool = make_sub_pool(p);
+  pr_pool_tag(tmp_pool, "FS remove tree pool");
+
+#ifdef FS_REMOVE_TREE_USE_AT
+  if (fs_remove_tree_uses_sys_io(path) == TRUE) {
+    pr_trace_msg(trace_channel, 8,
+      "removing tree '%s' relative to directory fds", path);
+    res = fs_remove_tree_at(tmp_pool, &tree, AT_FDCWD, path, path);
+    xerrno = errno;
+
+    destroy_pool(tmp_pool);
+    errno = xerrno;
+    return res;
+  }
+#endif /* FS_REMOVE_TREE_USE_AT */
+
+  pr_trace_msg(trace_channel, 8, "removing tree '%s' using FSIO paths", path);
+  res = fs_remove_tree_paths(tmp_pool, &tree, path);
+  xerrno = errno;
+
+  destroy_pool(tmp_pool);
+  errno = xerrno;
+  return res;
+}
+
 pr_fs_t *pr_register_fs2(pool *p, const char *name, const char *path,
     int flags) {
   pr_fs_t *fs = NULL;
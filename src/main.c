@@ -984,12 +984,176 @@ static void cmd_loop(server_rec *server, conn_t *c) {
   }
 }
 
-void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
-  int maxfd, res, xerrno;
-  fd_set childfds;
-  struct timeval restart_start, restart_finish;
-  long restart_elapsed = 0;
+/* Reloads.  On SIGHUP, the new configuration is first parsed by a
+ * short-lived helper process, while the master process continues to accept
+ * connections using the current configuration.  Only once the helper reports
+ * that the new configuration parsed cleanly does the master reload it;
+ * otherwise, the current configuration (and its listeners) are kept.
+ *
+ * Listening sockets for addresses/ports which are unchanged are kept open
+ * across the reload (see free_bindings()), and existing sessions continue
+ * to use the configuration with which they were started.
+ */
+static int reload_check_fd = -1;
+static int reload_check_again = FALSE;
+
+#define PR_RELOAD_CHECK_OK		'y'
+#define PR_RELOAD_CHECK_FAILED		'n'
+
+static void reload_daemon(void);
+
+/* Parse the configuration file, without generating any of the restart or
+ * postparse events which would affect the master process' shared state.
+ * This is only ever called in the reload helper process.
+ */
+static int reload_check_config(void) {
+  int res, xerrno;
+
+  init_netaddr();
+  init_class();
+  init_config();
+  init_dirtree();
+
+  pr_netaddr_clear_cache();
+  pr_parser_prepare(NULL, NULL);
+  pr_event_generate("core.preparse", NULL);
+
+  PRIVS_ROOT
+  res = pr_parser_parse_file(NULL, config_filename, NULL, 0);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    if (xerrno != EPERM) {
+      pr_log_pri(PR_LOG_WARNING,
+        "unable to read configuration file '%s': %s", config_filename,
+        strerror(xerrno));
+    }
+
+    return -1;
+  }
+
+  if (pr_parser_cleanup() < 0) {
+    pr_log_pri(PR_LOG_WARNING,
+      "error processing configuration file '%s': "
+      "unclosed configuration section", config_filename);
+    return -1;
+  }
+
+  if (fixup_servers(server_list) < 0) {
+    pr_log_pri(PR_LOG_WARNING,
+      "error processing configuration file '%s'", config_filename);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int reload_check_start(void) {
+  int fds[2], xerrno;
+  pid_t pid;
+
+  if (pipe(fds) < 0) {
+    return -1;
+  }
+
+  pid = fork();
+  xerrno = errno;
+
+  switch (pid) {
+    case -1:
+      (void) close(fds[0]);
+      (void) close(fds[1]);
+      errno = xerrno;
+      return -1;
+
+    case 0: {
+      char status = PR_RELOAD_CHECK_FAILED;
+
+      /* Helper process; it must not act on any signals meant for the master,
+       * e.g. terminating the master's children.
+       */
+      is_master = FALSE;
+      (void) close(fds[0]);
 
+      pr_proctitle_set("(checking configuration)");
+      if (reload_check_config() == 0) {
+        status = PR_RELOAD_CHECK_OK;
+      }
+
+      (void) write(fds[1], &status, 1);
+      (void) close(fds[1]);
+
+      /* Avoid any exit handlers, which would clean up the master's state. */
+      _exit(0);
+    }
+
+    default:
+      break;
+  }
+
+  (void) close(fds[1]);
+  reload_check_fd = fds[0];
+
+  pr_trace_msg("config", 9,
+    "checking configuration file '%s' in helper process (PID %lu)",
+    config_filename, (unsigned long) pid);
+  return 0;
+}
+
+/* Add the reload helper fd, if any, into the rfd for selecting */
+static int reload_check_fds(fd_set *rfd, int maxfd) {
+  if (reload_check_fd != -1) {
+    FD_SET(reload_check_fd, rfd);
+    if (reload_check_fd > maxfd) {
+      maxfd = reload_check_fd;
+    }
+  }
+
+  return maxfd;
+}
+
+static void reload_check_done(void) {
+  char status = PR_RELOAD_CHECK_FAILED;
+  ssize_t res;
+
+  res = read(reload_check_fd, &status, 1);
+  while (res < 0 &&
+         errno == EINTR) {
+    pr_signals_handle();
+    res = read(reload_check_fd, &status, 1);
+  }
+
+  /* The helper process itself is reaped by the SIGCHLD handler. */
+  (void) close(reload_check_fd);
+  reload_check_fd = -1;
+
+  if (reload_check_again == TRUE) {
+    /* Another SIGHUP arrived while the helper was running; the file may have
+     * changed since then, so check it again.
+     */
+    reload_check_again = FALSE;
+    if (reload_check_start() == 0) {
+      return;
+    }
+
+    pr_log_pri(PR_LOG_WARNING, "unable to check configuration file '%s': %s",
+      config_filename, strerror(errno));
+    return;
+  }
+
+  if (res != 1 ||
+      status != PR_RELOAD_CHECK_OK) {
+    pr_log_pri(PR_LOG_WARNING,
+      "configuration file '%s' contains errors; keeping current configuration",
+      config_filename);
+    return;
+  }
+
+  reload_daemon();
+}
+
+void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
   if (is_master == FALSE ||
       !mpid) {
     /* Child process -- cannot restart, log error */
@@ -997,8 +1161,33 @@ void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
     return;
   }
 
+  if (reload_check_fd != -1) {
+    pr_log_pri(PR_LOG_NOTICE, "received SIGHUP -- configuration check "
+      "already in progress, will recheck configuration file");
+    reload_check_again = TRUE;
+    return;
+  }
+
+  pr_log_pri(PR_LOG_NOTICE,
+    "received SIGHUP -- master server checking configuration file");
+
+  if (reload_check_start() < 0) {
+    pr_log_pri(PR_LOG_NOTICE, "unable to check configuration file '%s' "
+      "in helper process: %s", config_filename, strerror(errno));
+
+    /* Fall back to reloading in place. */
+    reload_daemon();
+  }
+}
+
+static void reload_daemon(void) {
+  int maxfd, res, xerrno;
+  fd_set childfds;
+  struct timeval restart_start, restart_finish;
+  long restart_elapsed = 0;
+
   pr_log_pri(PR_LOG_NOTICE,
-    "received SIGHUP -- master server reparsing configuration file");
+    "master server reparsing configuration file");
 
   gettimeofday(&restart_start, NULL);
 
@@ -1038,6 +1227,9 @@ void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
   /* Run through the list of registered restart callbacks. */
   pr_event_generate("core.restart", NULL);
 
+  /* Any session templates refer to the old configuration. */
+  pr_module_clear_session_templates(NULL);
+
   init_log();
   init_netaddr();
   init_class();
@@ -1210,6 +1402,12 @@ static void fork_server(int fd, conn_t *l, unsigned char no_fork) {
 
       /* No longer need the read side of the semaphore pipe. */
       (void) close(semfds[0]);
+
+      /* Nor of any pending configuration check. */
+      if (reload_check_fd != -1) {
+        (void) close(reload_check_fd);
+        reload_check_fd = -1;
+      }
       break;
 
     case -1:
@@ -1609,7 +1807,7 @@ static void daemon_loop(void) {
   time(&last_error);
 
   while (TRUE) {
-    int maxfd, res;
+    int maxfd, res, timer_fd;
 
     run_schedule();
 
@@ -1619,6 +1817,18 @@ static void daemon_loop(void) {
     /* Monitor children pipes */
     maxfd = semaphore_fds(&listenfds, maxfd);
 
+    /* Monitor the reload helper, if any */
+    maxfd = reload_check_fds(&listenfds, maxfd);
+
+    /* Monitor any pending timers */
+    timer_fd = pr_timer_get_fd();
+    if (timer_fd >= 0) {
+      FD_SET(timer_fd, &listenfds);
+      if (timer_fd > maxfd) {
+        maxfd = timer_fd;
+      }
+    }
+
     /* Check for ftp shutdown message file */
     res = check_shutmsg(permanent_pool, PR_SHUTMSG_PATH, &shut, &deny, &disc,
       shutmsg, sizeof(shutmsg));
@@ -1735,6 +1945,13 @@ static void daemon_loop(void) {
         strerror(xerrno));
     }
 
+    if (i > 0 &&
+        timer_fd >= 0 &&
+        FD_ISSET(timer_fd, &listenfds)) {
+      pr_timer_process();
+      i--;
+    }
+
     if (i == 0) {
       continue;
     }
@@ -1771,6 +1988,13 @@ static void daemon_loop(void) {
       continue;
     }
 
+    if (reload_check_fd != -1 &&
+        FD_ISSET(reload_check_fd, &listenfds)) {
+      /* Reloading may change the listening sockets; select on them anew. */
+      reload_check_done();
+      continue;
+    }
+
     /* Accept the connection. */
     listen_conn = pr_ipbind_accept_conn(&listenfds, &fd);
 
@@ -2365,6 +2589,8 @@ static void show_settings(void) {
   printf("    PR_TUNABLE_TIMEOUTLOGIN = %u\n", PR_TUNABLE_TIMEOUTLOGIN);
   printf("    PR_TUNABLE_TIMEOUTNOXFER = %u\n", PR_TUNABLE_TIMEOUTNOXFER);
   printf("    PR_TUNABLE_TIMEOUTSTALLED = %u\n", PR_TUNABLE_TIMEOUTSTALLED);
+  printf("    PR_TUNABLE_XFER_POLL_CTRL_INTERVAL = %u\n",
+    PR_TUNABLE_XFER_POLL_CTRL_INTERVAL);
   printf("    PR_TUNABLE_XFER_SCOREBOARD_UPDATES = %u\n\n",
     PR_TUNABLE_XFER_SCOREBOARD_UPDATES);
 }
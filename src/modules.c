@@ -35,6 +35,10 @@ module *curr_module = NULL;
 /* Used to track the priority for loaded modules. */
 static unsigned int curr_module_pri = 0;
 
+/* Per-server session templates, keyed by module name and server ID. */
+static pool *sess_tmpl_pool = NULL;
+static pr_table_t *sess_tmpl_tab = NULL;
+
 static const char *trace_channel = "module";
 
 modret_t *pr_module_call(module *m, modret_t *(*func)(cmd_rec *),
@@ -125,10 +129,20 @@ int modules_session_init(void) {
 
   for (m = loaded_modules; m; m = m->next) {
     if (m->sess_init) {
+      struct timeval start_tv, finish_tv;
+      int timed = FALSE;
+
       curr_module = m;
 
       pr_trace_msg(trace_channel, 12,
         "invoking sess_init callback on mod_%s.c", m->name);
+
+      /* Measure how long each module takes to initialize a session. */
+      if (pr_trace_get_level(trace_channel) >= 15) {
+        gettimeofday(&start_tv, NULL);
+        timed = TRUE;
+      }
+
       if (m->sess_init() < 0) {
         int xerrno = errno;
 
@@ -139,6 +153,17 @@ int modules_session_init(void) {
         errno = xerrno;
         return -1;
       }
+
+      if (timed == TRUE) {
+        long elapsed_usecs;
+
+        gettimeofday(&finish_tv, NULL);
+        elapsed_usecs = ((finish_tv.tv_sec - start_tv.tv_sec) * 1000000L) +
+          (finish_tv.tv_usec - start_tv.tv_usec);
+        pr_trace_msg(trace_channel, 15,
+          "sess_init callback on mod_%s.c took %ld usecs", m->name,
+          elapsed_usecs);
+      }
     }
   }
 
@@ -146,6 +171,127 @@ int modules_session_init(void) {
   return 0;
 }
 
+static const char *get_sess_template_key(char *buf, size_t bufsz, module *m,
+    server_rec *s) {
+  memset(buf, '\0', bufsz);
+  pr_snprintf(buf, bufsz-1, "mod_%s.c:%u", m->name, s->sid);
+  return buf;
+}
+
+int pr_module_set_session_template(module *m, server_rec *s, void *tmpl) {
+  char buf[256];
+  const char *key;
+
+  if (m == NULL ||
+      m->name == NULL ||
+      s == NULL ||
+      tmpl == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (sess_tmpl_pool == NULL) {
+    sess_tmpl_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(sess_tmpl_pool, "Module Session Templates Pool");
+
+    sess_tmpl_tab = pr_table_alloc(sess_tmpl_pool, 0);
+  }
+
+  key = get_sess_template_key(buf, sizeof(buf), m, s);
+  if (pr_table_get(sess_tmpl_tab, key, NULL) != NULL) {
+    return pr_table_set(sess_tmpl_tab, key, tmpl, sizeof(void *));
+  }
+
+  pr_trace_msg(trace_channel, 17,
+    "adding session template for mod_%s.c, server '%s' (ID %u)", m->name,
+    s->ServerName, s->sid);
+  return pr_table_add(sess_tmpl_tab, pstrdup(sess_tmpl_pool, key), tmpl,
+    sizeof(void *));
+}
+
+void *pr_module_get_session_template(module *m, server_rec *s) {
+  char buf[256];
+  const char *key;
+  void *tmpl;
+
+  if (m == NULL ||
+      m->name == NULL ||
+      s == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (sess_tmpl_tab == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  key = get_sess_template_key(buf, sizeof(buf), m, s);
+  tmpl = (void *) pr_table_get(sess_tmpl_tab, key, NULL);
+  if (tmpl == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  return tmpl;
+}
+
+int pr_module_clear_session_templates(module *m) {
+  char prefix[128];
+  size_t prefix_len;
+  const char *key;
+  array_header *keys;
+  pool *tmp_pool;
+  register unsigned int i;
+
+  if (sess_tmpl_tab == NULL) {
+    return 0;
+  }
+
+  if (m == NULL) {
+    /* Clear the templates for all modules. */
+    destroy_pool(sess_tmpl_pool);
+    sess_tmpl_pool = NULL;
+    sess_tmpl_tab = NULL;
+    return 0;
+  }
+
+  if (m->name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(prefix, '\0', sizeof(prefix));
+  pr_snprintf(prefix, sizeof(prefix)-1, "mod_%s.c:", m->name);
+  prefix_len = strlen(prefix);
+
+  /* We cannot remove entries while iterating over the table, so first
+   * collect the keys to be removed.
+   */
+  tmp_pool = make_sub_pool(sess_tmpl_pool);
+  keys = make_array(tmp_pool, 0, sizeof(char *));
+
+  pr_table_rewind(sess_tmpl_tab);
+  key = pr_table_next(sess_tmpl_tab);
+  while (key != NULL) {
+    pr_signals_handle();
+
+    if (strncmp(key, prefix, prefix_len) == 0) {
+      *((const char **) push_array(keys)) = key;
+    }
+
+    key = pr_table_next(sess_tmpl_tab);
+  }
+
+  for (i = 0; i < keys->nelts; i++) {
+    (void) pr_table_remove(sess_tmpl_tab, ((const char **) keys->elts)[i],
+      NULL);
+  }
+
+  destroy_pool(tmp_pool);
+  return 0;
+}
+
 unsigned char command_exists(const char *name) {
   int idx = -1;
   unsigned int hash = 0;
@@ -75,6 +75,46 @@ static pr_netio_t *default_othr_netio = NULL, *othr_netio = NULL;
  */
 static int properly_terminated_prev_command = TRUE;
 
+/* IDs of the events generated for each read and write, looked up once;
+ * these are generated often enough that looking them up by name each time
+ * shows up.
+ */
+#define NETIO_EVENT_READ	0
+#define NETIO_EVENT_WRITE	1
+
+static int netio_event_ids[2][3] = { { -1, -1, -1 }, { -1, -1, -1 } };
+static const char *netio_event_names[2][3] = {
+  { "core.ctrl-read", "core.data-read", "core.othr-read" },
+  { "core.ctrl-write", "core.data-write", "core.othr-write" }
+};
+
+static int netio_get_event_id(int strm_type, int io) {
+  int idx;
+
+  switch (strm_type) {
+    case PR_NETIO_STRM_CTRL:
+      idx = 0;
+      break;
+
+    case PR_NETIO_STRM_DATA:
+      idx = 1;
+      break;
+
+    case PR_NETIO_STRM_OTHR:
+      idx = 2;
+      break;
+
+    default:
+      return -1;
+  }
+
+  if (netio_event_ids[io][idx] < 0) {
+    netio_event_ids[io][idx] = pr_event_get_id(netio_event_names[io][idx]);
+  }
+
+  return netio_event_ids[io][idx];
+}
+
 static pr_netio_stream_t *netio_stream_alloc(pool *parent_pool) {
   pool *netio_pool = NULL;
   pr_netio_stream_t *nstrm = NULL;
@@ -167,10 +207,11 @@ static pr_netio_stream_t *core_netio_open_cb(pr_netio_stream_t *nstrm, int fd,
 }
 
 static int core_netio_poll_cb(pr_netio_stream_t *nstrm) {
-  int res;
+  int res, maxfd, timer_fd;
   fd_set rfds, *rfdsp, wfds, *wfdsp;
   struct timeval tval;
 
+  polling:
   FD_ZERO(&rfds);
   rfdsp = NULL;
   FD_ZERO(&wfds);
@@ -189,11 +230,45 @@ static int core_netio_poll_cb(pr_netio_stream_t *nstrm) {
     }
   }
 
+  maxfd = nstrm->strm_fd;
+
+  /* Watch for expiring timers as well, rather than waiting for SIGALRM to
+   * interrupt us.
+   */
+  timer_fd = pr_timer_get_fd();
+  if (timer_fd >= 0) {
+    FD_SET(timer_fd, &rfds);
+    rfdsp = &rfds;
+
+    if (timer_fd > maxfd) {
+      maxfd = timer_fd;
+    }
+  }
+
   tval.tv_sec = ((nstrm->strm_flags & PR_NETIO_SESS_INTR) ?
     nstrm->strm_interval : 60);
   tval.tv_usec = 0;
 
-  res = select(nstrm->strm_fd + 1, rfdsp, wfdsp, NULL, &tval);
+  res = select(maxfd + 1, rfdsp, wfdsp, NULL, &tval);
+  if (res > 0 &&
+      timer_fd >= 0 &&
+      FD_ISSET(timer_fd, &rfds)) {
+    pr_timer_process();
+
+    res--;
+    if (res == 0) {
+      if (!(nstrm->strm_flags & (PR_NETIO_SESS_INTR|PR_NETIO_SESS_ABORT))) {
+        goto polling;
+      }
+
+      /* Only the timer fired; report this as an interrupted poll, as
+       * SIGALRM would have done.
+       */
+      errno = EINTR;
+      res = -1;
+    }
+  }
+
   while (res < 0) {
     int xerrno = errno;
 
@@ -1055,6 +1130,7 @@ int pr_netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
   const char *nstrm_mode;
   pr_buffer_t *pbuf;
   pool *tmp_pool;
+  int event_id;
 
   /* Sanity check */
   if (nstrm == NULL ||
@@ -1082,32 +1158,23 @@ int pr_netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
    * pr_buffer_t out of that.  Then simply destroy the subpool when done.
    */
 
-  tmp_pool = make_sub_pool(nstrm->strm_pool);
-  pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
-  pbuf->buf = buf;
-  pbuf->buflen = buflen;
-  pbuf->current = pbuf->buf;
-  pbuf->remaining = 0;
-
-  switch (nstrm->strm_type) {
-    case PR_NETIO_STRM_CTRL:
-      pr_event_generate("core.ctrl-write", pbuf);
-      break;
+  event_id = netio_get_event_id(nstrm->strm_type, NETIO_EVENT_WRITE);
+  if (pr_event_listening_id(event_id) > 0) {
+    tmp_pool = make_sub_pool(nstrm->strm_pool);
+    pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
+    pbuf->buf = buf;
+    pbuf->buflen = buflen;
+    pbuf->current = pbuf->buf;
+    pbuf->remaining = 0;
 
-    case PR_NETIO_STRM_DATA:
-      pr_event_generate("core.data-write", pbuf);
-      break;
+    pr_event_generate_id(event_id, pbuf);
 
-    case PR_NETIO_STRM_OTHR:
-      pr_event_generate("core.othr-write", pbuf);
-      break;
+    /* The event listeners may have changed the data to write out. */
+    buf = pbuf->buf;
+    buflen = pbuf->buflen - pbuf->remaining;
+    destroy_pool(tmp_pool);
   }
 
-  /* The event listeners may have changed the data to write out. */
-  buf = pbuf->buf;
-  buflen = pbuf->buflen - pbuf->remaining;
-  destroy_pool(tmp_pool);
-
   while (buflen) {
 
     switch (pr_netio_poll(nstrm)) {
@@ -1199,6 +1266,7 @@ int pr_netio_write_async(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
   const char *nstrm_mode;
   pr_buffer_t *pbuf;
   pool *tmp_pool;
+  int event_id;
 
   /* Sanity check */
   if (nstrm == NULL) {
@@ -1227,32 +1295,23 @@ int pr_netio_write_async(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
    * for any listeners which may want to examine this data.
    */
 
-  tmp_pool = make_sub_pool(nstrm->strm_pool);
-  pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
-  pbuf->buf = buf;
-  pbuf->buflen = buflen;
-  pbuf->current = pbuf->buf;
-  pbuf->remaining = 0;
-
-  switch (nstrm->strm_type) {
-    case PR_NETIO_STRM_CTRL:
-      pr_event_generate("core.ctrl-write", pbuf);
-      break;
+  event_id = netio_get_event_id(nstrm->strm_type, NETIO_EVENT_WRITE);
+  if (pr_event_listening_id(event_id) > 0) {
+    tmp_pool = make_sub_pool(nstrm->strm_pool);
+    pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
+    pbuf->buf = buf;
+    pbuf->buflen = buflen;
+    pbuf->current = pbuf->buf;
+    pbuf->remaining = 0;
 
-    case PR_NETIO_STRM_DATA:
-      pr_event_generate("core.data-write", pbuf);
-      break;
+    pr_event_generate_id(event_id, pbuf);
 
-    case PR_NETIO_STRM_OTHR:
-      pr_event_generate("core.othr-write", pbuf);
-      break;
+    /* The event listeners may have changed the data to write out. */
+    buf = pbuf->buf;
+    buflen = pbuf->buflen - pbuf->remaining;
+    destroy_pool(tmp_pool);
   }
 
-  /* The event listeners may have changed the data to write out. */
-  buf = pbuf->buf;
-  buflen = pbuf->buflen - pbuf->remaining;
-  destroy_pool(tmp_pool);
-
   while (buflen) {
     do {
 
@@ -1341,6 +1400,7 @@ int pr_netio_read(pr_netio_stream_t *nstrm, char *buf, size_t buflen,
   const char *nstrm_mode;
   pr_buffer_t *pbuf;
   pool *tmp_pool;
+  int event_id;
 
   /* Sanity check. */
   if (nstrm == NULL ||
@@ -1486,32 +1546,23 @@ int pr_netio_read(pr_netio_stream_t *nstrm, char *buf, size_t buflen,
      * pr_buffer_t out of that.  Then simply destroy the subpool when done.
      */
 
-    tmp_pool = make_sub_pool(nstrm->strm_pool);
-    pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
-    pbuf->buf = buf;
-    pbuf->buflen = bread;
-    pbuf->current = pbuf->buf;
-    pbuf->remaining = 0;
-
-    switch (nstrm->strm_type) {
-      case PR_NETIO_STRM_CTRL:
-        pr_event_generate("core.ctrl-read", pbuf);
-        break;
+    event_id = netio_get_event_id(nstrm->strm_type, NETIO_EVENT_READ);
+    if (pr_event_listening_id(event_id) > 0) {
+      tmp_pool = make_sub_pool(nstrm->strm_pool);
+      pbuf = pcalloc(tmp_pool, sizeof(pr_buffer_t));
+      pbuf->buf = buf;
+      pbuf->buflen = bread;
+      pbuf->current = pbuf->buf;
+      pbuf->remaining = 0;
 
-      case PR_NETIO_STRM_DATA:
-        pr_event_generate("core.data-read", pbuf);
-        break;
+      pr_event_generate_id(event_id, pbuf);
 
-      case PR_NETIO_STRM_OTHR:
-        pr_event_generate("core.othr-read", pbuf);
-        break;
+      /* The event listeners may have changed the data read in out. */
+      buf = pbuf->buf;
+      bread = pbuf->buflen - pbuf->remaining;
+      destroy_pool(tmp_pool);
     }
 
-    /* The event listeners may have changed the data read in out. */
-    buf = pbuf->buf;
-    bread = pbuf->buflen - pbuf->remaining;
-    destroy_pool(tmp_pool);
-
     buf += bread;
     total += bread;
     bufmin -= bread;
@@ -1636,7 +1687,8 @@ char *pr_netio_gets(char *buf, size_t buflen, pr_netio_stream_t *nstrm) {
        * network, generate an event for any listeners which may want to
        * examine this data as well.
        */
-      pr_event_generate("core.othr-read", pbuf);
+      pr_event_generate_id(netio_get_event_id(PR_NETIO_STRM_OTHR,
+        NETIO_EVENT_READ), pbuf);
     }
 
     toread = pbuf->buflen - pbuf->remaining;
@@ -1725,7 +1777,8 @@ int pr_netio_telnet_gets2(char *buf, size_t bufsz,
        * network, handing any Telnet characters and such, generate an event
        * for any listeners which may want to examine this data as well.
        */
-      pr_event_generate("core.ctrl-read", pbuf);
+      pr_event_generate_id(netio_get_event_id(PR_NETIO_STRM_CTRL,
+        NETIO_EVENT_READ), pbuf);
     }
 
     toread = pbuf->buflen - pbuf->remaining;
@@ -63,6 +63,16 @@ static const char *trace_channel = "privs";
 static unsigned int root_privs = 0;
 static unsigned int user_privs = 0;
 
+/* The effective UID/GID most recently established by these functions.  When
+ * known, a transition to the IDs we already have is elided entirely, rather
+ * than costing a set of seteuid()/setegid() (and signal masking) syscalls.
+ * Any code which changes the process IDs directly must call
+ * pr_privs_clear_cache() (or PRIVS_SETUP/PRIVS_REVOKE) afterward.
+ */
+static int privs_ids_known = FALSE;
+static uid_t privs_euid = (uid_t) -1;
+static gid_t privs_egid = (gid_t) -1;
+
 static void privs_log_error(const char *msg, int xerrno) {
   if (xerrno == EPERM) {
     pr_log_debug(DEBUG2, "%s: %s", msg, strerror(xerrno));
@@ -72,7 +82,69 @@ static void privs_log_error(const char *msg, int xerrno) {
   }
 }
 
+#if defined(HAVE_SETEUID)
+static int privs_ids_match(uid_t euid, gid_t egid) {
+  if (privs_ids_known == TRUE &&
+      privs_euid == euid &&
+      privs_egid == egid) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void privs_remember_ids(uid_t euid, gid_t egid) {
+  privs_euid = euid;
+  privs_egid = egid;
+  privs_ids_known = TRUE;
+}
+
+static int privs_seteuid(uid_t euid) {
+  if (privs_ids_known == TRUE &&
+      privs_euid == euid) {
+    return 0;
+  }
+
+  if (seteuid(euid) < 0) {
+    int xerrno = errno;
+
+    privs_ids_known = FALSE;
+
+    errno = xerrno;
+    return -1;
+  }
+
+  privs_euid = euid;
+  return 0;
+}
+
+static int privs_setegid(gid_t egid) {
+  if (privs_ids_known == TRUE &&
+      privs_egid == egid) {
+    return 0;
+  }
+
+  if (setegid(egid) < 0) {
+    int xerrno = errno;
+
+    privs_ids_known = FALSE;
+
+    errno = xerrno;
+    return -1;
+  }
+
+  privs_egid = egid;
+  return 0;
+}
+#endif /* HAVE_SETEUID */
+
+void pr_privs_clear_cache(void) {
+  privs_ids_known = FALSE;
+}
+
 int pr_privs_setup(uid_t uid, gid_t gid, const char *file, int lineno) {
+  int ok = TRUE;
+
   if (nonroot_daemon == TRUE) {
     session.ouid = session.uid = getuid();
     session.gid = getgid();
@@ -89,6 +161,11 @@ int pr_privs_setup(uid_t uid, gid_t gid, const char *file, int lineno) {
   pr_trace_msg(trace_channel, 9, "PRIVS_SETUP called, "
     "resetting user/root privs count");
 
+  /* We only trust our notion of the effective IDs again once all of the
+   * ID switches here have succeeded.
+   */
+  privs_ids_known = FALSE;
+
   pr_signals_block();
 
   if (getuid() != PR_ROOT_UID) {
@@ -97,15 +174,22 @@ int pr_privs_setup(uid_t uid, gid_t gid, const char *file, int lineno) {
 
     if (setgid(session.gid) < 0) {
       privs_log_error("SETUP PRIVS: unable to setgid()", errno);
+      ok = FALSE;
     }
 
 #if defined(HAVE_SETEUID)
     if (setuid(session.uid) < 0) {
       privs_log_error("SETUP PRIVS: unable to setuid()", errno);
+      ok = FALSE;
     }
 
     if (seteuid(session.uid) < 0) {
       privs_log_error("SETUP PRIVS: unable to seteuid()", errno);
+      ok = FALSE;
+    }
+
+    if (ok == TRUE) {
+      privs_remember_ids(session.uid, session.gid);
     }
 #else
     if (setreuid(session.uid, session.uid) < 0) {
@@ -121,14 +205,21 @@ int pr_privs_setup(uid_t uid, gid_t gid, const char *file, int lineno) {
 #if defined(HAVE_SETEUID)
     if (setuid(PR_ROOT_UID) < 0) {
       privs_log_error("SETUP PRIVS: unable to setuid()", errno);
+      ok = FALSE;
     }
 
     if (setgid(gid) < 0) {
       privs_log_error("SETUP PRIVS: unable to setgid()", errno);
+      ok = FALSE;
     }
 
     if (seteuid(uid) < 0) {
       privs_log_error("SETUP PRIVS: unable to seteuid()", errno);
+      ok = FALSE;
+    }
+
+    if (ok == TRUE) {
+      privs_remember_ids(uid, gid);
     }
 #else
     if (setgid(session.gid) < 0) {
@@ -164,16 +255,25 @@ int pr_privs_root(const char *file, int lineno) {
     root_privs);
   root_privs++;
 
+#if defined(HAVE_SETEUID)
+  if (!session.disable_id_switching &&
+      privs_ids_match(PR_ROOT_UID, PR_ROOT_GID) == TRUE) {
+    pr_trace_msg(trace_channel, 9,
+      "already have root privs, eliding PRIVS_ROOT ID switch");
+    return 0;
+  }
+#endif /* HAVE_SETEUID */
+
   pr_signals_block();
 
   if (!session.disable_id_switching) {
 
 #if defined(HAVE_SETEUID)
-    if (seteuid(PR_ROOT_UID) < 0) {
+    if (privs_seteuid(PR_ROOT_UID) < 0) {
       privs_log_error("ROOT PRIVS: unable to seteuid()", errno);
     }
 
-    if (setegid(PR_ROOT_GID) < 0) {
+    if (privs_setegid(PR_ROOT_GID) < 0) {
       privs_log_error("ROOT PRIVS: unable to setegid()", errno);
     }
 #else
@@ -214,20 +314,29 @@ int pr_privs_user(const char *file, int lineno) {
     user_privs);
   user_privs++;
 
+#if defined(HAVE_SETEUID)
+  if (!session.disable_id_switching &&
+      privs_ids_match(session.login_uid, session.login_gid) == TRUE) {
+    pr_trace_msg(trace_channel, 9,
+      "already have user privs, eliding PRIVS_USER ID switch");
+    return 0;
+  }
+#endif /* HAVE_SETEUID */
+
   pr_signals_block();
 
   if (!session.disable_id_switching) {
 #if defined(HAVE_SETEUID)
-    if (seteuid(PR_ROOT_UID) < 0) {
+    if (privs_seteuid(PR_ROOT_UID) < 0) {
       privs_log_error("USER PRIVS: unable to seteuid(PR_ROOT_UID)", errno);
     }
 
-    if (setegid(session.login_gid) < 0) {
+    if (privs_setegid(session.login_gid) < 0) {
       privs_log_error("USER PRIVS: unable to setegid(session.login_gid)",
         errno);
     }
 
-    if (seteuid(session.login_uid) < 0) {
+    if (privs_seteuid(session.login_uid) < 0) {
       privs_log_error("USER PRIVS: unable to seteuid(session.login_uid)",
         errno);
     }
@@ -289,12 +398,35 @@ int pr_privs_relinquish(const char *file, int lineno) {
   pr_trace_msg(trace_channel, 9, "root privs count = %u, user privs "
     "count = %u, honoring PRIVS_RELINQUISH", root_privs, user_privs);
 
+#if defined(HAVE_SETEUID)
+  if (!session.disable_id_switching &&
+      privs_ids_match(session.uid, session.gid) == TRUE) {
+    if (privs_euid != PR_ROOT_UID) {
+      if (user_privs > 0) {
+        user_privs--;
+      }
+
+    } else {
+      if (root_privs > 0) {
+        root_privs--;
+      }
+    }
+
+    pr_trace_msg(trace_channel, 9,
+      "already have session privs, eliding PRIVS_RELINQUISH ID switch");
+    return 0;
+  }
+#endif /* HAVE_SETEUID */
+
   pr_signals_block();
 
   if (!session.disable_id_switching) {
 #if defined(HAVE_SETEUID)
-    if (geteuid() != PR_ROOT_UID) {
-      if (seteuid(PR_ROOT_UID) < 0) {
+    uid_t euid;
+
+    euid = privs_ids_known == TRUE ? privs_euid : geteuid();
+    if (euid != PR_ROOT_UID) {
+      if (privs_seteuid(PR_ROOT_UID) < 0) {
         privs_log_error(
           "RELINQUISH PRIVS: unable to seteuid(PR_ROOT_UID)", errno);
       }
@@ -309,12 +441,12 @@ int pr_privs_relinquish(const char *file, int lineno) {
       }
     }
 
-    if (setegid(session.gid) < 0) {
+    if (privs_setegid(session.gid) < 0) {
       privs_log_error(
         "RELINQUISH PRIVS: unable to setegid(session.gid)", errno);
     }
 
-    if (seteuid(session.uid) < 0) {
+    if (privs_seteuid(session.uid) < 0) {
       privs_log_error(
         "RELINQUISH PRIVS: unable to seteuid(session.uid)", errno);
     }
@@ -366,6 +498,8 @@ int pr_privs_relinquish(const char *file, int lineno) {
 }
 
 int pr_privs_revoke(const char *file, int lineno) {
+  int ok = TRUE;
+
   if (nonroot_daemon == TRUE) {
     pr_trace_msg(trace_channel, 9,
       "PRIVS_REVOKE called at %s:%d for nonroot daemon, ignoring", file,
@@ -379,19 +513,28 @@ int pr_privs_revoke(const char *file, int lineno) {
   pr_trace_msg(trace_channel, 9, "PRIVS_REVOKE called, "
     "clearing user/root privs count");
 
+  privs_ids_known = FALSE;
+
   pr_signals_block();
 
 #if defined(HAVE_SETEUID)
   if (seteuid(PR_ROOT_UID) < 0) {
     privs_log_error("REVOKE PRIVS: unable to seteuid()", errno);
+    ok = FALSE;
   }
 
   if (setgid(session.gid) < 0) {
     privs_log_error("REVOKE PRIVS: unable to setgid()", errno);
+    ok = FALSE;
   }
 
   if (setuid(session.uid) < 0) {
     privs_log_error("REVOKE PRIVS: unable to setuid()", errno);
+    ok = FALSE;
+  }
+
+  if (ok == TRUE) {
+    privs_remember_ids(session.uid, session.gid);
   }
 #else
   if (setreuid(PR_ROOT_UID, PR_ROOT_UID) < 0) {
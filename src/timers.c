@@ -22,18 +22,38 @@
  * the source code for OpenSSL in the source distribution.
  */
 
-/* Timer system, based on alarm() and SIGALRM. */
+/* Timer system, based on a hierarchical timer wheel with millisecond
+ * resolution.  Expiries are signalled via a timerfd(2) descriptor, where
+ * available, which the daemon and session poll loops watch; SIGALRM, via
+ * setitimer(2) or alarm(2), remains as a fallback for when the process is
+ * blocked elsewhere.
+ */
 
 #include "conf.h"
 
+#if defined(HAVE_SYS_TIMERFD_H) && \
+    defined(HAVE_TIMERFD_CREATE) && \
+    defined(HAVE_CLOCK_GETTIME) && \
+    defined(HAVE_CLOCK_MONOTONIC)
+# include <sys/timerfd.h>
+# define PR_USE_TIMERFD		1
+#endif
+
 /* From src/main.c */
 extern volatile unsigned int recvd_signal_flags;
 
 struct timer {
+  /* All registered timers. */
   struct timer *next, *prev;
 
-  long count;                   /* Amount of time remaining */
+  /* The wheel slot, or list of expired timers, containing this timer. */
+  struct timer *w_next, *w_prev;
+  struct timer **w_slot;
+
+  uint64_t expires;             /* When the timer expires, in msecs */
   long interval;                /* Original length of timer */
+  long interval_ms;             /* Original length of timer, in msecs */
+  int in_msecs;                 /* Whether interval is in secs or msecs */
 
   int timerno;                  /* Caller dependent timer number */
   module *mod;                  /* Module owning this timer */
@@ -45,223 +65,375 @@ struct timer {
 
 #define PR_TIMER_DYNAMIC_TIMERNO	1024
 
-static int current_timeout = 0;
-static int total_time = 0;
+/* The wheel has TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots each;
+ * a slot on level L spans 64^L msecs.  Six levels cover a little over two
+ * years; longer timers are parked in the last slot of the top level, and
+ * moved when that slot comes around.
+ */
+#define TIMER_WHEEL_BITS		6
+#define TIMER_WHEEL_SLOTS		(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK		(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS		6
+
+#define TIMER_TICK(ms, level)	((ms) >> (TIMER_WHEEL_BITS * (level)))
+
+/* When expiries are signalled via timerfd, the SIGALRM fallback is armed
+ * this much later, so that a process waiting in a poll loop handles its
+ * timers without being interrupted.
+ */
+#define TIMER_SIGNAL_GRACE_MS		250
+
+static struct timer *wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint64_t wheel_now = 0;
+static unsigned int wheel_count = 0;
+
+/* When the timerfd/SIGALRM is next due to fire; zero if disarmed. */
+static uint64_t armed_expiry = 0;
+static int sig_alarm_installed = FALSE;
+
+/* Whether the interval timer (or alarm) for the SIGALRM fallback is armed.
+ * This is tracked apart from armed_expiry, since the fallback is armed to
+ * fire a little after the timerfd, and so may still be pending once the
+ * timers have been processed.
+ */
+static int timer_signal_armed = FALSE;
+
+static int timer_fd = -1;
+static pid_t timer_fd_pid = 0;
+
+static struct timer *timers = NULL;
+static struct timer *free_timers = NULL;
 static int sleep_sem = 0;
 static int alarms_blocked = 0, alarm_pending = 0;
-static xaset_t *timers = NULL;
-static xaset_t *recycled = NULL;
-static xaset_t *free_timers = NULL;
 static int _indispatch = 0;
 static int dynamic_timerno = PR_TIMER_DYNAMIC_TIMERNO;
 static unsigned int nalarms = 0;
-static time_t alarmed_time = 0;
 
 static pool *timer_pool = NULL;
 
 static const char *trace_channel = "timer";
 
-static int timer_cmp(struct timer *t1, struct timer *t2) {
-  if (t1->count < t2->count) {
-    return -1;
+static void timer_arm(void);
+
+static void timer_cleanup(void *user_data) {
+  timers = NULL;
+  free_timers = NULL;
+
+  memset(wheel, 0, sizeof(wheel));
+  wheel_count = 0;
+}
+
+static uint64_t get_current_ms(void) {
+  uint64_t now;
+  int use_fallback = TRUE;
+
+#if defined(HAVE_CLOCK_GETTIME) && \
+    defined(HAVE_CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+    pr_trace_msg(trace_channel, 1,
+      "clock_gettime(3) error: %s, falling back to gettimeofday(2)",
+      strerror(errno));
+
+  } else {
+    now = ((uint64_t) ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+    use_fallback = FALSE;
   }
+#endif /* HAVE_CLOCK_GETTIME and HAVE_CLOCK_MONOTONIC */
+
+  if (use_fallback == TRUE) {
+    struct timeval tv;
 
-  if (t1->count > t2->count) {
-    return 1;
+    gettimeofday(&tv, NULL);
+    now = ((uint64_t) tv.tv_sec * 1000) + (tv.tv_usec / 1000);
   }
 
-  return 0;
+  return now;
 }
 
-static void timer_cleanup(void *user_data) {
-  timers = NULL;
-  free_timers = NULL;
+/* Wheel slot lists */
+
+static void timer_list_add(struct timer **list, struct timer *t) {
+  t->w_prev = NULL;
+  t->w_next = *list;
+  if (*list != NULL) {
+    (*list)->w_prev = t;
+  }
+
+  *list = t;
 }
 
-/* This function does the work of iterating through the list of registered
- * timers, checking to see if their callbacks should be invoked and whether
- * they should be removed from the registration list. Its return value is
- * the amount of time remaining on the first timer in the list.
- */
-static int process_timers(int elapsed) {
-  struct timer *t = NULL, *next = NULL;
-  int res = 0;
+static void timer_slot_add(struct timer **slot, struct timer *t) {
+  timer_list_add(slot, t);
+  t->w_slot = slot;
+  wheel_count++;
+}
+
+static void timer_wheel_insert(struct timer *t) {
+  register unsigned int level;
+  unsigned int slot;
 
-  if (recycled == NULL) {
-    recycled = xaset_create(timer_pool, NULL);
+  /* A timer always expires at least one tick from now; the current tick
+   * has already been processed.
+   */
+  if (t->expires <= wheel_now) {
+    t->expires = wheel_now + 1;
   }
 
-  if (elapsed == 0 &&
-      recycled->xas_list == NULL) {
-    if (timers == NULL) {
-      return 0;
+  for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    if (TIMER_TICK(t->expires, level) - TIMER_TICK(wheel_now, level) <
+        TIMER_WHEEL_SLOTS) {
+      slot = TIMER_TICK(t->expires, level) & TIMER_WHEEL_MASK;
+      timer_slot_add(&(wheel[level][slot]), t);
+      return;
     }
+  }
 
-    if (timers->xas_list != NULL) {
-      /* The value we return is a proposed timeout, for the next call to
-       * alarm(3).  We start with the simple count of timers in our list.
-       *
-       * But then we reduce the number; some of the timers' intervals may
-       * less than the number of total timers.
-       */
-      res = ((struct timer *) timers->xas_list)->count;
-      if (res > 5) {
-        res = 5;
-      }
-    }
+  /* Too far in the future; park the timer in the furthest slot. */
+  level = TIMER_WHEEL_LEVELS - 1;
+  slot = (TIMER_TICK(wheel_now, level) + TIMER_WHEEL_MASK) & TIMER_WHEEL_MASK;
+  timer_slot_add(&(wheel[level][slot]), t);
+}
 
-    return res;
+static void timer_wheel_remove(struct timer *t) {
+  if (t->w_slot == NULL) {
+    return;
   }
 
-  /* Critical code, no interruptions please */
-  if (_indispatch) {
-    return 0;
+  if (t->w_next != NULL) {
+    t->w_next->w_prev = t->w_prev;
   }
 
-  pr_alarms_block();
-  _indispatch++;
+  if (t->w_prev != NULL) {
+    t->w_prev->w_next = t->w_next;
 
-  if (elapsed) {
-    for (t = (struct timer *) timers->xas_list; t; t = next) {
-      /* If this timer has already been handled, skip */
-      next = t->next;
+  } else {
+    *(t->w_slot) = t->w_next;
+  }
 
-      if (t->remove) {
-        /* Move the timer onto the free_timers chain, for later reuse. */
-        xaset_remove(timers, (xasetmember_t *) t);
-        xaset_insert(free_timers, (xasetmember_t *) t);
+  t->w_next = t->w_prev = NULL;
+  t->w_slot = NULL;
+  wheel_count--;
+}
 
-      } else if ((t->count -= elapsed) <= 0) {
-        /* This timer's interval has elapsed, so trigger its callback. */
+/* Returns the earliest expiry in the wheel, or zero if the wheel is empty.
+ * Every timer in a slot expires before any timer in a later slot of the
+ * same level, so only the first occupied slot of each level need be
+ * examined.
+ */
+static uint64_t timer_wheel_next_expiry(void) {
+  register unsigned int level;
+  uint64_t next = 0;
 
-        pr_trace_msg(trace_channel, 4,
-          "%ld %s for timer ID %d ('%s', for module '%s') elapsed, invoking "
-          "callback (%p)", t->interval,
-          t->interval != 1 ? "seconds" : "second", t->timerno,
-          t->desc ? t->desc : "<unknown>",
-          t->mod ? t->mod->name : "<none>", t->callback);
+  if (wheel_count == 0) {
+    return 0;
+  }
 
-        if (t->callback(t->interval, t->timerno, t->interval - t->count,
-            t->mod) == 0) {
+  for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    register unsigned int i;
+    uint64_t curr_tick;
 
-          /* A return value of zero means this timer is done, and can be
-           * removed.
-           */
-          xaset_remove(timers, (xasetmember_t *) t);
-          xaset_insert(free_timers, (xasetmember_t *) t);
+    curr_tick = TIMER_TICK(wheel_now, level);
 
-        } else {
-          /* A non-zero return value from a timer callback signals that
-           * the timer should be reused/restarted.
-           */
-          pr_trace_msg(trace_channel, 6,
-            "restarting timer ID %d ('%s'), as per callback", t->timerno,
-            t->desc ? t->desc : "<unknown>");
-
-          xaset_remove(timers, (xasetmember_t *) t);
-          t->count = t->interval;
-          xaset_insert(recycled, (xasetmember_t *) t);
+    for (i = 1; i < TIMER_WHEEL_SLOTS; i++) {
+      uint64_t tick;
+
+      tick = curr_tick + i;
+      if (wheel[level][tick & TIMER_WHEEL_MASK] != NULL) {
+        struct timer *t;
+
+        for (t = wheel[level][tick & TIMER_WHEEL_MASK]; t; t = t->w_next) {
+          if (next == 0 ||
+              t->expires < next) {
+            next = t->expires;
+          }
         }
+
+        break;
       }
     }
   }
 
-  /* Put the recycled timers back into the main timer list. */
-  t = (struct timer *) recycled->xas_list;
-  while (t != NULL) {
-    pr_signals_handle();
+  return next;
+}
 
-    xaset_remove(recycled, (xasetmember_t *) t);
-    xaset_insert_sort(timers, (xasetmember_t *) t, TRUE);
-    t = (struct timer *) recycled->xas_list;
+/* Advances the wheel to the given time, returning the list of timers which
+ * have expired, ordered by expiry.
+ */
+static struct timer *timer_wheel_advance(uint64_t now) {
+  register unsigned int level;
+  struct timer *expired = NULL, *pending = NULL, *t;
+
+  if (now <= wheel_now) {
+    return NULL;
   }
 
-  _indispatch--;
-  pr_alarms_unblock();
+  for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    uint64_t from, to, tick;
 
-  /* If no active timers remain in the list, there is no reason to set the
-   * SIGALRM handle.
-   */
+    from = TIMER_TICK(wheel_now, level);
+    to = TIMER_TICK(now, level);
 
-  if (timers->xas_list != NULL) {
-    /* The value we return is a proposed timeout, for the next call to
-     * alarm(3).  We start with the simple count of timers in our list.
-     *
-     * But then we reduce the number; some of the timers' intervals may
-     * less than the number of total timers.
-     */
-    res = ((struct timer *) timers->xas_list)->count;
-    if (res > 5) {
-      res = 5;
+    if (from == to) {
+      /* The higher levels have not moved either. */
+      break;
+    }
+
+    if (to - from > TIMER_WHEEL_SLOTS) {
+      to = from + TIMER_WHEEL_SLOTS;
+    }
+
+    for (tick = from + 1; tick <= to; tick++) {
+      struct timer **slot;
+
+      slot = &(wheel[level][tick & TIMER_WHEEL_MASK]);
+
+      while (*slot != NULL) {
+        t = *slot;
+        timer_wheel_remove(t);
+
+        if (t->expires <= now) {
+          struct timer *ti, *tl = NULL;
+
+          /* Keep the expired list in order of expiry. */
+          for (ti = expired; ti != NULL && ti->expires <= t->expires;
+              ti = ti->w_next) {
+            tl = ti;
+          }
+
+          t->w_prev = tl;
+          t->w_next = ti;
+          if (ti != NULL) {
+            ti->w_prev = t;
+          }
+
+          if (tl != NULL) {
+            tl->w_next = t;
+
+          } else {
+            expired = t;
+          }
+
+        } else {
+          timer_list_add(&pending, t);
+        }
+      }
     }
   }
 
-  return res;
+  wheel_now = now;
+
+  /* Timers which have not yet expired move down to a finer level. */
+  while (pending != NULL) {
+    t = pending;
+    pending = t->w_next;
+    timer_wheel_insert(t);
+  }
+
+  return expired;
 }
 
-static time_t get_current_time(void) {
-  time_t now;
-  int use_fallback = TRUE;
+/* The registered timers list */
 
-#if defined(HAVE_CLOCK_GETTIME) && \
-    defined(HAVE_CLOCK_MONOTONIC)
-  struct timespec ts;
+static void timer_free(struct timer *t) {
+  if (t->next != NULL) {
+    t->next->prev = t->prev;
+  }
 
-  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
-    pr_trace_msg(trace_channel, 1,
-      "clock_gettime(3) error: %s, falling back to time(3)", strerror(errno));
+  if (t->prev != NULL) {
+    t->prev->next = t->next;
 
   } else {
-    now = ts.tv_sec;
-    use_fallback = FALSE;
+    timers = t->next;
   }
-#endif /* HAVE_CLOCK_GETTIME and HAVE_CLOCK_MONOTONIC */
 
-  if (use_fallback == TRUE) {
-    time(&now);
+  t->prev = NULL;
+  t->next = free_timers;
+  free_timers = t;
+}
+
+/* This function does the work of checking for expired timers, invoking
+ * their callbacks and either removing or restarting them, as the callbacks
+ * indicate.
+ */
+static void process_timers(void) {
+  struct timer *expired, *t;
+  uint64_t now;
+
+  /* Critical code, no interruptions please */
+  if (_indispatch) {
+    return;
   }
 
-  return now;
-}
+  pr_alarms_block();
+  _indispatch++;
 
-static RETSIGTYPE sig_alarm(int signo) {
-#if defined(HAVE_SIGACTION)
-  struct sigaction act;
+  now = get_current_ms();
+  expired = timer_wheel_advance(now);
 
-  act.sa_handler = sig_alarm;
-  sigemptyset(&act.sa_mask);
-  act.sa_flags = 0;
+  while (expired != NULL) {
+    long elapsed;
 
-# if defined(SA_INTERRUPT)
-  act.sa_flags |= SA_INTERRUPT;
-#endif /* SA_INTERRUPT */
-# if defined(SA_RESTART)
-  act.sa_flags &= SA_RESTART;
-#endif /* SA_RESTART */
+    t = expired;
+    expired = t->w_next;
+    if (expired != NULL) {
+      expired->w_prev = NULL;
+    }
 
-  /* Install this handler for SIGALRM. */
-  if (sigaction(SIGALRM, &act, NULL) < 0) {
-    pr_log_pri(PR_LOG_WARNING,
-      "unable to install SIGALRM handler via sigaction(2): %s",
-      strerror(errno));
-  }
+    t->w_next = t->w_prev = NULL;
 
-#elif defined(HAVE_SIGINTERRUPT)
-  if (siginterrupt(SIGALRM, 1) < 0) {
-    pr_log_pri(PR_LOG_WARNING,
-      "unable to allow SIGALRM to interrupt system calls: %s", strerror(errno));
+    if (t->remove) {
+      timer_free(t);
+      continue;
+    }
+
+    /* How long since the timer was (re)started, in the caller's units. */
+    elapsed = (long) (now - (t->expires - t->interval_ms));
+    if (t->in_msecs == FALSE) {
+      elapsed /= 1000;
+    }
+
+    /* This timer's interval has elapsed, so trigger its callback. */
+    pr_trace_msg(trace_channel, 4,
+      "%ld %s for timer ID %d ('%s', for module '%s') elapsed, invoking "
+      "callback (%p)", t->interval,
+      t->in_msecs ? "msecs" : t->interval != 1 ? "seconds" : "second",
+      t->timerno, t->desc ? t->desc : "<unknown>",
+      t->mod ? t->mod->name : "<none>", t->callback);
+
+    if (t->callback(t->interval, t->timerno, elapsed, t->mod) == 0 ||
+        t->remove) {
+
+      /* A return value of zero means this timer is done, and can be
+       * removed.
+       */
+      timer_free(t);
+
+    } else {
+      /* A non-zero return value from a timer callback signals that
+       * the timer should be reused/restarted.
+       */
+      pr_trace_msg(trace_channel, 6,
+        "restarting timer ID %d ('%s'), as per callback", t->timerno,
+        t->desc ? t->desc : "<unknown>");
+
+      t->expires = now + t->interval_ms;
+      timer_wheel_insert(t);
+    }
   }
-#endif /* HAVE_SIGACTION or HAVE_SIGINTERRUPT */
 
+  _indispatch--;
+  pr_alarms_unblock();
+
+  /* Recompute when we next need to be woken. */
+  armed_expiry = 0;
+  timer_arm();
+}
+
+static RETSIGTYPE sig_alarm(int signo) {
   recvd_signal_flags |= RECEIVED_SIG_ALRM;
   nalarms++;
-
-  /* Reset the alarm */
-  total_time += current_timeout;
-  if (current_timeout) {
-    alarmed_time = get_current_time();
-    alarm(current_timeout);
-  }
 }
 
 static void set_sig_alarm(void) {
@@ -286,53 +458,215 @@ static void set_sig_alarm(void) {
       strerror(errno));
   }
 
-#elif defined(HAVE_SIGINTERRUPT)
+#else
+  signal(SIGALRM, sig_alarm);
+
+# if defined(HAVE_SIGINTERRUPT)
   if (siginterrupt(SIGALRM, 1) < 0) {
     pr_log_pri(PR_LOG_WARNING,
       "unable to allow SIGALRM to interrupt system calls: %s", strerror(errno));
   }
-#endif /* HAVE_SIGACTION or HAVE_SIGINTERRUPT */
+# endif /* HAVE_SIGINTERRUPT */
+#endif /* HAVE_SIGACTION */
 }
 
-void handle_alarm(void) {
-  /* We need to adjust for any time that might be remaining on the alarm,
-   * in case we were called in order to change alarm durations.  Note
-   * that rapid-fire calling of this function will probably screw
-   * up the already poor resolution of alarm() _horribly_.  Oh well,
-   * this shouldn't be used for any precise work anyway, it's only
-   * for modules to perform approximate timing.
+#if defined(PR_USE_TIMERFD)
+static int timer_get_fd(void) {
+  pid_t pid;
+
+  pid = getpid();
+
+  /* A descriptor inherited from our parent shares its timer; we need our
+   * own.
    */
+  if (timer_fd >= 0 &&
+      timer_fd_pid != pid) {
+    (void) close(timer_fd);
+    timer_fd = -1;
+  }
+
+  if (timer_fd < 0) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (timer_fd < 0) {
+      pr_trace_msg(trace_channel, 1, "error creating timerfd: %s",
+        strerror(errno));
+      return -1;
+    }
+
+    (void) pr_fs_get_usable_fd2(&timer_fd);
+    timer_fd_pid = pid;
+  }
+
+  return timer_fd;
+}
+#endif /* PR_USE_TIMERFD */
+
+/* Disarms the timerfd and the SIGALRM fallback, so that no stray SIGALRM
+ * interrupts the process once there are no more timers.
+ */
+static void timer_disarm(void) {
+#if defined(PR_USE_TIMERFD)
+  if (armed_expiry != 0 &&
+      timer_fd >= 0 &&
+      timer_fd_pid == getpid()) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    (void) timerfd_settime(timer_fd, 0, &its, NULL);
+  }
+#endif /* PR_USE_TIMERFD */
+
+  if (timer_signal_armed == TRUE) {
+#if defined(HAVE_SETITIMER)
+    struct itimerval itv;
+
+    memset(&itv, 0, sizeof(itv));
+    (void) setitimer(ITIMER_REAL, &itv, NULL);
+#else
+    alarm(0);
+#endif /* HAVE_SETITIMER */
+
+    timer_signal_armed = FALSE;
+    pr_trace_msg(trace_channel, 19, "disarmed SIGALRM, no timers remaining");
+  }
+
+  armed_expiry = 0;
+}
+
+/* Arms the timerfd and/or SIGALRM for the earliest timer expiry, unless
+ * already armed to fire no later than that.  Firing early is harmless; the
+ * wheel is simply re-examined, and rearmed.
+ */
+static void timer_arm(void) {
+  uint64_t next, now, signal_ms;
+  int use_timerfd = FALSE;
+
+  next = timer_wheel_next_expiry();
+  if (next == 0) {
+    timer_disarm();
+    return;
+  }
+
+  if (armed_expiry != 0 &&
+      armed_expiry <= next) {
+    return;
+  }
+
+  if (sig_alarm_installed == FALSE) {
+    set_sig_alarm();
+    sig_alarm_installed = TRUE;
+  }
+
+  now = get_current_ms();
+  signal_ms = next > now ? next - now : 1;
+
+#if defined(PR_USE_TIMERFD)
+  if (timer_get_fd() >= 0) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = (next % 1000) * 1000000;
 
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+      pr_trace_msg(trace_channel, 1, "error arming timerfd: %s",
+        strerror(errno));
+
+    } else {
+      use_timerfd = TRUE;
+      signal_ms += TIMER_SIGNAL_GRACE_MS;
+    }
+  }
+#endif /* PR_USE_TIMERFD */
+
+#if defined(HAVE_SETITIMER)
+  {
+    struct itimerval itv;
+
+    memset(&itv, 0, sizeof(itv));
+    itv.it_value.tv_sec = signal_ms / 1000;
+    itv.it_value.tv_usec = (signal_ms % 1000) * 1000;
+
+    if (setitimer(ITIMER_REAL, &itv, NULL) < 0) {
+      pr_trace_msg(trace_channel, 1, "error arming interval timer: %s",
+        strerror(errno));
+
+    } else {
+      timer_signal_armed = TRUE;
+    }
+  }
+#else
+  alarm((unsigned int) ((signal_ms + 999) / 1000));
+  timer_signal_armed = TRUE;
+#endif /* HAVE_SETITIMER */
+
+  pr_trace_msg(trace_channel, 19, "armed %s for %lu msecs from now",
+    use_timerfd ? "timerfd" : "SIGALRM", (unsigned long) (next - now));
+  armed_expiry = next;
+}
+
+void handle_alarm(void) {
   /* It's possible that alarms are blocked when this function is
    * called, if so, increment alarm_pending and exit swiftly.
    */
-  while (nalarms) {
-    nalarms = 0;
+  nalarms = 0;
 
-    if (!alarms_blocked) {
-      int alarm_elapsed, new_timeout;
-      time_t now;
+  if (!alarms_blocked) {
+    process_timers();
 
-      /* Clear any pending ALRM signals. */
-      alarm(0);
+  } else {
+    alarm_pending++;
+  }
 
-      /* Determine how much time has elapsed since we last processed timers. */
-      now = get_current_time();
-      alarm_elapsed = alarmed_time > 0 ? (int) (now - alarmed_time) : 0;
+  pr_signals_handle();
+}
 
-      new_timeout = total_time + alarm_elapsed;
-      total_time = 0;
-      new_timeout = process_timers(new_timeout);
+int pr_timer_get_fd(void) {
+#if defined(PR_USE_TIMERFD)
+  if (timers == NULL) {
+    return -1;
+  }
 
-      alarmed_time = now;
-      alarm(current_timeout = new_timeout);
+  return timer_get_fd();
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* PR_USE_TIMERFD */
+}
 
-    } else {
-      alarm_pending++;
+void pr_timer_process(void) {
+#if defined(PR_USE_TIMERFD)
+  if (timer_fd >= 0) {
+    uint64_t expirations;
+
+    /* Drain the timerfd, so that it no longer polls as readable. */
+    (void) read(timer_fd, &expirations, sizeof(expirations));
+  }
+#endif /* PR_USE_TIMERFD */
+
+  if (!alarms_blocked) {
+    process_timers();
+
+  } else {
+    alarm_pending++;
+  }
+}
+
+static struct timer *timer_find(int timerno, module *mod) {
+  struct timer *t;
+
+  for (t = timers; t; t = t->next) {
+    if (t->remove) {
+      continue;
+    }
+
+    if (t->timerno == timerno &&
+        (t->mod == mod || mod == ANY_MODULE)) {
+      return t;
     }
   }
 
-  pr_signals_handle();
+  return NULL;
 }
 
 int pr_timer_reset(int timerno, module *mod) {
@@ -350,25 +684,14 @@ int pr_timer_reset(int timerno, module *mod) {
 
   pr_alarms_block();
 
-  if (recycled == NULL) {
-    recycled = xaset_create(timer_pool, NULL);
-  }
-
-  for (t = (struct timer *) timers->xas_list; t; t = t->next) {
-    if (t->timerno == timerno &&
-        (t->mod == mod || mod == ANY_MODULE)) {
-      t->count = t->interval;
-      xaset_remove(timers, (xasetmember_t *) t);
-      xaset_insert(recycled, (xasetmember_t *) t);
-      nalarms++;
-
-      /* The handle_alarm() function also readjusts the timers lists
-       * as part of its processing, so it needs to be called when a timer
-       * is reset.
-       */
-      handle_alarm();
-      break;
-    }
+  t = timer_find(timerno, mod);
+  if (t != NULL) {
+    /* Restarting a timer only ever moves its expiry later, so there is no
+     * need to rearm anything; an early wakeup finds nothing to do.
+     */
+    timer_wheel_remove(t);
+    t->expires = get_current_ms() + t->interval_ms;
+    timer_wheel_insert(t);
   }
 
   pr_alarms_unblock();
@@ -393,39 +716,38 @@ int pr_timer_remove(int timerno, module *mod) {
 
   pr_alarms_block();
 
-  for (t = (struct timer *) timers->xas_list; t; t = tnext) {
+  for (t = timers; t; t = tnext) {
     tnext = t->next;
 
+    if (t->remove) {
+      continue;
+    }
+
     if ((timerno < 0 || t->timerno == timerno) &&
         (mod == ANY_MODULE || t->mod == mod)) {
       nremoved++;
 
-      if (_indispatch) {
+      pr_trace_msg(trace_channel, 7,
+        "removed timer ID %d ('%s', for module '%s')", t->timerno, t->desc,
+        t->mod ? t->mod->name : "[none]");
+
+      if (t->w_slot == NULL) {
+        /* This timer has expired, and is being dispatched; let the
+         * dispatcher free it.
+         */
         t->remove++;
 
       } else {
-        xaset_remove(timers, (xasetmember_t *) t);
-        xaset_insert(free_timers, (xasetmember_t *) t);
-	nalarms++;
-
-        /* The handle_alarm() function also readjusts the timers lists
-         * as part of its processing, so it needs to be called when a timer
-         * is removed.
-         */
-        handle_alarm();
+        timer_wheel_remove(t);
+        timer_free(t);
       }
 
-      pr_trace_msg(trace_channel, 7,
-        "removed timer ID %d ('%s', for module '%s')", t->timerno, t->desc,
-        t->mod ? t->mod->name : "[none]");
-    }
-
-    /* If we are removing a specific timer, break out of the loop now.
-     * Otherwise, keep removing any matching timers.
-     */
-    if (nremoved > 0 &&
-        timerno >= 0) {
-      break;
+      /* If we are removing a specific timer, break out of the loop now.
+       * Otherwise, keep removing any matching timers.
+       */
+      if (timerno >= 0) {
+        break;
+      }
     }
   }
 
@@ -436,6 +758,13 @@ int pr_timer_remove(int timerno, module *mod) {
     return -1;
   }
 
+  /* If that was the last timer, disarm.  The dispatcher rearms once it is
+   * done.
+   */
+  if (!_indispatch) {
+    timer_arm();
+  }
+
   /* If we removed a specific timer because of the given timerno, return
    * that timerno value.
    */
@@ -446,24 +775,20 @@ int pr_timer_remove(int timerno, module *mod) {
   return nremoved;
 }
 
-int pr_timer_add(int seconds, int timerno, module *mod, callback_t cb,
-    const char *desc) {
+static int timer_add(long msecs, int in_msecs, int timerno, module *mod,
+    callback_t cb, const char *desc) {
   struct timer *t = NULL;
 
-  if (seconds <= 0 ||
+  if (msecs <= 0 ||
       cb == NULL ||
       desc == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  if (timers == NULL) {
-    timers = xaset_create(timer_pool, (XASET_COMPARE) timer_cmp);
-  }
-
   /* Check to see that, if specified, the timerno is not already in use. */
   if (timerno >= 0) {
-    for (t = (struct timer *) timers->xas_list; t; t = t->next) {
+    for (t = timers; t; t = t->next) {
       if (t->timerno == timerno) {
         errno = EPERM;
         return -1;
@@ -471,15 +796,11 @@ int pr_timer_add(int seconds, int timerno, module *mod, callback_t cb,
     }
   }
 
-  if (free_timers == NULL) {
-    free_timers = xaset_create(timer_pool, NULL);
-  }
-
   /* Try to use an old timer first */
   pr_alarms_block();
-  t = (struct timer *) free_timers->xas_list;
+  t = free_timers;
   if (t != NULL) {
-    xaset_remove(free_timers, (xasetmember_t *) t);
+    free_timers = t->next;
 
   } else {
     if (timer_pool == NULL) {
@@ -501,33 +822,34 @@ int pr_timer_add(int seconds, int timerno, module *mod, callback_t cb,
     timerno = dynamic_timerno++;
   }
 
+  memset(t, 0, sizeof(struct timer));
   t->timerno = timerno;
-  t->count = t->interval = seconds;
+  t->in_msecs = in_msecs;
+  t->interval_ms = msecs;
+  t->interval = in_msecs ? msecs : msecs / 1000;
   t->callback = cb;
   t->mod = mod;
-  t->remove = 0;
   t->desc = desc;
 
-  /* If called while _indispatch, add to the recycled list to prevent
-   * list corruption
+  t->next = timers;
+  if (timers != NULL) {
+    timers->prev = t;
+  }
+  timers = t;
+
+  /* Timers added while dispatching go straight into the wheel, which has
+   * already been advanced past the expired timers.
    */
+  if (_indispatch == 0 &&
+      wheel_count == 0) {
+    wheel_now = get_current_ms();
+  }
 
-  if (_indispatch) {
-    if (recycled == NULL) {
-      recycled = xaset_create(timer_pool, NULL);
-    }
-    xaset_insert(recycled, (xasetmember_t *) t);
+  t->expires = get_current_ms() + t->interval_ms;
+  timer_wheel_insert(t);
 
-  } else {
-    xaset_insert_sort(timers, (xasetmember_t *) t, TRUE);
-    nalarms++;
-    set_sig_alarm();
-
-    /* The handle_alarm() function also readjusts the timers lists
-     * as part of its processing, so it needs to be called when a timer
-     * is added.
-     */
-    handle_alarm();
+  if (_indispatch == 0) {
+    timer_arm();
   }
 
   pr_alarms_unblock();
@@ -535,10 +857,26 @@ int pr_timer_add(int seconds, int timerno, module *mod, callback_t cb,
   pr_trace_msg(trace_channel, 7, "added timer ID %d ('%s', for module '%s'), "
     "triggering in %ld %s", t->timerno, t->desc,
     t->mod ? t->mod->name : "[none]", t->interval,
-    t->interval != 1 ? "seconds" : "second");
+    in_msecs ? "msecs" : t->interval != 1 ? "seconds" : "second");
   return timerno;
 }
 
+int pr_timer_add(int seconds, int timerno, module *mod, callback_t cb,
+    const char *desc) {
+
+  if (seconds <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return timer_add((long) seconds * 1000, FALSE, timerno, mod, cb, desc);
+}
+
+int pr_timer_add_ms(long msecs, int timerno, module *mod, callback_t cb,
+    const char *desc) {
+  return timer_add(msecs, TRUE, timerno, mod, cb, desc);
+}
+
 /* Alarm blocking.  This is done manually rather than with syscalls,
  * so as to allow for easier signal handling, portability and
  * detecting the number of blocked alarms, as well as nesting the
@@ -582,6 +920,27 @@ int pr_timer_sleep(int seconds) {
 
   sigemptyset(&oset);
   while (!sleep_sem) {
+#if defined(PR_USE_TIMERFD)
+    int fd;
+
+    fd = pr_timer_get_fd();
+    if (fd >= 0) {
+      fd_set rfds;
+
+      FD_ZERO(&rfds);
+      FD_SET(fd, &rfds);
+
+      if (select(fd + 1, &rfds, NULL, NULL, NULL) < 0 &&
+          errno == EINTR) {
+        handle_alarm();
+        continue;
+      }
+
+      pr_timer_process();
+      continue;
+    }
+#endif /* PR_USE_TIMERFD */
+
     sigsuspend(&oset);
     handle_alarm();
   }
@@ -610,16 +969,25 @@ int pr_timer_usleep(unsigned long usecs) {
 void timers_init(void) {
 
   /* Reset some of the key static variables. */
-  current_timeout = 0;
-  total_time = 0;
   nalarms = 0;
-  alarmed_time = 0;
   dynamic_timerno = PR_TIMER_DYNAMIC_TIMERNO;
+  armed_expiry = 0;
+
+  /* Interval timers are not inherited across fork(2). */
+  timer_signal_armed = FALSE;
 
   /* Don't inherit the parent's timer lists. */
   timers = NULL;
-  recycled = NULL;
   free_timers = NULL;
+  memset(wheel, 0, sizeof(wheel));
+  wheel_count = 0;
+  wheel_now = get_current_ms();
+
+  /* Nor the parent's timerfd. */
+  if (timer_fd >= 0) {
+    (void) close(timer_fd);
+    timer_fd = -1;
+  }
 
   /* Reset the timer pool. */
   if (timer_pool != NULL) {
@@ -0,0 +1,309 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2026 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Bindings API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  init_netaddr();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("binding", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("binding", 0, 0);
+  }
+
+  free_bindings();
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+static server_rec *make_server(const char *name, const pr_netaddr_t *addr,
+    unsigned int port) {
+  server_rec *s;
+
+  s = pcalloc(p, sizeof(server_rec));
+  s->pool = make_sub_pool(p);
+  s->ServerName = name;
+  s->ServerPort = port;
+  s->addr = addr;
+  s->conf = xaset_create(s->pool, NULL);
+
+  return s;
+}
+
+/* Tests */
+
+START_TEST (namebind_create_test) {
+  int res;
+  unsigned int port = 2121;
+  const pr_netaddr_t *addr;
+  server_rec *s, *s2;
+  pr_ipbind_t *ipbind;
+
+  res = pr_namebind_create(NULL, NULL, NULL, NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  ck_assert_msg(addr != NULL, "Failed to get address: %s", strerror(errno));
+
+  s = make_server("default", addr, port);
+  s2 = make_server("named", addr, port);
+
+  res = pr_namebind_create(s2, "ftp.example.com", NULL, addr, port);
+  ck_assert_msg(res < 0, "Created namebind without ipbind unexpectedly");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = pr_ipbind_create(s, addr, port);
+  ck_assert_msg(res == 0, "Failed to create ipbind: %s", strerror(errno));
+
+  ipbind = pr_ipbind_find(addr, port, FALSE);
+  ck_assert_msg(ipbind != NULL, "Failed to find ipbind: %s", strerror(errno));
+
+  res = pr_namebind_create(s2, "ftp.example.com", ipbind, addr, port);
+  ck_assert_msg(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  res = pr_namebind_create(s2, "FTP.Example.COM", ipbind, addr, port);
+  ck_assert_msg(res < 0, "Created duplicate namebind unexpectedly");
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got %s (%d)", EEXIST,
+    strerror(errno), errno);
+
+  res = pr_namebind_create(s2, "*.example.com", ipbind, addr, port);
+  ck_assert_msg(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  res = pr_namebind_create(s2, "*.EXAMPLE.com", ipbind, addr, port);
+  ck_assert_msg(res < 0, "Created duplicate namebind unexpectedly");
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got %s (%d)", EEXIST,
+    strerror(errno), errno);
+
+  res = pr_namebind_create(s2, "ftp?.example.org", ipbind, addr, port);
+  ck_assert_msg(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  res = pr_namebind_create(s2, "ftp?.example.org", ipbind, addr, port);
+  ck_assert_msg(res < 0, "Created duplicate namebind unexpectedly");
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got %s (%d)", EEXIST,
+    strerror(errno), errno);
+
+  ck_assert_msg(pr_namebind_count(s) == 3, "Expected 3 namebinds, got %u",
+    pr_namebind_count(s));
+}
+END_TEST
+
+START_TEST (namebind_find_test) {
+  int res;
+  unsigned int port = 2121;
+  const pr_netaddr_t *addr;
+  server_rec *s, *s2, *s3, *s4, *named;
+  pr_ipbind_t *ipbind;
+  pr_namebind_t *nb;
+
+  nb = pr_namebind_find(NULL, NULL, 0, FALSE);
+  ck_assert_msg(nb == NULL, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  ck_assert_msg(addr != NULL, "Failed to get address: %s", strerror(errno));
+
+  s = make_server("default", addr, port);
+  s2 = make_server("wildcard", addr, port);
+  s3 = make_server("exact", addr, port);
+  s4 = make_server("glob", addr, port);
+
+  res = pr_ipbind_create(s, addr, port);
+  ck_assert_msg(res == 0, "Failed to create ipbind: %s", strerror(errno));
+
+  ipbind = pr_ipbind_find(addr, port, FALSE);
+  ck_assert_msg(ipbind != NULL, "Failed to find ipbind: %s", strerror(errno));
+
+  /* Note that the wildcard is created before the exact name, and thus
+   * takes precedence for names which match both.
+   */
+  res = pr_namebind_create(s2, "*.example.com", ipbind, addr, port);
+  ck_assert_msg(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  res = pr_namebind_create(s3, "ftp.example.com", ipbind, addr, port);
+  ck_assert_msg(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  res = pr_namebind_create(s3, "ftp.example.org", ipbind, addr, port);
+  ck_assert_msg(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  res = pr_namebind_create(s4, "ftp?.example.*", ipbind, addr, port);
+  ck_assert_msg(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  nb = pr_namebind_find("ftp.example.net", addr, port, FALSE);
+  ck_assert_msg(nb == NULL, "Found unexpected namebind '%s'",
+    nb ? nb->nb_name : "");
+
+  nb = pr_namebind_find("FTP.example.ORG", addr, port, FALSE);
+  ck_assert_msg(nb != NULL, "Failed to find namebind: %s", strerror(errno));
+  ck_assert_msg(nb->nb_server == s3, "Expected server '%s', got '%s'",
+    s3->ServerName, nb->nb_server->ServerName);
+
+  nb = pr_namebind_find("ftp.example.com", addr, port, FALSE);
+  ck_assert_msg(nb != NULL, "Failed to find namebind: %s", strerror(errno));
+  ck_assert_msg(nb->nb_server == s2, "Expected server '%s', got '%s'",
+    s2->ServerName, nb->nb_server->ServerName);
+
+  nb = pr_namebind_find("a.b.c.Example.Com", addr, port, FALSE);
+  ck_assert_msg(nb != NULL, "Failed to find namebind: %s", strerror(errno));
+  ck_assert_msg(nb->nb_server == s2, "Expected server '%s', got '%s'",
+    s2->ServerName, nb->nb_server->ServerName);
+
+  nb = pr_namebind_find("example.com", addr, port, FALSE);
+  ck_assert_msg(nb == NULL, "Found unexpected namebind '%s'",
+    nb ? nb->nb_name : "");
+
+  nb = pr_namebind_find("ftp1.example.net", addr, port, FALSE);
+  ck_assert_msg(nb != NULL, "Failed to find namebind: %s", strerror(errno));
+  ck_assert_msg(nb->nb_server == s4, "Expected server '%s', got '%s'",
+    s4->ServerName, nb->nb_server->ServerName);
+
+  /* Inactive namebinds are skipped, if requested. */
+  ipbind->ib_isactive = TRUE;
+
+  named = pr_namebind_get_server("ftp.example.org", addr, port);
+  ck_assert_msg(named == NULL, "Found unexpected server '%s'",
+    named ? named->ServerName : "");
+
+  res = pr_namebind_open("ftp.example.org", addr, port);
+  ck_assert_msg(res == 0, "Failed to open namebind: %s", strerror(errno));
+
+  named = pr_namebind_get_server("ftp.example.org", addr, port);
+  ck_assert_msg(named == s3, "Expected server '%s', got '%s'",
+    s3->ServerName, named ? named->ServerName : "");
+
+  /* An inactive earlier match does not hide a later active one. */
+  nb = pr_namebind_find("ftp.example.com", addr, port, FALSE);
+  ck_assert_msg(nb != NULL, "Failed to find namebind: %s", strerror(errno));
+  ck_assert_msg(nb->nb_server == s2, "Expected server '%s', got '%s'",
+    s2->ServerName, nb->nb_server->ServerName);
+
+  nb = pr_namebind_find("ftp.example.com", addr, port, TRUE);
+  ck_assert_msg(nb == NULL, "Found unexpected namebind '%s'",
+    nb ? nb->nb_name : "");
+
+  ((pr_namebind_t **) ipbind->ib_namebinds->elts)[1]->nb_isactive = TRUE;
+
+  named = pr_namebind_get_server("ftp.example.com", addr, port);
+  ck_assert_msg(named == s3, "Expected server '%s', got '%s'",
+    s3->ServerName, named ? named->ServerName : "");
+}
+END_TEST
+
+START_TEST (namebind_find_many_test) {
+  register unsigned int i;
+  int res;
+  unsigned int port = 2121, count = 50000;
+  const pr_netaddr_t *addr;
+  server_rec *s, *s2;
+  pr_ipbind_t *ipbind;
+
+  /* Many thousands of names on a single address should not require
+   * scanning all of them, for each lookup.
+   */
+
+  addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  ck_assert_msg(addr != NULL, "Failed to get address: %s", strerror(errno));
+
+  s = make_server("default", addr, port);
+  res = pr_ipbind_create(s, addr, port);
+  ck_assert_msg(res == 0, "Failed to create ipbind: %s", strerror(errno));
+
+  ipbind = pr_ipbind_find(addr, port, FALSE);
+  ck_assert_msg(ipbind != NULL, "Failed to find ipbind: %s", strerror(errno));
+
+  s2 = make_server("named", addr, port);
+
+  for (i = 0; i < count; i++) {
+    char *name;
+
+    if (i % 2 == 0) {
+      name = pstrcat(p, "ftp", pr_uid2str(p, i), ".example.com", NULL);
+
+    } else {
+      name = pstrcat(p, "*.customer", pr_uid2str(p, i), ".example.com", NULL);
+    }
+
+    res = pr_namebind_create(s2, name, ipbind, addr, port);
+    ck_assert_msg(res == 0, "Failed to create namebind '%s': %s", name,
+      strerror(errno));
+  }
+
+  for (i = 0; i < count; i++) {
+    pr_namebind_t *nb;
+    char *name;
+
+    if (i % 2 == 0) {
+      name = pstrcat(p, "FTP", pr_uid2str(p, i), ".example.com", NULL);
+
+    } else {
+      name = pstrcat(p, "ftp.customer", pr_uid2str(p, i), ".example.com",
+        NULL);
+    }
+
+    nb = pr_namebind_find(name, addr, port, FALSE);
+    ck_assert_msg(nb != NULL, "Failed to find namebind for '%s': %s", name,
+      strerror(errno));
+    ck_assert_msg(nb->nb_idx == i, "Expected namebind #%u, got #%u", i,
+      nb->nb_idx);
+  }
+
+  ck_assert_msg(pr_namebind_count(s) == count, "Expected %u namebinds, got %u",
+    count, pr_namebind_count(s));
+}
+END_TEST
+
+Suite *tests_get_bindings_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("bindings");
+
+  testcase = tcase_create("base");
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, namebind_create_test);
+  tcase_add_test(testcase, namebind_find_test);
+  tcase_add_test(testcase, namebind_find_many_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,150 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2026 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Child API tests. */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+/* Fixtures */
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+}
+
+static void tear_down(void) {
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+/* Tests */
+
+START_TEST (child_add_remove_test) {
+  int res;
+  pr_child_t *ch;
+  unsigned int nchildren = 0;
+
+  res = child_remove(1);
+  ck_assert_msg(res < 0, "Failed to handle empty child list");
+  ck_assert_msg(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = child_add(1, -1);
+  ck_assert_msg(res == 0, "Failed to add child: %s", strerror(errno));
+
+  res = child_add(2, -1);
+  ck_assert_msg(res == 0, "Failed to add child: %s", strerror(errno));
+
+  ck_assert_msg(child_count() == 2, "Expected 2 children, got %lu",
+    child_count());
+
+  res = child_remove(3);
+  ck_assert_msg(res < 0, "Failed to handle unknown PID");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = child_remove(1);
+  ck_assert_msg(res == 0, "Failed to remove child: %s", strerror(errno));
+
+  res = child_remove(1);
+  ck_assert_msg(res < 0, "Removed child twice unexpectedly");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  ck_assert_msg(child_count() == 1, "Expected 1 child, got %lu",
+    child_count());
+
+  /* Reaped children remain in the list until updated. */
+  for (ch = child_get(NULL); ch; ch = child_get(ch)) {
+    nchildren++;
+  }
+  ck_assert_msg(nchildren == 2, "Expected 2 list entries, got %u", nchildren);
+
+  child_update();
+
+  ch = child_get(NULL);
+  ck_assert_msg(ch != NULL, "Expected child, got NULL");
+  ck_assert_msg(ch->ch_pid == 2, "Expected PID 2, got %lu",
+    (unsigned long) ch->ch_pid);
+  ck_assert_msg(child_get(ch) == NULL, "Expected single child");
+
+  res = child_remove(2);
+  ck_assert_msg(res == 0, "Failed to remove child: %s", strerror(errno));
+  child_update();
+
+  ck_assert_msg(child_count() == 0, "Expected 0 children, got %lu",
+    child_count());
+}
+END_TEST
+
+START_TEST (child_mass_remove_test) {
+  register unsigned int i;
+  unsigned int count = 50000;
+  int res;
+
+  /* Simulate many sessions ending at once, e.g. on a mass disconnect. */
+  for (i = 0; i < count; i++) {
+    res = child_add((pid_t) (1000 + i), -1);
+    ck_assert_msg(res == 0, "Failed to add child: %s", strerror(errno));
+  }
+
+  ck_assert_msg(child_count() == count, "Expected %u children, got %lu",
+    count, child_count());
+
+  for (i = 0; i < count; i++) {
+    res = child_remove((pid_t) (1000 + i));
+    ck_assert_msg(res == 0, "Failed to remove child %u: %s", 1000 + i,
+      strerror(errno));
+
+    if (i % 1000 == 0) {
+      child_update();
+    }
+  }
+
+  child_update();
+  ck_assert_msg(child_count() == 0, "Expected 0 children, got %lu",
+    child_count());
+  ck_assert_msg(child_remove(1000) < 0, "Removed reaped child unexpectedly");
+}
+END_TEST
+
+Suite *tests_get_child_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("child");
+
+  testcase = tcase_create("base");
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, child_add_remove_test);
+  tcase_add_test(testcase, child_mass_remove_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
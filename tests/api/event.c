@@ -234,6 +234,209 @@ START_TEST (event_generate_test) {
 }
 END_TEST
 
+START_TEST (event_get_id_test) {
+  int id, id2, res;
+  const char *event = "foo", *event2 = "bar";
+
+  id = pr_event_get_id(NULL);
+  ck_assert_msg(id < 0, "Failed to handle null event");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  id = pr_event_get_id(event);
+  ck_assert_msg(id >= 0, "Failed to get ID for '%s': %s", event,
+    strerror(errno));
+
+  id2 = pr_event_get_id(event2);
+  ck_assert_msg(id2 >= 0, "Failed to get ID for '%s': %s", event2,
+    strerror(errno));
+  ck_assert_msg(id2 != id, "Expected different IDs for '%s' and '%s'", event,
+    event2);
+
+  res = pr_event_get_id(event);
+  ck_assert_msg(res == id, "Expected ID %d for '%s', got %d", id, event, res);
+
+  /* IDs must survive the registrations being cleared. */
+  res = pr_event_register(NULL, event, event_cb2, NULL);
+  ck_assert_msg(res == 0, "Failed to register event '%s': %s", event,
+    strerror(errno));
+
+  res = pr_event_get_id(event);
+  ck_assert_msg(res == id, "Expected ID %d for '%s', got %d", id, event, res);
+
+  res = pr_event_unregister(NULL, NULL, NULL);
+  ck_assert_msg(res == 0, "Failed to unregister events: %s", strerror(errno));
+
+  destroy_pool(p);
+  p = permanent_pool = make_sub_pool(NULL);
+
+  res = pr_event_get_id(event);
+  ck_assert_msg(res == id, "Expected ID %d for '%s', got %d", id, event, res);
+}
+END_TEST
+
+START_TEST (event_listening_id_test) {
+  int id, res;
+  const char *event = "foo";
+
+  res = pr_event_listening_id(-1);
+  ck_assert_msg(res == 0, "Expected 0 listeners, got %d", res);
+
+  id = pr_event_get_id(event);
+  ck_assert_msg(id >= 0, "Failed to get ID for '%s': %s", event,
+    strerror(errno));
+
+  res = pr_event_listening_id(id);
+  ck_assert_msg(res == 0, "Expected 0 listeners, got %d", res);
+
+  res = pr_event_register(NULL, event, event_cb2, NULL);
+  ck_assert_msg(res == 0, "Failed to register event '%s': %s", event,
+    strerror(errno));
+
+  res = pr_event_register(NULL, event, event_cb3, NULL);
+  ck_assert_msg(res == 0, "Failed to register event '%s': %s", event,
+    strerror(errno));
+
+  res = pr_event_listening_id(id);
+  ck_assert_msg(res == 2, "Expected 2 listeners, got %d", res);
+
+  res = pr_event_unregister(NULL, event, event_cb2);
+  ck_assert_msg(res == 0, "Failed to unregister event '%s': %s", event,
+    strerror(errno));
+
+  res = pr_event_listening_id(id);
+  ck_assert_msg(res == 1, "Expected 1 listener, got %d", res);
+}
+END_TEST
+
+static void event_unregister_cb(const void *event_data, void *user_data) {
+  event_triggered++;
+
+  /* Unregister the next listener while the event is being dispatched. */
+  (void) pr_event_unregister(NULL, NULL, event_cb);
+}
+
+START_TEST (event_generate_id_test) {
+  int id, res;
+  const char *event = "foo";
+  module m;
+
+  event_triggered = 0;
+
+  pr_event_generate_id(-1, NULL);
+  ck_assert_msg(event_triggered == 0, "Expected triggered count %u, got %u",
+    0, event_triggered);
+
+  id = pr_event_get_id(event);
+  ck_assert_msg(id >= 0, "Failed to get ID for '%s': %s", event,
+    strerror(errno));
+
+  pr_event_generate_id(id, NULL);
+  ck_assert_msg(event_triggered == 0, "Expected triggered count %u, got %u",
+    0, event_triggered);
+
+  res = pr_event_register(NULL, event, event_cb, NULL);
+  ck_assert_msg(res == 0, "Failed to register event: %s", strerror(errno));
+
+  pr_event_generate_id(id, NULL);
+  ck_assert_msg(event_triggered == 1, "Expected triggered count %u, got %u",
+    1, event_triggered);
+
+  pr_event_generate(event, NULL);
+  ck_assert_msg(event_triggered == 2, "Expected triggered count %u, got %u",
+    2, event_triggered);
+
+  /* Module listeners are dispatched before core listeners; a listener which
+   * unregisters a later listener should keep that listener from being
+   * called.
+   */
+  memset(&m, 0, sizeof(m));
+  m.name = "testsuite";
+
+  res = pr_event_register(&m, event, event_unregister_cb, NULL);
+  ck_assert_msg(res == 0, "Failed to register event: %s", strerror(errno));
+
+  pr_event_generate_id(id, NULL);
+  ck_assert_msg(event_triggered == 3, "Expected triggered count %u, got %u",
+    3, event_triggered);
+
+  res = pr_event_listening_id(id);
+  ck_assert_msg(res == 1, "Expected 1 listener, got %d", res);
+
+  res = pr_event_unregister(NULL, NULL, NULL);
+  ck_assert_msg(res == 0, "Failed to unregister events: %s", strerror(errno));
+
+  pr_event_generate_id(id, NULL);
+  ck_assert_msg(event_triggered == 3, "Expected triggered count %u, got %u",
+    3, event_triggered);
+
+  event_triggered = 0;
+}
+END_TEST
+
+START_TEST (event_generate_id_bench_test) {
+  register unsigned int i;
+  int id, res;
+  unsigned int nevents = 64, niters = 100000;
+  struct timeval start, end;
+  unsigned long name_usecs, id_usecs;
+  const char *event = NULL;
+
+  /* Register listeners for a realistic number of events, so that looking up
+   * an event by name has some work to do.
+   */
+  for (i = 0; i < nevents; i++) {
+    char name[32];
+
+    snprintf(name, sizeof(name)-1, "test.event-%u", i);
+    event = pstrdup(p, name);
+
+    res = pr_event_register(NULL, event, event_cb, NULL);
+    ck_assert_msg(res == 0, "Failed to register event '%s': %s", event,
+      strerror(errno));
+  }
+
+  /* The first event registered is the last one in the list. */
+  event = "test.event-0";
+  id = pr_event_get_id(event);
+  ck_assert_msg(id >= 0, "Failed to get ID for '%s': %s", event,
+    strerror(errno));
+
+  event_triggered = 0;
+
+  gettimeofday(&start, NULL);
+  for (i = 0; i < niters; i++) {
+    pr_event_generate(event, NULL);
+  }
+  gettimeofday(&end, NULL);
+
+  name_usecs = ((end.tv_sec - start.tv_sec) * 1000000) +
+    (end.tv_usec - start.tv_usec);
+
+  gettimeofday(&start, NULL);
+  for (i = 0; i < niters; i++) {
+    pr_event_generate_id(id, NULL);
+  }
+  gettimeofday(&end, NULL);
+
+  id_usecs = ((end.tv_sec - start.tv_sec) * 1000000) +
+    (end.tv_usec - start.tv_usec);
+
+  ck_assert_msg(event_triggered == (niters * 2),
+    "Expected triggered count %u, got %u", niters * 2, event_triggered);
+
+#if defined(PR_TEST_VERBOSE)
+  fprintf(stdout, "generated %u events by name in %lu usecs, by ID in "
+    "%lu usecs\n", niters, name_usecs, id_usecs);
+#else
+  (void) name_usecs;
+  (void) id_usecs;
+#endif /* PR_TEST_VERBOSE */
+
+  event_triggered = 0;
+}
+END_TEST
+
 START_TEST (event_dump_test) {
   int res;
   const char *event = "foo";
@@ -286,6 +489,10 @@ Suite *tests_get_event_suite(void) {
   tcase_add_test(testcase, event_unregister_test);
   tcase_add_test(testcase, event_listening_test);
   tcase_add_test(testcase, event_generate_test);
+  tcase_add_test(testcase, event_get_id_test);
+  tcase_add_test(testcase, event_listening_id_test);
+  tcase_add_test(testcase, event_generate_id_test);
+  tcase_add_test(testcase, event_generate_id_bench_test);
   tcase_add_test(testcase, event_dump_test);
 
   suite_add_tcase(suite, testcase);
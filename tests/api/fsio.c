@@ -4094,6 +4094,155 @@ START_TEST (fs_copy_file2_test) {
 }
 END_TEST
 
+static unsigned int remove_tree_pre_count = 0, remove_tree_post_count = 0;
+static const char *remove_tree_veto_path = NULL;
+
+static int remove_tree_pre_cb(pool *cb_pool, const char *path, int is_dir,
+    void *user_data) {
+  remove_tree_pre_count++;
+
+  if (remove_tree_veto_path != NULL &&
+      strcmp(path, remove_tree_veto_path) == 0) {
+    errno = EACCES;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void remove_tree_post_cb(pool *cb_pool, const char *path, int is_dir,
+    int res, int xerrno, void *user_data) {
+  remove_tree_post_count++;
+}
+
+static unsigned int remove_tree_unlink_count = 0;
+
+static int remove_tree_unlink(pr_fs_t *fs, const char *path) {
+  remove_tree_unlink_count++;
+  return unlink(path);
+}
+
+static void remove_tree_create(const char *src_path) {
+  int res;
+  const char *path;
+
+  res = mkdir(fsio_testdir_path, 0755);
+  ck_assert_msg(res == 0, "Failed to create '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  path = pdircat(p, fsio_testdir_path, "sub", NULL);
+  res = mkdir(path, 0755);
+  ck_assert_msg(res == 0, "Failed to create '%s': %s", path, strerror(errno));
+
+  path = pdircat(p, fsio_testdir_path, "sub", "deeper", NULL);
+  res = mkdir(path, 0755);
+  ck_assert_msg(res == 0, "Failed to create '%s': %s", path, strerror(errno));
+
+  path = pdircat(p, fsio_testdir_path, "a.txt", NULL);
+  res = creat(path, 0644);
+  ck_assert_msg(res >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(res);
+
+  path = pdircat(p, fsio_testdir_path, "sub", "b.txt", NULL);
+  res = creat(path, 0644);
+  ck_assert_msg(res >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(res);
+
+  path = pdircat(p, fsio_testdir_path, "sub", "deeper", "c.txt", NULL);
+  res = creat(path, 0644);
+  ck_assert_msg(res >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(res);
+
+  /* A symlink to a file outside of the tree, which must not be followed. */
+  path = pdircat(p, fsio_testdir_path, "link", NULL);
+  res = symlink(src_path, path);
+  ck_assert_msg(res == 0, "Failed to symlink '%s': %s", path, strerror(errno));
+}
+
+START_TEST (fs_remove_tree_test) {
+  int res;
+  const char *src_path, *path;
+  struct stat st;
+  pr_fs_t *fs;
+
+  mark_point();
+  res = pr_fs_remove_tree(NULL, NULL, NULL, NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_fs_remove_tree(p, NULL, NULL, NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = pr_fs_remove_tree(p, fsio_testdir_path, NULL, NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle nonexistent path");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  src_path = fsio_copy_src_path;
+  (void) unlink(src_path);
+  res = creat(src_path, 0644);
+  ck_assert_msg(res >= 0, "Failed to create '%s': %s", src_path,
+    strerror(errno));
+  (void) close(res);
+
+  remove_tree_create(src_path);
+  remove_tree_pre_count = remove_tree_post_count = 0;
+
+  mark_point();
+  res = pr_fs_remove_tree(p, fsio_testdir_path, remove_tree_pre_cb,
+    remove_tree_post_cb, NULL);
+  ck_assert_msg(res == 0, "Failed to remove tree '%s': %s", fsio_testdir_path,
+    strerror(errno));
+  ck_assert_msg(lstat(fsio_testdir_path, &st) < 0 && errno == ENOENT,
+    "Tree '%s' still exists", fsio_testdir_path);
+  ck_assert_msg(stat(src_path, &st) == 0, "Symlink target '%s' removed",
+    src_path);
+
+  /* Three directories, three files, and one symlink. */
+  ck_assert_msg(remove_tree_pre_count == 7, "Expected 7 pre callbacks, got %u",
+    remove_tree_pre_count);
+  ck_assert_msg(remove_tree_post_count == 7,
+    "Expected 7 post callbacks, got %u", remove_tree_post_count);
+
+  /* A vetoed entry stops the removal. */
+  remove_tree_create(src_path);
+  path = pdircat(p, fsio_testdir_path, "sub", "b.txt", NULL);
+  remove_tree_veto_path = path;
+
+  mark_point();
+  res = pr_fs_remove_tree(p, fsio_testdir_path, remove_tree_pre_cb,
+    remove_tree_post_cb, NULL);
+  ck_assert_msg(res < 0, "Removed tree despite vetoed entry");
+  ck_assert_msg(errno == EACCES, "Expected EACCES (%d), got %s (%d)", EACCES,
+    strerror(errno), errno);
+  ck_assert_msg(stat(path, &st) == 0, "Vetoed entry '%s' removed", path);
+
+  remove_tree_veto_path = NULL;
+
+  /* With a custom FS handler in the tree, removal goes through FSIO. */
+  path = pstrcat(p, fsio_testdir_path, "/", NULL);
+  fs = pr_register_fs(p, "testsuite", path);
+  ck_assert_msg(fs != NULL, "Failed to register FS: %s", strerror(errno));
+  fs->unlink = remove_tree_unlink;
+  remove_tree_unlink_count = 0;
+
+  mark_point();
+  res = pr_fs_remove_tree(p, fsio_testdir_path, NULL, NULL, NULL);
+  ck_assert_msg(res == 0, "Failed to remove tree '%s': %s", fsio_testdir_path,
+    strerror(errno));
+  ck_assert_msg(remove_tree_unlink_count > 0,
+    "Custom unlink handler not used for tree removal");
+
+  (void) pr_unregister_fs(path);
+  (void) unlink(src_path);
+}
+END_TEST
+
 START_TEST (fs_interpolate_test) {
   int res;
   char buf[PR_TUNABLE_PATH_MAX], *path;
@@ -5431,6 +5580,7 @@ Suite *tests_get_fsio_suite(void) {
   tcase_add_test(testcase, fs_glob_test);
   tcase_add_test(testcase, fs_copy_file_test);
   tcase_add_test(testcase, fs_copy_file2_test);
+  tcase_add_test(testcase, fs_remove_tree_test);
   tcase_add_test(testcase, fs_interpolate_test);
   tcase_add_test(testcase, fs_resolve_partial_test);
   tcase_add_test(testcase, fs_resolve_path_test);
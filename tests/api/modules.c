@@ -547,6 +547,88 @@ START_TEST (module_create_data_test) {
 }
 END_TEST
 
+START_TEST (module_session_template_test) {
+  int res, data1 = 1, data2 = 2;
+  void *tmpl;
+  module m, m2;
+  server_rec *s, *s2;
+
+  res = pr_module_set_session_template(NULL, NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  tmpl = pr_module_get_session_template(NULL, NULL);
+  ck_assert_msg(tmpl == NULL, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  memset(&m, 0, sizeof(m));
+  m.name = "testsuite";
+
+  memset(&m2, 0, sizeof(m2));
+  m2.name = "testsuite2";
+
+  s = pcalloc(p, sizeof(server_rec));
+  s->ServerName = "test1";
+  s->sid = 1;
+
+  s2 = pcalloc(p, sizeof(server_rec));
+  s2->ServerName = "test2";
+  s2->sid = 2;
+
+  res = pr_module_set_session_template(&m, s, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null template");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  tmpl = pr_module_get_session_template(&m, s);
+  ck_assert_msg(tmpl == NULL, "Found unexpected template");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = pr_module_set_session_template(&m, s, &data1);
+  ck_assert_msg(res == 0, "Failed to set template: %s", strerror(errno));
+
+  res = pr_module_set_session_template(&m2, s, &data2);
+  ck_assert_msg(res == 0, "Failed to set template: %s", strerror(errno));
+
+  tmpl = pr_module_get_session_template(&m, s);
+  ck_assert_msg(tmpl == &data1, "Expected %p, got %p", &data1, tmpl);
+
+  tmpl = pr_module_get_session_template(&m, s2);
+  ck_assert_msg(tmpl == NULL, "Found unexpected template");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Replace an existing template. */
+  res = pr_module_set_session_template(&m, s, &data2);
+  ck_assert_msg(res == 0, "Failed to set template: %s", strerror(errno));
+
+  tmpl = pr_module_get_session_template(&m, s);
+  ck_assert_msg(tmpl == &data2, "Expected %p, got %p", &data2, tmpl);
+
+  res = pr_module_clear_session_templates(&m);
+  ck_assert_msg(res == 0, "Failed to clear templates: %s", strerror(errno));
+
+  tmpl = pr_module_get_session_template(&m, s);
+  ck_assert_msg(tmpl == NULL, "Found unexpected template");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  tmpl = pr_module_get_session_template(&m2, s);
+  ck_assert_msg(tmpl == &data2, "Expected %p, got %p", &data2, tmpl);
+
+  res = pr_module_clear_session_templates(NULL);
+  ck_assert_msg(res == 0, "Failed to clear templates: %s", strerror(errno));
+
+  tmpl = pr_module_get_session_template(&m2, s);
+  ck_assert_msg(tmpl == NULL, "Found unexpected template");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
 Suite *tests_get_modules_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -567,6 +649,7 @@ Suite *tests_get_modules_suite(void) {
   tcase_add_test(testcase, module_load_cmdtab_test);
   tcase_add_test(testcase, module_load_conftab_test);
   tcase_add_test(testcase, module_call_test);
+  tcase_add_test(testcase, module_session_template_test);
 
   tcase_add_test(testcase, module_create_ret_test);
   tcase_add_test(testcase, module_create_error_test);
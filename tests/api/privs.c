@@ -163,6 +163,69 @@ START_TEST (privs_revoke_test) {
 }
 END_TEST
 
+START_TEST (privs_clear_cache_test) {
+  int nonroot, res;
+  uid_t uid = 65534;
+  gid_t gid = 65534;
+
+  /* Switching the effective IDs requires root privileges. */
+  if (privs_uid != PR_ROOT_UID) {
+    return;
+  }
+
+  nonroot = set_nonroot_daemon(FALSE);
+
+  res = pr_privs_setup(uid, PR_ROOT_GID, __FILE__, __LINE__);
+  ck_assert_msg(res == 0, "Failed to setup privs: %s", strerror(errno));
+  ck_assert_msg(geteuid() == uid, "Expected euid %lu, got %lu",
+    (unsigned long) uid, (unsigned long) geteuid());
+
+  res = pr_privs_root(__FILE__, __LINE__);
+  ck_assert_msg(res == 0, "Failed to set root privs: %s", strerror(errno));
+  ck_assert_msg(geteuid() == PR_ROOT_UID, "Expected euid %lu, got %lu",
+    (unsigned long) PR_ROOT_UID, (unsigned long) geteuid());
+
+  /* Change the effective GID behind the back of the PRIVS_ macros, as
+   * set_groups() does; once told, relinquishing must restore the session
+   * GID rather than trust its stale notion of the current IDs.
+   */
+  res = setegid(gid);
+  ck_assert_msg(res == 0, "Failed to setegid(%lu): %s", (unsigned long) gid,
+    strerror(errno));
+  pr_privs_clear_cache();
+
+  res = pr_privs_relinquish(__FILE__, __LINE__);
+  ck_assert_msg(res == 0, "Failed to relinquish privs: %s", strerror(errno));
+  ck_assert_msg(geteuid() == uid, "Expected euid %lu, got %lu",
+    (unsigned long) uid, (unsigned long) geteuid());
+  ck_assert_msg(getegid() == PR_ROOT_GID, "Expected egid %lu, got %lu",
+    (unsigned long) PR_ROOT_GID, (unsigned long) getegid());
+
+  /* A redundant transition leaves the IDs in place. */
+  res = pr_privs_root(__FILE__, __LINE__);
+  ck_assert_msg(res == 0, "Failed to set root privs: %s", strerror(errno));
+  res = pr_privs_root(__FILE__, __LINE__);
+  ck_assert_msg(res == 0, "Failed to set root privs: %s", strerror(errno));
+  ck_assert_msg(geteuid() == PR_ROOT_UID, "Expected euid %lu, got %lu",
+    (unsigned long) PR_ROOT_UID, (unsigned long) geteuid());
+
+  res = pr_privs_relinquish(__FILE__, __LINE__);
+  ck_assert_msg(res == 0, "Failed to relinquish privs: %s", strerror(errno));
+  ck_assert_msg(geteuid() == uid, "Expected euid %lu, got %lu",
+    (unsigned long) uid, (unsigned long) geteuid());
+
+  /* Restore our original IDs. */
+  res = pr_privs_setup(privs_uid, privs_gid, __FILE__, __LINE__);
+  ck_assert_msg(res == 0, "Failed to setup privs: %s", strerror(errno));
+  ck_assert_msg(geteuid() == privs_uid, "Expected euid %lu, got %lu",
+    (unsigned long) privs_uid, (unsigned long) geteuid());
+  ck_assert_msg(getegid() == privs_gid, "Expected egid %lu, got %lu",
+    (unsigned long) privs_gid, (unsigned long) getegid());
+
+  set_nonroot_daemon(nonroot);
+}
+END_TEST
+
 Suite *tests_get_privs_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -178,6 +241,7 @@ Suite *tests_get_privs_suite(void) {
   tcase_add_test(testcase, privs_user_test);
   tcase_add_test(testcase, privs_relinquish_test);
   tcase_add_test(testcase, privs_revoke_test);
+  tcase_add_test(testcase, privs_clear_cache_test);
 
   suite_add_tcase(suite, testcase);
   return suite;
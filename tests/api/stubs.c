@@ -29,6 +29,8 @@ session_t session;
 
 char ServerType = SERVER_STANDALONE;
 int ServerUseReverseDNS = 1;
+int SocketBindTight = FALSE;
+int tcpBackLog = PR_TUNABLE_DEFAULT_BACKLOG;
 unsigned char is_master = FALSE;
 server_rec *main_server = NULL;
 pid_t mpid = 1;
@@ -43,6 +43,8 @@ static struct testsuite_info suites[] = {
   { "feat", 		tests_get_feat_suite },
   { "netaddr", 		tests_get_netaddr_suite },
   { "netacl",		tests_get_netacl_suite },
+  { "bindings",		tests_get_bindings_suite },
+  { "child",		tests_get_child_suite },
   { "class",		tests_get_class_suite },
   { "regexp",		tests_get_regexp_suite },
   { "expr",		tests_get_expr_suite },
@@ -53,6 +53,8 @@ Suite *tests_get_version_suite(void);
 Suite *tests_get_feat_suite(void);
 Suite *tests_get_netaddr_suite(void);
 Suite *tests_get_netacl_suite(void);
+Suite *tests_get_bindings_suite(void);
+Suite *tests_get_child_suite(void);
 Suite *tests_get_class_suite(void);
 Suite *tests_get_regexp_suite(void);
 Suite *tests_get_expr_suite(void);
@@ -278,6 +278,146 @@ START_TEST (timer_usleep_test) {
 }
 END_TEST
 
+START_TEST (timer_add_ms_test) {
+  int res;
+  unsigned int ok = 0;
+
+  res = pr_timer_add_ms(0, -1, NULL, timers_test_cb, "test");
+  ck_assert_msg(res == -1, "Failed to handle zero msecs");
+  ck_assert_msg(errno == EINVAL, "Failed to set errno to EINVAL");
+
+  res = pr_timer_add_ms(100, -1, NULL, NULL, "test");
+  ck_assert_msg(res == -1, "Failed to handle null callback");
+  ck_assert_msg(errno == EINVAL, "Failed to set errno to EINVAL");
+
+  res = pr_timer_add_ms(100, -1, NULL, timers_test_cb, "test");
+  ck_assert_msg(res == 1024, "Failed to allocate timer: %s", strerror(errno));
+
+  res = pr_timer_usleep(500000);
+  ck_assert_msg(res == 0, "Failed to sleep: %s", strerror(errno));
+  timers_handle_signals();
+  pr_timer_process();
+
+  ok = 1;
+  ck_assert_msg(timer_triggered_count == ok,
+    "Timer failed to fire (expected count %u, got %u)", ok,
+    timer_triggered_count);
+
+  /* A repeating sub-second timer should fire several times a second. */
+  repeat_cb = TRUE;
+  timer_triggered_count = 0;
+
+  res = pr_timer_add_ms(100, -1, NULL, timers_test_cb, "test");
+  ck_assert_msg(res == 1025, "Failed to allocate timer: %s", strerror(errno));
+
+  res = pr_timer_sleep(1);
+  ck_assert_msg(res == 0, "Failed to sleep: %s", strerror(errno));
+
+  ck_assert_msg(timer_triggered_count >= 5,
+    "Timer failed to fire (expected count >= 5, got %u)",
+    timer_triggered_count);
+
+  res = pr_timer_remove(1025, ANY_MODULE);
+  ck_assert_msg(res == 1025, "Failed to remove timer: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (timer_get_fd_test) {
+  int fd, res;
+  fd_set rfds;
+  struct timeval tv;
+
+  fd = pr_timer_get_fd();
+  ck_assert_msg(fd == -1, "Expected -1 with no timers, got %d", fd);
+
+  res = pr_timer_add_ms(200, -1, NULL, timers_test_cb, "test");
+  ck_assert_msg(res == 1024, "Failed to allocate timer: %s", strerror(errno));
+
+  fd = pr_timer_get_fd();
+#if defined(HAVE_TIMERFD_CREATE)
+  ck_assert_msg(fd >= 0, "Failed to get timer fd: %s", strerror(errno));
+
+  FD_ZERO(&rfds);
+  FD_SET(fd, &rfds);
+  tv.tv_sec = 0;
+  tv.tv_usec = 10000;
+
+  res = select(fd + 1, &rfds, NULL, NULL, &tv);
+  ck_assert_msg(res == 0, "Expected timer fd to not be readable yet");
+
+  FD_ZERO(&rfds);
+  FD_SET(fd, &rfds);
+  tv.tv_sec = 2;
+  tv.tv_usec = 0;
+
+  res = select(fd + 1, &rfds, NULL, NULL, &tv);
+  ck_assert_msg(res == 1, "Expected timer fd to be readable (%d): %s", res,
+    strerror(errno));
+  ck_assert_msg(timer_triggered_count == 0,
+    "Timer fired before being processed");
+
+  pr_timer_process();
+  ck_assert_msg(timer_triggered_count == 1,
+    "Timer failed to fire (expected count 1, got %u)", timer_triggered_count);
+
+  /* The expired timer was not restarted, so there is nothing to watch. */
+  fd = pr_timer_get_fd();
+  ck_assert_msg(fd == -1, "Expected -1 with no timers, got %d", fd);
+#else
+  (void) rfds;
+  (void) tv;
+  ck_assert_msg(fd == -1, "Expected -1 without timerfd support, got %d", fd);
+#endif /* HAVE_TIMERFD_CREATE */
+}
+END_TEST
+
+START_TEST (timer_disarm_test) {
+  int res;
+  struct itimerval itv;
+
+  /* Removing the last timer disarms the SIGALRM fallback. */
+  res = pr_timer_add(2, -1, NULL, timers_test_cb, "test");
+  ck_assert_msg(res == 1024, "Failed to allocate timer: %s", strerror(errno));
+
+  memset(&itv, 0, sizeof(itv));
+  res = getitimer(ITIMER_REAL, &itv);
+  ck_assert_msg(res == 0, "Failed to get interval timer: %s", strerror(errno));
+  ck_assert_msg(itv.it_value.tv_sec != 0 || itv.it_value.tv_usec != 0,
+    "Expected interval timer to be armed");
+
+  res = pr_timer_remove(1024, ANY_MODULE);
+  ck_assert_msg(res == 1024, "Failed to remove timer: %s", strerror(errno));
+
+  memset(&itv, 0, sizeof(itv));
+  res = getitimer(ITIMER_REAL, &itv);
+  ck_assert_msg(res == 0, "Failed to get interval timer: %s", strerror(errno));
+  ck_assert_msg(itv.it_value.tv_sec == 0 && itv.it_value.tv_usec == 0,
+    "Expected interval timer to be disarmed, got %lu.%06lu secs",
+    (unsigned long) itv.it_value.tv_sec,
+    (unsigned long) itv.it_value.tv_usec);
+
+  /* As does processing the last timer, before its grace period is up. */
+  res = pr_timer_add_ms(50, -1, NULL, timers_test_cb, "test");
+  ck_assert_msg(res == 1025, "Failed to allocate timer: %s", strerror(errno));
+
+  res = pr_timer_usleep(100000);
+  ck_assert_msg(res == 0, "Failed to sleep: %s", strerror(errno));
+  timers_handle_signals();
+  pr_timer_process();
+
+  ck_assert_msg(timer_triggered_count == 1,
+    "Timer failed to fire (expected count 1, got %u)", timer_triggered_count);
+
+  memset(&itv, 0, sizeof(itv));
+  res = getitimer(ITIMER_REAL, &itv);
+  ck_assert_msg(res == 0, "Failed to get interval timer: %s", strerror(errno));
+  ck_assert_msg(itv.it_value.tv_sec == 0 && itv.it_value.tv_usec == 0,
+    "Expected interval timer to be disarmed, got %lu.%06lu secs",
+    (unsigned long) itv.it_value.tv_sec,
+    (unsigned long) itv.it_value.tv_usec);
+}
+END_TEST
+
 Suite *tests_get_timers_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -293,6 +433,9 @@ Suite *tests_get_timers_suite(void) {
   tcase_add_test(testcase, timer_reset_test);
   tcase_add_test(testcase, timer_sleep_test);
   tcase_add_test(testcase, timer_usleep_test);
+  tcase_add_test(testcase, timer_add_ms_test);
+  tcase_add_test(testcase, timer_get_fd_test);
+  tcase_add_test(testcase, timer_disarm_test);
 
   /* Allow a longer timeout on these tests, as they will need a second or
    * two to actually run through the test itself, plus overhead.
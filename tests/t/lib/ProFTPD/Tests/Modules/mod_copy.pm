@@ -31,6 +31,16 @@ my $TESTS = {
     test_class => [qw(forking)],
   },
 
+  copy_dir_concurrency => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  copy_dir_concurrency_quotatab => {
+    order => ++$order,
+    test_class => [qw(forking mod_quotatab_sql mod_sql_sqlite)],
+  },
+
   copy_enoent => {
     order => ++$order,
     test_class => [qw(forking)],
@@ -490,6 +500,393 @@ sub copy_dir {
   test_cleanup($setup, $ex);
 }
 
+sub copy_dir_concurrency {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'copy');
+
+  my $src_dir = File::Spec->rel2abs("$setup->{home_dir}/foo");
+  my $src_subdir = File::Spec->rel2abs("$src_dir/sub");
+  mkpath($src_subdir);
+
+  my $nfiles = 20;
+  my $src_files = [];
+  for (my $i = 0; $i < $nfiles; $i++) {
+    my $src_file = File::Spec->rel2abs(($i % 2 ? $src_subdir : $src_dir) .
+      "/test$i.txt");
+
+    if (open(my $fh, "> $src_file")) {
+      print $fh "Hello, World $i!\n" x ($i * 1024);
+
+      unless (close($fh)) {
+        die("Can't write $src_file: $!");
+      }
+
+    } else {
+      die("Can't open $src_file: $!");
+    }
+
+    push(@$src_files, $src_file);
+  }
+
+  my $dst_dir = File::Spec->rel2abs("$setup->{home_dir}/bar");
+
+  # Make sure that, if we're running as root, that the test directories have
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $src_dir, $src_subdir)) {
+      die("Can't set perms on $src_dir, $src_subdir to 0755: $!");
+    }
+
+    unless (chown($setup->{uid}, $setup->{gid}, $src_dir, $src_subdir,
+        @$src_files)) {
+      die("Can't set owner of $src_dir to $setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'copy:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_copy.c' => {
+        CopyConcurrency => 4,
+      },
+
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      $client->site('CPFR', 'foo');
+      $client->site('CPTO', 'bar');
+
+      my $resp_code = $client->response_code();
+      my $resp_msgs = $client->response_msgs();
+      $client->quit();
+
+      my $expected = 250;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $expected = 'Copied ' . $nfiles . ' files \(\d+ bytes\)';
+      $self->assert($resp_msgs->[0] =~ /$expected/,
+        test_msg("Expected response message '$expected', got '$resp_msgs->[0]'"));
+
+      foreach my $src_file (@$src_files) {
+        my $dst_file = $src_file;
+        $dst_file =~ s/\/foo\//\/bar\//;
+
+        unless (-f $dst_file) {
+          die("File $dst_file does not exist as expected");
+        }
+
+        $self->assert(-s $src_file == -s $dst_file,
+          test_msg("Expected size " . (-s $src_file) . " for $dst_file, got " .
+            (-s $dst_file)));
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup, $ex);
+}
+
+sub copy_dir_concurrency_quotatab {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'copy');
+
+  my $db_file = File::Spec->rel2abs("$tmpdir/proftpd.db");
+
+  # Build up sqlite3 command to create users, groups tables and populate them
+  my $db_script = File::Spec->rel2abs("$tmpdir/proftpd.sql");
+
+  if (open(my $fh, "> $db_script")) {
+    print $fh <<EOS;
+CREATE TABLE users (
+  userid TEXT,
+  passwd TEXT,
+  uid INTEGER,
+  gid INTEGER,
+  homedir TEXT,
+  shell TEXT,
+  lastdir TEXT
+);
+INSERT INTO users (userid, passwd, uid, gid, homedir, shell) VALUES ('$setup->{user}', '$setup->{passwd}', $setup->{uid}, $setup->{gid}, '$setup->{home_dir}', '/bin/bash');
+
+CREATE TABLE groups (
+  groupname TEXT,
+  gid INTEGER,
+  members TEXT
+);
+INSERT INTO groups (groupname, gid, members) VALUES ('ftpd', $setup->{gid}, '$setup->{user}');
+
+CREATE TABLE quotalimits (
+  name TEXT NOT NULL,
+  quota_type TEXT NOT NULL,
+  per_session TEXT NOT NULL,
+  limit_type TEXT NOT NULL,
+  bytes_in_avail REAL NOT NULL,
+  bytes_out_avail REAL NOT NULL,
+  bytes_xfer_avail REAL NOT NULL,
+  files_in_avail INTEGER NOT NULL,
+  files_out_avail INTEGER NOT NULL,
+  files_xfer_avail INTEGER NOT NULL
+);
+INSERT INTO quotalimits (name, quota_type, per_session, limit_type, bytes_in_avail, bytes_out_avail, bytes_xfer_avail, files_in_avail, files_out_avail, files_xfer_avail) VALUES ('$setup->{user}', 'user', 'false', 'hard', 4096, 0, 0, 0, 0, 0);
+
+CREATE TABLE quotatallies (
+  name TEXT NOT NULL,
+  quota_type TEXT NOT NULL,
+  bytes_in_used REAL NOT NULL,
+  bytes_out_used REAL NOT NULL,
+  bytes_xfer_used REAL NOT NULL,
+  files_in_used INTEGER NOT NULL,
+  files_out_used INTEGER NOT NULL,
+  files_xfer_used INTEGER NOT NULL
+);
+EOS
+
+    unless (close($fh)) {
+      die("Can't write $db_script: $!");
+    }
+
+  } else {
+    die("Can't open $db_script: $!");
+  }
+
+  my $cmd = "sqlite3 $db_file < $db_script";
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDERR "Executing sqlite3: $cmd\n";
+  }
+
+  my @output = `$cmd`;
+  if (scalar(@output) &&
+      $ENV{TEST_VERBOSE}) {
+    print STDERR "Output: ", join('', @output), "\n";
+  }
+
+  my $src_dir = File::Spec->rel2abs("$setup->{home_dir}/foo");
+  mkpath($src_dir);
+
+  # Each file uses a quarter of the allowed upload bytes, so only four of
+  # them may be copied.
+  my $nfiles = 10;
+  my $src_files = [];
+  for (my $i = 0; $i < $nfiles; $i++) {
+    my $src_file = File::Spec->rel2abs("$src_dir/test$i.txt");
+
+    if (open(my $fh, "> $src_file")) {
+      print $fh "A" x 1024;
+
+      unless (close($fh)) {
+        die("Can't write $src_file: $!");
+      }
+
+    } else {
+      die("Can't open $src_file: $!");
+    }
+
+    push(@$src_files, $src_file);
+  }
+
+  my $dst_dir = File::Spec->rel2abs("$setup->{home_dir}/bar");
+
+  # Make sure that, if we're running as root, that the test directories have
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $src_dir)) {
+      die("Can't set perms on $src_dir to 0755: $!");
+    }
+
+    unless (chown($setup->{uid}, $setup->{gid}, $src_dir, @$src_files)) {
+      die("Can't set owner of $src_dir to $setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'copy:20',
+
+    DefaultChdir => '~',
+
+    IfModules => {
+      'mod_copy.c' => {
+        CopyConcurrency => 4,
+      },
+
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+     'mod_quotatab_sql.c' => [
+        'SQLNamedQuery get-quota-limit SELECT "name, quota_type, per_session, limit_type, bytes_in_avail, bytes_out_avail, bytes_xfer_avail, files_in_avail, files_out_avail, files_xfer_avail FROM quotalimits WHERE name = \'%{0}\' AND quota_type = \'%{1}\'"',
+        'SQLNamedQuery get-quota-tally SELECT "name, quota_type, bytes_in_used, bytes_out_used, bytes_xfer_used, files_in_used, files_out_used, files_xfer_used FROM quotatallies WHERE name = \'%{0}\' AND quota_type = \'%{1}\'"',
+        'SQLNamedQuery update-quota-tally UPDATE "bytes_in_used = bytes_in_used + %{0}, bytes_out_used = bytes_out_used + %{1}, bytes_xfer_used = bytes_xfer_used + %{2}, files_in_used = files_in_used + %{3}, files_out_used = files_out_used + %{4}, files_xfer_used = files_xfer_used + %{5} WHERE name = \'%{6}\' AND quota_type = \'%{7}\'" quotatallies',
+        'SQLNamedQuery insert-quota-tally INSERT "%{0}, %{1}, %{2}, %{3}, %{4}, %{5}, %{6}, %{7}" quotatallies',
+
+        'QuotaEngine on',
+        "QuotaLog $setup->{log_file}",
+        'QuotaLimitTable sql:/get-quota-limit',
+        'QuotaTallyTable sql:/get-quota-tally/update-quota-tally/insert-quota-tally',
+      ],
+
+      'mod_sql.c' => {
+        AuthOrder => 'mod_sql.c',
+        SQLAuthTypes => 'plaintext',
+        SQLBackend => 'sqlite3',
+        SQLConnectInfo => $db_file,
+        SQLLogFile => $setup->{log_file},
+        SQLMinID => '0',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port, 0, 1);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      $client->site('CPFR', 'foo');
+
+      eval { $client->site('CPTO', 'bar') };
+      unless ($@) {
+        die("SITE CPTO succeeded unexpectedly");
+      }
+
+      my $resp_code = $client->response_code();
+
+      my $expected = 552;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $client->quit();
+
+      # With other SITE COPY handlers present, the files are copied one at a
+      # time, and each is checked against the quota before it is copied.
+      my $ncopied = 0;
+      foreach my $src_file (@$src_files) {
+        my $dst_file = $src_file;
+        $dst_file =~ s/\/foo\//\/bar\//;
+
+        if (-f $dst_file) {
+          $ncopied++;
+
+          $self->assert(-s $src_file == -s $dst_file,
+            test_msg("Expected size " . (-s $src_file) . " for $dst_file, " .
+              "got " . (-s $dst_file)));
+        }
+      }
+
+      $expected = 4;
+      $self->assert($expected == $ncopied,
+        test_msg("Expected $expected files copied, got $ncopied"));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  eval {
+    my ($quota_type, $bytes_in_used, $bytes_out_used, $bytes_xfer_used,
+      $files_in_used, $files_out_used, $files_xfer_used) = get_tally($db_file,
+      "name = \'$setup->{user}\'");
+
+    my $expected = '^(4096.0|4096)$';
+    $self->assert(qr/$expected/, $bytes_in_used,
+      test_msg("Expected $expected, got $bytes_in_used"));
+  };
+  if ($@) {
+    $ex = $@ unless $ex;
+  }
+
+  test_cleanup($setup, $ex);
+}
+
 sub copy_enoent {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
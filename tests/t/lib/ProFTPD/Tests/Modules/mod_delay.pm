@@ -72,8 +72,26 @@ my $TESTS = {
     test_class => [qw(bug forking)],
   },
 
+  delay_table_median_odd_even => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  delay_table_wraparound => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  delay_table_ctrls_reset => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
 };
 
+# Number of values kept per DelayTable row (DELAY_NVALUES).
+my $DELAY_NVALUES = 256;
+
 sub new {
   return shift()->SUPER::new(@_);
 }
@@ -82,6 +100,128 @@ sub list_tests {
   return testsuite_get_runnable_tests($TESTS);
 }
 
+sub ftpdctl {
+  my $sock_file = shift;
+  my $ctrl_cmd = shift;
+
+  my $ftpdctl_bin;
+  if ($ENV{PROFTPD_TEST_PATH}) {
+    $ftpdctl_bin = "$ENV{PROFTPD_TEST_PATH}/ftpdctl";
+
+  } else {
+    $ftpdctl_bin = '../ftpdctl';
+  }
+
+  my $verbosity = '';
+  if ($ENV{TEST_VERBOSE}) {
+    $verbosity = '-v';
+  }
+
+  my $cmd = "$ftpdctl_bin -s $sock_file $verbosity $ctrl_cmd";
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDERR "Executing ftpdctl: $cmd\n";
+  }
+
+  my @lines = `$cmd`;
+  my $exit_status = $? >> 8;
+
+  return ($exit_status, \@lines);
+}
+
+# Replays the intervals which the sessions traced as adding to the USER and
+# PASS rows, checking each selected median against the median computed here
+# from the same values.  Returns the values which should now be in each row,
+# oldest first, and the number of medians checked for odd and even numbers
+# of values.
+sub delay_check_medians {
+  my $self = shift;
+  my $log_file = shift;
+
+  my $rows = { USER => [], PASS => [] };
+  my $nchecked = { odd => 0, even => 0 };
+  my $median;
+
+  if (open(my $fh, "< $log_file")) {
+    while (my $line = <$fh>) {
+      chomp($line);
+
+      if ($line =~ /selected median interval of (\d+) usecs/) {
+        $median = $1;
+        next;
+      }
+
+      if ($line =~ /adding (\d+) usecs to (USER|PASS) row/) {
+        my $interval = $1;
+        my $vals = $rows->{$2};
+
+        $self->assert(defined($median),
+          test_msg("Saw interval $interval added without selected median"));
+
+        my $sorted = [sort { $a <=> $b } (@$vals, $interval)];
+        my $nvals = scalar(@$sorted);
+        my $expected = $sorted->[int($nvals / 2)];
+
+        $self->assert($median == $expected,
+          test_msg("Expected median $expected of $nvals values, got $median"));
+        $nchecked->{$nvals % 2 ? 'odd' : 'even'}++;
+        $median = undef;
+
+        push(@$vals, $interval);
+        if (scalar(@$vals) > $DELAY_NVALUES) {
+          shift(@$vals);
+        }
+      }
+    }
+
+    close($fh);
+
+  } else {
+    die("Can't read $log_file: $!");
+  }
+
+  return ($rows, $nchecked);
+}
+
+# Returns the values which 'delay info' lists for the given row, most
+# recently added first.
+sub delay_info_values {
+  my $lines = shift;
+  my $row_name = shift;
+  my $proto = shift;
+
+  my $vals;
+  my $in_row = 0;
+
+  foreach my $line (@$lines) {
+    if ($line =~ /Address \S+: (USER|PASS) values/) {
+      $in_row = ($1 eq $row_name);
+      next;
+    }
+
+    next unless $in_row;
+
+    if ($line =~ /\+ Protocol (\S+), (\d+) values?:/) {
+      if (defined($vals)) {
+        last;
+      }
+
+      if ($1 eq $proto) {
+        $vals = [];
+      }
+
+      next;
+    }
+
+    if (defined($vals)) {
+      $line =~ s/^ftpdctl://;
+      push(@$vals, ($line =~ /(-?\d+)/g));
+    }
+  }
+
+  return $vals;
+}
+
 sub delay_cold_table {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
@@ -1200,4 +1340,306 @@ sub delay_delayonevent_connect_issue1701 {
   test_cleanup($setup, $ex);
 }
 
+sub delay_table_median_odd_even {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'delay');
+
+  my $delay_tab = File::Spec->rel2abs("$setup->{home_dir}/delay.tab");
+  my $nlogins = 7;
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'delay:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayTable => $delay_tab,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(2);
+
+      for (my $i = 0; $i < $nlogins; $i++) {
+        my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+        $client->login($setup->{user}, $setup->{passwd});
+        $client->quit();
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh, 60) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  eval {
+    my ($rows, $nchecked) = delay_check_medians($self, $setup->{log_file});
+
+    # Each login checks one USER median, over 1 to $nlogins values.  (The
+    # PASS row only records failed logins.)
+    my $expected = ($nlogins + 1) / 2;
+    $self->assert($nchecked->{odd} == $expected,
+      test_msg("Expected $expected odd medians, got $nchecked->{odd}"));
+
+    $expected = ($nlogins - 1) / 2;
+    $self->assert($nchecked->{even} == $expected,
+      test_msg("Expected $expected even medians, got $nchecked->{even}"));
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup, $ex);
+}
+
+sub delay_table_wraparound {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'delay');
+
+  my $delay_tab = File::Spec->rel2abs("$setup->{home_dir}/delay.tab");
+  my $ctrls_sock = File::Spec->rel2abs("$tmpdir/ctrls.sock");
+
+  # Enough logins to fill the rows, and then wrap around them.
+  my $nlogins = $DELAY_NVALUES + 44;
+
+  my ($user, $group) = config_get_identity();
+  if ($< == 0) {
+    $user = 'root';
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'delay:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_ctrls.c' => {
+        ControlsEngine => 'on',
+        ControlsLog => $setup->{log_file},
+        ControlsSocket => $ctrls_sock,
+        ControlsACLs => "all allow user *",
+        ControlsSocketACL => "allow user *",
+      },
+
+      'mod_delay.c' => {
+        DelayTable => $delay_tab,
+        DelayControlsACLs => "all allow user $user",
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  my $ex;
+
+  # Start server
+  server_start($setup->{config_file});
+  sleep(2);
+
+  eval {
+    for (my $i = 0; $i < $nlogins; $i++) {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+      $client->quit();
+    }
+
+    my ($exit_status, $lines) = ftpdctl($ctrls_sock, 'delay info');
+    if ($ENV{TEST_VERBOSE}) {
+      print STDERR "# ftpdctl: (exit status $exit_status)\n";
+      foreach my $line (@$lines) {
+        chomp($line);
+        print STDERR "#  $line\n";
+      }
+    }
+
+    my $expected = 0;
+    $self->assert($exit_status == $expected,
+      test_msg("Expected exit status $expected, got $exit_status"));
+
+    my ($rows, $nchecked) = delay_check_medians($self, $setup->{log_file});
+
+    $expected = $nlogins;
+    my $checked = $nchecked->{odd} + $nchecked->{even};
+    $self->assert($checked == $expected,
+      test_msg("Expected $expected medians checked, got $checked"));
+
+    my $vals = delay_info_values($lines, 'USER', 'ftp');
+    $self->assert(defined($vals),
+      test_msg("Expected USER values in 'delay info' output"));
+
+    my $nvals = scalar(@$vals);
+    $expected = $DELAY_NVALUES;
+    $self->assert($nvals == $expected,
+      test_msg("Expected $expected USER values, got $nvals"));
+
+    # The listing starts with the newest value.
+    $expected = join(' ', reverse(@{ $rows->{USER} }));
+    my $got = join(' ', @$vals);
+    $self->assert($got eq $expected,
+      test_msg("Expected USER values '$expected', got '$got'"));
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  server_stop($setup->{pid_file});
+  test_cleanup($setup, $ex);
+}
+
+sub delay_table_ctrls_reset {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'delay');
+
+  my $delay_tab = File::Spec->rel2abs("$setup->{home_dir}/delay.tab");
+  my $ctrls_sock = File::Spec->rel2abs("$tmpdir/ctrls.sock");
+
+  my ($user, $group) = config_get_identity();
+  if ($< == 0) {
+    $user = 'root';
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'delay:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_ctrls.c' => {
+        ControlsEngine => 'on',
+        ControlsLog => $setup->{log_file},
+        ControlsSocket => $ctrls_sock,
+        ControlsACLs => "all allow user *",
+        ControlsSocketACL => "allow user *",
+      },
+
+      'mod_delay.c' => {
+        DelayTable => $delay_tab,
+        DelayControlsACLs => "all allow user $user",
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  my $ex;
+
+  # Start server
+  server_start($setup->{config_file});
+  sleep(2);
+
+  eval {
+    for (my $i = 0; $i < 3; $i++) {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+      $client->quit();
+    }
+
+    my ($exit_status, $lines) = ftpdctl($ctrls_sock, 'delay reset');
+    my $expected = 0;
+    $self->assert($exit_status == $expected,
+      test_msg("Expected exit status $expected, got $exit_status"));
+
+    ($exit_status, $lines) = ftpdctl($ctrls_sock, 'delay info');
+    $self->assert($exit_status == $expected,
+      test_msg("Expected exit status $expected, got $exit_status"));
+
+    my $vals = delay_info_values($lines, 'USER', 'ftp');
+    $self->assert(defined($vals),
+      test_msg("Expected USER values in 'delay info' output"));
+
+    my $nvals = scalar(@$vals);
+    $expected = 0;
+    $self->assert($nvals == $expected,
+      test_msg("Expected $expected USER values after reset, got $nvals"));
+
+    # Sessions must still be able to add values to the reset rows.
+    my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+    $client->login($setup->{user}, $setup->{passwd});
+    $client->quit();
+
+    ($exit_status, $lines) = ftpdctl($ctrls_sock, 'delay info');
+    if ($ENV{TEST_VERBOSE}) {
+      print STDERR "# ftpdctl: (exit status $exit_status)\n";
+      foreach my $line (@$lines) {
+        chomp($line);
+        print STDERR "#  $line\n";
+      }
+    }
+
+    $expected = 0;
+    $self->assert($exit_status == $expected,
+      test_msg("Expected exit status $expected, got $exit_status"));
+
+    $vals = delay_info_values($lines, 'USER', 'ftp');
+    $nvals = scalar(@$vals);
+    $expected = 1;
+    $self->assert($nvals == $expected,
+      test_msg("Expected $expected USER value after login, got $nvals"));
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  server_stop($setup->{pid_file});
+  test_cleanup($setup, $ex);
+}
+
 1;
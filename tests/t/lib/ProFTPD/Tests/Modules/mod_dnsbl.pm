@@ -0,0 +1,543 @@
+package ProFTPD::Tests::Modules::mod_dnsbl;
+
+use lib qw(t/lib);
+use base qw(ProFTPD::TestSuite::Child);
+use strict;
+
+use File::Spec;
+use IO::Handle;
+use IO::Socket::INET;
+use Socket qw(inet_aton);
+use Time::HiRes qw(gettimeofday tv_interval);
+
+use ProFTPD::TestSuite::FTP;
+use ProFTPD::TestSuite::Utils qw(:auth :config :running :test :testsuite);
+
+$| = 1;
+
+my $order = 0;
+
+my $TESTS = {
+  dnsbl_listed_second_domain => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  dnsbl_not_listed => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  dnsbl_cached_listing => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+};
+
+# The test client connects from 127.0.0.1; this is how DNSBLs see it.
+my $REVERSED_ADDR = '1.0.0.127';
+
+sub new {
+  return shift()->SUPER::new(@_);
+}
+
+sub list_tests {
+  return testsuite_get_runnable_tests($TESTS);
+}
+
+# Starts a minimal DNS server on a local UDP port, for use as the
+# DNSBLNameserver.  Names found in the given records are answered with
+# their A and TXT records; names found in the given list of names to drop
+# are never answered; all other names get NXDOMAIN.  Each query received
+# is logged, as its type and name, to the given file.  Returns the server's
+# port and process ID.
+sub dns_server_start {
+  my $records = shift;
+  my $drop = shift;
+  my $query_log = shift;
+
+  my $sock = IO::Socket::INET->new(
+    LocalAddr => '127.0.0.1',
+    LocalPort => 0,
+    Proto => 'udp',
+  );
+  unless ($sock) {
+    die("Can't create UDP socket: $!");
+  }
+
+  my $port = $sock->sockport();
+
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    $sock->close();
+    return ($port, $pid);
+  }
+
+  my $fh;
+  unless (open($fh, ">> $query_log")) {
+    die("Can't open $query_log: $!");
+  }
+  $fh->autoflush(1);
+
+  while (1) {
+    my $pkt;
+    my $from = $sock->recv($pkt, 512);
+    next unless defined($from);
+    next if length($pkt) < 12;
+
+    my ($id, $flags) = unpack('n n', $pkt);
+
+    # Skip over the question's name, to find its type.
+    my $offset = 12;
+    my @labels;
+    while ($offset < length($pkt)) {
+      my $len = unpack('C', substr($pkt, $offset, 1));
+      $offset++;
+      last if $len == 0;
+
+      push(@labels, substr($pkt, $offset, $len));
+      $offset += $len;
+    }
+
+    my $qtype = unpack('n', substr($pkt, $offset, 2));
+    my $question = substr($pkt, 12, $offset + 4 - 12);
+    my $name = lc(join('.', @labels));
+
+    my $type = $qtype == 1 ? 'A' : ($qtype == 16 ? 'TXT' : $qtype);
+    print $fh "$type $name\n";
+
+    next if grep { $_ eq $name } @$drop;
+
+    my $rcode = 0;
+    my @answers;
+
+    if (defined($records->{$name})) {
+      my $record = $records->{$name};
+
+      if ($type eq 'A' &&
+          defined($record->{A})) {
+        my $rdata = inet_aton($record->{A});
+        push(@answers, pack('n n n N n', 0xc00c, 1, 1, 300, length($rdata)) .
+          $rdata);
+
+      } elsif ($type eq 'TXT' &&
+               defined($record->{TXT})) {
+        my $rdata = pack('C', length($record->{TXT})) . $record->{TXT};
+        push(@answers, pack('n n n N n', 0xc00c, 16, 1, 300, length($rdata)) .
+          $rdata);
+      }
+
+    } else {
+      # NXDOMAIN
+      $rcode = 3;
+    }
+
+    my $resp = pack('n n n n n n', $id, 0x8180 | ($flags & 0x0100) | $rcode,
+      1, scalar(@answers), 0, 0) . $question . join('', @answers);
+    $sock->send($resp, 0, $from);
+  }
+}
+
+sub dns_server_stop {
+  my $pid = shift;
+
+  kill('TERM', $pid);
+  waitpid($pid, 0);
+}
+
+sub read_lines {
+  my $path = shift;
+
+  my $lines = [];
+  if (open(my $fh, "< $path")) {
+    while (my $line = <$fh>) {
+      chomp($line);
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "# $line\n";
+      }
+
+      push(@$lines, $line);
+    }
+
+    close($fh);
+
+  } else {
+    die("Can't read $path: $!");
+  }
+
+  return $lines;
+}
+
+sub dnsbl_listed_second_domain {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'dnsbl');
+
+  my $dnsbl_log = File::Spec->rel2abs("$tmpdir/dnsbl.log");
+  my $query_log = File::Spec->rel2abs("$tmpdir/queries.log");
+
+  # The first list does not list the client, the second one does, and the
+  # third one never answers.  The connection should be rejected as soon as
+  # the second list answers, without waiting for the third.
+  my $records = {
+    "$REVERSED_ADDR.b.dnsbl.test" => {
+      A => '127.0.0.2',
+      TXT => 'listed by b.dnsbl.test',
+    },
+  };
+  my $drop = ["$REVERSED_ADDR.c.dnsbl.test"];
+
+  my ($ns_port, $ns_pid) = dns_server_start($records, $drop, $query_log);
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'dnsbl:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_dnsbl.c' => [
+        'DNSBLEngine on',
+        "DNSBLLog $dnsbl_log",
+        'DNSBLPolicy allow,deny',
+        "DNSBLNameserver 127.0.0.1 $ns_port",
+        'DNSBLDomain a.dnsbl.test',
+        'DNSBLDomain b.dnsbl.test',
+        'DNSBLDomain c.dnsbl.test',
+      ],
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(2);
+
+      my $start = [gettimeofday()];
+      eval { ProFTPD::TestSuite::FTP->new('127.0.0.1', $port, undef, 0) };
+      unless ($@) {
+        die("Connect succeeded unexpectedly");
+      }
+      my $elapsed = tv_interval($start);
+
+      # The resolver's timeout, were we to wait for the third list, is
+      # several seconds.
+      $self->assert($elapsed < 3,
+        test_msg("Expected rejection within 3 secs, took $elapsed secs"));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+  dns_server_stop($ns_pid);
+
+  eval {
+    my $lines = read_lines($dnsbl_log);
+
+    my $expected = "listed by DNSBLDomain 'b.dnsbl.test', rejecting connection";
+    my $matches = scalar(grep { /\Q$expected\E/ } @$lines);
+    $self->assert($matches == 1,
+      test_msg("Expected '$expected' in DNSBLLog, got $matches matches"));
+
+    $expected = 'reason for blacklisting client address: .*listed by b';
+    $matches = scalar(grep { /$expected/ } @$lines);
+    $self->assert($matches == 1,
+      test_msg("Expected '$expected' in DNSBLLog, got $matches matches"));
+
+    $lines = read_lines($query_log);
+
+    # All three lists are queried at once.
+    foreach my $domain (qw(a b c)) {
+      $expected = "A $REVERSED_ADDR.$domain.dnsbl.test";
+      $matches = scalar(grep { $_ eq $expected } @$lines);
+      $self->assert($matches >= 1,
+        test_msg("Expected query '$expected', got $matches matches"));
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup, $ex);
+}
+
+sub dnsbl_not_listed {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'dnsbl');
+
+  my $dnsbl_log = File::Spec->rel2abs("$tmpdir/dnsbl.log");
+  my $query_log = File::Spec->rel2abs("$tmpdir/queries.log");
+
+  # No list lists the client; every query gets NXDOMAIN.
+  my ($ns_port, $ns_pid) = dns_server_start({}, [], $query_log);
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'dnsbl:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_dnsbl.c' => [
+        'DNSBLEngine on',
+        "DNSBLLog $dnsbl_log",
+        'DNSBLPolicy allow,deny',
+        "DNSBLNameserver 127.0.0.1 $ns_port",
+        'DNSBLDomain a.dnsbl.test',
+        'DNSBLDomain b.dnsbl.test',
+        'DNSBLDomain c.dnsbl.test',
+      ],
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(2);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+      $client->quit();
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+  dns_server_stop($ns_pid);
+
+  eval {
+    my $lines = read_lines($dnsbl_log);
+
+    foreach my $domain (qw(a b c)) {
+      my $expected = "no record returned for DNS name " .
+        "'$REVERSED_ADDR.$domain.dnsbl.test'";
+      my $matches = scalar(grep { /\Q$expected\E/ } @$lines);
+      $self->assert($matches == 1,
+        test_msg("Expected '$expected' in DNSBLLog, got $matches matches"));
+    }
+
+    my $expected = 'rejecting connection';
+    my $matches = scalar(grep { /$expected/ } @$lines);
+    $self->assert($matches == 0,
+      test_msg("Expected no '$expected' in DNSBLLog, got $matches matches"));
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup, $ex);
+}
+
+sub dnsbl_cached_listing {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'dnsbl');
+
+  my $dnsbl_log = File::Spec->rel2abs("$tmpdir/dnsbl.log");
+  my $query_log = File::Spec->rel2abs("$tmpdir/queries.log");
+
+  my $records = {
+    "$REVERSED_ADDR.b.dnsbl.test" => {
+      A => '127.0.0.2',
+      TXT => 'listed by b.dnsbl.test',
+    },
+  };
+
+  my ($ns_port, $ns_pid) = dns_server_start($records, [], $query_log);
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'dnsbl:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_dnsbl.c' => [
+        'DNSBLEngine on',
+        "DNSBLLog $dnsbl_log",
+        'DNSBLPolicy allow,deny',
+        "DNSBLNameserver 127.0.0.1 $ns_port",
+        'DNSBLDomain b.dnsbl.test',
+      ],
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(2);
+
+      for (my $i = 0; $i < 2; $i++) {
+        eval { ProFTPD::TestSuite::FTP->new('127.0.0.1', $port, undef, 0) };
+        unless ($@) {
+          die("Connect #", $i + 1, " succeeded unexpectedly");
+        }
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+  dns_server_stop($ns_pid);
+
+  eval {
+    my $lines = read_lines($query_log);
+
+    # The second connection is answered from the cache; only the reason is
+    # looked up again.
+    my $expected = "A $REVERSED_ADDR.b.dnsbl.test";
+    my $matches = scalar(grep { $_ eq $expected } @$lines);
+    $self->assert($matches == 1,
+      test_msg("Expected 1 query '$expected', got $matches"));
+
+    $expected = "TXT $REVERSED_ADDR.b.dnsbl.test";
+    $matches = scalar(grep { $_ eq $expected } @$lines);
+    $self->assert($matches == 2,
+      test_msg("Expected 2 queries '$expected', got $matches"));
+
+    $lines = read_lines($dnsbl_log);
+
+    $expected = "found cached record for DNSBLDomain 'b.dnsbl.test'";
+    $matches = scalar(grep { /\Q$expected\E/ } @$lines);
+    $self->assert($matches == 1,
+      test_msg("Expected '$expected' in DNSBLLog, got $matches matches"));
+
+    $expected = 'reason for blacklisting client address: .*listed by b';
+    $matches = scalar(grep { /$expected/ } @$lines);
+    $self->assert($matches == 2,
+      test_msg("Expected 2 '$expected' in DNSBLLog, got $matches matches"));
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup, $ex);
+}
+
+1;
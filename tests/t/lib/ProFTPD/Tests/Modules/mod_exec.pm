@@ -117,6 +117,11 @@ my $TESTS = {
     test_class => [qw(bug forking)],
   },
 
+  exec_worker_on_cmd => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
 };
 
 sub new {
@@ -2740,4 +2745,134 @@ EOC
   test_cleanup($setup->{log_file}, $ex);
 }
 
+sub exec_worker_on_cmd {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'exec');
+
+  my $cmd_file = File::Spec->rel2abs("$tmpdir/cmd.txt");
+  my $nfiles = 5;
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'exec:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    AllowOverwrite => 'on',
+
+    IfModules => {
+      'mod_exec.c' => {
+        ExecEngine => 'on',
+        ExecLog => $setup->{log_file},
+        ExecTimeout => 5,
+        ExecWorker => 'on 2',
+        ExecEnviron => 'EXEC_ENV_USER %u',
+        ExecOnCommand => "STOR /bin/bash -c \"sleep 0.2; echo \$EXEC_ENV_USER %F >> $cmd_file\"",
+      },
+
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port, 0, 5);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      for (my $i = 0; $i < $nfiles; $i++) {
+        my $conn = $client->stor_raw("test$i.txt");
+        unless ($conn) {
+          die("STOR test$i.txt failed: " . $client->response_code() . " " .
+            $client->response_msg());
+        }
+
+        my $buf = "Hello, World!\n";
+        $conn->write($buf, length($buf), 5);
+        eval { $conn->close() };
+
+        my $resp_code = $client->response_code();
+        my $resp_msg = $client->response_msg();
+        $self->assert_transfer_ok($resp_code, $resp_msg);
+      }
+
+      $client->quit();
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  eval {
+    # The worker keeps running the queued commands after the session ends;
+    # allow for them to finish.
+    sleep(2);
+
+    if (open(my $fh, "< $cmd_file")) {
+      my $lines = [<$fh>];
+      close($fh);
+
+      my $nlines = scalar(@$lines);
+      $self->assert($nlines == $nfiles,
+        test_msg("Expected $nfiles lines, got $nlines"));
+
+      for (my $i = 0; $i < $nfiles; $i++) {
+        my $line = $lines->[$i];
+        chomp($line);
+
+        my $expected = "$setup->{user} $setup->{home_dir}/test$i.txt";
+        $self->assert($expected eq $line,
+          test_msg("Expected '$expected', got '$line'"));
+      }
+
+    } else {
+      die("Can't read $cmd_file: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@ unless $ex;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 1;
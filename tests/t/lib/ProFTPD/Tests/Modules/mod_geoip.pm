@@ -26,6 +26,11 @@ my $TESTS = {
     test_class => [qw(bug forking)],
   },
 
+  geoip_shared_tables_cache => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
 };
 
 sub new {
@@ -211,4 +216,123 @@ sub geoip_multi_allow_bug4188 {
   test_cleanup($setup->{log_file}, $ex);
 }
 
+sub geoip_shared_tables_cache {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'geoip');
+
+  my $geoip_ip_table = File::Spec->rel2abs('t/etc/modules/mod_geoip/GeoIP.dat');
+  my $geoip_city_table = File::Spec->rel2abs('t/etc/modules/mod_geoip/GeoLiteCity.dat');
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'geoip:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_geoip.c' => [
+        'GeoIPEngine on',
+        "GeoIPLog $setup->{log_file}",
+        "GeoIPTable $geoip_ip_table",
+        "GeoIPTable $geoip_city_table",
+      ],
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # The second connection, from the same address, should use the
+      # results cached by the first.
+      for (my $i = 0; $i < 2; $i++) {
+        my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port, 1);
+        $client->login($setup->{user}, $setup->{passwd});
+        $client->quit();
+      }
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+
+  $self->assert_child_ok($pid);
+
+  eval {
+    if (open(my $fh, "< $setup->{log_file}")) {
+      my $shared = 0;
+      my $cached = 0;
+
+      while (my $line = <$fh>) {
+        chomp($line);
+
+        if ($line =~ /using shared GeoIP table/) {
+          $shared = 1;
+          next;
+        }
+
+        if ($line =~ /using cached GeoIP data for/) {
+          $cached = 1;
+          next;
+        }
+      }
+
+      close($fh);
+
+      $self->assert($shared,
+        test_msg("Did not see expected shared table log message"));
+      $self->assert($cached,
+        test_msg("Did not see expected cached data log message"));
+
+    } else {
+      die("Can't read $setup->{log_file}: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 1;
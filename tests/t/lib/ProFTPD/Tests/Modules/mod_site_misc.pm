@@ -42,6 +42,11 @@ my $TESTS = {
     test_class => [qw(forking)],
   },
 
+  site_misc_rmdir_large_tree => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
   site_misc_rmdir_failed_pathallowfilter => {
     order => ++$order,
     test_class => [qw(forking)],
@@ -709,6 +714,160 @@ sub site_misc_rmdir_ok {
   test_cleanup($setup, $ex);
 }
 
+sub site_misc_rmdir_large_tree {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'site_misc');
+
+  # Set TEST_VERBOSE to see how quickly the tree is removed; the number of
+  # files per directory can be raised via SITE_MISC_RMDIR_NFILES.
+  my $ndirs = 20;
+  my $nfiles = $ENV{SITE_MISC_RMDIR_NFILES} || 100;
+
+  my $test_dir = File::Spec->rel2abs("$tmpdir/foo");
+  mkpath($test_dir);
+
+  my $test_paths = [$test_dir];
+  for (my $i = 0; $i < $ndirs; $i++) {
+    my $sub_dir = File::Spec->rel2abs("$test_dir/dir$i/sub");
+    mkpath($sub_dir);
+    push(@$test_paths, File::Spec->rel2abs("$test_dir/dir$i"), $sub_dir);
+
+    for (my $j = 0; $j < $nfiles; $j++) {
+      my $test_file = File::Spec->rel2abs(($j % 2 ? $sub_dir : "$test_dir/dir$i") .
+        "/file$j.txt");
+
+      if (open(my $fh, "> $test_file")) {
+        print $fh "Quzz\n";
+
+        unless (close($fh)) {
+          die("Can't write $test_file: $!");
+        }
+
+      } else {
+        die("Can't open $test_file: $!");
+      }
+
+      push(@$test_paths, $test_file);
+    }
+  }
+
+  # A symlink to a directory outside of the tree, which is removed rather
+  # than followed.
+  my $outside_dir = File::Spec->rel2abs("$tmpdir/outside");
+  mkpath($outside_dir);
+  my $outside_file = File::Spec->rel2abs("$outside_dir/keep.txt");
+  if (open(my $fh, "> $outside_file")) {
+    close($fh);
+
+  } else {
+    die("Can't open $outside_file: $!");
+  }
+
+  unless (symlink($outside_dir, "$test_dir/link")) {
+    die("Can't symlink $test_dir/link to $outside_dir: $!");
+  }
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, @$test_paths)) {
+      die("Can't set owner of $test_dir to $setup->{uid}, $setup->{gid}: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:8',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Time::HiRes;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my $start = [Time::HiRes::gettimeofday()];
+      my ($resp_code, $resp_msg) = $client->site('RMDIR', 'foo');
+      my $elapsed = Time::HiRes::tv_interval($start);
+      $client->quit();
+
+      my $expected = 200;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $expected = "SITE RMDIR command successful";
+      $self->assert($expected eq $resp_msg,
+        test_msg("Expected response message '$expected', got '$resp_msg'"));
+
+      foreach my $test_path (@$test_paths) {
+        if (-e $test_path) {
+          die("Path $test_path exists, should be deleted");
+        }
+      }
+
+      unless (-f $outside_file) {
+        die("File $outside_file deleted, should not be");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        my $nentries = scalar(@$test_paths) + 1;
+        printf STDERR "removed %d entries in %.3f secs (%.1f/sec)\n",
+          $nentries, $elapsed, $nentries / $elapsed;
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup, $ex);
+}
+
 sub site_misc_rmdir_failed_pathallowfilter {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
@@ -95,6 +95,11 @@ my $TESTS = {
     test_class => [qw(forking snmp)],
   },
 
+  snmp_v1_get_ftp_sess_counts_concurrent => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
   snmp_v1_get_ftp_xfer_upload_counts => {
     order => ++$order,
     test_class => [qw(forking snmp)],
@@ -2888,6 +2893,194 @@ sub snmp_v1_get_ftp_sess_counts {
   unlink($log_file);
 }
 
+sub snmp_v1_get_ftp_sess_counts_concurrent {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $timeout_idle = 45;
+
+  # Many processes updating the same counters at once, to make sure that no
+  # updates are lost.
+  my $nclients = 10;
+  my $nlogins = 10;
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    AuthOrder => 'mod_auth_file.c',
+
+    MaxInstances => $nclients * 2,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+  require Time::HiRes;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(1);
+
+      local $SIG{CHLD} = 'DEFAULT';
+
+      my $start = [Time::HiRes::gettimeofday()];
+
+      my $client_pids = [];
+      for (my $i = 0; $i < $nclients; $i++) {
+        defined(my $client_pid = fork()) or die("Can't fork: $!");
+        if ($client_pid == 0) {
+          eval {
+            for (my $j = 0; $j < $nlogins; $j++) {
+              my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+              $client->login($user, $passwd);
+              $client->quit();
+            }
+          };
+          if ($@) {
+            warn($@);
+            exit 1;
+          }
+
+          exit 0;
+        }
+
+        push(@$client_pids, $client_pid);
+      }
+
+      my $failed = 0;
+      foreach my $client_pid (@$client_pids) {
+        waitpid($client_pid, 0);
+        $failed++ if $? != 0;
+      }
+
+      my $elapsed = Time::HiRes::tv_interval($start);
+
+      $self->assert($failed == 0,
+        test_msg("$failed clients failed to login"));
+
+      if ($ENV{TEST_VERBOSE}) {
+        my $nupdates = $nclients * $nlogins;
+        printf STDERR "%d logins from %d clients in %.3f secs (%.1f/sec)\n",
+          $nupdates, $nclients, $elapsed, $nupdates / $elapsed;
+      }
+
+      # Give the last sessions a chance to end.
+      sleep(1);
+
+      my ($sess_count, $sess_total) = get_ftp_sess_info($agent_port,
+        $snmp_community);
+
+      my $expected = 0;
+      $self->assert($sess_count == $expected,
+        test_msg("Expected session count $expected, got $sess_count"));
+
+      $expected = $nclients * $nlogins;
+      $self->assert($sess_total == $expected,
+        test_msg("Expected session total $expected, got $sess_total"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
 sub snmp_v1_get_ftp_xfer_upload_counts {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
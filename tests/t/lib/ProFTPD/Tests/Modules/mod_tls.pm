@@ -531,6 +531,11 @@ my $TESTS = {
     test_class => [qw(bug forking inprogress)],
   },
 
+  tls_session_tickets_shared_keys => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
   tls_restart_protected_certs_bug4260 => {
     order => ++$order,
     test_class => [qw(bug forking)],
@@ -14719,6 +14724,141 @@ sub tls_session_tickets_on_bug4176 {
   test_cleanup($setup->{log_file}, $ex);
 }
 
+sub tls_session_tickets_shared_keys {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'tls');
+
+  my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
+  my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'tls:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $setup->{log_file},
+        TLSRSACertificateFile => $cert_file,
+        TLSCACertificateFile => $ca_file,
+        TLSProtocol => 'TLSv1.2',
+        TLSSessionTickets => 'on',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require IO::Socket::INET;
+  require IO::Socket::SSL;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(2);
+
+      # Use the same client context, and thus session cache, for both
+      # connections, so that the second connection presents the ticket
+      # issued by the first session process to a different one.
+      my $ssl_ctx = IO::Socket::SSL::SSL_Context->new(
+        SSL_verify_mode => IO::Socket::SSL::SSL_VERIFY_NONE(),
+        SSL_session_cache_size => 10,
+      );
+
+      my $ssl_opts = {
+        SSL_reuse_ctx => $ssl_ctx,
+        SSL_session_key => "127.0.0.1:$port",
+      };
+
+      starttls_ftp($port, $ssl_opts);
+      starttls_ftp($port, $ssl_opts);
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh, 30) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+
+  $self->assert_child_ok($pid);
+
+  eval {
+    if (open(my $fh, "< $setup->{log_file}")) {
+      my $published = 0;
+      my $reused = 0;
+
+      while (my $line = <$fh>) {
+        chomp($line);
+
+        if ($line =~ /published \d+ TLS session ticket key/) {
+          $published = 1;
+          next;
+        }
+
+        if ($line =~ /client reused previous TLS session for control connection/) {
+          $reused = 1;
+          next;
+        }
+      }
+
+      close($fh);
+
+      $self->assert($published,
+        test_msg("Did not see expected shared ticket keys log message"));
+      $self->assert($reused,
+        test_msg("Did not see expected session reuse log message"));
+
+    } else {
+      die("Can't read $setup->{log_file}: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 sub tls_restart_protected_certs_bug4260 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
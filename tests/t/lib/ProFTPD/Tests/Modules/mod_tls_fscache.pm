@@ -24,6 +24,11 @@ my $TESTS = {
     test_class => [qw(bug forking mod_tls_fscache)],
   },
 
+  tls_stapling_refresh_fscache => {
+    order => ++$order,
+    test_class => [qw(forking mod_tls_fscache)],
+  },
+
 };
 
 sub new {
@@ -231,4 +236,191 @@ sub tls_stapling_on_fscache_bug4175 {
   test_cleanup($setup->{log_file}, $ex);
 }
 
+sub tls_stapling_refresh_fscache {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'tls_fscache');
+
+  my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-server.pem');
+  my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-ca.pem');
+
+  my $cache_tab = File::Spec->rel2abs("$tmpdir/var/tls/cache/ocsp");
+  mkpath($cache_tab);
+
+  # Use OpenSSL's ocsp(1) responder as a local stand-in for the OCSP
+  # responder; it looks up the server cert (serial 0F) in this index.
+  my $ocsp_index = File::Spec->rel2abs("$tmpdir/ocsp.index");
+  if (open(my $fh, "> $ocsp_index")) {
+    print $fh "V\t310625212753Z\t\t0F\tunknown\t/CN=ocsp-server\n";
+
+    unless (close($fh)) {
+      die("Can't write $ocsp_index: $!");
+    }
+
+  } else {
+    die("Can't open $ocsp_index: $!");
+  }
+
+  my $ocsp_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'tls:20 tls.fscache:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $setup->{log_file},
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $cert_file,
+        TLSCACertificateFile => $ca_file,
+        TLSStapling => 'on',
+        TLSStaplingCache => "fs:/path=$cache_tab",
+        TLSStaplingResponder => "http://127.0.0.1:$ocsp_port",
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  defined(my $ocsp_pid = fork()) or die("Can't fork: $!");
+  if ($ocsp_pid == 0) {
+    my $openssl = 'openssl';
+    my @cmd = ($openssl, 'ocsp', '-index', $ocsp_index, '-port', $ocsp_port,
+      '-CA', $ca_file, '-rsigner', $ca_file, '-rkey', $ca_file, '-nmin', 60);
+
+    unless ($ENV{TEST_VERBOSE}) {
+      open(STDOUT, '>', '/dev/null');
+      open(STDERR, '>', '/dev/null');
+    }
+
+    exec(@cmd) or die("Can't exec '$openssl': $!");
+  }
+
+  # Give the OCSP responder a chance to start up
+  sleep(1);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require IO::Socket::INET;
+  require IO::Socket::SSL;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up, and to fetch the OCSP response
+      # for its cert.
+      sleep(3);
+
+      # The daemon process should have cached the response, before any
+      # client connected.
+      my $cached = [glob("$cache_tab/*.der")];
+      $self->assert(scalar(@$cached) == 1,
+        test_msg("Expected 1 cached OCSP response, got " .
+          scalar(@$cached)));
+
+      # Stop the responder; the session must staple the cached response,
+      # rather than query the responder itself.
+      kill('TERM', $ocsp_pid);
+      waitpid($ocsp_pid, 0);
+      $ocsp_pid = undef;
+
+      my $ssl_opts = {
+        SSL_ocsp_mode => IO::Socket::SSL::SSL_OCSP_TRY_STAPLE(),
+        SSL_verify_mode => IO::Socket::SSL::SSL_VERIFY_NONE(),
+        SSL_alpn_protocols => [qw(ftp)],
+      };
+
+      starttls_ftp($port, $ssl_opts);
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+
+  $self->assert_child_ok($pid);
+
+  if (defined($ocsp_pid)) {
+    kill('TERM', $ocsp_pid);
+    waitpid($ocsp_pid, 0);
+  }
+
+  eval {
+    if (open(my $fh, "< $setup->{log_file}")) {
+      my $refreshed = 0;
+      my $stapled_fake = 0;
+
+      while (my $line = <$fh>) {
+        chomp($line);
+
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "# $line\n";
+        }
+
+        if ($line =~ /refreshing OCSP response for certificate/) {
+          $refreshed = 1;
+          next;
+        }
+
+        if ($line =~ /returning fake tryLater OCSP response/) {
+          $stapled_fake = 1;
+          next;
+        }
+      }
+
+      close($fh);
+
+      $self->assert($refreshed,
+        test_msg("Expected OCSP response refresh not found in log"));
+      $self->assert(!$stapled_fake,
+        test_msg("Stapled fake tryLater OCSP response unexpectedly"));
+
+    } else {
+      die("Can't read $setup->{log_file}: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 1;
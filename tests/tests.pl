@@ -297,6 +297,11 @@ if (scalar(@ARGV) > 0) {
       test_class => [qw(mod_digest)],
     },
 
+    't/modules/mod_dnsbl.t' => {
+      order => ++$order,
+      test_class => [qw(mod_dnsbl)],
+    },
+
     't/modules/mod_dynmasq.t' => {
       order => ++$order,
       test_class => [qw(mod_dynmasq)],